@@ -0,0 +1,265 @@
+// vim: set ts=8 sts=4 sw=4 tw=99 et:
+//
+//  Copyright (C) 2006-2018 AlliedModders LLC
+//
+//  This file is part of SourcePawn. SourcePawn is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  SourcePawn. If not, see http://www.gnu.org/licenses/.
+#include "asm-stream.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#include <amtl/am-hashmap.h>
+
+#include "lexer.h"
+#include "libpawnc.h"
+#include "sc.h"
+#include "scvars.h"
+
+using namespace ke;
+
+AsmStream gAsmProgram;
+
+// clang-format off
+static const AsmOpInfo sAsmOps[] = {
+#define _(op, name, opcode, format) { name, opcode, AsmFormat::format },
+    ASM_OPCODE_LIST(_)
+#undef _
+};
+// clang-format on
+
+const AsmOpInfo&
+asm_op_info(AsmOp op)
+{
+    assert(size_t(op) < size_t(AsmOp::TOTAL));
+    return sAsmOps[size_t(op)];
+}
+
+bool
+asm_find_op(const char* name, size_t length, AsmOp* op)
+{
+    for (size_t i = 0; i < size_t(AsmOp::TOTAL); i++) {
+        const AsmOpInfo& info = sAsmOps[i];
+        // Staging markers and listing-only records never appear in the text
+        // of a peephole pattern.
+        if (info.format == AsmFormat::Listing || *info.name == '[' || *info.name == ']' ||
+            *info.name == '|')
+        {
+            continue;
+        }
+        if (strncmp(info.name, name, length) == 0 && info.name[length] == '\0') {
+            *op = AsmOp(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+int
+AsmInsn::encode(cell* out) const
+{
+    int size = 0;
+    out[size++] = AsmRecord::header(op_, nargs_, has_note_);
+    for (int i = 0; i < nargs_; i++)
+        out[size++] = args_[i];
+    if (has_note_)
+        out[size++] = note_;
+    return size;
+}
+
+typedef HashMap<void*, cell, sp::PointerHashPolicy<void>> RefMap;
+
+static Vector<void*> sRefs;
+static RefMap sRefMap;
+
+static cell
+add_ref(void* ptr)
+{
+    if (!sRefMap.elements())
+        sRefMap.init(256);
+
+    RefMap::Insert p = sRefMap.findForAdd(ptr);
+    if (p.found())
+        return p->value;
+
+    cell ref = cell(sRefs.length());
+    sRefs.append(ptr);
+    sRefMap.add(p, ptr, ref);
+    return ref;
+}
+
+cell
+asm_symbol_ref(symbol* sym)
+{
+    return add_ref(sym);
+}
+
+symbol*
+asm_symbol(cell ref)
+{
+    assert(ref >= 0 && size_t(ref) < sRefs.length());
+    return (symbol*)sRefs[ref];
+}
+
+cell
+asm_name_ref(const char* name)
+{
+    return add_ref(gAtoms.add(name));
+}
+
+const char*
+asm_name(cell ref)
+{
+    assert(ref >= 0 && size_t(ref) < sRefs.length());
+    return ((sp::Atom*)sRefs[ref])->chars();
+}
+
+void
+asm_stream_cleanup()
+{
+    gAsmProgram.clear();
+    sRefs.clear();
+    sRefMap.clear();
+}
+
+/* A line of an assembler listing, in the format that the code generator used
+ * to write before instructions were kept in streams.
+ */
+class AsmLine
+{
+  public:
+    AsmLine()
+     : length_(0)
+    {
+        buffer_[0] = '\0';
+    }
+
+    void add(const char* str) {
+        size_t len = strlen(str);
+        assert(length_ + len < sizeof(buffer_));
+        memcpy(buffer_ + length_, str, len + 1);
+        length_ += len;
+    }
+    void hex(cell value) {
+        add(itoh(value));
+    }
+    const char* chars() const {
+        return buffer_;
+    }
+
+  private:
+    char buffer_[1024];
+    size_t length_;
+};
+
+void
+asm_render(const cell* record, memfile_t* fout)
+{
+    AsmRecord rec(record);
+    const AsmOpInfo& info = rec.info();
+    AsmLine line;
+
+    switch (rec.op()) {
+        case AsmOp::LABEL:
+            line.add("l.");
+            line.hex(rec.arg(0));
+            if (rec.hasNote()) {
+                line.add("\t\t; ");
+                line.hex(rec.note());
+            }
+            break;
+        case AsmOp::CODE:
+        case AsmOp::DATA:
+            line.add("\n");
+            line.add(info.name);
+            line.add(" ");
+            line.hex(rec.arg(0));
+            line.add("\t; ");
+            line.hex(rec.note());
+            break;
+        case AsmOp::DUMP:
+            line.add("dump ");
+            for (int i = 0; i < rec.nargs(); i++) {
+                line.hex(rec.arg(i));
+                line.add(" ");
+            }
+            break;
+        case AsmOp::DUMPFILL:
+        case AsmOp::STKSIZE:
+            line.add(info.name);
+            for (int i = 0; i < rec.nargs(); i++) {
+                line.add(" ");
+                line.hex(rec.arg(i));
+            }
+            break;
+        case AsmOp::LOCAL_DECL:
+            line.add("\t;$lcl ");
+            line.add(asm_name(rec.arg(0)));
+            line.add(" ");
+            line.hex(rec.arg(1));
+            break;
+        case AsmOp::LINE:
+            line.add("\t; line ");
+            line.hex(rec.arg(0));
+            break;
+        case AsmOp::COMMENT:
+            line.add(";");
+            line.add(asm_name(rec.arg(0)));
+            break;
+        case AsmOp::BLANK:
+            break;
+        case AsmOp::PROC:
+            line.add("\tproc");
+            if (rec.hasNote()) {
+                line.add("\t; ");
+                line.add(asm_name(rec.note()));
+            }
+            break;
+        case AsmOp::BREAK:
+            line.add("\tbreak");
+            if (rec.hasNote()) {
+                line.add("\t; ");
+                line.hex(rec.note());
+            }
+            break;
+        case AsmOp::CALL:
+        {
+            const char* name = asm_symbol(rec.arg(0))->name();
+            line.add("\tcall ");
+            line.add(name);
+            if (!isalpha(name[0]) && name[0] != '_' && name[0] != sc_ctrlchar) {
+                line.add("\t; ");
+                line.add(name);
+            }
+            break;
+        }
+        case AsmOp::SYSREQ_N:
+            line.add("\tsysreq.n ");
+            line.add(asm_symbol(rec.arg(0))->name());
+            line.add(" ");
+            line.hex(rec.arg(1));
+            break;
+        case AsmOp::LDGFN_PRI:
+            line.add("\tldgfn.pri ");
+            line.add(asm_symbol(rec.arg(0))->name());
+            break;
+        default:
+            assert(info.format != AsmFormat::Directive);
+            assert(rec.op() != AsmOp::REORDER_START && rec.op() != AsmOp::REORDER_END &&
+                   rec.op() != AsmOp::EXPR_START);
+            line.add("\t");
+            line.add(info.name);
+            for (int i = 0; i < rec.nargs(); i++) {
+                line.add(" ");
+                line.hex(rec.arg(i));
+            }
+            break;
+    }
+    line.add("\n");
+    pc_writeasm(fout, line.chars());
+}
@@ -0,0 +1,378 @@
+// vim: set ts=8 sts=4 sw=4 tw=99 et:
+//
+//  Copyright (C) 2006-2018 AlliedModders LLC
+//
+//  This file is part of SourcePawn. SourcePawn is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  SourcePawn. If not, see http://www.gnu.org/licenses/.
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <amtl/am-vector.h>
+#include <smx/smx-v1-opcodes.h>
+
+#include "amx.h"
+
+struct memfile_t;
+struct symbol;
+
+/*  Instructions, directives and optimizer markers that the code generator
+ *  emits, with the name used in assembler listings, the SMX opcode, and the
+ *  way the assembler encodes the operands.
+ */
+// clang-format off
+#define ASM_OPCODE_LIST(_)                                                      \
+  /* Directives; these are handled by the assembler but are not code. */       \
+  _(LABEL,               "l.",                  0,                 Directive)   \
+  _(CODE,                "CODE",                0,                 Directive)   \
+  _(DATA,                "DATA",                0,                 Directive)   \
+  _(DUMP,                "dump",                0,                 Directive)   \
+  _(DUMPFILL,            "dumpfill",            0,                 Directive)   \
+  _(STKSIZE,             "STKSIZE",             0,                 Directive)   \
+  /* Markers for the staging buffer and the peephole optimizer. */             \
+  _(REORDER_START,       "[",                   0,                 Marker)      \
+  _(REORDER_END,         "]",                   0,                 Marker)      \
+  _(EXPR_START,          "|",                   0,                 Marker)      \
+  _(EXPR_END,            ";$exp",               0,                 Marker)      \
+  _(PARM_END,            ";$par",               0,                 Marker)      \
+  _(LOCAL_DECL,          ";$lcl",               0,                 Marker)      \
+  /* Comments and layout, only used for assembler listings. */                 \
+  _(LINE,                "; line",              0,                 Listing)     \
+  _(COMMENT,             ";",                   0,                 Listing)     \
+  _(BLANK,               "",                    0,                 Listing)     \
+  /* Instructions. */                                                           \
+  _(ADD,                 "add",                 sp::OP_ADD,                  Plain)  \
+  _(ADD_C,               "add.c",               sp::OP_ADD_C,                Plain)  \
+  _(ADDR_ALT,            "addr.alt",            sp::OP_ADDR_ALT,             Plain)  \
+  _(ADDR_PRI,            "addr.pri",            sp::OP_ADDR_PRI,             Plain)  \
+  _(AND,                 "and",                 sp::OP_AND,                  Plain)  \
+  _(BOUNDS,              "bounds",              sp::OP_BOUNDS,               Plain)  \
+  _(BREAK,               "break",               sp::OP_BREAK,                Plain)  \
+  _(CALL,                "call",                sp::OP_CALL,                 Call)   \
+  _(CASE,                "case",                0,                           Case)   \
+  _(CASETBL,             "casetbl",             sp::OP_CASETBL,              Plain)  \
+  _(CONST,               "const",               sp::OP_CONST,                Plain)  \
+  _(CONST_ALT,           "const.alt",           sp::OP_CONST_ALT,            Plain)  \
+  _(CONST_PRI,           "const.pri",           sp::OP_CONST_PRI,            Plain)  \
+  _(CONST_S,             "const.s",             sp::OP_CONST_S,              Plain)  \
+  _(DEC,                 "dec",                 sp::OP_DEC,                  Plain)  \
+  _(DEC_ALT,             "dec.alt",             sp::OP_DEC_ALT,              Plain)  \
+  _(DEC_I,               "dec.i",               sp::OP_DEC_I,                Plain)  \
+  _(DEC_PRI,             "dec.pri",             sp::OP_DEC_PRI,              Plain)  \
+  _(DEC_S,               "dec.s",               sp::OP_DEC_S,                Plain)  \
+  _(ENDPROC,             "endproc",             sp::OP_ENDPROC,              Plain)  \
+  _(EQ,                  "eq",                  sp::OP_EQ,                   Plain)  \
+  _(EQ_C_ALT,            "eq.c.alt",            sp::OP_EQ_C_ALT,             Plain)  \
+  _(EQ_C_PRI,            "eq.c.pri",            sp::OP_EQ_C_PRI,             Plain)  \
+  _(FILL,                "fill",                sp::OP_FILL,                 Plain)  \
+  _(GENARRAY,            "genarray",            sp::OP_GENARRAY,             Plain)  \
+  _(GENARRAY_Z,          "genarray.z",          sp::OP_GENARRAY_Z,           Plain)  \
+  _(HALT,                "halt",                sp::OP_HALT,                 Plain)  \
+  _(HEAP,                "heap",                sp::OP_HEAP,                 Plain)  \
+  _(IDXADDR,             "idxaddr",             sp::OP_IDXADDR,              Plain)  \
+  _(IDXADDR_B,           "idxaddr.b",           sp::OP_UNGEN_IDXADDR_B,      Plain)  \
+  _(INC,                 "inc",                 sp::OP_INC,                  Plain)  \
+  _(INC_ALT,             "inc.alt",             sp::OP_INC_ALT,              Plain)  \
+  _(INC_I,               "inc.i",               sp::OP_INC_I,                Plain)  \
+  _(INC_PRI,             "inc.pri",             sp::OP_INC_PRI,              Plain)  \
+  _(INC_S,               "inc.s",               sp::OP_INC_S,                Plain)  \
+  _(INVERT,              "invert",              sp::OP_INVERT,               Plain)  \
+  _(JEQ,                 "jeq",                 sp::OP_JEQ,                  Jump)   \
+  _(JNEQ,                "jneq",                sp::OP_JNEQ,                 Jump)   \
+  _(JNZ,                 "jnz",                 sp::OP_JNZ,                  Jump)   \
+  _(JSGEQ,               "jsgeq",               sp::OP_JSGEQ,                Jump)   \
+  _(JSGRTR,              "jsgrtr",              sp::OP_JSGRTR,               Jump)   \
+  _(JSLEQ,               "jsleq",               sp::OP_JSLEQ,                Jump)   \
+  _(JSLESS,              "jsless",              sp::OP_JSLESS,               Jump)   \
+  _(JUMP,                "jump",                sp::OP_JUMP,                 Jump)   \
+  _(JZER,                "jzer",                sp::OP_JZER,                 Jump)   \
+  _(LDGFN_PRI,           "ldgfn.pri",           sp::OP_UNGEN_LDGFN_PRI,      Ldgfn)  \
+  _(LIDX,                "lidx",                sp::OP_LIDX,                 Plain)  \
+  _(LIDX_B,              "lidx.b",              sp::OP_UNGEN_LIDX_B,         Plain)  \
+  _(LOAD_ALT,            "load.alt",            sp::OP_LOAD_ALT,             Plain)  \
+  _(LOAD_BOTH,           "load.both",           sp::OP_LOAD_BOTH,            Plain)  \
+  _(LOAD_I,              "load.i",              sp::OP_LOAD_I,               Plain)  \
+  _(LOAD_PRI,            "load.pri",            sp::OP_LOAD_PRI,             Plain)  \
+  _(LOAD_S_ALT,          "load.s.alt",          sp::OP_LOAD_S_ALT,           Plain)  \
+  _(LOAD_S_BOTH,         "load.s.both",         sp::OP_LOAD_S_BOTH,          Plain)  \
+  _(LOAD_S_PRI,          "load.s.pri",          sp::OP_LOAD_S_PRI,           Plain)  \
+  _(LODB_I,              "lodb.i",              sp::OP_LODB_I,               Plain)  \
+  _(LREF_S_ALT,          "lref.s.alt",          sp::OP_LREF_S_ALT,           Plain)  \
+  _(LREF_S_PRI,          "lref.s.pri",          sp::OP_LREF_S_PRI,           Plain)  \
+  _(MOVE_ALT,            "move.alt",            sp::OP_MOVE_ALT,             Plain)  \
+  _(MOVE_PRI,            "move.pri",            sp::OP_MOVE_PRI,             Plain)  \
+  _(MOVS,                "movs",                sp::OP_MOVS,                 Plain)  \
+  _(NEG,                 "neg",                 sp::OP_NEG,                  Plain)  \
+  _(NEQ,                 "neq",                 sp::OP_NEQ,                  Plain)  \
+  _(NOP,                 "nop",                 sp::OP_NOP,                  Plain)  \
+  _(NOT,                 "not",                 sp::OP_NOT,                  Plain)  \
+  _(OR,                  "or",                  sp::OP_OR,                   Plain)  \
+  _(POP_ALT,             "pop.alt",             sp::OP_POP_ALT,              Plain)  \
+  _(POP_PRI,             "pop.pri",             sp::OP_POP_PRI,              Plain)  \
+  _(PROC,                "proc",                sp::OP_PROC,                 Plain)  \
+  _(PUSH,                "push",                sp::OP_PUSH,                 Plain)  \
+  _(PUSH_ADR,            "push.adr",            sp::OP_PUSH_ADR,             Plain)  \
+  _(PUSH_ALT,            "push.alt",            sp::OP_PUSH_ALT,             Plain)  \
+  _(PUSH_C,              "push.c",              sp::OP_PUSH_C,               Plain)  \
+  _(PUSH_PRI,            "push.pri",            sp::OP_PUSH_PRI,             Plain)  \
+  _(PUSH_S,              "push.s",              sp::OP_PUSH_S,               Plain)  \
+  _(PUSH2,               "push2",               sp::OP_PUSH2,                Plain)  \
+  _(PUSH2_ADR,           "push2.adr",           sp::OP_PUSH2_ADR,            Plain)  \
+  _(PUSH2_C,             "push2.c",             sp::OP_PUSH2_C,              Plain)  \
+  _(PUSH2_S,             "push2.s",             sp::OP_PUSH2_S,              Plain)  \
+  _(PUSH3,               "push3",               sp::OP_PUSH3,                Plain)  \
+  _(PUSH3_ADR,           "push3.adr",           sp::OP_PUSH3_ADR,            Plain)  \
+  _(PUSH3_C,             "push3.c",             sp::OP_PUSH3_C,              Plain)  \
+  _(PUSH3_S,             "push3.s",             sp::OP_PUSH3_S,              Plain)  \
+  _(PUSH4,               "push4",               sp::OP_PUSH4,                Plain)  \
+  _(PUSH4_ADR,           "push4.adr",           sp::OP_PUSH4_ADR,            Plain)  \
+  _(PUSH4_C,             "push4.c",             sp::OP_PUSH4_C,              Plain)  \
+  _(PUSH4_S,             "push4.s",             sp::OP_PUSH4_S,              Plain)  \
+  _(PUSH5,               "push5",               sp::OP_PUSH5,                Plain)  \
+  _(PUSH5_ADR,           "push5.adr",           sp::OP_PUSH5_ADR,            Plain)  \
+  _(PUSH5_C,             "push5.c",             sp::OP_PUSH5_C,              Plain)  \
+  _(PUSH5_S,             "push5.s",             sp::OP_PUSH5_S,              Plain)  \
+  _(RETN,                "retn",                sp::OP_RETN,                 Plain)  \
+  _(SDIV_ALT,            "sdiv.alt",            sp::OP_SDIV_ALT,             Plain)  \
+  _(SGEQ,                "sgeq",                sp::OP_SGEQ,                 Plain)  \
+  _(SGRTR,               "sgrtr",               sp::OP_SGRTR,                Plain)  \
+  _(SHL,                 "shl",                 sp::OP_SHL,                  Plain)  \
+  _(SHL_C_ALT,           "shl.c.alt",           sp::OP_SHL_C_ALT,            Plain)  \
+  _(SHL_C_PRI,           "shl.c.pri",           sp::OP_SHL_C_PRI,            Plain)  \
+  _(SHR,                 "shr",                 sp::OP_SHR,                  Plain)  \
+  _(SHR_C_ALT,           "shr.c.alt",           sp::OP_UNGEN_SHR_C_ALT,      Plain)  \
+  _(SHR_C_PRI,           "shr.c.pri",           sp::OP_UNGEN_SHR_C_PRI,      Plain)  \
+  _(SLEQ,                "sleq",                sp::OP_SLEQ,                 Plain)  \
+  _(SLESS,               "sless",               sp::OP_SLESS,                Plain)  \
+  _(SMUL,                "smul",                sp::OP_SMUL,                 Plain)  \
+  _(SMUL_C,              "smul.c",              sp::OP_SMUL_C,               Plain)  \
+  _(SREF_S_ALT,          "sref.s.alt",          sp::OP_SREF_S_ALT,           Plain)  \
+  _(SREF_S_PRI,          "sref.s.pri",          sp::OP_SREF_S_PRI,           Plain)  \
+  _(SSHR,                "sshr",                sp::OP_SSHR,                 Plain)  \
+  _(STACK,               "stack",               sp::OP_STACK,                Plain)  \
+  _(STOR_ALT,            "stor.alt",            sp::OP_STOR_ALT,             Plain)  \
+  _(STOR_I,              "stor.i",              sp::OP_STOR_I,               Plain)  \
+  _(STOR_PRI,            "stor.pri",            sp::OP_STOR_PRI,             Plain)  \
+  _(STOR_S_ALT,          "stor.s.alt",          sp::OP_STOR_S_ALT,           Plain)  \
+  _(STOR_S_PRI,          "stor.s.pri",          sp::OP_STOR_S_PRI,           Plain)  \
+  _(STRADJUST_PRI,       "stradjust.pri",       sp::OP_STRADJUST_PRI,        Plain)  \
+  _(STRB_I,              "strb.i",              sp::OP_STRB_I,               Plain)  \
+  _(SUB,                 "sub",                 sp::OP_SUB,                  Plain)  \
+  _(SUB_ALT,             "sub.alt",             sp::OP_SUB_ALT,              Plain)  \
+  _(SWAP_ALT,            "swap.alt",            sp::OP_SWAP_ALT,             Plain)  \
+  _(SWAP_PRI,            "swap.pri",            sp::OP_SWAP_PRI,             Plain)  \
+  _(SWITCH,              "switch",              sp::OP_SWITCH,               Jump)   \
+  _(SYSREQ_N,            "sysreq.n",            sp::OP_SYSREQ_N,             Sysreq) \
+  _(TRACKER_POP_SETHEAP, "tracker.pop.setheap", sp::OP_TRACKER_POP_SETHEAP,  Plain)  \
+  _(TRACKER_PUSH_C,      "tracker.push.c",      sp::OP_TRACKER_PUSH_C,       Plain)  \
+  _(XCHG,                "xchg",                sp::OP_XCHG,                 Plain)  \
+  _(XOR,                 "xor",                 sp::OP_XOR,                  Plain)  \
+  _(ZERO,                "zero",                sp::OP_ZERO,                 Plain)  \
+  _(ZERO_ALT,            "zero.alt",            sp::OP_ZERO_ALT,             Plain)  \
+  _(ZERO_PRI,            "zero.pri",            sp::OP_ZERO_PRI,             Plain)  \
+  _(ZERO_S,              "zero.s",              sp::OP_ZERO_S,               Plain)
+// clang-format on
+
+enum class AsmOp : uint16_t
+{
+#define _(op, name, opcode, format) op,
+    ASM_OPCODE_LIST(_)
+#undef _
+    TOTAL
+};
+
+enum class AsmFormat
+{
+    Plain,     /* opcode, then the operands as they are */
+    Jump,      /* opcode, then a label number */
+    Call,      /* opcode, then a function (symbol reference) */
+    Sysreq,    /* opcode, then a native (symbol reference) and an argument count */
+    Ldgfn,     /* a function (symbol reference), loaded as its function id */
+    Case,      /* a case table record: a value and a label number */
+    Directive, /* no code; see the assembler */
+    Marker,    /* no code; only meaningful to the optimizer */
+    Listing,   /* no code; only meaningful in assembler listings */
+};
+
+struct AsmOpInfo {
+    const char* name;
+    cell opcode;
+    AsmFormat format;
+};
+
+const AsmOpInfo& asm_op_info(AsmOp op);
+
+/* Look up an instruction by the name used in assembler listings. Returns
+ * false if there is no such instruction.
+ */
+bool asm_find_op(const char* name, size_t length, AsmOp* op);
+
+/*  An instruction in a stream is a header cell followed by its operands. The
+ *  header holds the op, the number of operands and whether a note follows the
+ *  operands. A note is an extra cell that only appears in assembler listings,
+ *  like the code address of a label.
+ *
+ *  Operands that refer to symbols or names (the target of a "call", or the
+ *  name in a ";$lcl" marker) are stored as references; see asm_symbol_ref()
+ *  and asm_name_ref().
+ */
+class AsmInsn
+{
+  public:
+    static const int kMaxArgs = 16;
+    static const int kMaxSize = kMaxArgs + 2;
+
+    explicit AsmInsn(AsmOp op)
+     : op_(op),
+       nargs_(0),
+       has_note_(false),
+       note_(0)
+    {}
+    AsmInsn(AsmOp op, cell arg)
+     : AsmInsn(op)
+    {
+        add(arg);
+    }
+    AsmInsn(AsmOp op, cell arg1, cell arg2)
+     : AsmInsn(op)
+    {
+        add(arg1);
+        add(arg2);
+    }
+
+    void add(cell arg) {
+        assert(nargs_ < kMaxArgs);
+        args_[nargs_++] = arg;
+    }
+    void setNote(cell note) {
+        has_note_ = true;
+        note_ = note;
+    }
+    AsmOp op() const {
+        return op_;
+    }
+    int nargs() const {
+        return nargs_;
+    }
+    cell arg(int i) const {
+        assert(i < nargs_);
+        return args_[i];
+    }
+
+    /* Writes the record, and returns its size in cells. */
+    int encode(cell* out) const;
+
+  private:
+    AsmOp op_;
+    int nargs_;
+    bool has_note_;
+    cell note_;
+    cell args_[kMaxArgs];
+};
+
+/* A read-only view of an encoded instruction. */
+class AsmRecord
+{
+  public:
+    explicit AsmRecord(const cell* pos)
+     : pos_(pos)
+    {}
+
+    static cell header(AsmOp op, int nargs, bool has_note) {
+        return cell(op) | (nargs << 16) | (has_note ? (1 << 24) : 0);
+    }
+
+    AsmOp op() const {
+        return AsmOp(pos_[0] & 0xffff);
+    }
+    int nargs() const {
+        return (pos_[0] >> 16) & 0xff;
+    }
+    cell arg(int index) const {
+        assert(index >= 0 && index < nargs());
+        return pos_[1 + index];
+    }
+    bool hasNote() const {
+        return (pos_[0] & (1 << 24)) != 0;
+    }
+    cell note() const {
+        assert(hasNote());
+        return pos_[1 + nargs()];
+    }
+    const AsmOpInfo& info() const {
+        return asm_op_info(op());
+    }
+
+    /* The size of the record in cells. */
+    int size() const {
+        return 1 + nargs() + (hasNote() ? 1 : 0);
+    }
+    const cell* pos() const {
+        return pos_;
+    }
+    const cell* next() const {
+        return pos_ + size();
+    }
+
+  private:
+    const cell* pos_;
+};
+
+/* A sequence of encoded instructions. */
+class AsmStream
+{
+  public:
+    void append(const cell* record) {
+        AsmRecord rec(record);
+        for (int i = 0; i < rec.size(); i++)
+            cells_.append(record[i]);
+    }
+    void append(const AsmInsn& insn) {
+        cell record[AsmInsn::kMaxSize];
+        append(record, insn.encode(record));
+    }
+    void append(const cell* cells, int count) {
+        for (int i = 0; i < count; i++)
+            cells_.append(cells[i]);
+    }
+    void clear() {
+        cells_.clear();
+    }
+
+    const cell* begin() const {
+        return cells_.buffer();
+    }
+    const cell* end() const {
+        return cells_.buffer() + cells_.length();
+    }
+    size_t length() const {
+        return cells_.length();
+    }
+
+  private:
+    ke::Vector<cell> cells_;
+};
+
+/* The program generated in the final pass, unless assembler output was
+ * requested (in which case the code is written as text to "outf").
+ */
+extern AsmStream gAsmProgram;
+
+/* References to symbols and names from instruction operands. References
+ * stay valid until asm_stream_cleanup().
+ */
+cell asm_symbol_ref(symbol* sym);
+symbol* asm_symbol(cell ref);
+cell asm_name_ref(const char* name);
+const char* asm_name(cell ref);
+
+/* Writes an instruction to an assembler listing. */
+void asm_render(const cell* record, memfile_t* fout);
+
+void asm_stream_cleanup();
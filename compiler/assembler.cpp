@@ -31,6 +31,8 @@
 #    include <alloc/fortify.h>
 #endif
 #include "amxdbg.h"
+#include "asm-stream.h"
+#include "compile-timings.h"
 #include "errors.h"
 #include "lstring.h"
 #include "sc.h"
@@ -58,18 +60,6 @@
 using namespace sp;
 using namespace ke;
 
-class AsmReader;
-class CellWriter;
-
-typedef void (*OPCODE_PROC)(CellWriter* writer, AsmReader* reader, cell opcode);
-
-typedef struct {
-    cell opcode;
-    const char* name;
-    int segment; /* sIN_CSEG=parse in cseg, sIN_DSEG=parse in dseg */
-    OPCODE_PROC func;
-} OPCODEC;
-
 struct BackpatchEntry {
     size_t index;
     cell target;
@@ -152,21 +142,6 @@ hex2long(const char* s, const char** n)
     return (ucell)result;
 }
 
-static ucell
-getparam(const char* s, const char** n)
-{
-    ucell result = 0;
-    for (;;) {
-        result += hex2long(s, &s);
-        if (*s != '+')
-            break;
-        s++;
-    }
-    if (n != NULL)
-        *n = s;
-    return result;
-}
-
 static const char*
 skipwhitespace(const char* str)
 {
@@ -175,509 +150,114 @@ skipwhitespace(const char* str)
     return str;
 }
 
-class AsmReader final
-{
-  public:
-    explicit AsmReader(memfile_t* fp)
-     : fp_(fp)
-    {
-        pc_resetasm(fp_);
-        pos_ = fp_->pos();
-        end_ = fp_->end();
-    }
-
-    // Find the next token that is immediately proceeded by a newline.
-    const char* next_line();
-
-    // Process characters until non-whitespace is encountered, up to the next
-    // newline. If the position is currently not whitespace then the position
-    // will remain unchanged.
-    const char* next_token_on_line();
-
-    // Advance the stream to the end of the current token, and return the new
-    // position (which should only be used for pointer arithmetic, since it may
-    // point beyond the end of the stream).
-    const char* end_of_token();
-
-    ucell getparam() {
-        return ::getparam(pos_, &pos_);
-    }
-    ucell hex2long() {
-        return ::hex2long(pos_, &pos_);
-    }
-    const char* pos() const {
-        assert(pos_ < end_);
-        return pos_;
-    }
-    Vector<symbol*>& native_list() {
-        return native_list_;
-    }
-    symbol* extract_call_target();
-
-  private:
-    template <bool StopAtLine>
-    inline const char* advance();
-
-  private:
-    memfile_t* fp_;
-    const char* pos_;
-    const char* end_;
-    Vector<symbol*> native_list_;
-};
-
-const char*
-AsmReader::next_line()
-{
-    while (true) {
-        if (pos_ >= end_)
-            return nullptr;
-        if (*pos_ == '\n') {
-            pos_++;
-            break;
-        }
-        pos_++;
-    }
-    if (pos_ >= end_)
-        return nullptr;
-    return pos_;
-}
-
-const char*
-AsmReader::next_token_on_line()
-{
-    for (; pos_ < end_; pos_++) {
-        // Ignore spaces/tabs, stop on newline.
-        if (isspace(*pos_)) {
-            if (*pos_ == '\n')
-                return nullptr;
-            continue;
-        }
-        // Eat comments until the newline.
-        if (*pos_ == ';') {
-            while (pos_ < end_ && *pos_ != '\n')
-                pos_++;
-            return nullptr;
-        }
-        // Probably a token, stop and return.
-        return pos_;
-    }
-    return nullptr;
-}
-
-const char*
-AsmReader::end_of_token()
-{
-    assert(!isspace(*pos_) && *pos_ != ';');
-    for (; pos_ < end_; pos_++) {
-        if (isspace(*pos_) || *pos_ == ';')
-            return pos_;
-    }
-    return pos_;
-}
-
-symbol*
-AsmReader::extract_call_target()
-{
-    char name[METHOD_NAMEMAX];
-
-    const char* params = pos();
-
-    int i;
-    for (i = 0; !isspace(*params); i++, params++) {
-        assert(*params != '\0');
-        assert(i < METHOD_NAMEMAX);
-        name[i] = *params;
-    }
-    name[i] = '\0';
-    pos_ += i;
-
-    symbol* sym = findglb(name);
-    if (!sym) {
-        return nullptr;
-    }
-
-    assert(sym->ident == iFUNCTN);
-    assert(sym->vclass == sGLOBAL);
-    return sym;
-}
-
-static void
-noop(CellWriter* writer, AsmReader* reader, cell opcode)
-{
-}
-
-static void
-set_currentfile(CellWriter* writer, AsmReader* reader, cell opcode)
-{
-    fcurrent = (short)reader->getparam();
-}
-
-static void
-parm0(CellWriter* writer, AsmReader* reader, cell opcode)
-{
-    writer->append(opcode);
-}
-
-static void
-parm1(CellWriter* writer, AsmReader* reader, cell opcode)
-{
-    ucell p = reader->getparam();
-    writer->append(opcode);
-    writer->append(p);
-}
-
-static void
-parm2(CellWriter* writer, AsmReader* reader, cell opcode)
-{
-    ucell p1 = reader->getparam();
-    ucell p2 = reader->getparam();
-    writer->append(opcode);
-    writer->append(p1);
-    writer->append(p2);
-}
-
-static void
-parm3(CellWriter* writer, AsmReader* reader, cell opcode)
-{
-    ucell p1 = reader->getparam();
-    ucell p2 = reader->getparam();
-    ucell p3 = reader->getparam();
-    writer->append(opcode);
-    writer->append(p1);
-    writer->append(p2);
-    writer->append(p3);
-}
-
-static void
-parm4(CellWriter* writer, AsmReader* reader, cell opcode)
-{
-    ucell p1 = reader->getparam();
-    ucell p2 = reader->getparam();
-    ucell p3 = reader->getparam();
-    ucell p4 = reader->getparam();
-    writer->append(opcode);
-    writer->append(p1);
-    writer->append(p2);
-    writer->append(p3);
-    writer->append(p4);
-}
-
-static void
-parm5(CellWriter* writer, AsmReader* reader, cell opcode)
-{
-    ucell p1 = reader->getparam();
-    ucell p2 = reader->getparam();
-    ucell p3 = reader->getparam();
-    ucell p4 = reader->getparam();
-    ucell p5 = reader->getparam();
-    writer->append(opcode);
-    writer->append(p1);
-    writer->append(p2);
-    writer->append(p3);
-    writer->append(p4);
-    writer->append(p5);
-}
-
-static void
-do_dump(CellWriter* writer, AsmReader* reader, cell opcode)
-{
-    int num = 0;
-
-    while (reader->next_token_on_line()) {
-        ucell p = reader->getparam();
-        writer->append(p);
-        num++;
-    }
-}
-
-static void
-do_dumpfill(CellWriter* writer, AsmReader* reader, cell opcode)
-{
-    ucell value = reader->getparam();
-    ucell times = reader->getparam();
-    while (times-- > 0) {
-        writer->append(value);
-    }
-}
-
-static void
-do_ldgfen(CellWriter* writer, AsmReader* reader, cell opcode)
-{
-    symbol* sym = reader->extract_call_target();
-    assert(sym->ident == iFUNCTN);
-    assert(!sym->native);
-    assert((sym->function()->funcid & 1) == 1);
-    assert(sym->usage & uREAD);
-    assert(!sym->skipped);
-
-    // Note: we emit const.pri for backward compatibility.
-    assert(opcode == sp::OP_UNGEN_LDGFN_PRI);
-    writer->append(sp::OP_CONST_PRI);
-    writer->append(sym->function()->funcid);
-}
-
-static void
-do_call(CellWriter* writer, AsmReader* reader, cell opcode)
-{
-    symbol* sym = reader->extract_call_target();
-    assert(sym->usage & uREAD);
-    assert(!sym->skipped);
-
-    writer->append(opcode);
-    writer->append(sym->addr());
-}
-
-static void
-do_sysreq(CellWriter* writer, AsmReader* reader, cell opcode)
-{
-    symbol* sym = reader->extract_call_target();
-    ucell nargs = reader->getparam();
-
-    assert(sym->native);
-    if (sym->addr() < 0) {
-      sym->setAddr(reader->native_list().length());
-      reader->native_list().append(sym);
-    }
-
-    writer->append(opcode);
-    writer->append(sym->addr());
-    writer->append(nargs);
-}
-
-static void
-do_jump(CellWriter* writer, AsmReader* reader, cell opcode)
-{
-    int i = reader->hex2long();
-
-    writer->append(opcode);
-    writer->write_label(i);
-}
-
-static void
-do_switch(CellWriter* writer, AsmReader* reader, cell opcode)
-{
-    int i = reader->hex2long();
-
-    writer->append(opcode);
-    writer->write_label(i);
-}
-
+// Generate code or data into a buffer.
 static void
-do_case(CellWriter* writer, AsmReader* reader, cell opcode)
+generate_segment(Vector<symbol*>* native_list, Vector<cell>* code_buffer,
+                 Vector<cell>* data_buffer)
 {
-    cell v = reader->hex2long();
-    int i = reader->hex2long();
-
-    writer->append(v);
-    writer->write_label(i);
-}
+    CellWriter code_writer(*code_buffer);
+    CellWriter data_writer(*data_buffer);
 
-// clang-format off
-static OPCODEC opcodelist[] = {
-  /* node for "invalid instruction" */
-  {  0, NULL,         0,        noop },
-  {  0, "CODE",       sIN_CSEG, set_currentfile },
-  {  0, "DATA",       sIN_DSEG, set_currentfile },
-  {  0, "STKSIZE",    0,        noop },
-  /* opcodes in sorted order */
-  { 78, "add",        sIN_CSEG, parm0 },
-  { 87, "add.c",      sIN_CSEG, parm1 },
-  { 14, "addr.alt",   sIN_CSEG, parm1 },
-  { 13, "addr.pri",   sIN_CSEG, parm1 },
-  { 81, "and",        sIN_CSEG, parm0 },
-  {121, "bounds",     sIN_CSEG, parm1 },
-  {137, "break",      sIN_CSEG, parm0 },  /* version 8 */
-  { 49, "call",       sIN_CSEG, do_call },
-  {  0, "case",       sIN_CSEG, do_case },
-  {130, "casetbl",    sIN_CSEG, parm0 },  /* version 1 */
-  {156, "const",      sIN_CSEG, parm2 },  /* version 9 */
-  { 12, "const.alt",  sIN_CSEG, parm1 },
-  { 11, "const.pri",  sIN_CSEG, parm1 },
-  {157, "const.s",    sIN_CSEG, parm2 },  /* version 9 */
-  {114, "dec",        sIN_CSEG, parm1 },
-  {113, "dec.alt",    sIN_CSEG, parm0 },
-  {116, "dec.i",      sIN_CSEG, parm0 },
-  {112, "dec.pri",    sIN_CSEG, parm0 },
-  {115, "dec.s",      sIN_CSEG, parm1 },
-  {  0, "dump",       sIN_DSEG, do_dump },
-  {  0, "dumpfill",   sIN_DSEG, do_dumpfill },
-  {166, "endproc",    sIN_CSEG, parm0 },
-  { 95, "eq",         sIN_CSEG, parm0 },
-  {106, "eq.c.alt",   sIN_CSEG, parm1 },
-  {105, "eq.c.pri",   sIN_CSEG, parm1 },
-  {119, "fill",       sIN_CSEG, parm1 },
-  {162, "genarray",   sIN_CSEG, parm1 },
-  {163, "genarray.z", sIN_CSEG, parm1 },
-  {120, "halt",       sIN_CSEG, parm1 },
-  { 45, "heap",       sIN_CSEG, parm1 },
-  { 27, "idxaddr",    sIN_CSEG, parm0 },
-  { 28, "idxaddr.b",  sIN_CSEG, parm1 },
-  {109, "inc",        sIN_CSEG, parm1 },
-  {108, "inc.alt",    sIN_CSEG, parm0 },
-  {111, "inc.i",      sIN_CSEG, parm0 },
-  {107, "inc.pri",    sIN_CSEG, parm0 },
-  {110, "inc.s",      sIN_CSEG, parm1 },
-  { 86, "invert",     sIN_CSEG, parm0 },
-  { 55, "jeq",        sIN_CSEG, do_jump },
-  { 56, "jneq",       sIN_CSEG, do_jump },
-  { 54, "jnz",        sIN_CSEG, do_jump },
-  { 64, "jsgeq",      sIN_CSEG, do_jump },
-  { 63, "jsgrtr",     sIN_CSEG, do_jump },
-  { 62, "jsleq",      sIN_CSEG, do_jump },
-  { 61, "jsless",     sIN_CSEG, do_jump },
-  { 51, "jump",       sIN_CSEG, do_jump },
-  { 53, "jzer",       sIN_CSEG, do_jump },
-  {167, "ldgfn.pri",  sIN_CSEG, do_ldgfen },
-  { 25, "lidx",       sIN_CSEG, parm0 },
-  { 26, "lidx.b",     sIN_CSEG, parm1 },
-  {  2, "load.alt",   sIN_CSEG, parm1 },
-  {154, "load.both",  sIN_CSEG, parm2 },  /* version 9 */
-  {  9, "load.i",     sIN_CSEG, parm0 },
-  {  1, "load.pri",   sIN_CSEG, parm1 },
-  {  4, "load.s.alt", sIN_CSEG, parm1 },
-  {155, "load.s.both",sIN_CSEG, parm2 },  /* version 9 */
-  {  3, "load.s.pri", sIN_CSEG, parm1 },
-  { 10, "lodb.i",     sIN_CSEG, parm1 },
-  {  8, "lref.s.alt", sIN_CSEG, parm1 },
-  {  7, "lref.s.pri", sIN_CSEG, parm1 },
-  { 34, "move.alt",   sIN_CSEG, parm0 },
-  { 33, "move.pri",   sIN_CSEG, parm0 },
-  {117, "movs",       sIN_CSEG, parm1 },
-  { 85, "neg",        sIN_CSEG, parm0 },
-  { 96, "neq",        sIN_CSEG, parm0 },
-  {134, "nop",        sIN_CSEG, parm0 },  /* version 6 */
-  { 84, "not",        sIN_CSEG, parm0 },
-  { 82, "or",         sIN_CSEG, parm0 },
-  { 43, "pop.alt",    sIN_CSEG, parm0 },
-  { 42, "pop.pri",    sIN_CSEG, parm0 },
-  { 46, "proc",       sIN_CSEG, parm0 },
-  { 40, "push",       sIN_CSEG, parm1 },
-  {133, "push.adr",   sIN_CSEG, parm1 },  /* version 4 */
-  { 37, "push.alt",   sIN_CSEG, parm0 },
-  { 39, "push.c",     sIN_CSEG, parm1 },
-  { 36, "push.pri",   sIN_CSEG, parm0 },
-  { 41, "push.s",     sIN_CSEG, parm1 },
-  {139, "push2",      sIN_CSEG, parm2 },  /* version 9 */
-  {141, "push2.adr",  sIN_CSEG, parm2 },  /* version 9 */
-  {138, "push2.c",    sIN_CSEG, parm2 },  /* version 9 */
-  {140, "push2.s",    sIN_CSEG, parm2 },  /* version 9 */
-  {143, "push3",      sIN_CSEG, parm3 },  /* version 9 */
-  {145, "push3.adr",  sIN_CSEG, parm3 },  /* version 9 */
-  {142, "push3.c",    sIN_CSEG, parm3 },  /* version 9 */
-  {144, "push3.s",    sIN_CSEG, parm3 },  /* version 9 */
-  {147, "push4",      sIN_CSEG, parm4 },  /* version 9 */
-  {149, "push4.adr",  sIN_CSEG, parm4 },  /* version 9 */
-  {146, "push4.c",    sIN_CSEG, parm4 },  /* version 9 */
-  {148, "push4.s",    sIN_CSEG, parm4 },  /* version 9 */
-  {151, "push5",      sIN_CSEG, parm5 },  /* version 9 */
-  {153, "push5.adr",  sIN_CSEG, parm5 },  /* version 9 */
-  {150, "push5.c",    sIN_CSEG, parm5 },  /* version 9 */
-  {152, "push5.s",    sIN_CSEG, parm5 },  /* version 9 */
-  { 48, "retn",       sIN_CSEG, parm0 },
-  { 74, "sdiv.alt",   sIN_CSEG, parm0 },
-  {104, "sgeq",       sIN_CSEG, parm0 },
-  {103, "sgrtr",      sIN_CSEG, parm0 },
-  { 65, "shl",        sIN_CSEG, parm0 },
-  { 69, "shl.c.alt",  sIN_CSEG, parm1 },
-  { 68, "shl.c.pri",  sIN_CSEG, parm1 },
-  { 66, "shr",        sIN_CSEG, parm0 },
-  { 71, "shr.c.alt",  sIN_CSEG, parm1 },
-  { 70, "shr.c.pri",  sIN_CSEG, parm1 },
-  {102, "sleq",       sIN_CSEG, parm0 },
-  {101, "sless",      sIN_CSEG, parm0 },
-  { 72, "smul",       sIN_CSEG, parm0 },
-  { 88, "smul.c",     sIN_CSEG, parm1 },
-  { 22, "sref.s.alt", sIN_CSEG, parm1 },
-  { 21, "sref.s.pri", sIN_CSEG, parm1 },
-  { 67, "sshr",       sIN_CSEG, parm0 },
-  { 44, "stack",      sIN_CSEG, parm1 },
-  { 16, "stor.alt",   sIN_CSEG, parm1 },
-  { 23, "stor.i",     sIN_CSEG, parm0 },
-  { 15, "stor.pri",   sIN_CSEG, parm1 },
-  { 18, "stor.s.alt", sIN_CSEG, parm1 },
-  { 17, "stor.s.pri", sIN_CSEG, parm1 },
-  {164, "stradjust.pri", sIN_CSEG, parm0 },
-  { 24, "strb.i",     sIN_CSEG, parm1 },
-  { 79, "sub",        sIN_CSEG, parm0 },
-  { 80, "sub.alt",    sIN_CSEG, parm0 },
-  {132, "swap.alt",   sIN_CSEG, parm0 },
-  {131, "swap.pri",   sIN_CSEG, parm0 },
-  {129, "switch",     sIN_CSEG, do_switch },
-  {135, "sysreq.n",   sIN_CSEG, do_sysreq },
-  {161, "tracker.pop.setheap", sIN_CSEG, parm0 },
-  {160, "tracker.push.c", sIN_CSEG, parm1 },
-  { 35, "xchg",       sIN_CSEG, parm0 },
-  { 83, "xor",        sIN_CSEG, parm0 },
-  { 91, "zero",       sIN_CSEG, parm1 },
-  { 90, "zero.alt",   sIN_CSEG, parm0 },
-  { 89, "zero.pri",   sIN_CSEG, parm0 },
-  { 92, "zero.s",     sIN_CSEG, parm1 },
-};
-// clang-format on
+    for (const cell* pos = gAsmProgram.begin(); pos < gAsmProgram.end();) {
+        AsmRecord rec(pos);
+        pos = rec.next();
+
+        const AsmOpInfo& info = rec.info();
+        switch (info.format) {
+            case AsmFormat::Directive:
+                switch (rec.op()) {
+                    case AsmOp::LABEL:
+                    {
+                        int lindex = rec.arg(0);
+                        assert(lindex >= 0 && lindex < sc_labnum);
+                        assert(sLabelTable[lindex] == -1);
+                        sLabelTable[lindex] = code_writer.current_address();
+                        break;
+                    }
+                    case AsmOp::CODE:
+                    case AsmOp::DATA:
+                        fcurrent = (short)rec.arg(0);
+                        break;
+                    case AsmOp::DUMP:
+                        for (int i = 0; i < rec.nargs(); i++)
+                            data_writer.append(rec.arg(i));
+                        break;
+                    case AsmOp::DUMPFILL:
+                        for (cell times = rec.arg(1); times > 0; times--)
+                            data_writer.append(rec.arg(0));
+                        break;
+                    case AsmOp::STKSIZE:
+                        break;
+                    default:
+                        assert(false);
+                        break;
+                }
+                break;
 
-static ke::HashMap<CharsAndLength, int, KeywordTablePolicy> sOpcodeLookup;
+            case AsmFormat::Plain:
+                code_writer.append(info.opcode);
+                for (int i = 0; i < rec.nargs(); i++)
+                    code_writer.append(rec.arg(i));
+                break;
 
-static void
-init_opcode_lookup()
-{
-    if (sOpcodeLookup.elements())
-        return;
+            case AsmFormat::Jump:
+                code_writer.append(info.opcode);
+                code_writer.write_label(rec.arg(0));
+                break;
 
-    sOpcodeLookup.init(512);
+            case AsmFormat::Call:
+            {
+                symbol* sym = asm_symbol(rec.arg(0));
+                assert(sym->usage & uREAD);
+                assert(!sym->skipped);
 
-    static const int kNumOpcodes = size_t(sizeof(opcodelist) / sizeof(*opcodelist));
-    for (int i = 1; i < kNumOpcodes; i++) {
-        const auto& entry = opcodelist[i];
-        CharsAndLength key(entry.name, strlen(entry.name));
-        auto p = sOpcodeLookup.findForAdd(key);
-        assert(!p.found());
-        sOpcodeLookup.add(p, key, i);
-    }
-}
+                code_writer.append(info.opcode);
+                code_writer.append(sym->addr());
+                break;
+            }
 
-static int
-findopcode(const char* instr, size_t maxlen)
-{
-    CharsAndLength key(instr, maxlen);
-    auto p = sOpcodeLookup.find(key);
-    if (!p.found())
-        return 0;
-    return p->value;
-}
+            case AsmFormat::Sysreq:
+            {
+                symbol* sym = asm_symbol(rec.arg(0));
+                assert(sym->native);
+                if (sym->addr() < 0) {
+                    sym->setAddr(native_list->length());
+                    native_list->append(sym);
+                }
 
-// Generate code or data into a buffer.
-static void
-generate_segment(AsmReader& reader, Vector<cell>* code_buffer, Vector<cell>* data_buffer)
-{
-    CellWriter code_writer(*code_buffer);
-    CellWriter data_writer(*data_buffer);
+                code_writer.append(info.opcode);
+                code_writer.append(sym->addr());
+                code_writer.append(rec.arg(1));
+                break;
+            }
 
-    do {
-        const char* instr = reader.next_token_on_line();
+            case AsmFormat::Ldgfn:
+            {
+                symbol* sym = asm_symbol(rec.arg(0));
+                assert(sym->ident == iFUNCTN);
+                assert(!sym->native);
+                assert((sym->function()->funcid & 1) == 1);
+                assert(sym->usage & uREAD);
+                assert(!sym->skipped);
+
+                // Note: we emit const.pri for backward compatibility.
+                assert(info.opcode == sp::OP_UNGEN_LDGFN_PRI);
+                code_writer.append(sp::OP_CONST_PRI);
+                code_writer.append(sym->function()->funcid);
+                break;
+            }
 
-        // Ignore empty lines.
-        if (!instr)
-            continue;
+            case AsmFormat::Case:
+                code_writer.append(rec.arg(0));
+                code_writer.write_label(rec.arg(1));
+                break;
 
-        if (tolower(instr[0]) == 'l' && instr[1] == '.') {
-            int lindex = (int)hex2long(instr + 2, nullptr);
-            assert(lindex >= 0 && lindex < sc_labnum);
-            assert(sLabelTable[lindex] == -1);
-            sLabelTable[lindex] = code_writer.current_address();
-            continue;
+            default:
+                // Markers and listing records never reach the program stream.
+                assert(false);
+                break;
         }
-
-        const char* pos = reader.end_of_token();
-        int op_index = findopcode(instr, (pos - instr));
-        OPCODEC& op = opcodelist[op_index];
-        assert(op.name != nullptr);
-
-        reader.next_token_on_line();
-        if (op.segment == sIN_CSEG)
-            op.func(&code_writer, &reader, op.opcode);
-        else if (op.segment == sIN_DSEG)
-            op.func(&data_writer, &reader, op.opcode);
-    } while (reader.next_line());
+    }
 
     // Fix up backpatches.
     for (const auto& patch : sBackpatchList) {
@@ -688,21 +268,6 @@ generate_segment(AsmReader& reader, Vector<cell>* code_buffer, Vector<cell>* dat
     }
 }
 
-#if !defined NDEBUG
-// The opcode list should be sorted by name.
-class VerifyOpcodeSorting
-{
-  public:
-    VerifyOpcodeSorting() {
-        assert(opcodelist[1].name != NULL);
-        for (size_t i = 2; i < (sizeof opcodelist / sizeof opcodelist[0]); i++) {
-            assert(opcodelist[i].name != NULL);
-            assert(strcmp(opcodelist[i].name, opcodelist[i - 1].name) > 0);
-        }
-    }
-} sVerifyOpcodeSorting;
-#endif
-
 static int
 sort_by_name(const void* a1, const void* a2)
 {
@@ -1411,7 +976,7 @@ typedef SmxBlobSection<sp_file_data_t> SmxDataSection;
 typedef SmxBlobSection<sp_file_code_t> SmxCodeSection;
 
 static void
-assemble_to_buffer(SmxByteBuffer* buffer, memfile_t* fin)
+assemble_to_buffer(SmxByteBuffer* buffer)
 {
     SmxBuilder builder;
     RefPtr<SmxNativeSection> natives = new SmxNativeSection(".natives");
@@ -1421,7 +986,9 @@ assemble_to_buffer(SmxByteBuffer* buffer, memfile_t* fin)
     RefPtr<SmxCodeSection> code = new SmxCodeSection(".code");
     RefPtr<SmxNameTable> names = new SmxNameTable(".names");
 
+    timings_enter(CompilePhase::Rtti);
     RttiBuilder rtti(names);
+    timings_leave();
 
     Vector<function_entry> functions;
 
@@ -1490,21 +1057,25 @@ assemble_to_buffer(SmxByteBuffer* buffer, memfile_t* fin)
 
         sym->function()->funcid = (uint32_t(i) << 1) | 1;
 
+        timings_enter(CompilePhase::Rtti);
         rtti.add_method(sym);
+        timings_leave();
     }
 
+    sLabelTable.clear();
+    sBackpatchList.clear();
     for (int i = 1; i <= sc_labnum; i++)
         sLabelTable.append(-1);
     assert(sLabelTable.length() == size_t(sc_labnum));
 
     // Generate buffers.
-    AsmReader reader(fin);
+    Vector<symbol*> native_list;
     Vector<cell> code_buffer, data_buffer;
-    generate_segment(reader, &code_buffer, &data_buffer);
+    generate_segment(&native_list, &code_buffer, &data_buffer);
 
     // Populate the native table.
-    for (size_t i = 0; i < reader.native_list().length(); i++) {
-        symbol* sym = reader.native_list()[i];
+    for (size_t i = 0; i < native_list.length(); i++) {
+        symbol* sym = native_list[i];
         assert(size_t(sym->addr()) == i);
 
         sp_file_natives_t& entry = natives->add();
@@ -1515,7 +1086,9 @@ assemble_to_buffer(SmxByteBuffer* buffer, memfile_t* fin)
         else
             entry.name = names->add(sym->nameAtom());
 
+        timings_enter(CompilePhase::Rtti);
         rtti.add_native(sym);
+        timings_leave();
     }
 
     // Set up the code section.
@@ -1546,7 +1119,9 @@ assemble_to_buffer(SmxByteBuffer* buffer, memfile_t* fin)
     builder.add(pubvars);
     builder.add(natives);
     builder.add(names);
+    timings_enter(CompilePhase::Rtti);
     rtti.finish(builder);
+    timings_leave();
 
     builder.write(buffer);
 }
@@ -1569,12 +1144,12 @@ splat_to_binary(const char* binfname, const void* bytes, size_t size)
 }
 
 void
-assemble(const char* binfname, memfile_t* fin)
+assemble(const char* binfname)
 {
-    init_opcode_lookup();
-
     SmxByteBuffer buffer;
-    assemble_to_buffer(&buffer, fin);
+    timings_enter(CompilePhase::Assemble);
+    assemble_to_buffer(&buffer);
+    timings_leave();
 
     // Buffer compression logic.
     sp_file_hdr_t* header = (sp_file_hdr_t*)buffer.bytes();
@@ -1585,8 +1160,10 @@ assemble(const char* binfname, memfile_t* fin)
         UniquePtr<Bytef[]> zbuf = MakeUnique<Bytef[]>(zbuf_max);
 
         uLong new_disksize = zbuf_max;
+        timings_enter(CompilePhase::Compress);
         int err = compress2(zbuf.get(), &new_disksize, (Bytef*)(buffer.bytes() + header->dataoffs),
                             region_size, sc_compression_level);
+        timings_leave();
         if (err == Z_OK) {
             header->disksize = new_disksize + header->dataoffs;
             header->compression = SmxConsts::FILE_COMPRESSION_GZ;
@@ -0,0 +1,237 @@
+// vim: set ts=8 sts=4 sw=4 tw=99 et:
+//
+//  Copyright (C) 2006-2018 AlliedModders LLC
+//
+//  This file is part of SourcePawn. SourcePawn is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  SourcePawn. If not, see http://www.gnu.org/licenses/.
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <amtl/am-vector.h>
+
+#if defined __linux__ || defined __FreeBSD__ || defined __OpenBSD__ || defined DARWIN
+#    include <poll.h>
+#    include <signal.h>
+#    include <sys/wait.h>
+#    include <unistd.h>
+#endif
+
+#include "sc.h"
+#include "scvars.h"
+
+/* With "-j N" and more than one source file, every file is compiled on its own
+ * into its own output file, instead of all files being compiled as one
+ * program. Up to N compilations run at the same time.
+ *
+ * The state of a compilation lives in globals, so each compilation runs in a
+ * child process of its own (see runjob()). Running them on threads instead
+ * would first need that state moved into a per-compilation context.
+ *
+ * The output of a compilation is collected, and printed once the output of
+ * every file before it on the command line has been printed, so the messages
+ * come in the same order for any N.
+ *
+ * Where there is no fork(), the files are compiled one after the other.
+ */
+
+#if defined __linux__ || defined __FreeBSD__ || defined __OpenBSD__ || defined DARWIN
+
+struct CompileJob
+{
+    CompileJob()
+     : pid(-1),
+       fd(-1),
+       done(false),
+       retcode(0)
+    {}
+
+    pid_t pid;
+    int fd;             /* read end of the pipe with the output */
+    bool done;
+    int retcode;
+    ke::Vector<char> output;
+};
+
+/* runjob
+ *
+ * Starts the compilation of source file "index" in a child process, whose
+ * standard output and error go to a pipe.
+ */
+static bool
+runjob(CompileJob* job, int index, int argc, char** argv)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        fprintf(stderr, "pipe failed: %s\n", strerror(errno));
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "fork failed: %s\n", strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        dup2(fds[1], fileno(stdout));
+        dup2(fds[1], fileno(stderr));
+        close(fds[1]);
+
+        sc_jobfile = index;
+        int retcode = pc_compile(argc, argv);
+        fflush(stdout);
+        fflush(stderr);
+        _exit(retcode);
+    }
+
+    close(fds[1]);
+    job->pid = pid;
+    job->fd = fds[0];
+    return true;
+}
+
+/* killjobs
+ *
+ * Stops every job that is still running, and waits for it to exit.
+ */
+static void
+killjobs(ke::Vector<CompileJob>& jobs, int started)
+{
+    for (int i = 0; i < started; i++) {
+        CompileJob& job = jobs[i];
+        if (job.done)
+            continue;
+        kill(job.pid, SIGKILL);
+        close(job.fd);
+        job.fd = -1;
+        while (waitpid(job.pid, nullptr, 0) < 0 && errno == EINTR)
+            ;
+        job.done = true;
+    }
+}
+
+/* readjob
+ *
+ * Reads what is in the pipe of a running job; at the end of the output, it
+ * collects the exit code of the child.
+ */
+static void
+readjob(CompileJob* job)
+{
+    char buffer[4096];
+    ssize_t bytes = read(job->fd, buffer, sizeof(buffer));
+    if (bytes < 0 && errno == EINTR)
+        return;
+    if (bytes > 0) {
+        for (ssize_t i = 0; i < bytes; i++)
+            job->output.append(buffer[i]);
+        return;
+    }
+
+    close(job->fd);
+    job->fd = -1;
+
+    int status;
+    while (waitpid(job->pid, &status, 0) < 0 && errno == EINTR)
+        ;
+    if (WIFEXITED(status)) {
+        job->retcode = WEXITSTATUS(status);
+    } else {
+        char message[64];
+        snprintf(message, sizeof(message), "\nCompilation aborted (signal %d).\n",
+                 WIFSIGNALED(status) ? WTERMSIG(status) : 0);
+        for (const char* ptr = message; *ptr != '\0'; ptr++)
+            job->output.append(*ptr);
+        job->retcode = 1;
+    }
+    job->done = true;
+}
+
+int
+pc_compile_jobs(int argc, char** argv, int files)
+{
+    ke::Vector<CompileJob> jobs;
+    for (int i = 0; i < files; i++)
+        jobs.append(CompileJob());
+
+    /* do not let the children print what is still buffered */
+    fflush(stdout);
+    fflush(stderr);
+
+    int retcode = 0;
+    int started = 0, running = 0, printed = 0;
+    while (printed < files) {
+        while (started < files && running < sc_jobs) {
+            if (!runjob(&jobs[started], started, argc, argv)) {
+                /* let the jobs that run finish, but start no others */
+                files = started;
+                retcode = 1;
+                break;
+            }
+            started++;
+            running++;
+        }
+
+        ke::Vector<struct pollfd> fds;
+        ke::Vector<int> fdjobs;
+        for (int i = printed; i < started; i++) {
+            if (jobs[i].done)
+                continue;
+            struct pollfd fd;
+            fd.fd = jobs[i].fd;
+            fd.events = POLLIN;
+            fd.revents = 0;
+            fds.append(fd);
+            fdjobs.append(i);
+        }
+        if (fds.length() > 0) {
+            if (poll(&fds[0], fds.length(), -1) < 0 && errno != EINTR) {
+                fprintf(stderr, "poll failed: %s\n", strerror(errno));
+                killjobs(jobs, started);
+                return 1;
+            }
+            for (size_t i = 0; i < fds.length(); i++) {
+                if (fds[i].revents == 0)
+                    continue;
+                readjob(&jobs[fdjobs[i]]);
+                if (jobs[fdjobs[i]].done)
+                    running--;
+            }
+        }
+
+        for (; printed < started && jobs[printed].done; printed++) {
+            CompileJob& job = jobs[printed];
+            if (job.output.length() > 0)
+                fwrite(&job.output[0], 1, job.output.length(), stdout);
+            fflush(stdout);
+            if (job.retcode != 0)
+                retcode = 1;
+        }
+    }
+    return retcode;
+}
+
+#else
+
+int
+pc_compile_jobs(int argc, char** argv, int files)
+{
+    int retcode = 0;
+    for (int i = 0; i < files; i++) {
+        sc_jobfile = i;
+        if (pc_compile(argc, argv) != 0)
+            retcode = 1;
+    }
+    sc_jobfile = -1;
+    return retcode;
+}
+
+#endif
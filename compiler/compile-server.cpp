@@ -0,0 +1,198 @@
+// vim: set ts=8 sts=4 sw=4 tw=99 et:
+//
+//  Copyright (C) 2006-2018 AlliedModders LLC
+//
+//  This file is part of SourcePawn. SourcePawn is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  SourcePawn. If not, see http://www.gnu.org/licenses/.
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <amtl/am-vector.h>
+
+#if defined __linux__ || defined __FreeBSD__ || defined __OpenBSD__ || defined DARWIN
+#    include <signal.h>
+#    include <sys/socket.h>
+#    include <sys/un.h>
+#    include <unistd.h>
+#    define HAVE_UNIX_SOCKETS
+#elif defined _WIN32
+#    include <direct.h>
+#    include <io.h>
+#endif
+
+#include "sc.h"
+#include "scvars.h"
+
+/* In server mode ("spcomp --server"), the compiler reads compile requests from
+ * its standard input and answers each of them on its standard output, so that
+ * a build that compiles many plugins pays for starting the compiler only once.
+ * A request is a line with the directory to compile in and the arguments of the
+ * compilation, separated by TAB characters:
+ *
+ *     <directory> TAB <argument> TAB <argument> ... NEWLINE
+ *
+ * A relative directory is taken from the directory that the server was started
+ * in, whatever the requests before it asked for.
+ *
+ * The answer is everything that the compilation prints, followed by a NUL
+ * character and the exit code that "spcomp" would have returned, as a decimal
+ * number on a line of its own. The server stops at the end of its input.
+ *
+ * With "spcomp --server=<path>", the server listens on a Unix domain socket at
+ * <path> instead, and reads requests from each connection in turn until the
+ * client closes it; the answers go back over the same connection. This form
+ * runs until it is killed.
+ *
+ * Between compilations, the stripped lines of the include files and the macro
+ * history are kept (see keep_linecache()), as are the interned strings in
+ * gAtoms, so that the next compilation does not read and strip the same include
+ * files again. Only the text is kept: every compilation still parses and
+ * declares everything that its include files contain.
+ */
+
+static char sStartDir[_MAX_PATH];
+
+static bool
+readrequest(FILE* input, ke::Vector<char>* request)
+{
+    request->clear();
+    char buffer[1024];
+    while (fgets(buffer, sizeof(buffer), input) != NULL) {
+        size_t length = strlen(buffer);
+        for (size_t i = 0; i < length; i++)
+            request->append(buffer[i]);
+        if (length > 0 && buffer[length - 1] == '\n')
+            break;
+    }
+    if (request->length() == 0)
+        return false;
+    while (request->length() > 0 && (request->back() == '\n' || request->back() == '\r'))
+        request->pop();
+    request->append('\0');
+    return true;
+}
+
+/* Answers the requests read from "input" on stdout, until the end of "input" */
+static void
+serve(char* program, FILE* input)
+{
+    ke::Vector<char> request;
+    while (readrequest(input, &request)) {
+        ke::Vector<char*> args;
+        args.append(program);
+        char* directory = &request[0];
+        for (char* ptr = directory; (ptr = strchr(ptr, '\t')) != NULL;) {
+            *ptr++ = '\0';
+            args.append(ptr);
+        }
+        args.append(nullptr);
+
+        int retcode;
+        if (chdir(directory) != 0) {
+            printf("chdir failed: %s\n", strerror(errno));
+            retcode = 1;
+        } else {
+            retcode = pc_compile((int)args.length() - 1, &args[0]);
+        }
+        if (chdir(sStartDir) != 0) {
+            printf("cannot return to %s: %s\n", sStartDir, strerror(errno));
+            retcode = 1;
+        }
+        putchar('\0');
+        printf("%d\n", retcode);
+        fflush(stdout);
+    }
+}
+
+#if defined HAVE_UNIX_SOCKETS
+static int
+serve_socket(char* program, const char* path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "socket path is too long: %s\n", path);
+        return 1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        fprintf(stderr, "cannot create a socket: %s\n", strerror(errno));
+        return 1;
+    }
+    unlink(path);
+    if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 8) != 0) {
+        fprintf(stderr, "cannot listen on %s: %s\n", path, strerror(errno));
+        close(listener);
+        return 1;
+    }
+
+    /* a client that goes away must not take the server with it */
+    signal(SIGPIPE, SIG_IGN);
+
+    int console = dup(fileno(stdout));
+    for (;;) {
+        int conn = accept(listener, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "accept failed: %s\n", strerror(errno));
+            break;
+        }
+        FILE* input = fdopen(conn, "r");
+        if (input == NULL) {
+            close(conn);
+            continue;
+        }
+        fflush(stdout);
+        fflush(stderr);
+        dup2(conn, fileno(stdout));
+        dup2(conn, fileno(stderr));
+        serve(program, input);
+        fflush(stdout);
+        fflush(stderr);
+        dup2(console, fileno(stdout));
+        dup2(console, fileno(stderr));
+        fclose(input);
+    }
+    close(console);
+    close(listener);
+    unlink(path);
+    return 1;
+}
+#endif
+
+int
+pc_compile_server(char* program, const char* socket_path)
+{
+    if (getcwd(sStartDir, sizeof(sStartDir)) == NULL) {
+        fprintf(stderr, "cannot get the current directory: %s\n", strerror(errno));
+        return 1;
+    }
+
+    sc_keepincludes = true;
+
+    if (socket_path != NULL) {
+#if defined HAVE_UNIX_SOCKETS
+        return serve_socket(program, socket_path);
+#else
+        fprintf(stderr, "--server=<path> is not supported on this platform\n");
+        return 1;
+#endif
+    }
+
+    /* the option errors that go to stderr are part of the answer too */
+    fflush(stderr);
+    dup2(fileno(stdout), fileno(stderr));
+
+    serve(program, stdin);
+    return 0;
+}
@@ -0,0 +1,305 @@
+// vim: set ts=8 sts=4 sw=4 tw=99 et:
+//
+//  Copyright (C) 2006-2018 AlliedModders LLC
+//
+//  This file is part of SourcePawn. SourcePawn is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  SourcePawn. If not, see http://www.gnu.org/licenses/.
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+
+#include <amtl/am-vector.h>
+
+#if defined __linux__ || defined __FreeBSD__ || defined __OpenBSD__ || defined DARWIN
+#    include <sys/resource.h>
+#    include <sys/time.h>
+#endif
+
+#include "compile-timings.h"
+#include "libpawnc.h"
+#include "pool-allocator.h"
+#include "sc.h"
+#include "sclist.h"
+#include "scvars.h"
+
+/* With "--timings", the compiler reports the wall time spent in each phase of
+ * the compilation, and how much the pool allocator grew while it ran. The clock
+ * and the pool's usage are sampled whenever the innermost phase changes, and
+ * the difference is charged to the phase that ran.
+ *
+ * Other allocations are not hooked, so the report also shows the peak resident
+ * set size of the process. Reading it is a system call, and the preprocessor
+ * phase is entered for every line, so it is only read when an outermost phase
+ * starts or ends, and is reported for those phases only. In the compile server
+ * it is the peak of the server, not of one compilation.
+ *
+ * A fatal error skips the timings_leave() calls, so the report closes any
+ * phases that are still open.
+ *
+ * With "--timings-json=<file>", the same report is also written as JSON, so
+ * that it can be compared between builds.
+ */
+
+typedef std::chrono::steady_clock Clock;
+
+struct PhaseRecord {
+    CompilePhase phase;
+    int pass;              /* for parse passes, 0 for the pass that writes */
+    double seconds;
+    size_t pool_growth;    /* bytes the pool allocator grew by while the phase ran */
+    long peak_rss;         /* in KB, at the end of the phase; -1 if it only ran nested */
+    long rss_growth;       /* in KB, how much the peak grew during the phase */
+};
+
+CompileCounters gCompileCounters;
+
+static ke::Vector<PhaseRecord> sPhases; /* in the order they first ran */
+static ke::Vector<size_t> sActivePhases; /* indices in sPhases, innermost last */
+static Clock::time_point sStartTime;
+static Clock::time_point sLastSample;
+static size_t sLastPoolAllocated;
+static long sLastRss;
+
+static const char*
+phase_name(CompilePhase phase)
+{
+    switch (phase) {
+        case CompilePhase::Preprocess:
+            return "preprocess";
+        case CompilePhase::Parse:
+            return "parse";
+        case CompilePhase::Semantics:
+            return "semantics";
+        case CompilePhase::Optimize:
+            return "optimize";
+        case CompilePhase::Assemble:
+            return "assemble";
+        case CompilePhase::Rtti:
+            return "rtti";
+        case CompilePhase::Compress:
+            return "compress";
+    }
+    return "unknown";
+}
+
+static void
+format_phase(char* buffer, size_t maxlength, const PhaseRecord& record)
+{
+    if (record.phase != CompilePhase::Parse)
+        snprintf(buffer, maxlength, "%s", phase_name(record.phase));
+    else if (record.pass > 0)
+        snprintf(buffer, maxlength, "parse (pass %d)", record.pass);
+    else
+        snprintf(buffer, maxlength, "parse (write)");
+}
+
+/* The peak resident set size of the process, in KB, or 0 if it is unknown */
+static long
+peak_rss(void)
+{
+#if defined __linux__ || defined __FreeBSD__ || defined __OpenBSD__ || defined DARWIN
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#    if defined DARWIN
+    return (long)(usage.ru_maxrss / 1024); /* in bytes on macOS */
+#    else
+    return (long)usage.ru_maxrss;
+#    endif
+#else
+    return 0;
+#endif
+}
+
+/* The bytes handed out by the pool allocator */
+static size_t
+pool_allocated(void)
+{
+    size_t allocated, reserved, bookkeeping;
+    gPoolAllocator.memoryUsage(&allocated, &reserved, &bookkeeping);
+    return allocated;
+}
+
+/* Charges the time and pool growth since the last sample to the innermost
+ * phase. If "outer" is set, an outermost phase is starting or ending, and the
+ * peak RSS is read too and charged to that phase.
+ */
+static void
+sample(bool outer)
+{
+    Clock::time_point now = Clock::now();
+    size_t allocated = pool_allocated();
+    if (!sActivePhases.empty()) {
+        PhaseRecord& record = sPhases[sActivePhases.back()];
+        record.seconds += std::chrono::duration<double>(now - sLastSample).count();
+        if (allocated > sLastPoolAllocated)
+            record.pool_growth += allocated - sLastPoolAllocated;
+    }
+    sLastSample = now;
+    sLastPoolAllocated = allocated;
+
+    if (!outer)
+        return;
+
+    long rss = peak_rss();
+    if (!sActivePhases.empty()) {
+        PhaseRecord& record = sPhases[sActivePhases[0]];
+        if (rss > sLastRss)
+            record.rss_growth += rss - sLastRss;
+        if (rss > record.peak_rss)
+            record.peak_rss = rss;
+    }
+    sLastRss = rss;
+}
+
+void
+timings_reset(void)
+{
+    memset(&gCompileCounters, 0, sizeof(gCompileCounters));
+    sPhases.clear();
+    sActivePhases.clear();
+    sStartTime = Clock::now();
+    sLastSample = sStartTime;
+    sLastPoolAllocated = pool_allocated();
+    sLastRss = peak_rss();
+}
+
+void
+timings_enter(CompilePhase phase, int pass)
+{
+    if (!sc_timings)
+        return;
+
+    sample(sActivePhases.empty());
+
+    size_t index;
+    for (index = 0; index < sPhases.length(); index++) {
+        if (sPhases[index].phase == phase && sPhases[index].pass == pass)
+            break;
+    }
+    if (index == sPhases.length()) {
+        PhaseRecord record;
+        record.phase = phase;
+        record.pass = pass;
+        record.seconds = 0;
+        record.pool_growth = 0;
+        record.peak_rss = -1;
+        record.rss_growth = 0;
+        sPhases.append(record);
+    }
+    sActivePhases.append(index);
+}
+
+void
+timings_leave(void)
+{
+    if (!sc_timings)
+        return;
+
+    assert(!sActivePhases.empty());
+    sample(sActivePhases.length() == 1);
+    sActivePhases.pop();
+}
+
+static void
+write_json_string(FILE* fp, const char* str)
+{
+    fputc('"', fp);
+    for (; *str != '\0'; str++) {
+        if (*str == '"' || *str == '\\')
+            fprintf(fp, "\\%c", *str);
+        else if ((unsigned char)*str < ' ')
+            fprintf(fp, "\\u%04x", (unsigned char)*str);
+        else
+            fputc(*str, fp);
+    }
+    fputc('"', fp);
+}
+
+static void
+write_json(const char* filename, const char* source, double total, long rss, size_t allocated,
+           size_t reserved)
+{
+    FILE* fp = fopen(filename, "wt");
+    if (fp == NULL) {
+        pc_printf("Unable to write the timings to %s\n", filename);
+        return;
+    }
+
+    fprintf(fp, "{\n  \"source\": ");
+    write_json_string(fp, source);
+    fprintf(fp, ",\n  \"phases\": [\n");
+    for (size_t i = 0; i < sPhases.length(); i++) {
+        const PhaseRecord& record = sPhases[i];
+        char name[64];
+        format_phase(name, sizeof(name), record);
+        fprintf(fp, "    {\"name\": ");
+        write_json_string(fp, name);
+        fprintf(fp, ", \"seconds\": %.6f, \"pool_growth_bytes\": %" PRIu64, record.seconds,
+                (uint64_t)record.pool_growth);
+        if (record.peak_rss >= 0) {
+            fprintf(fp, ", \"peak_rss_kb\": %ld, \"rss_growth_kb\": %ld", record.peak_rss,
+                    record.rss_growth);
+        }
+        fprintf(fp, "}%s\n", (i + 1 < sPhases.length()) ? "," : "");
+    }
+    fprintf(fp, "  ],\n");
+    fprintf(fp, "  \"total_seconds\": %.6f,\n", total);
+    fprintf(fp, "  \"peak_rss_kb\": %ld,\n", rss);
+    fprintf(fp, "  \"counters\": {\n");
+    fprintf(fp, "    \"tokens\": %" PRIu64 ",\n", gCompileCounters.tokens);
+    fprintf(fp, "    \"symbols\": %" PRIu64 ",\n", gCompileCounters.symbols);
+    fprintf(fp, "    \"peephole_matches\": %" PRIu64 ",\n", gCompileCounters.peephole_matches);
+    fprintf(fp, "    \"pool_allocated_bytes\": %" PRIu64 ",\n", (uint64_t)allocated);
+    fprintf(fp, "    \"pool_reserved_bytes\": %" PRIu64 "\n", (uint64_t)reserved);
+    fprintf(fp, "  }\n}\n");
+    fclose(fp);
+}
+
+/* Prints the report and, if "filename" is not empty, writes it as JSON */
+void
+timings_report(const char* filename)
+{
+    if (!sc_timings)
+        return;
+
+    sample(true);
+    sActivePhases.clear();
+
+    double total = std::chrono::duration<double>(sLastSample - sStartTime).count();
+    long rss = sLastRss;
+    size_t allocated, reserved, bookkeeping;
+    gPoolAllocator.memoryUsage(&allocated, &reserved, &bookkeeping);
+
+    const char* source = get_sourcefile(0) != NULL ? get_sourcefile(0) : "";
+    pc_printf("\nTimings for %s:\n", source);
+    pc_printf("  %-20s %12s %14s %14s %14s\n", "Phase", "Time (ms)", "Pool (bytes)",
+              "Peak RSS (KB)", "Growth (KB)");
+    for (const auto& record : sPhases) {
+        char name[64];
+        format_phase(name, sizeof(name), record);
+        pc_printf("  %-20s %12.3f %14" PRIu64, name, record.seconds * 1000.0,
+                  (uint64_t)record.pool_growth);
+        if (record.peak_rss >= 0)
+            pc_printf(" %14ld %14ld\n", record.peak_rss, record.rss_growth);
+        else
+            pc_printf(" %14s %14s\n", "-", "-");
+    }
+    pc_printf("  %-20s %12.3f %14s %14ld\n", "total", total * 1000.0, "", rss);
+    pc_printf("  Tokens lexed:       %12" PRIu64 "\n", gCompileCounters.tokens);
+    pc_printf("  Symbols created:    %12" PRIu64 "\n", gCompileCounters.symbols);
+    pc_printf("  Peephole matches:   %12" PRIu64 "\n", gCompileCounters.peephole_matches);
+    pc_printf("  Pool allocated:     %12" PRIu64 " bytes\n", (uint64_t)allocated);
+    pc_printf("  Pool reserved:      %12" PRIu64 " bytes\n", (uint64_t)reserved);
+
+    if (filename != NULL && filename[0] != '\0')
+        write_json(filename, source, total, rss, allocated, reserved);
+}
@@ -0,0 +1,44 @@
+// vim: set ts=8 sts=4 sw=4 tw=99 et:
+//
+//  Copyright (C) 2006-2018 AlliedModders LLC
+//
+//  This file is part of SourcePawn. SourcePawn is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  You should have received a copy of the GNU General Public License along with
+//  SourcePawn. If not, see http://www.gnu.org/licenses/.
+#pragma once
+
+#include <stdint.h>
+
+/*  The phases of a compilation that "--timings" reports on. Phases nest, and
+ *  time is charged to the innermost one only: reading and preprocessing a line
+ *  that the parser asks for counts for Preprocess, not for the parse pass.
+ */
+enum class CompilePhase {
+    Preprocess, /* reading lines, stripping comments, directives, macros */
+    Parse,      /* one pass of the parser, including code generation */
+    Semantics,  /* binding and analysis of expressions */
+    Optimize,   /* the staging buffer and the peephole optimizer */
+    Assemble,   /* building the SMX sections from the generated code */
+    Rtti,       /* RttiBuilder: type and debug information */
+    Compress,   /* zlib compression of the image */
+};
+
+/*  Counts kept during every compilation; they are cheap enough to keep when
+ *  no report is asked for.
+ */
+struct CompileCounters {
+    uint64_t tokens;           /* tokens read by lex(), not counting pushed back ones */
+    uint64_t symbols;          /* symbols created by addsym() */
+    uint64_t peephole_matches; /* sequences replaced by the peephole optimizer */
+};
+
+extern CompileCounters gCompileCounters;
+
+void timings_reset(void);
+void timings_enter(CompilePhase phase, int pass = 0);
+void timings_leave(void);
+void timings_report(const char* filename);
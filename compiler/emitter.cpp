@@ -22,7 +22,6 @@
  *  Version: $Id$
  */
 #include <assert.h>
-#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h> /* for _MAX_PATH */
 #include <string.h>
@@ -54,8 +53,9 @@ writeleader(symbol* root)
     assert(code_idx == 0);
 
     begcseg();
-    stgwrite(";program exit point\n");
-    stgwrite("\thalt 0\n\n");
+    stgwrite(AsmInsn(AsmOp::COMMENT, asm_name_ref("program exit point")));
+    stgwrite(AsmInsn(AsmOp::HALT, 0));
+    stgwrite(AsmInsn(AsmOp::BLANK));
     code_idx += opcodes(1) + opargs(1); /* calculate code length */
 }
 
@@ -85,16 +85,24 @@ writetrailer(void)
     assert(litidx == 0 || !cc_ok()); /* literal queue should have been emptied */
     assert(sc_dataalign % sizeof(cell) == 0);
     if (((glb_declared * sizeof(cell)) % sc_dataalign) != 0) {
+        cell zeros[AsmInsn::kMaxArgs] = {0};
+        int count = 0;
         begdseg();
-        defstorage();
         while (((glb_declared * sizeof(cell)) % sc_dataalign) != 0) {
-            stgwrite("0 ");
+            if (count == AsmInsn::kMaxArgs) {
+                defstorage(zeros, count);
+                count = 0;
+            }
+            count++;
             glb_declared++;
         }
+        defstorage(zeros, count);
+    } else {
+        stgwrite(AsmInsn(AsmOp::BLANK));
     }
 
-    stgwrite("\nSTKSIZE "); /* write stack size (align stack top) */
-    outval(pc_stksize - (pc_stksize % sc_dataalign), TRUE);
+    /* write stack size (align stack top) */
+    stgwrite(AsmInsn(AsmOp::STKSIZE, pc_stksize - (pc_stksize % sc_dataalign)));
 }
 
 /*
@@ -112,11 +120,9 @@ void
 begcseg(void)
 {
     if (sc_status != statSKIP && (curseg != sIN_CSEG || fcurrent != fcurseg)) {
-        stgwrite("\n");
-        stgwrite("CODE ");
-        outval(fcurrent, FALSE);
-        stgwrite("\t; ");
-        outval(code_idx, TRUE);
+        AsmInsn insn(AsmOp::CODE, fcurrent);
+        insn.setNote(code_idx);
+        stgwrite(insn);
         curseg = sIN_CSEG;
         fcurseg = fcurrent;
     } /* endif */
@@ -131,11 +137,9 @@ void
 begdseg(void)
 {
     if (sc_status != statSKIP && (curseg != sIN_DSEG || fcurrent != fcurseg)) {
-        stgwrite("\n");
-        stgwrite("DATA ");
-        outval(fcurrent, FALSE);
-        stgwrite("\t; ");
-        outval((glb_declared - litidx) * sizeof(cell), TRUE);
+        AsmInsn insn(AsmOp::DATA, fcurrent);
+        insn.setNote((glb_declared - litidx) * sizeof(cell));
+        stgwrite(insn);
         curseg = sIN_DSEG;
         fcurseg = fcurrent;
     }
@@ -144,17 +148,16 @@ begdseg(void)
 void
 setline(int chkbounds)
 {
-    if (sc_asmfile) {
-        stgwrite("\t; line ");
-        outval(fline, TRUE);
-    }
+    if (sc_asmfile)
+        stgwrite(AsmInsn(AsmOp::LINE, fline));
     if ((sc_debug & sSYMBOLIC) != 0 || (chkbounds && (sc_debug & sCHKBOUNDS) != 0)) {
         /* generate a "break" (start statement) opcode rather than a "line" opcode
          * because earlier versions of Small/Pawn have an incompatible version of the
          * line opcode
          */
-        stgwrite("\tbreak\t; ");
-        outval(code_idx, TRUE);
+        AsmInsn insn(AsmOp::BREAK);
+        insn.setNote(code_idx);
+        stgwrite(insn);
         code_idx += opcodes(1);
     }
 }
@@ -188,18 +191,15 @@ void
 setlabel(int number)
 {
     assert(number >= 0);
-    stgwrite("l.");
-    stgwrite((char*)itoh(number));
+    AsmInsn insn(AsmOp::LABEL, number);
     /* To assist verification of the assembled code, put the address of the
      * label as a comment. However, labels that occur inside an expression
      * may move (through optimization or through re-ordering). So write the
      * address only if it is known to accurate.
      */
-    if (!staging) {
-        stgwrite("\t\t; ");
-        outval(code_idx, FALSE);
-    }
-    stgwrite("\n");
+    if (!staging)
+        insn.setNote(code_idx);
+    stgwrite(insn);
 }
 
 /* Write a token that signifies the start or end of an expression or special
@@ -211,17 +211,14 @@ markexpr(optmark type, const char* name, cell offset)
 {
     switch (type) {
         case sEXPR:
-            stgwrite("\t;$exp\n");
+            stgwrite(AsmInsn(AsmOp::EXPR_END));
             break;
         case sPARM:
-            stgwrite("\t;$par\n");
+            stgwrite(AsmInsn(AsmOp::PARM_END));
             break;
         case sLDECL:
             assert(name != NULL);
-            stgwrite("\t;$lcl ");
-            stgwrite(name);
-            stgwrite(" ");
-            outval(offset, TRUE);
+            stgwrite(AsmInsn(AsmOp::LOCAL_DECL, asm_name_ref(name), offset));
             break;
         default:
             assert(0);
@@ -235,14 +232,13 @@ markexpr(optmark type, const char* name, cell offset)
 void
 startfunc(const char* fname)
 {
-    stgwrite("\tproc");
+    AsmInsn insn(AsmOp::PROC);
     if (sc_asmfile) {
         char symname[2 * sNAMEMAX + 16];
         funcdisplayname(symname, fname);
-        stgwrite("\t; ");
-        stgwrite(symname);
+        insn.setNote(asm_name_ref(symname));
     }
-    stgwrite("\n");
+    stgwrite(insn);
     code_idx += opcodes(1);
 }
 
@@ -253,7 +249,7 @@ startfunc(const char* fname)
 void
 endfunc(void)
 {
-    stgwrite("\n"); /* skip a line */
+    stgwrite(AsmInsn(AsmOp::BLANK)); /* skip a line */
 }
 
 /*  rvalue
@@ -271,15 +267,13 @@ rvalue(value* lval)
         load_i();
     } else if (lval->ident == iARRAYCHAR) {
         /* indirect fetch of a character from a pack, address already in PRI */
-        stgwrite("\tlodb.i ");
-        outval(sCHARBITS / 8, TRUE); /* read one or two bytes */
+        stgwrite(AsmInsn(AsmOp::LODB_I, sCHARBITS / 8)); /* read one or two bytes */
         code_idx += opcodes(1) + opargs(1);
     } else if (lval->ident == iREFERENCE) {
         /* indirect fetch, but address not yet in PRI */
         assert(sym != NULL);
         assert(sym->vclass == sLOCAL); /* global references don't exist in Pawn */
-        stgwrite("\tlref.s.pri ");
-        outval(sym->addr(), TRUE);
+        stgwrite(AsmInsn(AsmOp::LREF_S_PRI, sym->addr()));
         markusage(sym, uREAD);
         code_idx += opcodes(1) + opargs(1);
     } else if (lval->ident == iACCESSOR) {
@@ -289,11 +283,8 @@ rvalue(value* lval)
     } else {
         /* direct or stack relative fetch */
         assert(sym != NULL);
-        if (sym->vclass == sLOCAL)
-            stgwrite("\tload.s.pri ");
-        else
-            stgwrite("\tload.pri ");
-        outval(sym->addr(), TRUE);
+        AsmOp op = (sym->vclass == sLOCAL) ? AsmOp::LOAD_S_PRI : AsmOp::LOAD_PRI;
+        stgwrite(AsmInsn(op, sym->addr()));
         markusage(sym, uREAD);
         code_idx += opcodes(1) + opargs(1);
     }
@@ -329,35 +320,18 @@ address(symbol* sym, regid reg)
     /* the symbol can be a local array, a global array, or an array
      * that is passed by reference.
      */
+    AsmOp op;
     if (sym->ident == iREFARRAY || sym->ident == iREFERENCE) {
         /* reference to a variable or to an array; currently this is
          * always a local variable */
-        switch (reg) {
-            case sPRI:
-                stgwrite("\tload.s.pri ");
-                break;
-            case sALT:
-                stgwrite("\tload.s.alt ");
-                break;
-        }
-    } else {
+        op = (reg == sPRI) ? AsmOp::LOAD_S_PRI : AsmOp::LOAD_S_ALT;
+    } else if (sym->vclass == sLOCAL) {
         /* a local array or local variable */
-        switch (reg) {
-            case sPRI:
-                if (sym->vclass == sLOCAL)
-                    stgwrite("\taddr.pri ");
-                else
-                    stgwrite("\tconst.pri ");
-                break;
-            case sALT:
-                if (sym->vclass == sLOCAL)
-                    stgwrite("\taddr.alt ");
-                else
-                    stgwrite("\tconst.alt ");
-                break;
-        }
+        op = (reg == sPRI) ? AsmOp::ADDR_PRI : AsmOp::ADDR_ALT;
+    } else {
+        op = (reg == sPRI) ? AsmOp::CONST_PRI : AsmOp::CONST_ALT;
     }
-    outval(sym->addr(), TRUE);
+    stgwrite(AsmInsn(op, sym->addr()));
     markusage(sym, uREAD);
     code_idx += opcodes(1) + opargs(1);
 }
@@ -365,11 +339,8 @@ address(symbol* sym, regid reg)
 static void
 addr_reg(int val, regid reg)
 {
-    if (reg == sPRI)
-        stgwrite("\taddr.pri ");
-    else
-        stgwrite("\taddr.alt ");
-    outval(val, TRUE);
+    AsmOp op = (reg == sPRI) ? AsmOp::ADDR_PRI : AsmOp::ADDR_ALT;
+    stgwrite(AsmInsn(op, val));
     code_idx += opcodes(1) + opargs(1);
 }
 
@@ -381,11 +352,8 @@ addr_reg(int val, regid reg)
 static void
 load_argcount(regid reg)
 {
-    if (reg == sPRI)
-        stgwrite("\tload.s.pri ");
-    else
-        stgwrite("\tload.s.alt ");
-    outval(2 * sizeof(cell), TRUE);
+    AsmOp op = (reg == sPRI) ? AsmOp::LOAD_S_PRI : AsmOp::LOAD_S_ALT;
+    stgwrite(AsmInsn(op, 2 * sizeof(cell)));
     code_idx += opcodes(1) + opargs(1);
 }
 
@@ -393,14 +361,14 @@ load_argcount(regid reg)
 void
 idxaddr()
 {
-    stgwrite("\tidxaddr\n");
+    stgwrite(AsmInsn(AsmOp::IDXADDR));
     code_idx += opcodes(1);
 }
 
 void
 load_i()
 {
-    stgwrite("\tload.i\n");
+    stgwrite(AsmInsn(AsmOp::LOAD_I));
     code_idx += opcodes(1);
 }
 
@@ -439,29 +407,24 @@ store(const value* lval)
     sym = lval->sym;
     if (lval->ident == iARRAYCELL) {
         /* store at address in ALT */
-        stgwrite("\tstor.i\n");
+        stgwrite(AsmInsn(AsmOp::STOR_I));
         code_idx += opcodes(1);
     } else if (lval->ident == iARRAYCHAR) {
         /* store at address in ALT */
-        stgwrite("\tstrb.i ");
-        outval(sCHARBITS / 8, TRUE); /* write one or two bytes */
+        stgwrite(AsmInsn(AsmOp::STRB_I, sCHARBITS / 8)); /* write one or two bytes */
         code_idx += opcodes(1) + opargs(1);
     } else if (lval->ident == iREFERENCE) {
         assert(sym != NULL);
         assert(sym->vclass == sLOCAL);
-        stgwrite("\tsref.s.pri ");
-        outval(sym->addr(), TRUE);
+        stgwrite(AsmInsn(AsmOp::SREF_S_PRI, sym->addr()));
         code_idx += opcodes(1) + opargs(1);
     } else if (lval->ident == iACCESSOR) {
         invoke_setter(lval->accessor, TRUE);
     } else {
         assert(sym != NULL);
         markusage(sym, uWRITTEN);
-        if (sym->vclass == sLOCAL)
-            stgwrite("\tstor.s.pri ");
-        else
-            stgwrite("\tstor.pri ");
-        outval(sym->addr(), TRUE);
+        AsmOp op = (sym->vclass == sLOCAL) ? AsmOp::STOR_S_PRI : AsmOp::STOR_PRI;
+        stgwrite(AsmInsn(op, sym->addr()));
         code_idx += opcodes(1) + opargs(1);
     }
 }
@@ -471,11 +434,8 @@ void
 loadreg(cell address, regid reg)
 {
     assert(reg == sPRI || reg == sALT);
-    if (reg == sPRI)
-        stgwrite("\tload.pri ");
-    else
-        stgwrite("\tload.alt ");
-    outval(address, TRUE);
+    AsmOp op = (reg == sPRI) ? AsmOp::LOAD_PRI : AsmOp::LOAD_ALT;
+    stgwrite(AsmInsn(op, address));
     code_idx += opcodes(1) + opargs(1);
 }
 
@@ -484,11 +444,8 @@ void
 storereg(cell address, regid reg)
 {
     assert(reg == sPRI || reg == sALT);
-    if (reg == sPRI)
-        stgwrite("\tstor.pri ");
-    else
-        stgwrite("\tstor.alt ");
-    outval(address, TRUE);
+    AsmOp op = (reg == sPRI) ? AsmOp::STOR_PRI : AsmOp::STOR_ALT;
+    stgwrite(AsmInsn(op, address));
     code_idx += opcodes(1) + opargs(1);
 }
 
@@ -498,8 +455,7 @@ storereg(cell address, regid reg)
 void
 memcopy(cell size)
 {
-    stgwrite("\tmovs ");
-    outval(size, TRUE);
+    stgwrite(AsmInsn(AsmOp::MOVS, size));
 
     code_idx += opcodes(1) + opargs(1);
 }
@@ -514,18 +470,16 @@ copyarray(symbol* sym, cell size)
     /* the symbol can be a local array, a global array, or an array
      * that is passed by reference.
      */
+    AsmOp op;
     if (sym->ident == iREFARRAY) {
         /* reference to an array; currently this is always a local variable */
         assert(sym->vclass == sLOCAL); /* symbol must be stack relative */
-        stgwrite("\tload.s.alt ");
+        op = AsmOp::LOAD_S_ALT;
     } else {
         /* a local or global array */
-        if (sym->vclass == sLOCAL)
-            stgwrite("\taddr.alt ");
-        else
-            stgwrite("\tconst.alt ");
+        op = (sym->vclass == sLOCAL) ? AsmOp::ADDR_ALT : AsmOp::CONST_ALT;
     }
-    outval(sym->addr(), TRUE);
+    stgwrite(AsmInsn(op, sym->addr()));
     markusage(sym, uWRITTEN);
 
     code_idx += opcodes(1) + opargs(1);
@@ -541,23 +495,20 @@ fillarray(symbol* sym, cell size, cell value)
     /* the symbol can be a local array, a global array, or an array
      * that is passed by reference.
      */
+    AsmOp op;
     if (sym->ident == iREFARRAY) {
         /* reference to an array; currently this is always a local variable */
         assert(sym->vclass == sLOCAL); /* symbol must be stack relative */
-        stgwrite("\tload.s.alt ");
+        op = AsmOp::LOAD_S_ALT;
     } else {
         /* a local or global array */
-        if (sym->vclass == sLOCAL)
-            stgwrite("\taddr.alt ");
-        else
-            stgwrite("\tconst.alt ");
+        op = (sym->vclass == sLOCAL) ? AsmOp::ADDR_ALT : AsmOp::CONST_ALT;
     }
-    outval(sym->addr(), TRUE);
+    stgwrite(AsmInsn(op, sym->addr()));
     markusage(sym, uWRITTEN);
 
     assert(size > 0);
-    stgwrite("\tfill ");
-    outval(size, TRUE);
+    stgwrite(AsmInsn(AsmOp::FILL, size));
 
     code_idx += opcodes(2) + opargs(2);
 }
@@ -566,7 +517,7 @@ void
 stradjust(regid reg)
 {
     assert(reg == sPRI);
-    stgwrite("\tstradjust.pri\n");
+    stgwrite(AsmInsn(AsmOp::STRADJUST_PRI));
     code_idx += opcodes(1);
 }
 
@@ -580,21 +531,19 @@ ldconst(cell val, regid reg)
     switch (reg) {
         case sPRI:
             if (val == 0) {
-                stgwrite("\tzero.pri\n");
+                stgwrite(AsmInsn(AsmOp::ZERO_PRI));
                 code_idx += opcodes(1);
             } else {
-                stgwrite("\tconst.pri ");
-                outval(val, TRUE);
+                stgwrite(AsmInsn(AsmOp::CONST_PRI, val));
                 code_idx += opcodes(1) + opargs(1);
             }
             break;
         case sALT:
             if (val == 0) {
-                stgwrite("\tzero.alt\n");
+                stgwrite(AsmInsn(AsmOp::ZERO_ALT));
                 code_idx += opcodes(1);
             } else {
-                stgwrite("\tconst.alt ");
-                outval(val, TRUE);
+                stgwrite(AsmInsn(AsmOp::CONST_ALT, val));
                 code_idx += opcodes(1) + opargs(1);
             }
             break;
@@ -605,14 +554,14 @@ ldconst(cell val, regid reg)
 void
 moveto1(void)
 {
-    stgwrite("\tmove.pri\n");
+    stgwrite(AsmInsn(AsmOp::MOVE_PRI));
     code_idx += opcodes(1) + opargs(0);
 }
 
 void
 move_alt(void)
 {
-    stgwrite("\tmove.alt\n");
+    stgwrite(AsmInsn(AsmOp::MOVE_ALT));
     code_idx += opcodes(1) + opargs(0);
 }
 
@@ -624,10 +573,10 @@ pushreg(regid reg)
     assert(reg == sPRI || reg == sALT);
     switch (reg) {
         case sPRI:
-            stgwrite("\tpush.pri\n");
+            stgwrite(AsmInsn(AsmOp::PUSH_PRI));
             break;
         case sALT:
-            stgwrite("\tpush.alt\n");
+            stgwrite(AsmInsn(AsmOp::PUSH_ALT));
             break;
     }
     code_idx += opcodes(1);
@@ -639,8 +588,7 @@ pushreg(regid reg)
 void
 pushval(cell val)
 {
-    stgwrite("\tpush.c ");
-    outval(val, TRUE);
+    stgwrite(AsmInsn(AsmOp::PUSH_C, val));
     code_idx += opcodes(1) + opargs(1);
 }
 
@@ -652,10 +600,10 @@ popreg(regid reg)
     assert(reg == sPRI || reg == sALT);
     switch (reg) {
         case sPRI:
-            stgwrite("\tpop.pri\n");
+            stgwrite(AsmInsn(AsmOp::POP_PRI));
             break;
         case sALT:
-            stgwrite("\tpop.alt\n");
+            stgwrite(AsmInsn(AsmOp::POP_ALT));
             break;
     }
     code_idx += opcodes(1);
@@ -671,12 +619,8 @@ popreg(regid reg)
 void
 genarray(int dims, int _autozero)
 {
-    if (_autozero) {
-        stgwrite("\tgenarray.z ");
-    } else {
-        stgwrite("\tgenarray ");
-    }
-    outval(dims, TRUE);
+    AsmOp op = _autozero ? AsmOp::GENARRAY_Z : AsmOp::GENARRAY;
+    stgwrite(AsmInsn(op, dims));
     code_idx += opcodes(1) + opargs(1);
 }
 
@@ -686,7 +630,7 @@ genarray(int dims, int _autozero)
 void
 swap1(void)
 {
-    stgwrite("\tswap.pri\n");
+    stgwrite(AsmInsn(AsmOp::SWAP_PRI));
     code_idx += opcodes(1);
 }
 
@@ -702,23 +646,18 @@ swap1(void)
 void
 ffswitch(int label)
 {
-    stgwrite("\tswitch ");
-    outval(label, TRUE); /* the label is the address of the case table */
+    stgwrite(AsmInsn(AsmOp::SWITCH, label)); /* the label is the address of the case table */
     code_idx += opcodes(1) + opargs(1);
 }
 
 void
-ffcase(cell value, char* labelname, int newtable)
+ffcase(cell value, int label, int newtable)
 {
     if (newtable) {
-        stgwrite("\tcasetbl\n");
+        stgwrite(AsmInsn(AsmOp::CASETBL));
         code_idx += opcodes(1);
     }
-    stgwrite("\tcase ");
-    outval(value, FALSE);
-    stgwrite(" ");
-    stgwrite(labelname);
-    stgwrite("\n");
+    stgwrite(AsmInsn(AsmOp::CASE, value, label));
     code_idx += opcodes(0) + opargs(2);
 }
 
@@ -728,17 +667,11 @@ ffcase(cell value, char* labelname, int newtable)
 void
 ffcall(symbol* sym, int numargs)
 {
-    char symname[2 * sNAMEMAX + 16];
     char aliasname[sNAMEMAX + 1];
 
     assert(sym != NULL);
     assert(sym->ident == iFUNCTN);
-    if (sc_asmfile)
-        funcdisplayname(symname, sym->name());
     if (sym->native) {
-        /* reserve a SYSREQ id if called for the first time */
-        stgwrite("\tsysreq.n ");
-
         /* Look for an alias */
         symbol* target = sym;
         if (lookup_alias(aliasname, sym->name())) {
@@ -746,24 +679,13 @@ ffcall(symbol* sym, int numargs)
             if (asym && asym->ident == iFUNCTN && sym->native)
                 target = asym;
         }
-        stgwrite(target->name());
-        stgwrite(" ");
-        outval(numargs, FALSE);
-        stgwrite("\n");
+        /* the assembler reserves a SYSREQ id when it is called for the first time */
+        stgwrite(AsmInsn(AsmOp::SYSREQ_N, asm_symbol_ref(target), numargs));
         code_idx += opcodes(1) + opargs(2);
     } else {
-        const char* symname = sym->name();
         pushval(numargs);
         /* normal function */
-        stgwrite("\tcall ");
-        stgwrite(symname);
-        if (sc_asmfile &&
-            ((!isalpha(symname[0]) && symname[0] != '_' && symname[0] != sc_ctrlchar)))
-        {
-            stgwrite("\t; ");
-            stgwrite(symname);
-        }
-        stgwrite("\n");
+        stgwrite(AsmInsn(AsmOp::CALL, asm_symbol_ref(sym)));
         code_idx += opcodes(1) + opargs(1);
     }
 }
@@ -775,23 +697,21 @@ ffcall(symbol* sym, int numargs)
 void
 ffret()
 {
-    stgwrite("\tretn\n");
+    stgwrite(AsmInsn(AsmOp::RETN));
     code_idx += opcodes(1);
 }
 
 void
 ffabort(int reason)
 {
-    stgwrite("\thalt ");
-    outval(reason, TRUE);
+    stgwrite(AsmInsn(AsmOp::HALT, reason));
     code_idx += opcodes(1) + opargs(1);
 }
 
 void
 ffbounds(cell size)
 {
-    stgwrite("\tbounds ");
-    outval(size, TRUE);
+    stgwrite(AsmInsn(AsmOp::BOUNDS, size));
     code_idx += opcodes(1) + opargs(1);
 }
 
@@ -800,8 +720,7 @@ ffbounds()
 {
     // Since the VM uses an unsigned compare here, this effectively protects us
     // from negative array indices.
-    stgwrite("\tbounds ");
-    outval(INT_MAX, TRUE);
+    stgwrite(AsmInsn(AsmOp::BOUNDS, INT_MAX));
     code_idx += opcodes(1) + opargs(1);
 }
 
@@ -811,8 +730,7 @@ ffbounds()
 void
 jumplabel(int number)
 {
-    stgwrite("\tjump ");
-    outval(number, TRUE);
+    stgwrite(AsmInsn(AsmOp::JUMP, number));
     code_idx += opcodes(1) + opargs(1);
 }
 
@@ -820,9 +738,13 @@ jumplabel(int number)
  *   Define storage (global and static variables)
  */
 void
-defstorage(void)
+defstorage(const cell* values, int count)
 {
-    stgwrite("dump ");
+    assert(count > 0 && count <= AsmInsn::kMaxArgs);
+    AsmInsn insn(AsmOp::DUMP);
+    for (int i = 0; i < count; i++)
+        insn.add(values[i]);
+    stgwrite(insn);
 }
 
 /*
@@ -833,8 +755,7 @@ void
 modstk(int delta)
 {
     if (delta) {
-        stgwrite("\tstack ");
-        outval(delta, TRUE);
+        stgwrite(AsmInsn(AsmOp::STACK, delta));
         code_idx += opcodes(1) + opargs(1);
     }
 }
@@ -843,8 +764,7 @@ void
 modheap(int delta)
 {
     if (delta) {
-        stgwrite("\theap ");
-        outval(delta, TRUE);
+        stgwrite(AsmInsn(AsmOp::HEAP, delta));
         code_idx += opcodes(1) + opargs(1);
     }
 }
@@ -852,7 +772,7 @@ modheap(int delta)
 void
 modheap_i()
 {
-    stgwrite("\ttracker.pop.setheap\n");
+    stgwrite(AsmInsn(AsmOp::TRACKER_POP_SETHEAP));
     code_idx += opcodes(1);
 }
 
@@ -860,18 +780,16 @@ void
 setheap_save(cell value)
 {
     assert(value);
-    stgwrite("\ttracker.push.c ");
-    outval(value, TRUE);
+    stgwrite(AsmInsn(AsmOp::TRACKER_PUSH_C, value));
     code_idx += opcodes(1) + opargs(1);
 }
 
 void
 setheap_pri(void)
 {
-    stgwrite("\theap "); /* ALT = HEA++ */
-    outval(sizeof(cell), TRUE);
-    stgwrite("\tstor.i\n");   /* store PRI (default value) at address ALT */
-    stgwrite("\tmove.pri\n"); /* move ALT to PRI: PRI contains the address */
+    stgwrite(AsmInsn(AsmOp::HEAP, sizeof(cell))); /* ALT = HEA++ */
+    stgwrite(AsmInsn(AsmOp::STOR_I));   /* store PRI (default value) at address ALT */
+    stgwrite(AsmInsn(AsmOp::MOVE_PRI)); /* move ALT to PRI: PRI contains the address */
     code_idx += opcodes(3) + opargs(1);
     markheap(MEMUSE_STATIC, 1);
 }
@@ -879,8 +797,7 @@ setheap_pri(void)
 void
 setheap(cell value)
 {
-    stgwrite("\tconst.pri "); /* load default value in PRI */
-    outval(value, TRUE);
+    stgwrite(AsmInsn(AsmOp::CONST_PRI, value)); /* load default value in PRI */
     code_idx += opcodes(1) + opargs(1);
     setheap_pri();
 }
@@ -892,7 +809,7 @@ setheap(cell value)
 void
 cell2addr(void)
 {
-    stgwrite("\tshl.c.pri 2\n");
+    stgwrite(AsmInsn(AsmOp::SHL_C_PRI, 2));
     code_idx += opcodes(1) + opargs(1);
 }
 
@@ -902,7 +819,7 @@ cell2addr(void)
 void
 cell2addr_alt(void)
 {
-    stgwrite("\tshl.c.alt 2\n");
+    stgwrite(AsmInsn(AsmOp::SHL_C_ALT, 2));
     code_idx += opcodes(1) + opargs(1);
 }
 
@@ -913,7 +830,7 @@ void
 char2addr(void)
 {
 #if sCHARBITS == 16
-    stgwrite("\tshl.c.pri 1\n");
+    stgwrite(AsmInsn(AsmOp::SHL_C_PRI, 1));
     code_idx += opcodes(1) + opargs(1);
 #endif
 }
@@ -925,8 +842,7 @@ void
 addconst(cell value)
 {
     if (value != 0) {
-        stgwrite("\tadd.c ");
-        outval(value, TRUE);
+        stgwrite(AsmInsn(AsmOp::ADD_C, value));
         code_idx += opcodes(1) + opargs(1);
     }
 }
@@ -937,7 +853,7 @@ addconst(cell value)
 void
 os_mult(void)
 {
-    stgwrite("\tsmul\n");
+    stgwrite(AsmInsn(AsmOp::SMUL));
     code_idx += opcodes(1);
 }
 
@@ -948,7 +864,7 @@ os_mult(void)
 void
 os_div(void)
 {
-    stgwrite("\tsdiv.alt\n");
+    stgwrite(AsmInsn(AsmOp::SDIV_ALT));
     code_idx += opcodes(1);
 }
 
@@ -958,8 +874,8 @@ os_div(void)
 void
 os_mod(void)
 {
-    stgwrite("\tsdiv.alt\n");
-    stgwrite("\tmove.pri\n"); /* move ALT to PRI */
+    stgwrite(AsmInsn(AsmOp::SDIV_ALT));
+    stgwrite(AsmInsn(AsmOp::MOVE_PRI)); /* move ALT to PRI */
     code_idx += opcodes(2);
 }
 
@@ -969,7 +885,7 @@ os_mod(void)
 void
 ob_add(void)
 {
-    stgwrite("\tadd\n");
+    stgwrite(AsmInsn(AsmOp::ADD));
     code_idx += opcodes(1);
 }
 
@@ -979,7 +895,7 @@ ob_add(void)
 void
 ob_sub(void)
 {
-    stgwrite("\tsub.alt\n");
+    stgwrite(AsmInsn(AsmOp::SUB_ALT));
     code_idx += opcodes(1);
 }
 
@@ -992,8 +908,8 @@ ob_sub(void)
 void
 ob_sal(void)
 {
-    stgwrite("\txchg\n");
-    stgwrite("\tshl\n");
+    stgwrite(AsmInsn(AsmOp::XCHG));
+    stgwrite(AsmInsn(AsmOp::SHL));
     code_idx += opcodes(2);
 }
 
@@ -1004,8 +920,8 @@ ob_sal(void)
 void
 os_sar(void)
 {
-    stgwrite("\txchg\n");
-    stgwrite("\tsshr\n");
+    stgwrite(AsmInsn(AsmOp::XCHG));
+    stgwrite(AsmInsn(AsmOp::SSHR));
     code_idx += opcodes(2);
 }
 
@@ -1016,8 +932,8 @@ os_sar(void)
 void
 ou_sar(void)
 {
-    stgwrite("\txchg\n");
-    stgwrite("\tshr\n");
+    stgwrite(AsmInsn(AsmOp::XCHG));
+    stgwrite(AsmInsn(AsmOp::SHR));
     code_idx += opcodes(2);
 }
 
@@ -1027,7 +943,7 @@ ou_sar(void)
 void
 ob_or(void)
 {
-    stgwrite("\tor\n");
+    stgwrite(AsmInsn(AsmOp::OR));
     code_idx += opcodes(1);
 }
 
@@ -1037,7 +953,7 @@ ob_or(void)
 void
 ob_xor(void)
 {
-    stgwrite("\txor\n");
+    stgwrite(AsmInsn(AsmOp::XOR));
     code_idx += opcodes(1);
 }
 
@@ -1047,7 +963,7 @@ ob_xor(void)
 void
 ob_and(void)
 {
-    stgwrite("\tand\n");
+    stgwrite(AsmInsn(AsmOp::AND));
     code_idx += opcodes(1);
 }
 
@@ -1057,7 +973,7 @@ ob_and(void)
 void
 ob_eq(void)
 {
-    stgwrite("\teq\n");
+    stgwrite(AsmInsn(AsmOp::EQ));
     code_idx += opcodes(1);
 }
 
@@ -1067,7 +983,7 @@ ob_eq(void)
 void
 ob_ne(void)
 {
-    stgwrite("\tneq\n");
+    stgwrite(AsmInsn(AsmOp::NEQ));
     code_idx += opcodes(1);
 }
 
@@ -1094,17 +1010,17 @@ ob_ne(void)
 void
 relop_prefix(void)
 {
-    stgwrite("\tpush.pri\n");
-    stgwrite("\tmove.pri\n");
+    stgwrite(AsmInsn(AsmOp::PUSH_PRI));
+    stgwrite(AsmInsn(AsmOp::MOVE_PRI));
     code_idx += opcodes(2);
 }
 
 void
 relop_suffix(void)
 {
-    stgwrite("\tswap.alt\n");
-    stgwrite("\tand\n");
-    stgwrite("\tpop.alt\n");
+    stgwrite(AsmInsn(AsmOp::SWAP_ALT));
+    stgwrite(AsmInsn(AsmOp::AND));
+    stgwrite(AsmInsn(AsmOp::POP_ALT));
     code_idx += opcodes(3);
 }
 
@@ -1114,8 +1030,8 @@ relop_suffix(void)
 void
 os_lt(void)
 {
-    stgwrite("\txchg\n");
-    stgwrite("\tsless\n");
+    stgwrite(AsmInsn(AsmOp::XCHG));
+    stgwrite(AsmInsn(AsmOp::SLESS));
     code_idx += opcodes(2);
 }
 
@@ -1125,8 +1041,8 @@ os_lt(void)
 void
 os_le(void)
 {
-    stgwrite("\txchg\n");
-    stgwrite("\tsleq\n");
+    stgwrite(AsmInsn(AsmOp::XCHG));
+    stgwrite(AsmInsn(AsmOp::SLEQ));
     code_idx += opcodes(2);
 }
 
@@ -1136,8 +1052,8 @@ os_le(void)
 void
 os_gt(void)
 {
-    stgwrite("\txchg\n");
-    stgwrite("\tsgrtr\n");
+    stgwrite(AsmInsn(AsmOp::XCHG));
+    stgwrite(AsmInsn(AsmOp::SGRTR));
     code_idx += opcodes(2);
 }
 
@@ -1147,8 +1063,8 @@ os_gt(void)
 void
 os_ge(void)
 {
-    stgwrite("\txchg\n");
-    stgwrite("\tsgeq\n");
+    stgwrite(AsmInsn(AsmOp::XCHG));
+    stgwrite(AsmInsn(AsmOp::SGEQ));
     code_idx += opcodes(2);
 }
 
@@ -1158,7 +1074,7 @@ os_ge(void)
 void
 lneg(void)
 {
-    stgwrite("\tnot\n");
+    stgwrite(AsmInsn(AsmOp::NOT));
     code_idx += opcodes(1);
 }
 
@@ -1168,7 +1084,7 @@ lneg(void)
 void
 neg(void)
 {
-    stgwrite("\tneg\n");
+    stgwrite(AsmInsn(AsmOp::NEG));
     code_idx += opcodes(1);
 }
 
@@ -1178,7 +1094,7 @@ neg(void)
 void
 invert(void)
 {
-    stgwrite("\tinvert\n");
+    stgwrite(AsmInsn(AsmOp::INVERT));
     code_idx += opcodes(1);
 }
 
@@ -1188,21 +1104,21 @@ invert(void)
 void
 nooperation(void)
 {
-    stgwrite("\tnop\n");
+    stgwrite(AsmInsn(AsmOp::NOP));
     code_idx += opcodes(1);
 }
 
 void
 inc_pri()
 {
-    stgwrite("\tinc.pri\n");
+    stgwrite(AsmInsn(AsmOp::INC_PRI));
     code_idx += opcodes(1);
 }
 
 void
 dec_pri()
 {
-    stgwrite("\tdec.pri\n");
+    stgwrite(AsmInsn(AsmOp::DEC_PRI));
     code_idx += opcodes(1);
 }
 
@@ -1216,34 +1132,30 @@ inc(const value* lval)
     sym = lval->sym;
     if (lval->ident == iARRAYCELL) {
         /* indirect increment, address already in PRI */
-        stgwrite("\tinc.i\n");
+        stgwrite(AsmInsn(AsmOp::INC_I));
         code_idx += opcodes(1);
     } else if (lval->ident == iARRAYCHAR) {
         /* indirect increment of single character, address already in PRI */
-        stgwrite("\tpush.pri\n");
-        stgwrite("\tpush.alt\n");
-        stgwrite("\tmove.alt\n");    /* copy address */
-        stgwrite("\tlodb.i ");       /* read from PRI into PRI */
-        outval(sCHARBITS / 8, TRUE); /* read one or two bytes */
-        stgwrite("\tinc.pri\n");
-        stgwrite("\tstrb.i ");       /* write PRI to ALT */
-        outval(sCHARBITS / 8, TRUE); /* write one or two bytes */
-        stgwrite("\tpop.alt\n");
-        stgwrite("\tpop.pri\n");
+        stgwrite(AsmInsn(AsmOp::PUSH_PRI));
+        stgwrite(AsmInsn(AsmOp::PUSH_ALT));
+        stgwrite(AsmInsn(AsmOp::MOVE_ALT));              /* copy address */
+        stgwrite(AsmInsn(AsmOp::LODB_I, sCHARBITS / 8)); /* read one or two bytes into PRI */
+        stgwrite(AsmInsn(AsmOp::INC_PRI));
+        stgwrite(AsmInsn(AsmOp::STRB_I, sCHARBITS / 8)); /* write one or two bytes to ALT */
+        stgwrite(AsmInsn(AsmOp::POP_ALT));
+        stgwrite(AsmInsn(AsmOp::POP_PRI));
         code_idx += opcodes(8) + opargs(2);
     } else if (lval->ident == iREFERENCE) {
         assert(sym != NULL);
-        stgwrite("\tpush.pri\n");
+        stgwrite(AsmInsn(AsmOp::PUSH_PRI));
         /* load dereferenced value */
         assert(sym->vclass == sLOCAL); /* global references don't exist in Pawn */
-        stgwrite("\tlref.s.pri ");
-        outval(sym->addr(), TRUE);
+        stgwrite(AsmInsn(AsmOp::LREF_S_PRI, sym->addr()));
         /* increment */
-        stgwrite("\tinc.pri\n");
+        stgwrite(AsmInsn(AsmOp::INC_PRI));
         /* store dereferenced value */
-        stgwrite("\tsref.s.pri ");
-        outval(sym->addr(), TRUE);
-        stgwrite("\tpop.pri\n");
+        stgwrite(AsmInsn(AsmOp::SREF_S_PRI, sym->addr()));
+        stgwrite(AsmInsn(AsmOp::POP_PRI));
         code_idx += opcodes(5) + opargs(2);
     } else if (lval->ident == iACCESSOR) {
         inc_pri();
@@ -1251,11 +1163,8 @@ inc(const value* lval)
     } else {
         /* local or global variable */
         assert(sym != NULL);
-        if (sym->vclass == sLOCAL)
-            stgwrite("\tinc.s ");
-        else
-            stgwrite("\tinc ");
-        outval(sym->addr(), TRUE);
+        AsmOp op = (sym->vclass == sLOCAL) ? AsmOp::INC_S : AsmOp::INC;
+        stgwrite(AsmInsn(op, sym->addr()));
         code_idx += opcodes(1) + opargs(1);
     }
 }
@@ -1272,34 +1181,30 @@ dec(const value* lval)
     sym = lval->sym;
     if (lval->ident == iARRAYCELL) {
         /* indirect decrement, address already in PRI */
-        stgwrite("\tdec.i\n");
+        stgwrite(AsmInsn(AsmOp::DEC_I));
         code_idx += opcodes(1);
     } else if (lval->ident == iARRAYCHAR) {
         /* indirect decrement of single character, address already in PRI */
-        stgwrite("\tpush.pri\n");
-        stgwrite("\tpush.alt\n");
-        stgwrite("\tmove.alt\n");    /* copy address */
-        stgwrite("\tlodb.i ");       /* read from PRI into PRI */
-        outval(sCHARBITS / 8, TRUE); /* read one or two bytes */
-        stgwrite("\tdec.pri\n");
-        stgwrite("\tstrb.i ");       /* write PRI to ALT */
-        outval(sCHARBITS / 8, TRUE); /* write one or two bytes */
-        stgwrite("\tpop.alt\n");
-        stgwrite("\tpop.pri\n");
+        stgwrite(AsmInsn(AsmOp::PUSH_PRI));
+        stgwrite(AsmInsn(AsmOp::PUSH_ALT));
+        stgwrite(AsmInsn(AsmOp::MOVE_ALT));              /* copy address */
+        stgwrite(AsmInsn(AsmOp::LODB_I, sCHARBITS / 8)); /* read one or two bytes into PRI */
+        stgwrite(AsmInsn(AsmOp::DEC_PRI));
+        stgwrite(AsmInsn(AsmOp::STRB_I, sCHARBITS / 8)); /* write one or two bytes to ALT */
+        stgwrite(AsmInsn(AsmOp::POP_ALT));
+        stgwrite(AsmInsn(AsmOp::POP_PRI));
         code_idx += opcodes(8) + opargs(2);
     } else if (lval->ident == iREFERENCE) {
         assert(sym != NULL);
-        stgwrite("\tpush.pri\n");
+        stgwrite(AsmInsn(AsmOp::PUSH_PRI));
         /* load dereferenced value */
         assert(sym->vclass == sLOCAL); /* global references don't exist in Pawn */
-        stgwrite("\tlref.s.pri ");
-        outval(sym->addr(), TRUE);
+        stgwrite(AsmInsn(AsmOp::LREF_S_PRI, sym->addr()));
         /* decrement */
-        stgwrite("\tdec.pri\n");
+        stgwrite(AsmInsn(AsmOp::DEC_PRI));
         /* store dereferenced value */
-        stgwrite("\tsref.s.pri ");
-        outval(sym->addr(), TRUE);
-        stgwrite("\tpop.pri\n");
+        stgwrite(AsmInsn(AsmOp::SREF_S_PRI, sym->addr()));
+        stgwrite(AsmInsn(AsmOp::POP_PRI));
         code_idx += opcodes(5) + opargs(2);
     } else if (lval->ident == iACCESSOR) {
         dec_pri();
@@ -1307,11 +1212,8 @@ dec(const value* lval)
     } else {
         /* local or global variable */
         assert(sym != NULL);
-        if (sym->vclass == sLOCAL)
-            stgwrite("\tdec.s ");
-        else
-            stgwrite("\tdec ");
-        outval(sym->addr(), TRUE);
+        AsmOp op = (sym->vclass == sLOCAL) ? AsmOp::DEC_S : AsmOp::DEC;
+        stgwrite(AsmInsn(op, sym->addr()));
         code_idx += opcodes(1) + opargs(1);
     }
 }
@@ -1322,8 +1224,7 @@ dec(const value* lval)
 void
 jmp_ne0(int number)
 {
-    stgwrite("\tjnz ");
-    outval(number, TRUE);
+    stgwrite(AsmInsn(AsmOp::JNZ, number));
     code_idx += opcodes(1) + opargs(1);
 }
 
@@ -1333,20 +1234,10 @@ jmp_ne0(int number)
 void
 jmp_eq0(int number)
 {
-    stgwrite("\tjzer ");
-    outval(number, TRUE);
+    stgwrite(AsmInsn(AsmOp::JZER, number));
     code_idx += opcodes(1) + opargs(1);
 }
 
-/* write a value in hexadecimal; optionally adds a newline */
-void
-outval(cell val, int newline)
-{
-    stgwrite(itoh(val));
-    if (newline)
-        stgwrite("\n");
-}
-
 void
 invoke_getter(methodmap_method_t* method)
 {
@@ -1390,9 +1281,7 @@ load_glbfn(symbol* sym)
 {
     assert(sym->ident == iFUNCTN);
     assert(!sym->native);
-    stgwrite("\tldgfn.pri ");
-    stgwrite(sym->name());
-    stgwrite("\n");
+    stgwrite(AsmInsn(AsmOp::LDGFN_PRI, asm_symbol_ref(sym)));
     code_idx += opcodes(1) + opargs(1);
 
     if (sc_status != statSKIP)
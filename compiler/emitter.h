@@ -70,14 +70,14 @@ void popreg(regid reg);
 void genarray(int dims, int _autozero);
 void swap1(void);
 void ffswitch(int label);
-void ffcase(cell value, char* labelname, int newtable);
+void ffcase(cell value, int label, int newtable);
 void ffcall(symbol* sym, int numargs);
 void ffret();
 void ffabort(int reason);
 void ffbounds(cell size);
 void ffbounds();
 void jumplabel(int number);
-void defstorage(void);
+void defstorage(const cell* values, int count);
 void modstk(int delta);
 void modheap(int delta);
 void modheap_i();
@@ -132,7 +132,6 @@ void inc(const value* lval);
 void dec(const value* lval);
 void jmp_ne0(int number);
 void jmp_eq0(int number);
-void outval(cell val, int newline);
 
 /* macros for code generation */
 #define opcodes(n) ((n) * sizeof(cell)) /* opcode size */
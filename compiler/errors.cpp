@@ -58,6 +58,9 @@
 static unsigned char warndisable[(NUM_WARNINGS + 7) / 8]; /* 8 flags in a char */
 
 static int errflag;
+static unsigned int sRaisedCount;
+static int lastline, errorcount; /* messages on the line of the last message */
+static short lastfile;
 static AutoErrorPos* sPosOverride = nullptr;
 
 AutoErrorPos::AutoErrorPos(const token_pos_t& pos)
@@ -225,8 +228,7 @@ ErrorReport::infer_va(int number, va_list ap)
 void
 report_error(ErrorReport* report)
 {
-    static int lastline, errorcount;
-    static short lastfile;
+    sRaisedCount++;
 
     /* errflag is reset on each semicolon.
      * In a two-pass compiler, an error should not be reported twice. Therefore
@@ -297,6 +299,33 @@ errorset(int code, int line)
     }
 }
 
+/* reset_errors()
+ * Prepares the error system for a new compilation: all warnings are enabled
+ * again and no messages were reported yet. A fatal error in the compilation
+ * before may have left an AutoErrorPos behind, since longjmp() skips its
+ * destructor.
+ */
+void
+reset_errors()
+{
+    memset(warndisable, 0, sizeof(warndisable));
+    errflag = FALSE;
+    sPosOverride = nullptr;
+    lastline = 0;
+    lastfile = 0;
+    errorcount = 0;
+}
+
+/* diagnostics_raised()
+ * Returns the number of errors and warnings raised so far, including those that
+ * were not reported because they were raised before the final pass.
+ */
+unsigned int
+diagnostics_raised()
+{
+    return sRaisedCount;
+}
+
 /* sc_enablewarning()
  * Enables or disables a warning (errors cannot be disabled).
  * Initially all warnings are enabled. The compiler does this by setting bits
@@ -86,7 +86,9 @@ int error(symbol* sym, int number, ...);
 int error(const token_pos_t& where, int number, ...);
 int error_va(const token_pos_t& where, int number, va_list ap);
 void errorset(int code, int line);
+void reset_errors();
 void report_error(ErrorReport* report);
+unsigned int diagnostics_raised();
 
 int pc_enablewarning(int number, int enable);
 
@@ -32,6 +32,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "compile-timings.h"
 #include "emitter.h"
 #include "errors.h"
 #include "libpawnc.h"
@@ -58,7 +59,6 @@ using namespace sp;
 #define UTF8MODE 0x2
 #define ISPACKED 0x4
 static cell litchar(const unsigned char** lptr, int flags);
-static symbol* find_symbol(const symbol* root, const char* name, int fnumber);
 
 static void substallpatterns(unsigned char* line, int buffersize);
 static int alpha(char c);
@@ -77,6 +77,123 @@ static short skiplevel; /* level at which we started skipping (including nested
 static unsigned char term_expr[] = "";
 static int listline = -1; /* "current line" for the list file */
 
+/* Lines as read by readline() and stripped by stripcom(), kept from the first
+ * pass so that the later passes over the same source do not read and strip
+ * them again. A line is identified by the file it was read from, its position
+ * in that file and the state that stripping it depends on. It is only kept if
+ * reading it raised no diagnostics, so that replaying it has the same effect
+ * as reading it again. The text after macro substitution is kept as well,
+ * along with the state of the macro table it was substituted with.
+ *
+ * Since every pass reads the lines in (mostly) the same order, the lines are
+ * kept in the order in which they were first read, and only a line that does
+ * not follow the line read before it in the cache is entered in the index.
+ */
+struct LineKey {
+    sp::Atom* file; /* NULL for the main file */
+    ptrdiff_t pos;
+    short comment;
+    int ctrlchar;
+};
+struct LineKeyPolicy {
+    static bool matches(const LineKey& a, const LineKey& b) {
+        return a.file == b.file && a.pos == b.pos && a.comment == b.comment &&
+               a.ctrlchar == b.ctrlchar;
+    }
+    static uint32_t hash(const LineKey& key) {
+        return ke::HashPointer(key.file) ^ ke::HashInt32(int32_t(key.pos));
+    }
+};
+struct CachedLine {
+    LineKey key;
+    size_t text;    /* offset in sLineText */
+    ptrdiff_t next; /* position of the line after it */
+    int nlines;     /* number of lines read, with continuations */
+    short comment;  /* "icomment" after the line */
+    bool substituted;
+    bool subst_shared; /* whether no macro specific to the compilation was used */
+    unsigned int subst_state;
+    int subst_needsemicolon;
+    size_t subst_text; /* offset in sLineText */
+};
+static const size_t kNoCachedLine = size_t(-1);
+static ke::Vector<CachedLine> sLineCache;
+static ke::Vector<char> sLineText; /* zero-terminated texts of the cached lines */
+static bool sLineCacheIndexInitialized;
+static ke::HashMap<LineKey, size_t, LineKeyPolicy> sLineCacheIndex;
+static size_t sCurrentLine = kNoCachedLine; /* the cached line in "pline", if any */
+static size_t sNextLine = kNoCachedLine;   /* the cached line most likely to follow */
+static bool sLineReplayed;                  /* whether "pline" was replayed from the cache */
+static bool sLinePending;                   /* whether the line read must be added */
+static LineKey sPendingKey;
+static void* sPendingFile;
+static int sPendingLine;
+static unsigned int sPendingDiagnostics;
+static sp::Atom* sInputAtom; /* name of the file "inpf" reads, NULL for the main file */
+static ke::Vector<sp::Atom*> sInputAtomStack;
+
+/* The lines of include files can be kept in a "precompiled header" between
+ * compilations, so that the first pass replays them too. It holds the history
+ * of macro changes as well (see sclist.cpp), so that the substitutions can be
+ * reused by a compilation that defines the same macros, except those that used
+ * a macro specific to the compilation. The lines of an include file are only
+ * loaded if the file that opens under the same name still has the same length
+ * and contents; an include file that changed or that now resolves to another
+ * file is read again.
+ */
+static const uint32_t kPrecompiledMagic = 0x48435053; /* "SPCH" */
+static const uint32_t kPrecompiledVersion = 1;
+static const uint32_t kNoPrecompiledFile = uint32_t(-1);
+struct PrecompiledHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nfiles;
+    uint32_t nlines;
+};
+struct PrecompiledFile {
+    int64_t length; /* of the source, in bytes */
+    uint64_t hash;  /* of the source, see hashsource() */
+    uint32_t namelength;
+};
+struct PrecompiledLine {
+    int64_t pos;
+    int64_t next;
+    uint32_t file; /* index in the file table */
+    int32_t ctrlchar;
+    int32_t nlines;
+    uint32_t textlength;
+    uint32_t subst_state;
+    int32_t subst_needsemicolon;
+    uint32_t substlength;
+    int16_t comment;
+    int16_t comment_after;
+    uint8_t indexed; /* whether to enter the line in the index */
+    uint8_t substituted;
+};
+static bool sLineCacheChanged; /* whether lines of include files were added */
+
+/* A header is made for the include files of one plugin. One that is shared by
+ * plugins with other include files would be rewritten by every compilation,
+ * so it is only rewritten by compilations that read the same include files as
+ * the compilation that wrote it.
+ */
+static bool sPrecompiledLoaded;
+static ke::Vector<sp::Atom*> sPrecompiledFiles; /* the include files it was made for */
+
+/* A compilation that is followed by another one in the same process (see
+ * compile-server.cpp) keeps the lines of the include files, much as if it saved
+ * them to a precompiled header that the next compilation loads. The include
+ * files are recorded with their length and a hash of their contents, and the
+ * lines of a file that changed, or that now opens as another file, are dropped
+ * before the next compilation can replay them.
+ */
+struct KeptFile {
+    sp::Atom* name;
+    int64_t length;
+    uint64_t hash;
+};
+static ke::Vector<KeptFile> sKeptFiles;
+
 static bool sLiteralQueueDisabled = false;
 
 ke::HashMap<CharsAndLength, int, KeywordTablePolicy> sKeywords;
@@ -128,9 +245,11 @@ plungequalifiedfile(char* name)
     sCommentStack.append(icomment);
     gCurrentFileStack.append(fcurrent);
     gCurrentLineStack.append(fline);
+    sInputAtomStack.append(sInputAtom);
     inpfname = strdup(name); /* set name of include file */
     if (inpfname == NULL)
         error(FATAL_ERROR_OOM);
+    sInputAtom = gAtoms.add(inpfname);
     inpf = fp; /* set input file pointer to include file */
     fnumber++;
     fline = 0; /* set current line number to 0 */
@@ -243,6 +362,616 @@ doinclude(int silent)
         error(FATAL_ERROR_READ, name);
 }
 
+/*  line_constant
+ *
+ *  Returns the __LINE__ constant, which is updated for every line that is read.
+ */
+static symbol*
+line_constant()
+{
+    static sp::Atom* sLineAtom = gAtoms.add("__LINE__");
+    return findconst(sLineAtom);
+}
+
+/*  replayline
+ *
+ *  Looks up the line at the current position of "inpf" in the line cache. If it
+ *  is there, it is copied into "line" and the input file, the line number and
+ *  the comment state are advanced past it as readline() would. Otherwise the
+ *  position is remembered, so that cacheline() can add the line once it has
+ *  been read and stripped.
+ */
+static bool
+replayline(unsigned char* line)
+{
+    LineKey key;
+    key.file = sInputAtom;
+    key.pos = (ptrdiff_t)pc_getpossrc(inpf);
+    key.comment = icomment;
+    key.ctrlchar = sc_ctrlchar;
+
+    size_t index = sNextLine;
+    if (index >= sLineCache.length() || !LineKeyPolicy::matches(sLineCache[index].key, key)) {
+        if (!sLineCacheIndexInitialized) {
+            sLineCacheIndex.init(1024);
+            sLineCacheIndexInitialized = true;
+        }
+        auto p = sLineCacheIndex.find(key);
+        if (!p.found()) {
+            sLinePending = true;
+            sPendingKey = key;
+            sPendingFile = inpf;
+            sPendingLine = fline;
+            sPendingDiagnostics = diagnostics_raised();
+            return false;
+        }
+        index = p->value;
+    }
+
+    const CachedLine& cached = sLineCache[index];
+    strcpy((char*)line, &sLineText[cached.text]);
+    pc_resetsrc(inpf, (void*)cached.next);
+    fline += cached.nlines;
+    icomment = cached.comment;
+    symbol* sym = line_constant();
+    assert(sym != NULL);
+    sym->setAddr(fline);
+    sCurrentLine = index;
+    sNextLine = index + 1;
+    sLineReplayed = true;
+    return true;
+}
+
+static void
+indexline(size_t index)
+{
+    if (!sLineCacheIndexInitialized) {
+        sLineCacheIndex.init(1024);
+        sLineCacheIndexInitialized = true;
+    }
+    const LineKey& key = sLineCache[index].key;
+    auto p = sLineCacheIndex.findForAdd(key);
+    if (!p.found())
+        sLineCacheIndex.add(p, key, index);
+}
+
+static size_t
+cachetext(const unsigned char* text)
+{
+    size_t offset = sLineText.length();
+    size_t size = strlen((const char*)text) + 1;
+    sLineText.resize(offset + size);
+    memcpy(&sLineText[offset], text, size);
+    return offset;
+}
+
+/*  cacheline
+ *
+ *  Adds the line that readline() read and stripcom() stripped to the line
+ *  cache, unless it came from more than one file or raised a diagnostic.
+ */
+static void
+cacheline(const unsigned char* line)
+{
+    if (!sLinePending)
+        return;
+    sLinePending = false;
+    if (inpf != sPendingFile || diagnostics_raised() != sPendingDiagnostics)
+        return;
+
+    CachedLine cached;
+    cached.key = sPendingKey;
+    cached.text = cachetext(line);
+    cached.next = (ptrdiff_t)pc_getpossrc(inpf);
+    cached.nlines = fline - sPendingLine;
+    cached.comment = icomment;
+    cached.substituted = false;
+    sCurrentLine = sLineCache.length();
+    sLineCache.append(cached);
+    if (cached.key.file != NULL)
+        sLineCacheChanged = true;
+
+    if (sNextLine != sCurrentLine)
+        indexline(sCurrentLine);
+    sNextLine = sCurrentLine + 1;
+}
+
+/*  substline
+ *
+ *  Substitutes the macros in a line that is not a directive. The result for a
+ *  cached line is reused if the macro table is the same as when it was made.
+ */
+static void
+substline(unsigned char* line)
+{
+    CachedLine* cached = NULL;
+    if (sCurrentLine != kNoCachedLine) {
+        cached = &sLineCache[sCurrentLine];
+        if (cached->substituted && cached->subst_state == subst_state() &&
+            cached->subst_needsemicolon == sc_needsemicolon)
+        {
+            strcpy((char*)line, &sLineText[cached->subst_text]);
+            return;
+        }
+    }
+
+    unsigned int diagnostics = diagnostics_raised();
+    unsigned int uses = compilation_subst_uses();
+    substallpatterns(line, sLINEMAX);
+    if (cached != NULL && diagnostics_raised() == diagnostics) {
+        cached->substituted = true;
+        cached->subst_shared = compilation_subst_uses() == uses;
+        if (cached->subst_shared && cached->key.file != NULL)
+            sLineCacheChanged = true;
+        cached->subst_state = subst_state();
+        cached->subst_needsemicolon = sc_needsemicolon;
+        cached->subst_text = cachetext(line);
+    }
+}
+
+void
+delete_linecache(void)
+{
+    sLineCache.clear();
+    sLineText.clear();
+    sLineCacheIndex.clear();
+    sCurrentLine = kNoCachedLine;
+    sNextLine = kNoCachedLine;
+    sLinePending = false;
+    sLineCacheChanged = false;
+    sKeptFiles.clear();
+}
+
+/*  hashsource
+ *
+ *  Gets the length of a source file and a hash of its contents, or returns
+ *  false if it cannot be read.
+ */
+static bool
+hashsource(const char* name, int64_t* length, uint64_t* hash)
+{
+    FILE* fp = fopen(name, "rb");
+    if (fp == NULL)
+        return false;
+
+    uint64_t value = 0;
+    int64_t total = 0;
+    uint64_t block[512];
+    size_t size;
+    while ((size = fread(block, 1, sizeof(block), fp)) > 0) {
+        if (size % sizeof(uint64_t) != 0)
+            memset((char*)block + size, 0, sizeof(uint64_t) - size % sizeof(uint64_t));
+        for (size_t i = 0; i < (size + sizeof(uint64_t) - 1) / sizeof(uint64_t); i++) {
+            value = (value ^ block[i]) * 0x9e3779b97f4a7c15ULL;
+            value ^= value >> 29;
+        }
+        total += size;
+    }
+    bool ok = !ferror(fp);
+    fclose(fp);
+    *length = total;
+    *hash = value;
+    return ok;
+}
+
+/* A precompiled header has many small records, so all of it that follows the
+ * macro history is read at once and taken apart in memory.
+ */
+struct PrecompiledReader {
+    const char* pos;
+    const char* end;
+
+    bool read(void* buffer, size_t size) {
+        if (size_t(end - pos) < size)
+            return false;
+        memcpy(buffer, pos, size);
+        pos += size;
+        return true;
+    }
+};
+
+static bool
+readprecompiled(FILE* fp)
+{
+    PrecompiledHeader header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 || header.magic != kPrecompiledMagic ||
+        header.version != kPrecompiledVersion || !read_substhistory(fp))
+    {
+        return false;
+    }
+
+    long start = ftell(fp);
+    if (start < 0 || fseek(fp, 0, SEEK_END) != 0)
+        return false;
+    long end = ftell(fp);
+    if (end < start || fseek(fp, start, SEEK_SET) != 0)
+        return false;
+    ke::Vector<char> data;
+    data.resize(size_t(end - start) + 1);
+    if (fread(&data[0], 1, size_t(end - start), fp) != size_t(end - start))
+        return false;
+    PrecompiledReader reader;
+    reader.pos = &data[0];
+    reader.end = reader.pos + (end - start);
+
+    ke::Vector<sp::Atom*> files; /* NULL for a file that is not the same */
+    for (uint32_t i = 0; i < header.nfiles; i++) {
+        PrecompiledFile file;
+        char name[_MAX_PATH];
+        if (!reader.read(&file, sizeof(file)) || file.namelength >= sizeof(name) ||
+            !reader.read(name, file.namelength))
+        {
+            return false;
+        }
+        name[file.namelength] = '\0';
+
+        sp::Atom* atom = gAtoms.add(name);
+        sPrecompiledFiles.append(atom);
+
+        int64_t length;
+        uint64_t hash;
+        if (hashsource(name, &length, &hash) && length == file.length && hash == file.hash)
+            files.append(atom);
+        else
+            files.append(nullptr);
+    }
+
+    bool previous = false; /* whether the line before was loaded */
+    for (uint32_t i = 0; i < header.nlines; i++) {
+        PrecompiledLine record;
+        if (!reader.read(&record, sizeof(record)) || record.file >= files.length() ||
+            record.textlength > sLINEMAX || record.substlength > sLINEMAX)
+        {
+            return false;
+        }
+        if (files[record.file] == NULL) {
+            size_t skip = record.textlength + (record.substituted ? record.substlength : 0);
+            if (size_t(reader.end - reader.pos) < skip)
+                return false;
+            reader.pos += skip;
+            previous = false;
+            continue;
+        }
+
+        size_t text = sLineText.length();
+        size_t subst_text = text + record.textlength + 1;
+        sLineText.resize(subst_text + (record.substituted ? record.substlength + 1 : 0));
+        if (!reader.read(&sLineText[text], record.textlength))
+            return false;
+        sLineText[text + record.textlength] = '\0';
+        if (record.substituted) {
+            if (!reader.read(&sLineText[subst_text], record.substlength))
+                return false;
+            sLineText[subst_text + record.substlength] = '\0';
+        }
+
+        CachedLine cached;
+        cached.key.file = files[record.file];
+        cached.key.pos = (ptrdiff_t)record.pos;
+        cached.key.comment = record.comment;
+        cached.key.ctrlchar = record.ctrlchar;
+        cached.text = text;
+        cached.next = (ptrdiff_t)record.next;
+        cached.nlines = record.nlines;
+        cached.comment = record.comment_after;
+        cached.substituted = record.substituted != 0;
+        cached.subst_shared = true;
+        cached.subst_state = record.subst_state;
+        cached.subst_needsemicolon = record.subst_needsemicolon;
+        cached.subst_text = subst_text;
+        sLineCache.append(cached);
+        if (record.indexed || !previous)
+            indexline(sLineCache.length() - 1);
+        previous = true;
+    }
+    return true;
+}
+
+/*  load_precompiled
+ *
+ *  Fills the line cache with the lines of the include files that a precompiled
+ *  header holds, skipping the files that changed since it was saved. This must
+ *  be done before the first pass. A line cache that was kept from the
+ *  compilation before is used as it is.
+ */
+bool
+load_precompiled(const char* filename)
+{
+    sPrecompiledLoaded = false;
+    sPrecompiledFiles.clear();
+    if (sLineCache.length() > 0)
+        return true;
+    delete_substhistory();
+    FILE* fp = fopen(filename, "rb");
+    if (fp == NULL)
+        return false;
+    bool ok = readprecompiled(fp);
+    fclose(fp);
+    if (ok) {
+        sPrecompiledLoaded = true;
+    } else {
+        delete_linecache();
+        delete_substhistory();
+        sPrecompiledFiles.clear();
+    }
+    return ok;
+}
+
+/* Whether the line cache holds the lines of the same include files as the
+ * precompiled header that was loaded.
+ */
+static bool
+same_precompiled_files(void)
+{
+    ke::Vector<sp::Atom*> files;
+    for (size_t i = 0; i < sLineCache.length(); i++) {
+        sp::Atom* atom = sLineCache[i].key.file;
+        if (atom == NULL || (i > 0 && atom == sLineCache[i - 1].key.file))
+            continue;
+        size_t file;
+        for (file = 0; file < files.length() && files[file] != atom; file++)
+            /* nothing */;
+        if (file == files.length())
+            files.append(atom);
+    }
+
+    if (files.length() != sPrecompiledFiles.length())
+        return false;
+    for (size_t i = 0; i < files.length(); i++) {
+        size_t file;
+        for (file = 0; file < sPrecompiledFiles.length() && sPrecompiledFiles[file] != files[i];
+             file++)
+            /* nothing */;
+        if (file == sPrecompiledFiles.length())
+            return false;
+    }
+    return true;
+}
+
+static bool
+writeprecompiled(FILE* fp)
+{
+    /* collect the include files, and the index in the table for every line */
+    ke::Vector<sp::Atom*> files;
+    ke::Vector<uint32_t> lines;
+    uint32_t nlines = 0;
+    for (size_t i = 0; i < sLineCache.length(); i++) {
+        sp::Atom* atom = sLineCache[i].key.file;
+        uint32_t file = kNoPrecompiledFile;
+        if (atom != NULL) {
+            if (i > 0 && atom == sLineCache[i - 1].key.file) {
+                file = lines[i - 1];
+            } else {
+                for (file = 0; file < files.length() && files[file] != atom; file++)
+                    /* nothing */;
+                if (file == files.length())
+                    files.append(atom);
+            }
+            nlines++;
+        }
+        lines.append(file);
+    }
+
+    PrecompiledHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = kPrecompiledMagic;
+    header.version = kPrecompiledVersion;
+    header.nfiles = (uint32_t)files.length();
+    header.nlines = nlines;
+    if (fwrite(&header, sizeof(header), 1, fp) != 1 || !write_substhistory(fp))
+        return false;
+
+    for (size_t i = 0; i < files.length(); i++) {
+        PrecompiledFile file;
+        memset(&file, 0, sizeof(file));
+        if (!hashsource(files[i]->chars(), &file.length, &file.hash))
+            return false;
+        file.namelength = (uint32_t)files[i]->length();
+        if (fwrite(&file, sizeof(file), 1, fp) != 1 ||
+            fwrite(files[i]->chars(), 1, file.namelength, fp) != file.namelength)
+        {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < sLineCache.length(); i++) {
+        if (lines[i] == kNoPrecompiledFile)
+            continue;
+        const CachedLine& cached = sLineCache[i];
+        const char* text = &sLineText[cached.text];
+        PrecompiledLine record;
+        memset(&record, 0, sizeof(record));
+        record.pos = cached.key.pos;
+        record.next = cached.next;
+        record.file = lines[i];
+        record.ctrlchar = cached.key.ctrlchar;
+        record.nlines = cached.nlines;
+        record.textlength = (uint32_t)strlen(text);
+        record.comment = cached.key.comment;
+        record.comment_after = cached.comment;
+        if (cached.substituted && cached.subst_shared) {
+            record.substituted = true;
+            record.subst_state = cached.subst_state;
+            record.subst_needsemicolon = cached.subst_needsemicolon;
+            record.substlength = (uint32_t)strlen(&sLineText[cached.subst_text]);
+        }
+        if (i == 0 || lines[i - 1] == kNoPrecompiledFile) {
+            record.indexed = true;
+        } else {
+            auto p = sLineCacheIndex.find(cached.key);
+            record.indexed = p.found() && p->value == i;
+        }
+        if (fwrite(&record, sizeof(record), 1, fp) != 1 ||
+            fwrite(text, 1, record.textlength, fp) != record.textlength ||
+            (record.substituted &&
+             fwrite(&sLineText[cached.subst_text], 1, record.substlength, fp) !=
+                 record.substlength))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*  save_precompiled
+ *
+ *  Writes the lines of the include files in the line cache to a precompiled
+ *  header, unless they all came from it. A header that was made for other
+ *  include files is left alone. The file is written under another name first,
+ *  so that a compilation that loads it at the same time does not see half of
+ *  it.
+ */
+bool
+save_precompiled(const char* filename)
+{
+    if (!sLineCacheChanged)
+        return true;
+    if (sPrecompiledLoaded && !same_precompiled_files()) {
+        pc_printf("Note: not updating precompiled header %s, which was made for other include "
+                  "files\n", filename);
+        return true;
+    }
+
+    /* the jobs of "-j" may write the same header at the same time */
+    char tmpname[_MAX_PATH + 24];
+    if (sc_jobfile >= 0)
+        snprintf(tmpname, sizeof(tmpname), "%s.tmp%d", filename, sc_jobfile);
+    else
+        snprintf(tmpname, sizeof(tmpname), "%s.tmp", filename);
+    FILE* fp = fopen(tmpname, "wb");
+    if (fp == NULL)
+        return false;
+    bool ok = writeprecompiled(fp);
+    if (fclose(fp) != 0)
+        ok = false;
+    if (ok && rename(tmpname, filename) != 0) {
+        /* rename() does not replace an existing file on Windows */
+        remove(filename);
+        ok = rename(tmpname, filename) == 0;
+    }
+    if (!ok)
+        remove(tmpname);
+    return ok;
+}
+
+static bool
+iskept(sp::Atom* name)
+{
+    for (size_t i = 0; i < sKeptFiles.length(); i++) {
+        if (sKeptFiles[i].name == name)
+            return true;
+    }
+    return false;
+}
+
+/* Drops the lines of the files that are not kept, and the substitutions that
+ * used a macro specific to the compilation.
+ */
+static void
+keeplines()
+{
+    ke::Vector<CachedLine> lines;
+    ke::Vector<char> text;
+    ke::Vector<size_t> indexed;
+    sp::Atom* file = nullptr;
+    bool keep = false;
+    bool previous = false; /* whether the line before was kept */
+    for (size_t i = 0; i < sLineCache.length(); i++) {
+        CachedLine cached = sLineCache[i];
+        if (cached.key.file != file) {
+            file = cached.key.file;
+            keep = file != NULL && iskept(file);
+        }
+        if (!keep) {
+            previous = false;
+            continue;
+        }
+
+        bool index = !previous;
+        if (!index) {
+            auto p = sLineCacheIndex.find(cached.key);
+            index = p.found() && p->value == i;
+        }
+        if (index)
+            indexed.append(lines.length());
+        previous = true;
+
+        const char* line = &sLineText[cached.text];
+        size_t length = strlen(line) + 1;
+        cached.text = text.length();
+        text.resize(cached.text + length);
+        memcpy(&text[cached.text], line, length);
+        if (cached.substituted && cached.subst_shared) {
+            line = &sLineText[cached.subst_text];
+            length = strlen(line) + 1;
+            cached.subst_text = text.length();
+            text.resize(cached.subst_text + length);
+            memcpy(&text[cached.subst_text], line, length);
+        } else {
+            cached.substituted = false;
+        }
+        lines.append(cached);
+    }
+
+    sLineCache = ke::Move(lines);
+    sLineText = ke::Move(text);
+    sLineCacheIndex.clear();
+    for (size_t i = 0; i < indexed.length(); i++)
+        indexline(indexed[i]);
+    sCurrentLine = kNoCachedLine;
+    sNextLine = kNoCachedLine;
+    sLinePending = false;
+}
+
+/*  keep_linecache
+ *
+ *  Keeps the lines of the include files in the line cache for the next
+ *  compilation, and drops the others. This is done in place of
+ *  delete_linecache(), at the end of a compilation.
+ */
+void
+keep_linecache(void)
+{
+    sp::Atom* file = nullptr;
+    for (size_t i = 0; i < sLineCache.length(); i++) {
+        if (sLineCache[i].key.file == NULL || sLineCache[i].key.file == file)
+            continue;
+        file = sLineCache[i].key.file;
+        KeptFile kept;
+        if (!iskept(file) && hashsource(file->chars(), &kept.length, &kept.hash)) {
+            kept.name = file;
+            sKeptFiles.append(kept);
+        }
+    }
+    keeplines();
+}
+
+/*  check_linecache
+ *
+ *  Drops the lines of the include files that changed since keep_linecache()
+ *  kept them. This must be done before the first pass.
+ */
+void
+check_linecache(void)
+{
+    bool changed = false;
+    for (size_t i = 0; i < sKeptFiles.length();) {
+        const KeptFile& kept = sKeptFiles[i];
+        int64_t length;
+        uint64_t hash;
+        if (hashsource(kept.name->chars(), &length, &hash) && length == kept.length &&
+            hash == kept.hash)
+        {
+            i++;
+        } else {
+            sKeptFiles.remove(i);
+            changed = true;
+        }
+    }
+    if (changed)
+        keeplines();
+}
+
 /*  readline
  *
  *  Reads in a new line from the input file pointed to by "inpf". readline()
@@ -259,6 +988,9 @@ readline(unsigned char* line)
     unsigned char* ptr;
     symbol* sym;
 
+    sCurrentLine = kNoCachedLine;
+    sLineReplayed = false;
+    sLinePending = false;
     if (lptr == term_expr)
         return;
     num = sLINEMAX;
@@ -291,12 +1023,15 @@ readline(unsigned char* line)
             free(inpfname);      /* return memory allocated for the include file name */
             inpfname = gInputFilenameStack.popCopy();
             inpf = gInputFileStack.popCopy();
+            sInputAtom = sInputAtomStack.popCopy();
             insert_dbgfile(inpfname);
             setfiledirect(inpfname);
             assert(sc_status == statFIRST || strcmp(get_inputfile(fcurrent), inpfname) == 0);
             listline = -1; /* force a #line directive when changing the file */
         }
 
+        if (!cont && replayline(line))
+            return;
         if (pc_readsrc(inpf, line, num) == NULL) {
             *line = '\0'; /* delete line */
             cont = FALSE;
@@ -333,7 +1068,7 @@ readline(unsigned char* line)
             line += strlen((char*)line);
         }
         fline += 1;
-        sym = findconst("__LINE__");
+        sym = line_constant();
         assert(sym != NULL);
         sym->setAddr(fline);
     } while (num >= 0 && cont);
@@ -361,9 +1096,20 @@ stripcom(unsigned char* line)
     char comment[COMMENT_LIMIT + COMMENT_MARGIN];
     int commentidx = 0;
     int skipstar = TRUE;
+    size_t plain;
 
     while (*line) {
         if (icomment != 0) {
+            if (icomment == 1) {
+                /* blank out the text up to a character that may end (or nest) the
+                 * comment in one go; only documentation comments are collected
+                 */
+                plain = strcspn((char*)line, "*/");
+                memset(line, ' ', plain);
+                line += plain;
+                if (*line == '\0')
+                    break;
+            }
             if (*line == '*' && *(line + 1) == '/') {
                 if (icomment == 2) {
                     assert(commentidx < COMMENT_LIMIT + COMMENT_MARGIN);
@@ -393,6 +1139,10 @@ stripcom(unsigned char* line)
                 line += 1;
             }
         } else {
+            /* skip the text up to the start of a comment or a literal */
+            line += strcspn((char*)line, "/\"'");
+            if (*line == '\0')
+                break;
             if (*line == '/' && *(line + 1) == '*') {
                 icomment = 1; /* start comment */
                 /* there must be two "*" behind the slash and then white space */
@@ -1239,34 +1989,15 @@ skippgroup(const unsigned char* string)
     return string;
 }
 
-static char*
-strdel(char* str, size_t len)
-{
-    size_t length = strlen(str);
-    if (len > length)
-        len = length;
-    memmove(str, str + len, length - len + 1); /* include EOS byte */
-    return str;
-}
-
-static char*
-strins(char* dest, const char* src, size_t srclen)
-{
-    size_t destlen = strlen(dest);
-    assert(srclen <= strlen(src));
-    memmove(dest + srclen, dest, destlen + 1); /* include EOS byte */
-    memcpy(dest, src, srclen);
-    return dest;
-}
-
 static int
 substpattern(unsigned char* line, size_t buffersize, const char* pattern,
              const char* substitution)
 {
     int prefixlen;
     const unsigned char *p, *s, *e;
-    unsigned char* args[10];
-    int match, arg, len, argsnum = 0;
+    const unsigned char* args[10]; /* the arguments point into "line" */
+    size_t arglengths[10];
+    int match, arg;
     int stringize;
 
     memset(args, 0, sizeof args);
@@ -1305,15 +2036,8 @@ substpattern(unsigned char* line, size_t buffersize, const char* pattern,
                               * a string, or the closing paranthese of a group) */
                 }
                 /* store the parameter (overrule any earlier) */
-                if (args[arg] != NULL)
-                    free(args[arg]);
-                else
-                    argsnum++;
-                len = (int)(e - s);
-                args[arg] = (unsigned char*)malloc(len + 1);
-                if (args[arg] == NULL)
-                    error(FATAL_ERROR_OOM);
-                strlcpy((char*)args[arg], (char*)s, len + 1);
+                args[arg] = s;
+                arglengths[arg] = e - s;
                 /* character behind the pattern was matched too */
                 if (*e == *p) {
                     s = e + 1;
@@ -1362,88 +2086,90 @@ substpattern(unsigned char* line, size_t buffersize, const char* pattern,
     }
 
     if (match) {
-        /* calculate the length of the substituted string */
-        for (e = (unsigned char*)substitution, len = 0; *e != '\0'; e++) {
-            if (*e == '#' && *(e + 1) == '%' && isdigit(*(e + 2)) && argsnum) {
+        /* build the substituted text apart, so that the rest of the line moves
+         * only once
+         */
+        static ke::Vector<char> text;
+        int missing = 0;
+        text.clear();
+        for (e = (unsigned char*)substitution; *e != '\0'; e++) {
+            if (*e == '#' && *(e + 1) == '%' && isdigit(*(e + 2))) {
                 stringize = 1;
                 e++; /* skip '#' */
             } else {
                 stringize = 0;
             }
-            if (*e == '%' && isdigit(*(e + 1)) && argsnum) {
+            if (*e == '%' && isdigit(*(e + 1))) {
                 arg = *(e + 1) - '0';
                 assert(arg >= 0 && arg <= 9);
-                assert(stringize == 0 || stringize == 1);
                 if (args[arg] != NULL) {
-                    len += strlen((char*)args[arg]) + 2 * stringize;
-                    e++;
+                    if (stringize)
+                        text.append('"');
+                    for (size_t i = 0; i < arglengths[arg]; i++)
+                        text.append((char)args[arg][i]);
+                    if (stringize)
+                        text.append('"');
                 } else {
-                    len++;
+                    missing++;
+                    text.append((char)e[0]);
+                    text.append((char)e[1]);
                 }
+                e++; /* skip %, digit is skipped later */
+            } else if (*e == '"' && is_startstring(e)) {
+                p = e;
+                e = skipstring(e);
+                for (; p <= e; p++)
+                    text.append((char)*p);
             } else {
-                len++;
+                text.append((char)*e);
             }
         }
         /* check length of the string after substitution */
-        if (strlen((char*)line) + len - (int)(s - line) > buffersize) {
+        size_t rest = strlen((char*)s);
+        if (rest + text.length() > buffersize) {
             error(75); /* line too long */
+            match = FALSE; /* leave the text as it is, do not match it again */
         } else {
-            /* substitute pattern */
-            strdel((char*)line, (int)(s - line));
-            for (e = (unsigned char*)substitution, s = line; *e != '\0'; e++) {
-                if (*e == '#' && *(e + 1) == '%' && isdigit(*(e + 2))) {
-                    stringize = 1;
-                    e++; /* skip '#' */
-                } else {
-                    stringize = 0;
-                }
-                if (*e == '%' && isdigit(*(e + 1))) {
-                    arg = *(e + 1) - '0';
-                    assert(arg >= 0 && arg <= 9);
-                    if (args[arg] != NULL) {
-                        if (stringize)
-                            strins((char*)s++, "\"", 1);
-                        strins((char*)s, (char*)args[arg], strlen((char*)args[arg]));
-                        s += strlen((char*)args[arg]);
-                        if (stringize)
-                            strins((char*)s++, "\"", 1);
-                    } else {
-                        error(236); /* parameter does not exist, incorrect #define pattern */
-                        strins((char*)s, (char*)e, 2);
-                        s += 2;
-                    }
-                    e++; /* skip %, digit is skipped later */
-                } else if (*e == '"') {
-                    p = e;
-                    if (is_startstring(e)) {
-                        e = skipstring(e);
-                        strins((char*)s, (char*)p, (e - p + 1));
-                        s += (e - p + 1);
-                    } else {
-                        strins((char*)s, (char*)e, 1);
-                        s++;
-                    }
-                } else {
-                    strins((char*)s, (char*)e, 1);
-                    s++;
-                }
-            }
+            while (missing-- > 0)
+                error(236); /* parameter does not exist, incorrect #define pattern */
+            memmove(line + text.length(), s, rest + 1); /* include EOS byte */
+            if (text.length() > 0)
+                memcpy(line, &text[0], text.length());
         }
     }
 
-    for (arg = 0; arg < 10; arg++)
-        if (args[arg] != NULL)
-            free(args[arg]);
-
     return match;
 }
 
+/* Looks for a word in the line that starts with the first character of a
+ * macro. Strings are not skipped, so this may find a word where there is none,
+ * but when it finds nothing, no macro can match in this line.
+ */
+static int
+substcandidate(const unsigned char* line)
+{
+    int inword = FALSE;
+    for (; *line != '\0'; line++) {
+        if (inword) {
+            inword = alphanum(*line);
+        } else if (alpha(*line)) {
+            if (subst_lead(*line))
+                return TRUE;
+            inword = TRUE; /* digits behind it are part of the word */
+        }
+    }
+    return FALSE;
+}
+
 static void
 substallpatterns(unsigned char* line, int buffersize)
 {
     unsigned char *start, *end;
     int prefixlen;
 
+    if (!substcandidate(line))
+        return;
+
     start = line;
     while (*start != '\0') {
         /* find the start of a prefix (skip all non-alphabetic characters),
@@ -1482,7 +2208,9 @@ substallpatterns(unsigned char* line, int buffersize)
         assert(prefixlen > 0);
 
         macro_t subst;
-        if (find_subst((const char*)start, prefixlen, &subst)) {
+        if (subst_maybe((const char*)start, prefixlen) &&
+            find_subst((const char*)start, prefixlen, &subst))
+        {
             /* properly match the pattern and substitute */
             if (!substpattern(start, buffersize - (int)(start - line), subst.first, subst.second))
                 start = end; /* match failed, skip this prefix */
@@ -1570,17 +2298,20 @@ preprocess(void)
 
     if (!freading)
         return;
+    timings_enter(CompilePhase::Preprocess);
     do {
         readline(pline);
-        stripcom(
-            pline); /* ??? no need for this when reading back from list file (in the second pass) */
+        if (!sLineReplayed) {
+            stripcom(pline);
+            cacheline(pline);
+        }
         lptr = pline; /* set "line pointer" to start of the parsing buffer */
         iscommand = command();
         if (iscommand != CMD_NONE)
             errorset(sRESET, 0); /* reset error flag ("panic mode") on empty line or directive */
         if (iscommand == CMD_NONE) {
             assert(lptr != term_expr);
-            substallpatterns(pline, sLINEMAX);
+            substline(pline);
             lptr = pline; /* reset "line pointer" to start of the parsing buffer */
         }
         if (sc_status == statFIRST && sc_listing && freading &&
@@ -1597,6 +2328,7 @@ preprocess(void)
                 pc_writeasm(outf, (char*)pline);
         }
     } while (iscommand != CMD_NONE && iscommand != CMD_TERM && freading); /* enddo */
+    timings_leave();
 }
 
 static const unsigned char*
@@ -1844,6 +2576,8 @@ lexinit()
     iflevel = 0;   /* preprocessor: nesting of "#if" is currently 0 */
     skiplevel = 0; /* preprocessor: not currently skipping */
     icomment = 0;  /* currently not in a multiline comment */
+    sInputAtom = NULL;
+    sInputAtomStack.clear();
     _lexnewline = FALSE;
     memset(&sNormalBuffer, 0, sizeof(sNormalBuffer));
     memset(&sPreprocessBuffer, 0, sizeof(sPreprocessBuffer));
@@ -1988,11 +2722,13 @@ lex(cell* lexvalue, char** lexsym)
         return current_token()->id;
     }
 
+    gCompileCounters.tokens++;
     full_token_t* tok = advance_token_ptr();
     tok->id = 0;
     tok->value = 0;
     tok->str[0] = '\0';
     tok->len = 0;
+    tok->atom = nullptr;
 
     *lexvalue = tok->value;
     *lexsym = tok->str;
@@ -2351,6 +3087,7 @@ lex_keyword(full_token_t* tok, const char* token_start)
         tok->id = tSYMBOL;
         strcpy(tok->str, get_token_string(tok_id).chars());
         tok->len = strlen(tok->str);
+        tok->atom = gAtoms.add(tok->str, tok->len);
     } else if (*lptr == ':' && (tok_id == tINT || tok_id == tVOID)) {
         // Special case 'int:' to its old behavior: an implicit view_as<> cast
         // with Pawn's awful lowercase coercion semantics.
@@ -2368,6 +3105,7 @@ lex_keyword(full_token_t* tok, const char* token_start)
         tok->id = tLABEL;
         strcpy(tok->str, token);
         tok->len = strlen(tok->str);
+        tok->atom = gAtoms.add(tok->str, tok->len);
     } else {
         tok->id = tok_id;
         errorset(sRESET, 0); /* reset error flag (clear the "panic mode")*/
@@ -2426,6 +3164,9 @@ lex_symbol(full_token_t* tok, const char* token_start)
         error(200, tok->str, sNAMEMAX);
     }
 
+    /* the name is interned once here, so that looking up the symbol does not
+     * need to hash the string again */
+    tok->atom = gAtoms.add(tok->str, tok->len);
     tok->id = tSYMBOL;
 
     if (*lptr == ':' && *(lptr + 1) != ':') {
@@ -2505,6 +3246,11 @@ const token_pos_t& current_pos()
     return current_token()->start;
 }
 
+sp::Atom* current_atom()
+{
+    return current_token()->atom;
+}
+
 /*  matchtoken
  *
  *  This routine is useful if only a simple check is needed. If the token
@@ -2856,6 +3602,8 @@ add_symbol(symbol* root, symbol* entry)
     root->next = entry;
     if (root == &glbtab)
         AddToHashTable(sp_Globals, entry);
+    else if (root == &loctab)
+        AddToScopeTable(sp_Locals, entry);
     return entry;
 }
 
@@ -2881,6 +3629,8 @@ delete_symbol(symbol* root, symbol* sym)
 
     if (origRoot == &glbtab)
         RemoveFromHashTable(sp_Globals, sym);
+    else if (origRoot == &loctab)
+        RemoveFromScopeTable(sp_Locals, sym);
 
     /* unlink it, then free it */
     root->next = sym->next;
@@ -2966,6 +3716,8 @@ delete_symbols(symbol* root, int level, int delete_functions)
         if (mustdelete) {
             if (origRoot == &glbtab)
                 RemoveFromHashTable(sp_Globals, sym);
+            else if (origRoot == &loctab)
+                RemoveFromScopeTable(sp_Locals, sym);
             root->next = sym->next;
             free_symbol(sym);
         } else {
@@ -2988,25 +3740,6 @@ delete_symbols(symbol* root, int level, int delete_functions)
     }
 }
 
-static symbol*
-find_symbol(const symbol* root, const char* name, int fnumber)
-{
-    symbol* sym = root->next;
-    sp::Atom* atom = gAtoms.add(name);
-    while (sym != NULL) {
-        if (atom == sym->nameAtom() &&
-            (sym->parent() == NULL ||
-             sym->ident ==
-                 iCONSTEXPR) /* sub-types (hierarchical types) are skipped, except for enum fields */
-            && (sym->fnumber < 0 || sym->fnumber == fnumber)) /* check file number for scope */
-        {
-            return sym; /* return first match */
-        }               /*  */
-        sym = sym->next;
-    }
-    return nullptr;
-}
-
 void
 markusage(symbol* sym, int usage)
 {
@@ -3032,6 +3765,12 @@ markusage(symbol* sym, int usage)
  */
 symbol*
 findglb(const char* name)
+{
+    return findglb(gAtoms.add(name));
+}
+
+symbol*
+findglb(sp::Atom* name)
 {
     return FindInHashTable(sp_Globals, name, fcurrent);
 }
@@ -3039,20 +3778,33 @@ findglb(const char* name)
 /*  findloc
  *
  *  Returns a pointer to the local symbol (if found) or NULL (if not found).
- *  See add_symbol() how the deepest nesting level is searched first.
+ *  If a name is declared in nested blocks, the deepest declaration is found
+ *  (see FindInScopeTable()).
  */
 symbol*
 findloc(const char* name)
 {
-    return find_symbol(&loctab, name, -1);
+    return findloc(gAtoms.add(name));
+}
+
+symbol*
+findloc(sp::Atom* name)
+{
+    return FindInScopeTable(sp_Locals, name);
 }
 
 symbol*
 findconst(const char* name)
+{
+    return findconst(gAtoms.add(name));
+}
+
+symbol*
+findconst(sp::Atom* name)
 {
     symbol* sym;
 
-    sym = find_symbol(&loctab, name, -1);          /* try local symbols first */
+    sym = FindInScopeTable(sp_Locals, name);       /* try local symbols first */
     if (sym == NULL || sym->ident != iCONSTEXPR) { /* not found, or not a constant */
         sym = FindInHashTable(sp_Globals, name, fcurrent);
     }
@@ -3219,6 +3971,7 @@ addsym(const char* name, cell addr, int ident, int vclass, int tag)
 {
     /* first fill in the entry */
     symbol* sym = new symbol(name, addr, ident, vclass, tag);
+    gCompileCounters.symbols++;
 
     /* then insert it in the list */
     if (vclass == sGLOBAL)
@@ -3335,6 +4088,7 @@ int
 lextok(token_t* tok)
 {
     tok->id = lex(&tok->val, &tok->str);
+    tok->atom = current_token()->atom;
     return tok->id;
 }
 
@@ -3346,6 +4100,7 @@ expecttoken(int id, token_t* tok)
         tok->val = current_token()->value;
         tok->id = current_token()->id;
         tok->str = current_token()->str;
+        tok->atom = current_token()->atom;
         return rval;
     }
     return FALSE;
@@ -3356,6 +4111,7 @@ matchtoken2(int id, token_t* tok)
 {
     if (matchtoken(id)) {
         tok->id = tokeninfo(&tok->val, &tok->str);
+        tok->atom = current_token()->atom;
         return TRUE;
     }
     return FALSE;
@@ -41,6 +41,7 @@ struct token_t {
     int id;
     cell val;
     char* str;
+    sp::Atom* atom; /* the interned name of a tSYMBOL or tLABEL */
 };
 
 struct token_ident_t {
@@ -53,6 +54,7 @@ struct full_token_t {
     int value;
     char str[sLINEMAX + 1];
     size_t len;
+    sp::Atom* atom;
     token_pos_t start;
     token_pos_t end;
 };
@@ -267,12 +269,18 @@ int plungefile(char* name, int try_currentpath,
                int try_includepaths); /* search through "include" paths */
 void preprocess(void);
 void lexinit(void);
+void delete_linecache(void);
+void keep_linecache(void);
+void check_linecache(void);
+bool load_precompiled(const char* filename);
+bool save_precompiled(const char* filename);
 int lex(cell* lexvalue, char** lexsym);
 int lextok(token_t* tok);
 int lexpeek(int id);
 void lexpush(void);
 void lexclr(int clreol);
 const token_pos_t& current_pos();
+sp::Atom* current_atom();
 int matchtoken(int token);
 int tokeninfo(cell* val, char** str);
 int needtoken(int token);
@@ -290,8 +298,11 @@ void delete_symbol(symbol* root, symbol* sym);
 void delete_symbols(symbol* root, int level, int delete_functions);
 void markusage(symbol* sym, int usage);
 symbol* findglb(const char* name);
+symbol* findglb(sp::Atom* name);
 symbol* findloc(const char* name);
+symbol* findloc(sp::Atom* name);
 symbol* findconst(const char* name);
+symbol* findconst(sp::Atom* name);
 symbol* find_enumstruct_field(Type* type, const char* name);
 symbol* addsym(const char* name, cell addr, int ident, int vclass, int tag);
 symbol* addvariable(const char* name, cell addr, int ident, int vclass, int tag, int dim[],
@@ -26,6 +26,7 @@
 #include "libpawnc.h"
 #include <assert.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -33,8 +34,12 @@
 #include "sc.h"
 
 #if defined __linux__ || defined __FreeBSD__ || defined __OpenBSD__ || defined DARWIN
+#    include <fcntl.h>
+#    include <sys/mman.h>
 #    include <sys/stat.h>
 #    include <sys/types.h>
+#    include <unistd.h>
+#    define SOURCE_MMAP
 #endif
 
 /* pc_printf()
@@ -63,6 +68,7 @@ typedef struct src_file_s {
     char* pos;        // IO position.
     char* end;        // End of buffer.
     size_t maxlength; // Maximum length of the writable buffer.
+    bool mapped;      // Set if the buffer is a read-only mapping of the file.
 } src_file_t;
 
 /* pc_opensrc()
@@ -84,15 +90,37 @@ pc_opensrc(char* filename)
     long length;
     src_file_t* src = NULL;
 
-#if defined __linux__ || defined __FreeBSD__ || defined __OpenBSD__ || defined DARWIN
+#if defined SOURCE_MMAP
+    /* map the file rather than reading it, the source is only ever read */
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1)
+        return NULL;
+
     struct stat fileInfo;
-    if (stat(filename, &fileInfo) != 0) {
+    if (fstat(fd, &fileInfo) != 0 || S_ISDIR(fileInfo.st_mode)) {
+        close(fd);
         return NULL;
     }
 
-    if (S_ISDIR(fileInfo.st_mode)) {
+    if ((src = (src_file_t*)calloc(1, sizeof(src_file_t))) == NULL) {
+        close(fd);
         return NULL;
     }
+    if (fileInfo.st_size > 0) {
+        void* base = mmap(NULL, fileInfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (base != MAP_FAILED) {
+            src->buffer = (char*)base;
+            src->pos = src->buffer;
+            src->end = src->buffer + fileInfo.st_size;
+            src->mapped = true;
+            close(fd);
+            return src;
+        }
+    }
+    close(fd);
+    free(src);
+    src = NULL;
+    /* empty files (and files that cannot be mapped) are read below */
 #endif
 
     if ((fp = fopen(filename, "rb")) == NULL)
@@ -170,10 +198,40 @@ pc_closesrc(void* handle)
         fwrite(src->buffer, src->pos - src->buffer, 1, src->fp);
         fclose(src->fp);
     }
-    free(src->buffer);
+#if defined SOURCE_MMAP
+    if (src->mapped)
+        munmap(src->buffer, src->end - src->buffer);
+    else
+#endif
+        free(src->buffer);
     free(src);
 }
 
+/* Returns the first '\n' or '\r' in the range, or "end" if there is none. The
+ * range is scanned a word at a time, since most lines are much longer than
+ * a word.
+ */
+static const char*
+find_line_end(const char* pos, const char* end)
+{
+    static const uint64_t kOnes = UINT64_C(0x0101010101010101);
+    static const uint64_t kHighs = UINT64_C(0x8080808080808080);
+
+    while (end - pos >= (ptrdiff_t)sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, pos, sizeof(word));
+        /* a byte in "lf" or "cr" is zero where the word holds that character */
+        uint64_t lf = word ^ (kOnes * '\n');
+        uint64_t cr = word ^ (kOnes * '\r');
+        if (((lf - kOnes) & ~lf & kHighs) | ((cr - kOnes) & ~cr & kHighs))
+            break;
+        pos += sizeof(uint64_t);
+    }
+    while (pos < end && *pos != '\n' && *pos != '\r')
+        pos++;
+    return pos;
+}
+
 /* pc_readsrc()
  * Reads a single line from the source file (or up to a maximum number of
  * characters if the line in the input file is too long).
@@ -190,23 +248,26 @@ pc_readsrc(void* handle, unsigned char* target, int maxchars)
     if (src->pos == src->end)
         return NULL;
 
-    while (outptr < outend && src->pos < src->end) {
-        char c = *src->pos++;
-        *outptr++ = c;
-
-        if (c == '\n')
-            break;
-        if (c == '\r') {
-            // Handle CRLF.
-            if (src->pos < src->end && *src->pos == '\n') {
-                src->pos++;
-                if (outptr < outend)
-                    *outptr++ = '\n';
-            } else {
-                // Replace with \n.
-                *(outptr - 1) = '\n';
-            }
-            break;
+    size_t avail = src->end - src->pos;
+    if (avail > (size_t)maxchars)
+        avail = maxchars;
+    const char* eol = find_line_end(src->pos, src->pos + avail);
+    size_t length = eol - src->pos;
+    if (eol < src->pos + avail)
+        length++; /* copy the line ending too */
+    memcpy(outptr, src->pos, length);
+    src->pos += length;
+    outptr += length;
+
+    if (length > 0 && *(outptr - 1) == '\r') {
+        // Handle CRLF.
+        if (src->pos < src->end && *src->pos == '\n') {
+            src->pos++;
+            if (outptr < outend)
+                *outptr++ = '\n';
+        } else {
+            // Replace with \n.
+            *(outptr - 1) = '\n';
         }
     }
 
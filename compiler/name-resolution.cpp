@@ -32,11 +32,11 @@ SymbolExpr::Bind()
 {
     AutoErrorPos aep(pos_);
 
-    sym_ = findconst(name_->chars());
+    sym_ = findconst(name_);
     if (!sym_)
-        sym_ = findloc(name_->chars());
+        sym_ = findloc(name_);
     if (!sym_)
-        sym_ = findglb(name_->chars());
+        sym_ = findglb(name_);
 
     if (!sym_) {
         // We assume this is a function that hasn't been seen yet. We should
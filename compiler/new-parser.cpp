@@ -24,6 +24,7 @@
 #include <assert.h>
 #include <string.h>
 
+#include "compile-timings.h"
 #include "emitter.h"
 #include "errors.h"
 #include "lexer.h"
@@ -42,12 +43,15 @@ int
 Parser::expression(value* lval)
 {
     Expr* expr = hier14();
+    timings_enter(CompilePhase::Semantics);
     if (!expr->Bind() || !expr->Analyze()) {
+        timings_leave();
         sideeffect = TRUE;
         *lval = value::ErrorValue();
         return FALSE;
     }
     expr->ProcessUses();
+    timings_leave();
 
     *lval = expr->val();
     if (cc_ok())
@@ -247,7 +251,7 @@ Parser::new_hier2()
             if (!needsymbol(&ident))
                 return new ErrorExpr();
 
-            Expr* target = new SymbolExpr(current_pos(), gAtoms.add(ident.name));
+            Expr* target = new SymbolExpr(current_pos(), ident.tok.atom);
 
             needtoken('(');
             return parse_call(pos, tok, target);
@@ -273,7 +277,7 @@ Parser::new_hier2()
                 return new ErrorExpr();
             while (parens--)
                 needtoken(')');
-            return new IsDefinedExpr(pos, gAtoms.add(ident.name));
+            return new IsDefinedExpr(pos, ident.tok.atom);
         }
         case tSIZEOF:
         {
@@ -297,7 +301,7 @@ Parser::new_hier2()
                 token_ident_t field_name;
                 if (!needsymbol(&field_name))
                     return new ErrorExpr();
-                field = gAtoms.add(field_name.name);
+                field = field_name.tok.atom;
             } else {
                 lexpush();
                 token = 0;
@@ -306,7 +310,7 @@ Parser::new_hier2()
             while (parens--)
                 needtoken(')');
 
-            Atom* name = gAtoms.add(ident.name);
+            Atom* name = ident.tok.atom;
             return new SizeofExpr(pos, name, field, token, array_levels);
         }
         default:
@@ -362,7 +366,7 @@ Parser::new_hier1()
             token_ident_t ident;
             if (!needsymbol(&ident))
                 break;
-            base = new FieldAccessExpr(pos, tok, base, gAtoms.add(ident.name));
+            base = new FieldAccessExpr(pos, tok, base, ident.tok.atom);
         } else if (tok == '[') {
             auto pos = current_pos();
             Expr* inner = hier14();
@@ -406,7 +410,7 @@ Parser::primary()
     if (tok == tTHIS)
         return new ThisExpr(current_pos());
     if (tok == tSYMBOL)
-        return new SymbolExpr(current_pos(), gAtoms.add(st));
+        return new SymbolExpr(current_pos(), current_atom());
 
     lexpush();
 
@@ -468,7 +472,7 @@ Parser::parse_call(const token_pos_t& pos, int tok, Expr* target)
                 break;
             needtoken('=');
 
-            name = gAtoms.add(ident.name);
+            name = ident.tok.atom;
         } else {
             if (named_params)
                 error(44);
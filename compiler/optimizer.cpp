@@ -6,23 +6,24 @@
  *  of redundant code, optimization by a tinkering process and reversing
  *  the ouput of evaluated expressions (which is used for the reversed
  *  evaluation of arguments in functions).
- *  Initially, stgwrite() writes to the file directly, but after a call to
+ *  Initially, stgwrite() writes to the output directly, but after a call to
  *  stgset(TRUE), output is redirected to the buffer. After a call to
- *  stgset(FALSE), stgwrite()'s output is directed to the file again. Thus
+ *  stgset(FALSE), stgwrite()'s output is directed to the output again. Thus
  *  only one routine is used for writing to the output, which can be
- *  buffered output or direct output.
+ *  buffered output or direct output. The buffer holds encoded instructions
+ *  (see asm-stream.h), not text.
  *
  *  staging buffer variables:   stgbuf  - the buffer
  *                              stgidx  - current index in the staging buffer
  *                              staging - if true, write to the staging buffer;
- *                                        if false, write to file directly.
+ *                                        if false, write to output directly.
  *
  * The peephole optimizer uses a dual "pipeline". The staging buffer (described
  * above) gets optimized for each expression or sub-expression in a function
  * call. The peephole optimizer is recursive, but it does not span multiple
  * sub-expressions. However, the data gets written to a second buffer that
  * behaves much like the staging buffer. This second buffer gathers all
- * optimized strings from the staging buffer for a complete expression. The
+ * optimized instructions from the staging buffer for a complete expression. The
  * peephole optmizer then runs over this second buffer to find optimzations
  * across function parameter boundaries.
  *
@@ -48,17 +49,19 @@
  *  Version: $Id$
  */
 #include <assert.h>
-#include <ctype.h>
 #include <stdio.h>
-#include <stdlib.h> /* for atoi() */
+#include <stdlib.h> /* for strtol() */
 #include <string.h>
 #if defined FORTIFY
 #    include <alloc/fortify.h>
 #endif
+#include "asm-stream.h"
+#include "compile-timings.h"
 #include "emitter.h"
 #include "errors.h"
 #include "lexer.h"
 #include "libpawnc.h"
+#include "optimizer.h"
 #include "sc.h"
 #include "scvars.h"
 
@@ -73,19 +76,32 @@
 #    pragma warning(pop)
 #endif
 
-static int stgstring(char* start, char* end);
-static void stgopt(char* start, char* end, int (*outputfunc)(char* str));
+static int stgstring(cell* start, cell* end);
+static void stgopt(cell* start, cell* end, void (*outputfunc)(const cell* record));
 
 #define sSTG_GROW 512
 #define sSTG_MAX 20480
 
-static char* stgbuf = NULL;
-static int stgmax = 0; /* current size of the staging buffer */
+static cell* stgbuf = NULL;
+static int stgmax = 0; /* current size of the staging buffer, in cells */
 
-static char* stgpipe = NULL;
+static cell* stgpipe = NULL;
 static int pipemax = 0; /* current size of the stage pipe, a second staging buffer */
 static int pipeidx = 0;
 
+/* Code that is not staged never passes through stgopt(), but it has runs of
+ * "stack" instructions where several scopes end at once (typically right
+ * before a "retn"). A "stack" only moves STK, so the last one written is held
+ * back and a directly following one is folded into it.
+ */
+static bool stack_held = false;
+static cell stack_held_delta;
+
+/* The instructions that stgopt() found no match at, in order. It is kept
+ * between calls so that its storage is reused, and emptied at every call.
+ */
+static ke::Vector<cell*> stgvisited;
+
 #define CHECK_STGBUFFER(index)  \
     if ((int)(index) >= stgmax) \
     grow_stgbuffer(&stgbuf, &stgmax, (index) + 1)
@@ -94,10 +110,9 @@ static int pipeidx = 0;
     grow_stgbuffer(&stgpipe, &pipemax, (index) + 1)
 
 static void
-grow_stgbuffer(char** buffer, int* curmax, int requiredsize)
+grow_stgbuffer(cell** buffer, int* curmax, int requiredsize)
 {
-    char* p;
-    int clear = (*buffer == NULL); /* if previously none, empty buffer explicitly */
+    cell* p;
 
     assert(*curmax < requiredsize);
     /* if the staging buffer (holding intermediate code for one line) grows
@@ -107,14 +122,12 @@ grow_stgbuffer(char** buffer, int* curmax, int requiredsize)
         error(FATAL_ERROR_OOM);
     *curmax = requiredsize + sSTG_GROW;
     if (*buffer != NULL)
-        p = (char*)realloc(*buffer, *curmax * sizeof(char));
+        p = (cell*)realloc(*buffer, *curmax * sizeof(cell));
     else
-        p = (char*)malloc(*curmax * sizeof(char));
+        p = (cell*)malloc(*curmax * sizeof(cell));
     if (p == NULL)
         error(FATAL_ERROR_OOM);
     *buffer = p;
-    if (clear)
-        **buffer = '\0';
 }
 
 void
@@ -131,6 +144,8 @@ stgbuffer_cleanup(void)
         pipemax = 0;
         pipeidx = 0;
     }
+    stack_held = false;
+    stgvisited.clear();
 }
 
 /* the variables "stgidx" and "staging" are declared in "scvars.c" */
@@ -154,87 +169,101 @@ stgbuffer_cleanup(void)
 void
 stgmark(char mark)
 {
-    if (staging) {
-        CHECK_STGBUFFER(stgidx);
-        stgbuf[stgidx++] = mark;
+    if (!staging)
+        return;
+    if (mark == sSTARTREORDER) {
+        stgwrite(AsmInsn(AsmOp::REORDER_START));
+    } else if (mark == sENDREORDER) {
+        stgwrite(AsmInsn(AsmOp::REORDER_END));
+    } else {
+        assert((mark & sEXPRSTART) == sEXPRSTART);
+        stgwrite(AsmInsn(AsmOp::EXPR_START, (unsigned char)mark - sEXPRSTART));
     }
 }
 
-static int
-rebuffer(char* str)
+static void
+rebuffer(const cell* record)
 {
     if (sc_status == statWRITE) {
-        if (pipeidx >= 2 && stgpipe[pipeidx - 1] == '\0' && stgpipe[pipeidx - 2] != '\n')
-            pipeidx -= 1;      /* overwrite last '\0' */
-        while (*str != '\0') { /* copy to staging buffer */
-            CHECK_STGPIPE(pipeidx);
-            stgpipe[pipeidx++] = *str++;
-        }
-        CHECK_STGPIPE(pipeidx);
-        stgpipe[pipeidx++] = '\0';
+        int size = AsmRecord(record).size();
+        CHECK_STGPIPE(pipeidx + size);
+        memcpy(stgpipe + pipeidx, record, size * sizeof(cell));
+        pipeidx += size;
     }
-    return TRUE;
 }
 
-static int
-filewrite(char* str)
+static void
+writerecord(const cell* record)
 {
-    if (sc_status == statWRITE)
-        return pc_writeasm(outf, str);
-    return TRUE;
+    if (sc_status != statWRITE)
+        return;
+    if (sc_asmfile) {
+        asm_render(record, outf);
+        return;
+    }
+    /* markers and comments are of no use to the assembler */
+    AsmFormat format = AsmRecord(record).info().format;
+    if (format != AsmFormat::Marker && format != AsmFormat::Listing)
+        gAsmProgram.append(record);
+}
+
+static void
+flushstack(void)
+{
+    if (stack_held) {
+        cell record[AsmInsn::kMaxSize];
+        AsmInsn(AsmOp::STACK, stack_held_delta).encode(record);
+        stack_held = false;
+        writerecord(record);
+    }
+}
+
+static void
+filewrite(const cell* record)
+{
+    flushstack();
+    writerecord(record);
 }
 
 /*  stgwrite
  *
- *  Writes the string "st" to the staging buffer or to the output file. In the
- *  case of writing to the staging buffer, the terminating byte of zero is
- *  copied too, but... the optimizer can only work on complete lines (not on
- *  fractions of it. Therefore if the string is staged, if the last character
- *  written to the buffer is a '\0' and the previous-to-last is not a '\n',
- *  the string is concatenated to the last string in the buffer (the '\0' is
- *  overwritten). This also means an '\n' used in the middle of a string isn't
- *  recognized and could give wrong results with the optimizer.
- *  Even when writing to the output file directly, all strings are buffered
- *  until a whole line is complete.
+ *  Writes an instruction to the staging buffer or to the output. The output
+ *  is the program that is handed to the assembler, or the assembler listing
+ *  if one was requested.
  *
  *  Global references: stgidx  (altered)
  *                     stgbuf  (altered)
  *                     staging (referred to only)
  */
 void
-stgwrite(const char* st)
+stgwrite(const AsmInsn& insn)
 {
-    int len;
-    int st_len = strlen(st);
-
     if (staging) {
-        assert(
-            stgidx == 0 ||
-            stgbuf !=
-                NULL); /* staging buffer must be valid if there is (apparently) something in it */
-        if (stgidx >= 2 && stgbuf[stgidx - 1] == '\0' && stgbuf[stgidx - 2] != '\n')
-            stgidx -= 1; /* overwrite last '\0' */
-
-        CHECK_STGBUFFER(stgidx + st_len + 1);
-        memcpy(stgbuf + stgidx, st, st_len + 1);
-        stgidx += st_len + 1;
-    } else {
-        len = (stgbuf != NULL) ? strlen(stgbuf) : 0;
-        CHECK_STGBUFFER(len + st_len + 1);
-        memcpy(stgbuf + len, st, st_len + 1);
-        len += st_len;
-        if (len > 0 && stgbuf[len - 1] == '\n') {
-            filewrite(stgbuf);
-            stgbuf[0] = '\0';
+        CHECK_STGBUFFER(stgidx + AsmInsn::kMaxSize);
+        stgidx += insn.encode(stgbuf + stgidx);
+    } else if (insn.op() == AsmOp::STACK && pc_optimize > sOPTIMIZE_NONE &&
+               sc_status == statWRITE)
+    {
+        if (stack_held) {
+            /* the caller adds the size of this instruction to code_idx */
+            stack_held_delta += insn.arg(0);
+            code_idx -= opcodes(1) + opargs(1);
+        } else {
+            stack_held = true;
+            stack_held_delta = insn.arg(0);
         }
+    } else {
+        cell record[AsmInsn::kMaxSize];
+        insn.encode(record);
+        filewrite(record);
     }
 }
 
 /*  stgout
  *
- *  Writes the staging buffer to the output file via stgstring() (for
- *  reversing expressions in the buffer) and stgopt() (for optimizing). It
- *  resets "stgidx".
+ *  Writes the staging buffer to the output via stgstring() (for reversing
+ *  expressions in the buffer) and stgopt() (for optimizing). It resets
+ *  "stgidx".
  *
  *  Global references: stgidx  (altered)
  *                     stgbuf  (referred to only)
@@ -249,6 +278,7 @@ stgout(int index)
     if (!staging)
         return;
     assert(pipeidx == 0);
+    timings_enter(CompilePhase::Optimize);
 
     /* first pass: sub-expressions */
     if (sc_status == statWRITE)
@@ -263,21 +293,22 @@ stgout(int index)
             /* there is no sense in re-optimizing if the order of the sub-expressions
              * did not change; so output directly
              */
-            for (idx = 0; idx < pipeidx; idx += strlen(stgpipe + idx) + 1)
+            for (idx = 0; idx < pipeidx; idx += AsmRecord(stgpipe + idx).size())
                 filewrite(stgpipe + idx);
         }
     }
     pipeidx = 0; /* reset second pipe */
+    timings_leave();
 }
 
 typedef struct {
-    char *start, *end;
+    cell *start, *end;
 } argstack;
 
 /*  stgstring
  *
- *  Analyses whether code strings should be output to the file as they appear
- *  in the staging buffer or whether portions of it should be re-ordered.
+ *  Analyses whether instructions should be output as they appear in the
+ *  staging buffer or whether portions of it should be re-ordered.
  *  Re-ordering takes place in function argument lists; Pawn passes arguments
  *  to functions from right to left. When arguments are "named" rather than
  *  positional, the order in the source stream is indeterminate.
@@ -287,8 +318,8 @@ typedef struct {
  *  In any case, stgstring() sends a block as large as possible to the
  *  optimizer stgopt().
  *
- *  In "reorder" mode, each set of code strings must start with the token
- *  sEXPRSTART, even the first. If the token sSTARTREORDER is represented
+ *  In "reorder" mode, each set of instructions must start with the mark
+ *  sEXPRSTART, even the first. If the mark sSTARTREORDER is represented
  *  by '[', sENDREORDER by ']' and sEXPRSTART by '|' the following applies:
  *     '[]...'     valid, but useless; no output
  *     '[|...]     valid, but useless; only one string
@@ -297,16 +328,16 @@ typedef struct {
  *     '[|...|]    invalid
  */
 static int
-stgstring(char* start, char* end)
+stgstring(cell* start, cell* end)
 {
-    char* ptr;
+    cell* ptr;
     int nest, argc, arg;
     argstack* stack;
     int reordered = 0;
 
     while (start < end) {
-        if (*start == sSTARTREORDER) {
-            start += 1; /* skip token */
+        if (AsmRecord(start).op() == AsmOp::REORDER_START) {
+            start += AsmRecord(start).size(); /* skip mark */
             /* allocate a argstack with SP_MAX_CALL_ARGUMENTS items */
             stack = (argstack*)malloc(SP_MAX_CALL_ARGUMENTS * sizeof(argstack));
             if (stack == NULL)
@@ -316,33 +347,31 @@ stgstring(char* start, char* end)
             argc = 0;       /* argument counter */
             arg = -1;       /* argument index; no valid argument yet */
             do {
-                switch (*start) {
-                    case sSTARTREORDER:
+                AsmRecord rec(start);
+                switch (rec.op()) {
+                    case AsmOp::REORDER_START:
                         nest++;
-                        start++;
                         break;
-                    case sENDREORDER:
+                    case AsmOp::REORDER_END:
                         nest--;
-                        start++;
                         break;
-                    default:
-                        if ((*start & sEXPRSTART) == sEXPRSTART) {
-                            if (nest == 1) {
-                                if (arg >= 0)
-                                    stack[arg].end = start - 1; /* finish previous argument */
-                                arg = (unsigned char)*start - sEXPRSTART;
-                                stack[arg].start = start + 1;
-                                if (arg >= argc)
-                                    argc = arg + 1;
-                            }
-                            start++;
-                        } else {
-                            start += strlen(start) + 1;
+                    case AsmOp::EXPR_START:
+                        if (nest == 1) {
+                            if (arg >= 0)
+                                stack[arg].end = start; /* finish previous argument */
+                            arg = rec.arg(0);
+                            stack[arg].start = (cell*)rec.next();
+                            if (arg >= argc)
+                                argc = arg + 1;
                         }
+                        break;
+                    default:
+                        break;
                 }
+                if (nest == 0 && arg >= 0)
+                    stack[arg].end = start; /* finish previous argument */
+                start += rec.size();
             } while (nest); /* enddo */
-            if (arg >= 0)
-                stack[arg].end = start - 1; /* finish previous argument */
             while (argc > 0) {
                 argc--;
                 stgstring(stack[argc].start, stack[argc].end);
@@ -350,8 +379,8 @@ stgstring(char* start, char* end)
             free(stack);
         } else {
             ptr = start;
-            while (ptr < end && *ptr != sSTARTREORDER)
-                ptr += strlen(ptr) + 1;
+            while (ptr < end && AsmRecord(ptr).op() != AsmOp::REORDER_START)
+                ptr += AsmRecord(ptr).size();
             stgopt(start, ptr, rebuffer);
             start = ptr;
         }
@@ -387,13 +416,11 @@ stgget(int* index, cell* code_index)
 
 /*  stgset
  *
- *  Sets staging on or off. If it's turned off, the staging buffer must be
- *  initialized to an empty string. If it's turned on, the routine makes sure
- *  the index ("stgidx") is set to 0 (it should already be 0).
+ *  Sets staging on or off. If it's turned on, the routine makes sure the
+ *  index ("stgidx") is set to 0 (it should already be 0).
  *
  *  Global references: staging  (altered)
  *                     stgidx   (altered)
- *                     stgbuf   (contents altered)
  */
 void
 stgset(int onoff)
@@ -402,26 +429,182 @@ stgset(int onoff)
     if (staging) {
         assert(stgidx == 0);
         stgidx = 0;
-        CHECK_STGBUFFER(stgidx);
-        /* write any contents that may be put in the buffer by stgwrite()
-         * when "staging" was 0
-         */
-        if (strlen(stgbuf) > 0)
-            filewrite(stgbuf);
     }
-    stgbuf[0] = '\0';
 }
 
-/* phopt_init
- * Initialize all sequence strings of the peehole optimizer. The strings
- * are embedded in the .EXE file in compressed format, here we expand
- * them (and allocate memory for the sequences).
+#define MAX_OPT_VARS 5
+#define MAX_OPT_CELLS 64 /* max. size of a sequence, in cells */
+
+/* The sequences of the peephole optimizer are written as text in patterns.h.
+ * phopt_init() compiles them once to instructions, so that matching does not
+ * need to look at names or parse numbers.
+ *
+ * Operands are a literal value or a variable ("%1"). A replacement may also
+ * negate a variable ("-%1") or add two of them ("%1+%2"). A sequence may
+ * have a "fold" function, which checks the values bound to the variables
+ * and may compute new values for the replacement.
+ */
+enum class PatternArgKind
+{
+    Literal,
+    Var,
+    NegVar,
+    Sum,
+};
+
+struct PatternArg {
+    PatternArgKind kind;
+    cell value;
+    int var;
+    int var2;
+};
+
+struct PatternInsn {
+    AsmOp op;
+    int nargs;
+    PatternArg args[MAX_OPT_VARS];
+};
+
+struct Pattern {
+    int find;      /* index of the first instruction in sPatternInsns */
+    int nfind;
+    int find_size; /* size of a match, in cells */
+    int replace;
+    int nreplace;
+    int savesize;
+    bool (*fold)(cell* symbols);
+};
+
+static ke::Vector<PatternInsn> sPatternInsns;
+static ke::Vector<Pattern> sPatterns;
+
+/* Patterns from this index on generate macro instructions. */
+static int sMacroPatterns;
+
+/* The longest sequence, in instructions. */
+static int sMaxFindCount;
+
+/* For every instruction, the patterns whose sequence starts with it, in the
+ * order of patterns.h.
  */
-static SEQUENCE* sequences = sequences_cmp;
+static ke::Vector<int> sPatternsByOp[size_t(AsmOp::TOTAL)];
 
+static bool
+compile_insn(const char** pattern, PatternInsn* insn)
+{
+    const char* ptr = *pattern;
+    const char* name = ptr;
+    while (*ptr != ' ' && *ptr != '!') {
+        assert(*ptr != '\0');
+        ptr++;
+    }
+    if (!asm_find_op(name, ptr - name, &insn->op))
+        return false;
+
+    insn->nargs = 0;
+    while (*ptr == ' ') {
+        ptr++;
+        assert(insn->nargs < MAX_OPT_VARS);
+        PatternArg& arg = insn->args[insn->nargs++];
+        int negate = (*ptr == '-');
+        if (negate)
+            ptr++;
+        if (*ptr == '%') {
+            arg.var = ptr[1] - '1';
+            assert(arg.var >= 0 && arg.var < MAX_OPT_VARS);
+            ptr += 2;
+            if (*ptr == '+') {
+                assert(!negate && ptr[1] == '%');
+                arg.kind = PatternArgKind::Sum;
+                arg.var2 = ptr[2] - '1';
+                assert(arg.var2 >= 0 && arg.var2 < MAX_OPT_VARS);
+                ptr += 3;
+            } else {
+                arg.kind = negate ? PatternArgKind::NegVar : PatternArgKind::Var;
+            }
+        } else {
+            char* endptr;
+            arg.kind = PatternArgKind::Literal;
+            arg.value = (cell)strtol(ptr, &endptr, 16);
+            if (negate)
+                arg.value = -arg.value;
+            ptr = endptr;
+        }
+    }
+    assert(*ptr == '!');
+    *pattern = ptr + 1;
+    return true;
+}
+
+/* Compiles a '!'-separated list of instructions. Returns false if it uses an
+ * instruction that the code generator does not know; such a sequence can
+ * never match.
+ */
+static bool
+compile_sequence(const char* text, int* first, int* count, int* size)
+{
+    *first = (int)sPatternInsns.length();
+    *count = 0;
+    *size = 0;
+    while (*text != '\0') {
+        PatternInsn insn;
+        if (!compile_insn(&text, &insn)) {
+            while ((int)sPatternInsns.length() > *first)
+                sPatternInsns.pop();
+            return false;
+        }
+        sPatternInsns.append(insn);
+        *count += 1;
+        *size += 1 + insn.nargs;
+    }
+    return true;
+}
+
+/* phopt_init
+ * Compile the sequences of the peephole optimizer. This happens only once,
+ * the compiled sequences are kept until the compiler exits.
+ */
 int
 phopt_init(void)
 {
+    if (sPatterns.length() > 0)
+        return TRUE;
+
+    sMacroPatterns = -1;
+    sMaxFindCount = 0;
+    for (const SEQUENCE* seq = sequences_cmp; seq->find != NULL; seq++) {
+        if (*seq->find == '\0') {
+            /* the separator before the macro instructions */
+            assert(sMacroPatterns < 0);
+            sMacroPatterns = (int)sPatterns.length();
+            continue;
+        }
+
+        Pattern pattern;
+        int replace_size;
+        pattern.savesize = seq->savesize;
+        pattern.fold = seq->fold;
+        if (!compile_sequence(seq->find, &pattern.find, &pattern.nfind, &pattern.find_size))
+            continue;
+        if (!compile_sequence(seq->replace, &pattern.replace, &pattern.nreplace, &replace_size)) {
+            assert(0);
+            continue;
+        }
+
+        /* The peephole optimizer must replace sequences with sequences that
+         * are not longer; the staging buffer is modified in place.
+         */
+        assert(pattern.nfind > 0);
+        assert(pattern.find_size <= MAX_OPT_CELLS);
+        assert(replace_size <= pattern.find_size);
+
+        AsmOp lead = sPatternInsns[pattern.find].op;
+        sPatternsByOp[size_t(lead)].append((int)sPatterns.length());
+        if (pattern.nfind > sMaxFindCount)
+            sMaxFindCount = pattern.nfind;
+        sPatterns.append(pattern);
+    }
+    assert(sMacroPatterns >= 0);
     return TRUE;
 }
 
@@ -431,255 +614,150 @@ phopt_cleanup(void)
     return FALSE;
 }
 
-#define MAX_OPT_VARS 5
-#define MAX_OPT_CAT 5 /* max. values that are concatenated */
-#if sNAMEMAX > (PAWN_CELL_SIZE / 4) * MAX_OPT_CAT
-#    define MAX_ALIAS sNAMEMAX
-#else
-#    define MAX_ALIAS (PAWN_CELL_SIZE / 4) * MAX_OPT_CAT
-#endif
-
 static int
-matchsequence(const char* start, const char* end, const char* pattern,
-              char symbols[MAX_OPT_VARS][MAX_ALIAS + 1], int* match_length)
+matchsequence(const cell* start, const cell* end, const Pattern& pattern,
+              cell symbols[MAX_OPT_VARS])
 {
-    int var, i;
-    char str[MAX_ALIAS + 1];
-    const char* start_org = start;
-    cell value;
-    char* ptr;
-
-    *match_length = 0;
-    for (var = 0; var < MAX_OPT_VARS; var++)
-        symbols[var][0] = '\0';
+    int bound[MAX_OPT_VARS] = {0};
 
-    while (*start == '\t' || *start == ' ')
-        start++;
-    while (*pattern) {
+    for (int i = 0; i < pattern.nfind; i++) {
         if (start >= end)
             return FALSE;
-        switch (*pattern) {
-            case '%': /* new "symbol" */
-                pattern++;
-                assert(isdigit(*pattern));
-                var = atoi(pattern) - 1;
-                assert(var >= 0 && var < MAX_OPT_VARS);
-                assert(*start == '-' || alphanum(*start));
-                for (i = 0; start < end && (*start == '-' || *start == '+' || alphanum(*start));
-                     i++, start++)
-                {
-                    assert(i <= MAX_ALIAS);
-                    str[i] = *start;
-                }
-                str[i] = '\0';
-                if (symbols[var][0] != '\0') {
-                    if (strcmp(symbols[var], str) != 0)
-                        return FALSE; /* symbols should be identical */
-                } else {
-                    strcpy(symbols[var], str);
-                }
-                break;
-            case '-':
-                value = -strtol(pattern + 1, (char**)&pattern, 16);
-                ptr = itoh((ucell)value);
-                while (*ptr != '\0') {
-                    if (tolower(*start) != tolower(*ptr))
-                        return FALSE;
-                    start++;
-                    ptr++;
-                }
-                pattern--; /* there is an increment following at the end of the loop */
-                break;
-            case ' ':
-                if (*start != '\t' && *start != ' ')
-                    return FALSE;
-                while (start < end && (*start == '\t' || *start == ' '))
-                    start++;
-                break;
-            case '!':
-                while (start < end && (*start == '\t' || *start == ' '))
-                    start++; /* skip trailing white space */
-                if (*start == ';')
-                    while (start < end && *start != '\n')
-                        start++; /* skip trailing comment */
-                if (*start != '\n')
-                    return FALSE;
-                assert(*(start + 1) == '\0');
-                start += 2; /* skip '\n' and '\0' */
-                if (*(pattern + 1) != '\0')
-                    while ((start < end && *start == '\t') || *start == ' ')
-                        start++; /* skip leading white space of next instruction */
-                break;
-            default:
-                if (tolower(*start) != tolower(*pattern))
+
+        AsmRecord rec(start);
+        const PatternInsn& insn = sPatternInsns[pattern.find + i];
+        if (rec.op() != insn.op || rec.nargs() != insn.nargs)
+            return FALSE;
+        for (int j = 0; j < insn.nargs; j++) {
+            const PatternArg& arg = insn.args[j];
+            cell value = rec.arg(j);
+            if (arg.kind == PatternArgKind::Literal) {
+                if (value != arg.value)
                     return FALSE;
-                start++;
+                continue;
+            }
+            assert(arg.kind == PatternArgKind::Var);
+            if (bound[arg.var]) {
+                if (symbols[arg.var] != value)
+                    return FALSE; /* symbols should be identical */
+            } else {
+                bound[arg.var] = TRUE;
+                symbols[arg.var] = value;
+            }
         }
-        pattern++;
+        start = rec.next();
     }
-
-    *match_length = (int)(start - start_org);
+    if (pattern.fold && !pattern.fold(symbols))
+        return FALSE;
     return TRUE;
 }
 
-static char*
-replacesequence(const char* pattern, char symbols[MAX_OPT_VARS][MAX_ALIAS + 1], int* repl_length)
+static int
+replacesequence(const Pattern& pattern, const cell symbols[MAX_OPT_VARS], cell* buffer)
 {
-    const char* lptr;
-    int var;
-    char* buffer;
-
-    /* calculate the length of the new buffer
-     * this is the length of the pattern plus the length of all symbols (note
-     * that the same symbol may occur multiple times in the pattern) plus
-     * line endings and startings ('\t' to start a line and '\n\0' to end one)
-     */
-    assert(repl_length != NULL);
-    *repl_length = 0;
-    lptr = pattern;
-    while (*lptr) {
-        switch (*lptr) {
-            case '%':
-                lptr++; /* skip '%' */
-                assert(isdigit(*lptr));
-                var = atoi(lptr) - 1;
-                assert(var >= 0 && var < MAX_OPT_VARS);
-                assert(symbols[var][0] != '\0'); /* variable should be defined */
-                *repl_length += strlen(symbols[var]);
-                break;
-            case '!':
-                *repl_length += 3; /* '\t', '\n' & '\0' */
-                break;
-            default:
-                *repl_length += 1;
-        }
-        lptr++;
-    }
-
-    /* allocate a buffer to replace the sequence in */
-    if ((buffer = (char*)malloc(*repl_length)) == NULL) {
-        error(103);
-        return NULL;
-    }
-
-    /* replace the pattern into this temporary buffer */
-    char* ptr = buffer;
-    *ptr++ = '\t'; /* the "replace" patterns do not have tabs */
-    while (*pattern) {
-        assert((int)(ptr - buffer) < *repl_length);
-        switch (*pattern) {
-            case '%':
-                /* write out the symbol */
-                pattern++;
-                assert(isdigit(*pattern));
-                var = atoi(pattern) - 1;
-                assert(var >= 0 && var < MAX_OPT_VARS);
-                assert(symbols[var][0] != '\0'); /* variable should be defined */
-                strcpy(ptr, symbols[var]);
-                ptr += strlen(symbols[var]);
-                break;
-            case '!':
-                /* finish the line, optionally start the next line with an indent */
-                *ptr++ = '\n';
-                *ptr++ = '\0';
-                if (*(pattern + 1) != '\0')
-                    *ptr++ = '\t';
-                break;
-            default:
-                *ptr++ = *pattern;
+    int length = 0;
+
+    for (int i = 0; i < pattern.nreplace; i++) {
+        const PatternInsn& insn = sPatternInsns[pattern.replace + i];
+        AsmInsn out(insn.op);
+        for (int j = 0; j < insn.nargs; j++) {
+            const PatternArg& arg = insn.args[j];
+            switch (arg.kind) {
+                case PatternArgKind::Literal:
+                    out.add(arg.value);
+                    break;
+                case PatternArgKind::Var:
+                    out.add(symbols[arg.var]);
+                    break;
+                case PatternArgKind::NegVar:
+                    out.add(-symbols[arg.var]);
+                    break;
+                case PatternArgKind::Sum:
+                    out.add(symbols[arg.var] + symbols[arg.var2]);
+                    break;
+            }
         }
-        pattern++;
+        length += out.encode(buffer + length);
     }
-
-    assert((int)(ptr - buffer) == *repl_length);
-    return buffer;
+    return length;
 }
 
-static void
-strreplace(char* dest, char* replace, int sub_length, int repl_length, int dest_length)
+/* Returns the first pattern (in the order of patterns.h) that matches at
+ * "start", or -1.
+ */
+static int
+findsequence(const cell* start, const cell* end, cell symbols[MAX_OPT_VARS])
 {
-    int offset = sub_length - repl_length;
-    if (offset > 0) { /* delete a section */
-        memmove(dest, dest + offset, dest_length - offset);
-        memset(dest + dest_length - offset, 0xcc, offset); /* not needed, but for cleanlyness */
-    } else if (offset < 0) {                               /* insert a section */
-        memmove(dest - offset, dest, dest_length);
+    const ke::Vector<int>& candidates = sPatternsByOp[size_t(AsmRecord(start).op())];
+    for (size_t i = 0; i < candidates.length(); i++) {
+        int seq = candidates[i];
+        if (seq >= sMacroPatterns && pc_optimize == sOPTIMIZE_NOMACRO)
+            break; /* don't look further */
+        if (matchsequence(start, end, sPatterns[seq], symbols))
+            return seq;
     }
-    memcpy(dest, replace, repl_length);
+    return -1;
 }
 
 /*  stgopt
  *
  *  Optimizes the staging buffer by checking for series of instructions that
- *  can be coded more compact. The routine expects the lines in the staging
- *  buffer to be separated with '\n' and '\0' characters.
+ *  can be coded more compact.
  *
- *  The longest sequences should probably be checked first.
+ *  Only the patterns that start with the instruction at the current position
+ *  are tried. After a replacement, matching is retried at the same position;
+ *  when the end of the buffer is reached, another pass is made if anything
+ *  changed. A new match can only start in the replaced code or in the
+ *  instructions just before it, so that pass starts at most the length of
+ *  the longest sequence (minus one) before the first replacement, instead
+ *  of at the start of the buffer.
  */
 
 static void
-stgopt(char* start, char* end, int (*outputfunc)(char* str))
+stgopt(cell* start, cell* end, void (*outputfunc)(const cell* record))
 {
-    char symbols[MAX_OPT_VARS][MAX_ALIAS + 1];
-    int seq, match_length, repl_length;
-    int matches;
-    char* debut = start; /* save original start of the buffer */
+    cell symbols[MAX_OPT_VARS];
+    cell replace[MAX_OPT_CELLS];
+    cell* debut = start; /* save original start of the buffer */
+    cell* rescan;
 
-    assert(sequences != NULL);
     /* do not match anything if debug-level is maximum */
     if (pc_optimize > sOPTIMIZE_NONE && sc_status == statWRITE) {
+        stgvisited.clear();
         do {
-            matches = 0;
-            start = debut;
+            /* the instructions before "start" did not change */
+            while (stgvisited.length() > 0 && stgvisited.back() >= start)
+                stgvisited.pop();
+            rescan = NULL;
             while (start < end) {
-                seq = 0;
-                while (sequences[seq].find != NULL) {
-                    assert(seq >= 0);
-                    if (*sequences[seq].find == '\0') {
-                        if (pc_optimize == sOPTIMIZE_NOMACRO) {
-                            break; /* don't look further */
-                        } else {
-                            seq++; /* continue with next string */
-                            continue;
-                        }
-                    }
-                    if (matchsequence(start, end, sequences[seq].find, symbols, &match_length)) {
-                        char* replace =
-                            replacesequence(sequences[seq].replace, symbols, &repl_length);
-                        /* If the replacement is bigger than the original section, we may need
-                         * to "grow" the staging buffer. This is quite complex, due to the
-                         * re-ordering of expressions that can also happen in the staging
-                         * buffer. In addition, it should not happen: the peephole optimizer
-                         * must replace sequences with *shorter* sequences, not longer ones.
-                         * So, I simply forbid sequences that are longer than the ones they
-                         * are meant to replace.
-                         */
-                        assert(match_length >= repl_length);
-                        if (match_length >= repl_length) {
-                            strreplace(start, replace, match_length, repl_length,
-                                       (int)(end - start));
-                            end -= match_length - repl_length;
-                            free(replace);
-                            code_idx -= sequences[seq].savesize;
-                            seq = 0; /* restart search for matches */
-                            matches++;
-                        } else {
-                            /* actually, we should never get here (match_length<repl_length) */
-                            assert(0);
-                            seq++;
-                        }
-                    } else {
-                        seq++;
-                    }
+                int seq = findsequence(start, end, symbols);
+                if (seq < 0) {
+                    stgvisited.append(start);
+                    start += AsmRecord(start).size(); /* to next instruction */
+                    continue;
                 }
-                assert(sequences[seq].find == NULL ||
-                       (*sequences[seq].find == '\0' && pc_optimize == sOPTIMIZE_NOMACRO));
-                start += strlen(start) + 1; /* to next string */
-            }                               /* while (start<end) */
-        } while (matches > 0);
+
+                gCompileCounters.peephole_matches++;
+                const Pattern& pattern = sPatterns[seq];
+                int repl_length = replacesequence(pattern, symbols, replace);
+                assert(pattern.find_size >= repl_length);
+                memmove(start + repl_length, start + pattern.find_size,
+                        (end - start - pattern.find_size) * sizeof(cell));
+                memcpy(start, replace, repl_length * sizeof(cell));
+                end -= pattern.find_size - repl_length;
+                code_idx -= pattern.savesize;
+
+                if (rescan == NULL) {
+                    size_t back = sMaxFindCount - 1;
+                    rescan = (stgvisited.length() > back) ? stgvisited[stgvisited.length() - back]
+                                                          : debut;
+                }
+            }
+            start = rescan;
+        } while (rescan != NULL);
     } /* if (pc_optimize>sOPTIMIZE_NONE && sc_status==statWRITE) */
 
-    for (start = debut; start < end; start += strlen(start) + 1)
+    for (start = debut; start < end; start += AsmRecord(start).size())
         outputfunc(start);
 }
 
@@ -20,10 +20,11 @@
 #pragma once
 
 #include "amx.h"
+#include "asm-stream.h"
 
 void stgbuffer_cleanup(void);
 void stgmark(char mark);
-void stgwrite(const char* st);
+void stgwrite(const AsmInsn& insn);
 void stgout(int index);
 void stgdel(int index, cell code_index);
 int stgget(int* index, cell* code_index);
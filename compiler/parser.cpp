@@ -82,6 +82,7 @@ static unsigned total_drives; /* dummy variable */
 #endif
 
 #include "assembler.h"
+#include "compile-timings.h"
 #include "emitter.h"
 #include "errors.h"
 #include "expressions.h"
@@ -89,6 +90,7 @@ static unsigned total_drives; /* dummy variable */
 #include "libpawnc.h"
 #include "lstring.h"
 #include "optimizer.h"
+#include "pool-allocator.h"
 #include "sc.h"
 #include "sci18n.h"
 #include "sclist.h"
@@ -117,7 +119,7 @@ sp::StringPool gAtoms;
 static void resetglobals(void);
 static void initglobals(void);
 static char* get_extension(char* filename);
-static void setopt(int argc, char** argv, char* oname, char* ename, char* pname);
+static bool setopt(int argc, char** argv, char* oname, char* ename, char* pname);
 static void setconfig(char* root);
 static void setcaption(void);
 static void setconstants(void);
@@ -174,7 +176,7 @@ static void docont(void);
 static void addwhile(int* ptr);
 static void delwhile(void);
 static int* readwhile(void);
-static void inst_datetime_defines(void);
+static void inst_datetime_defines(time_t td);
 static void inst_binary_name(char* binfname);
 static int operatorname(char* name);
 static int parse_new_typename(const token_t* tok);
@@ -207,6 +209,7 @@ static int wq[wqTABSZ];               /* "while queue", internal stack for neste
 static int* wqptr;                    /* pointer to next entry */
 static char* sc_documentation = NULL; /* main documentation */
 static int sReturnType = RETURN_NONE;
+static int unknown_methodmap_num = 0; /* for the names of methodmaps without one */
 #if defined __WIN32__ || defined _WIN32 || defined _Windows
 static HWND hwndFinish = 0;
 #endif
@@ -228,14 +231,19 @@ pc_compile(int argc, char* argv[]) {
 
     int entry, jmpcode;
     int retcode;
+    int jobfiles = 0;
     char incfname[_MAX_PATH];
     void* inpfmark;
+    time_t compiletime;
     int lcl_packstr, lcl_needsemicolon, lcl_tabsize, lcl_require_newdecls;
     char* ptr;
+    /* the parse nodes of this compilation are released when it returns */
+    PoolScope pool_scope;
 
     /* set global variables to their initial value */
     initglobals();
-    errorset(sRESET, 0);
+    timings_reset();
+    reset_errors();
     errorset(sEXPRRELEASE, 0);
     lexinit();
 
@@ -247,6 +255,9 @@ pc_compile(int argc, char* argv[]) {
     sp_Globals = NewHashTable();
     if (!sp_Globals)
         error(FATAL_ERROR_OOM);
+    sp_Locals = NewScopeTable();
+    if (!sp_Locals)
+        error(FATAL_ERROR_OOM);
 
     /* allocate memory for fixed tables */
     inpfname = (char*)malloc(_MAX_PATH);
@@ -258,7 +269,19 @@ pc_compile(int argc, char* argv[]) {
     if (!phopt_init())
         error(FATAL_ERROR_OOM); /* insufficient memory */
 
-    setopt(argc, argv, outfname, errfname, incfname);
+    if (!setopt(argc, argv, outfname, errfname, incfname)) {
+        norun = 1; /* nothing was compiled, exit with 1 as for a fatal error */
+        jmpcode = 1;
+        goto cleanup;
+    }
+    if (sc_jobs > 0 && sc_jobfile < 0 && get_sourcefile(1) != NULL) {
+        /* the files are compiled on their own, after the cleanup below */
+        for (jobfiles = 0; get_sourcefile(jobfiles) != NULL; jobfiles++)
+            /* nothing */;
+        norun = 1;
+        jmpcode = 1;
+        goto cleanup;
+    }
     strcpy(binfname, outfname);
     ptr = get_extension(binfname);
     if (ptr != NULL && stricmp(ptr, ".asm") == 0)
@@ -353,15 +376,22 @@ pc_compile(int argc, char* argv[]) {
         pc_writeasm(outf, string);
         setfiledirect(inpfname);
     }
+    /* replay the include files kept from the compilation before, or from the
+     * precompiled header, if they are current */
+    if (sc_keepincludes)
+        check_linecache();
+    if (strlen(pchfname) > 0)
+        load_precompiled(pchfname);
     /* do the first pass through the file (or possibly two or more "first passes") */
     sc_parsenum = 0;
     inpfmark = pc_getpossrc(inpf_org);
+    time(&compiletime); /* the same __DATE__ and __TIME__ in every pass */
     do {
         /* reset "defined" flag of all functions and global variables */
         reduce_referrers(&glbtab);
         delete_symbols(&glbtab, 0, FALSE);
         delete_substtable();
-        inst_datetime_defines();
+        inst_datetime_defines(compiletime);
         inst_binary_name(binfname);
         resetglobals();
         gTypes.clearExtendedTypes();
@@ -390,8 +420,10 @@ pc_compile(int argc, char* argv[]) {
                 error(FATAL_ERROR_READ, incfname);
             }
         }
+        timings_enter(CompilePhase::Parse, sc_parsenum + 1);
         preprocess(); /* fetch first line */
         parse();      /* process all input */
+        timings_leave();
         sc_parsenum++;
     } while (sc_reparse);
 
@@ -417,7 +449,7 @@ pc_compile(int argc, char* argv[]) {
     methodmaps_free();
     pstructs_free();
     delete_substtable();
-    inst_datetime_defines();
+    inst_datetime_defines(compiletime);
     inst_binary_name(binfname);
     resetglobals();
     sc_ctrlchar = sc_ctrlchar_org;
@@ -438,10 +470,12 @@ pc_compile(int argc, char* argv[]) {
     if (strlen(incfname) > 0) {
         plungefile(incfname, FALSE, TRUE); /* parse "default.inc" (again) */
     }
+    timings_enter(CompilePhase::Parse);
     preprocess(); /* fetch first line */
     parse();      /* process all input */
     /* inpf is already closed when readline() attempts to pop of a file */
     writetrailer(); /* write remaining stuff */
+    timings_leave();
 
     entry = testsymbols(&glbtab, 0, TRUE, FALSE); /* test for unused or undefined
                                                    * functions and variables */
@@ -454,19 +488,23 @@ cleanup:
         pc_closesrc(inpf);
         inpf = nullptr;
     }
+    /* nor are the files that include the file with a fatal error */
+    for (void* fp : gInputFileStack)
+        pc_closesrc(fp);
 
     // Write the binary file.
-    if (!(sc_asmfile || sc_listing) && errnum == 0 && jmpcode == 0) {
-        pc_resetasm(outf);
-        assemble(binfname, outf);
-    }
+    if (!(sc_asmfile || sc_listing) && errnum == 0 && jmpcode == 0)
+        assemble(binfname);
 
     if (outf != NULL) {
         pc_closeasm(outf, !(sc_asmfile || sc_listing));
         outf = NULL;
     }
 
-    if (errnum == 0 && strlen(errfname) == 0) {
+    if (jobfiles == 0)
+        timings_report(timingsfname);
+
+    if (errnum == 0 && strlen(errfname) == 0 && jobfiles == 0) {
         if ((!norun && (sc_debug & sSYMBOLIC) != 0) || verbosity >= 2) {
             pc_printf("Code size:         %8ld bytes\n", (long)code_idx);
             pc_printf("Data size:         %8ld bytes\n", (long)glb_declared * sizeof(cell));
@@ -479,6 +517,7 @@ cleanup:
 
     if (g_tmpfile[0] != '\0') {
         remove(g_tmpfile);
+        g_tmpfile[0] = '\0';
     }
     if (inpfname != NULL) {
         free(inpfname);
@@ -487,6 +526,7 @@ cleanup:
         free(litq);
     phopt_cleanup();
     stgbuffer_cleanup();
+    asm_stream_cleanup();
 
     gCurrentFileStack.clear();
     gCurrentLineStack.clear();
@@ -499,6 +539,8 @@ cleanup:
                                                   * done (i.e. on a fatal error) */
     delete_symbols(&glbtab, 0, TRUE);
     DestroyHashTable(sp_Globals);
+    DestroyScopeTable(sp_Locals);
+    sp_Locals = NULL;
     delete_consttable(&libname_tab);
     delete_aliastable();
     delete_pathtable();
@@ -509,11 +551,21 @@ cleanup:
     funcenums_free();
     methodmaps_free();
     pstructs_free();
-    delete_substtable();
+    if (jmpcode == 0 && strlen(pchfname) > 0)
+        save_precompiled(pchfname);
+    if (sc_keepincludes) {
+        keep_linecache();
+        delete_substtable();
+    } else {
+        delete_substhistory();
+        delete_linecache();
+    }
     if (sc_documentation != NULL)
         free(sc_documentation);
     delete_autolisttable();
-    if (errnum != 0) {
+    if (jobfiles > 0) {
+        retcode = pc_compile_jobs(argc, argv, jobfiles);
+    } else if (errnum != 0) {
         if (strlen(errfname) == 0)
             pc_printf("\n%d Error%s.\n", errnum, (errnum > 1) ? "s" : "");
         retcode = 1;
@@ -570,18 +622,16 @@ inst_binary_name(char* binfname) {
     snprintf(newpath, sizeof(newpath), "\"%s\"", binfname);
     snprintf(newname, sizeof(newname), "\"%s\"", binptr);
 
-    insert_subst("__BINARY_PATH__", 15, newpath);
-    insert_subst("__BINARY_NAME__", 15, newname);
+    insert_compilation_subst("__BINARY_PATH__", 15, newpath);
+    insert_compilation_subst("__BINARY_NAME__", 15, newname);
 }
 
 static void
-inst_datetime_defines(void) {
+inst_datetime_defines(time_t td) {
     char date[64];
     char ltime[64];
-    time_t td;
     struct tm* curtime;
 
-    time(&td);
     curtime = localtime(&td);
 
 #if defined __EMSCRIPTEN__
@@ -594,8 +644,8 @@ inst_datetime_defines(void) {
     strftime(ltime, 31, "\"%H:%M:%S\"", curtime);
 #endif
 
-    insert_subst("__DATE__", 8, date);
-    insert_subst("__TIME__", 8, ltime);
+    insert_compilation_subst("__DATE__", 8, date);
+    insert_compilation_subst("__TIME__", 8, ltime);
 }
 
 const char*
@@ -666,10 +716,13 @@ initglobals(void) {
     resetglobals();
 
     sc_asmfile = FALSE;                /* do not create .ASM file */
+    sc_timings = false;                /* do not report the time per phase */
     sc_listing = FALSE;                /* do not create .LST file */
     sc_ctrlchar = CTRL_CHAR;           /* the escape character */
     litmax = sDEF_LITMAX;              /* current size of the literal table */
     errnum = 0;                        /* number of errors */
+    sc_total_errors = 0;               /* number of errors, see cc_ok() */
+    sc_err_status = FALSE;             /* report errors in the first passes too? */
     warnnum = 0;                       /* number of warnings */
     verbosity = 1;                     /* verbosity level, no copyright banner */
     sc_debug = sCHKBOUNDS | sSYMBOLIC; /* sourcemod: full debug stuff */
@@ -684,6 +737,8 @@ initglobals(void) {
 
     outfname[0] = '\0';      /* output file name */
     errfname[0] = '\0';      /* error file name */
+    pchfname[0] = '\0';      /* precompiled header file name */
+    timingsfname[0] = '\0';  /* file name for the timings as JSON */
     inpf = NULL;             /* file read from */
     inpfname = NULL;         /* pointer to name of the file currently read from */
     outf = NULL;             /* file written to */
@@ -698,6 +753,10 @@ initglobals(void) {
 
     wqptr = wq; /* initialize while queue pointer */
     sc_documentation = NULL;
+    norun = 0;
+    unknown_methodmap_num = 0;
+    pc_code_version = 0;
+    pc_must_drop_stack = true;
 }
 
 static char*
@@ -731,52 +790,66 @@ set_extension(char* filename, const char* extension, int force) {
         strcat(filename, extension);
 }
 
-args::ToggleOption opt_assembly("-a", "--assembly-only", Some(false), "Output assembler code");
-args::StringOption opt_active_dir("-D", "--active-dir", {}, "Active directory path");
-args::StringOption opt_error_file("-e", "--error-file", {}, "Error file path");
-#if defined __WIN32__ || defined _WIN32 || defined _Windows
-args::StringOption opt_hwnd("-H", "--hwnd", {},
-                            "Window handle to send a notification message on finish");
-#endif
-args::ToggleOption opt_warnings_as_errors("-E", "--warnings-as-errors", Some(false),
-                                          "Treat warnings as errors");
-args::ToggleOption opt_showincludes("-h", "--show-includes", Some(false),
-                                    "Show included file paths");
-args::ToggleOption opt_listing("-l", "--listing", Some(false),
-                               "Create list file (preprocess only)");
-args::IntOption opt_compression("-z", "--compress-level", Some(9),
-                                "Compression level, default 9 (0=none, 1=worst, 9=best)");
-args::IntOption opt_tabsize("-t", "--tabsize", Some(8),
-                            "TAB indent size (in character positions, default=8)");
-args::StringOption opt_verbosity("-v", "--verbose", {},
-                                 "Verbosity level; 0=quiet, 1=normal, 2=verbose");
-args::IntOption opt_codeversion("-x", "--code-version", {},
-                                 "Code version level (testing only)");
-args::StringOption opt_prefixfile("-p", "--prefix", {}, "Set name of \"prefix\" file");
-args::StringOption opt_outputfile("-o", "--output", {},
-                                  "Set base name of (P-code) output file");
-args::IntOption opt_optlevel("-O", "--opt-level", Some(2),
-                             "Optimization level (0=none, 2=full)");
-args::RepeatOption<AString> opt_includes("-i", "--include", "Path for include files");
-args::RepeatOption<AString> opt_warnings("-w", "--warning",
-                                         "Disable a specific warning by its number.");
-args::ToggleOption opt_semicolons("-;", "--require-semicolons", Some(false),
-                                  "Require a semicolon to end each statement.");
-
-static void
+static bool
 Usage(args::Parser& parser, int argc, char** argv)
 {
     if (strlen(errfname) == 0) {
         setcaption();
         parser.usage(stdout, argc, argv);
     }
-    exit(1);
+    return false;
 }
 
-static void
+/* The options are local, so that every call to pc_compile() starts from the
+ * defaults. Errors return false instead of exiting, since the compiler may be
+ * serving more than one compilation (see compile-server.cpp).
+ */
+static bool
 parseoptions(int argc, char** argv, char* oname, char* ename, char* pname)
 {
     args::Parser parser;
+    args::ToggleOption opt_assembly(parser, "-a", "--assembly-only", Some(false),
+                                    "Output assembler code");
+    args::StringOption opt_active_dir(parser, "-D", "--active-dir", {}, "Active directory path");
+    args::StringOption opt_error_file(parser, "-e", "--error-file", {}, "Error file path");
+    args::StringOption opt_precompiled(parser, "-P", "--precompiled-header", {},
+                                       "Precompiled header path for the preprocessed include "
+                                       "files (created if missing or stale)");
+#if defined __WIN32__ || defined _WIN32 || defined _Windows
+    args::StringOption opt_hwnd(parser, "-H", "--hwnd", {},
+                                "Window handle to send a notification message on finish");
+#endif
+    args::ToggleOption opt_warnings_as_errors(parser, "-E", "--warnings-as-errors", Some(false),
+                                              "Treat warnings as errors");
+    args::ToggleOption opt_showincludes(parser, "-h", "--show-includes", Some(false),
+                                        "Show included file paths");
+    args::ToggleOption opt_listing(parser, "-l", "--listing", Some(false),
+                                   "Create list file (preprocess only)");
+    args::IntOption opt_compression(parser, "-z", "--compress-level", Some(9),
+                                    "Compression level, default 9 (0=none, 1=worst, 9=best)");
+    args::IntOption opt_tabsize(parser, "-t", "--tabsize", Some(8),
+                                "TAB indent size (in character positions, default=8)");
+    args::StringOption opt_verbosity(parser, "-v", "--verbose", {},
+                                     "Verbosity level; 0=quiet, 1=normal, 2=verbose");
+    args::IntOption opt_codeversion(parser, "-x", "--code-version", {},
+                                    "Code version level (testing only)");
+    args::StringOption opt_prefixfile(parser, "-p", "--prefix", {}, "Set name of \"prefix\" file");
+    args::StringOption opt_outputfile(parser, "-o", "--output", {},
+                                      "Set base name of (P-code) output file");
+    args::IntOption opt_optlevel(parser, "-O", "--opt-level", Some(2),
+                                 "Optimization level (0=none, 2=full)");
+    args::RepeatOption<AString> opt_includes(parser, "-i", "--include", "Path for include files");
+    args::RepeatOption<AString> opt_warnings(parser, "-w", "--warning",
+                                             "Disable a specific warning by its number.");
+    args::ToggleOption opt_semicolons(parser, "-;", "--require-semicolons", Some(false),
+                                      "Require a semicolon to end each statement.");
+    args::IntOption opt_jobs(parser, "-j", "--jobs", Some(0),
+                             "Compile each file on its own, this many at once");
+    args::ToggleOption opt_timings(parser, nullptr, "--timings", Some(false),
+                                   "Report the time and memory spent in each phase");
+    args::StringOption opt_timings_json(parser, nullptr, "--timings-json", {},
+                                        "Also write the timings as JSON to this file");
+
     parser.enable_inline_values();
     parser.collect_extra_args();
 #if DIRSEP_CHAR != '/'
@@ -789,9 +862,8 @@ parseoptions(int argc, char** argv, char* oname, char* ename, char* pname)
     auto usage = "[options] <filename> [filename...]";
     parser.set_usage_line(usage);
 
-    if (!parser.parse(argc, argv)) {
-        Usage(parser, argc, argv);
-    }
+    if (!parser.parse(argc, argv))
+        return Usage(parser, argc, argv);
 
     sc_warnings_are_errors = opt_warnings_as_errors.value();
     sc_showincludes = opt_showincludes.value();
@@ -799,6 +871,8 @@ parseoptions(int argc, char** argv, char* oname, char* ename, char* pname)
     sc_compression_level = opt_compression.value();
     sc_tabsize = opt_tabsize.value();
     sc_needsemicolon = opt_semicolons.value();
+    sc_jobs = opt_jobs.value();
+    sc_timings = opt_timings.value() || opt_timings_json.hasValue();
 
     if (opt_codeversion.hasValue()) {
         switch (opt_codeversion.value()) {
@@ -811,7 +885,7 @@ parseoptions(int argc, char** argv, char* oname, char* ename, char* pname)
                 break;
             default:
                 fprintf(stderr, "unknown code version: %d\n", opt_codeversion.value());
-                exit(1);
+                return false;
         }
     }
 
@@ -819,7 +893,7 @@ parseoptions(int argc, char** argv, char* oname, char* ename, char* pname)
     if (pc_optimize < sOPTIMIZE_NONE || pc_optimize >= sOPTIMIZE_NUMBER ||
         pc_optimize == sOPTIMIZE_NOMACRO)
     {
-        Usage(parser, argc, argv);
+        return Usage(parser, argc, argv);
     }
 
     if (opt_prefixfile.hasValue())
@@ -838,7 +912,8 @@ parseoptions(int argc, char** argv, char* oname, char* ename, char* pname)
     if (sc_asmfile && verbosity > 1)
         verbosity = 1;
 
-    if (opt_active_dir.hasValue()) {
+    /* the process that started the job has changed directory already */
+    if (opt_active_dir.hasValue() && sc_jobfile < 0) {
         const char* ptr = opt_active_dir.value().chars();
 #if defined dos_setdrive
         if (ptr[1] == ':')
@@ -846,12 +921,16 @@ parseoptions(int argc, char** argv, char* oname, char* ename, char* pname)
 #endif
             if (chdir(ptr)) {
                 fprintf(stderr, "chdir failed: %s\n", strerror(errno));
-                exit(1);
+                return false;
             }
     }
 
     if (opt_error_file.hasValue())
         strlcpy(ename, opt_error_file.value().chars(), _MAX_PATH);
+    if (opt_precompiled.hasValue())
+        strlcpy(pchfname, opt_precompiled.value().chars(), _MAX_PATH);
+    if (opt_timings_json.hasValue())
+        strlcpy(timingsfname, opt_timings_json.value().chars(), _MAX_PATH);
 
 #if defined __WIN32__ || defined _WIN32 || defined _Windows
     if (opt_hwnd.hasValue()) {
@@ -886,13 +965,14 @@ parseoptions(int argc, char** argv, char* oname, char* ename, char* pname)
             pc_enablewarning(i, 2);
     }
 
+    int files = 0;
     for (const auto& option : parser.extra_args()) {
         char str[_MAX_PATH];
         const char* ptr = nullptr;
         const char* arg = option.chars();
         if (arg[0] == '@') {
             fprintf(stderr, "Response files (@ prefix) are no longer supported.");
-            exit(1);
+            return false;
         } else if ((ptr = strchr(arg, '=')) != NULL) {
             int i = (int)(ptr - arg);
             if (i > sNAMEMAX) {
@@ -902,6 +982,8 @@ parseoptions(int argc, char** argv, char* oname, char* ename, char* pname)
             strlcpy(str, arg, i + 1); /* str holds symbol name */
             i = atoi(ptr + 1);
             add_constant(str, i, sGLOBAL, 0);
+        } else if (sc_jobfile >= 0 && files++ != sc_jobfile) {
+            /* a job of "-j" compiles only one of the files */
         } else {
             strlcpy(str, arg, sizeof(str) - 5); /* -5 because default extension is ".sp" */
             set_extension(str, ".sp", FALSE);
@@ -922,10 +1004,20 @@ parseoptions(int argc, char** argv, char* oname, char* ename, char* pname)
     }
 
     if (get_sourcefile(0) == NULL)
-        Usage(parser, argc, argv);
+        return Usage(parser, argc, argv);
+    if (sc_jobs > 0 && get_sourcefile(1) != NULL &&
+        (opt_outputfile.hasValue() || opt_error_file.hasValue() ||
+         opt_timings_json.hasValue()))
+    {
+        /* every file has an output file of its own */
+        fprintf(stderr,
+                "-o, -e and --timings-json cannot be used with -j and more than one file\n");
+        return false;
+    }
+    return true;
 }
 
-static void
+static bool
 setopt(int argc, char** argv, char* oname, char* ename, char* pname) {
     delete_sourcefiletable(); /* make sure it is empty */
     *oname = '\0';
@@ -933,7 +1025,7 @@ setopt(int argc, char** argv, char* oname, char* ename, char* pname) {
     *pname = '\0';
     strcpy(pname, sDEF_PREFIX);
 
-    parseoptions(argc, argv, oname, ename, pname);
+    return parseoptions(argc, argv, oname, ename, pname);
 }
 
 #if defined __BORLANDC__ || defined __WATCOMC__
@@ -1199,7 +1291,7 @@ parse(void) {
  */
 static void
 dumplits(void) {
-    int j, k;
+    int k;
 
     if (sc_status == statSKIP)
         return;
@@ -1208,20 +1300,11 @@ dumplits(void) {
     while (k < litidx) {
         /* should be in the data segment */
         assert(curseg == 2);
-        defstorage();
-        j = 16; /* 16 values per line */
-        while (j && k < litidx) {
-            outval(litq[k], FALSE);
-            stgwrite(" ");
-            k++;
-            j--;
-            if (j == 0 || k >= litidx)
-                stgwrite("\n"); /* force a newline after 10 dumps */
-            /* Note: stgwrite() buffers a line until it is complete. It recognizes
-             * the end of line as a sequence of "\n\0", so something like "\n\t"
-             * so should not be passed to stgwrite().
-             */
-        }
+        int count = litidx - k;
+        if (count > 16)
+            count = 16; /* 16 values per line */
+        defstorage(&litq[k], count);
+        k += count;
     }
 }
 
@@ -1235,10 +1318,7 @@ dumpzero(int count) {
         return;
     assert(curseg == 2);
 
-    stgwrite("dumpfill ");
-    outval(0, FALSE);
-    stgwrite(" ");
-    outval(count, TRUE);
+    stgwrite(AsmInsn(AsmOp::DUMPFILL, 0, count));
 }
 
 /* declstruct - declare global struct symbols
@@ -3544,7 +3624,6 @@ domethodmap(LayoutSpec spec) {
     if (needsymbol(&ident)) {
         strcpy(mapname, ident.name);
     } else {
-        static int unknown_methodmap_num = 0;
         ke::SafeSprintf(mapname, sizeof(mapname), "methodmap_%d", ++unknown_methodmap_num);
     }
 
@@ -5979,7 +6058,6 @@ doswitch(void) {
     char* str;
     constvalue caselist = {NULL, "", 0, 0}; /* case list starts empty */
     constvalue *cse, *csp;
-    char labelname[sNAMEMAX + 1];
     bool all_cases_return = true;
     int switch_tag, case_tag;
 
@@ -6031,16 +6109,9 @@ doswitch(void) {
                         /* nothing */;
                     if (cse != NULL && cse->value == val)
                         error(40, val); /* duplicate "case" label */
-        /* Since the label is stored as a string in the "constvalue", the
-         * size of an identifier must be at least 8, as there are 8
-         * hexadecimal digits in a 32-bit number.
-         */
-#if sNAMEMAX < 8
-#    error Length of identifier (sNAMEMAX) too small.
-#endif
                     assert(csp != NULL);
                     assert(csp->next == cse);
-                    insert_constval(csp, cse, itoh(lbl_case), val, 0);
+                    insert_constval(csp, cse, NULL, val, lbl_case);
                     if (matchtoken(tDBLDOT)) {
                         error(1, ":", "..");
                     }
@@ -6087,17 +6158,13 @@ doswitch(void) {
     /* generate the table here, before lbl_exit (general jump target) */
     setlabel(lbl_table);
     assert(swdefault == FALSE || swdefault == TRUE);
-    if (swdefault == FALSE) {
-        /* store lbl_exit as the "none-matched" label in the switch table */
-        strcpy(labelname, itoh(lbl_exit));
-    } else {
-        /* lbl_case holds the label of the "default" clause */
-        strcpy(labelname, itoh(lbl_case));
-    }
-    ffcase(casecount, labelname, TRUE);
+    /* without a "default" clause, lbl_exit is the "none-matched" label in the
+     * switch table; otherwise lbl_case holds the label of the "default" clause
+     */
+    ffcase(casecount, swdefault ? lbl_case : lbl_exit, TRUE);
     /* generate the rest of the table */
     for (cse = caselist.next; cse != NULL; cse = cse->next)
-        ffcase(cse->value, cse->name, FALSE);
+        ffcase(cse->value, cse->index, FALSE);
 
     setlabel(lbl_exit);
     delete_consttable(&caselist); /* clear list of case labels */
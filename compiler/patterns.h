@@ -31,7 +31,65 @@ typedef struct {
     const char* find;
     const char* replace;
     int savesize; /* number of bytes saved (in bytecode) */
+    /* optional; checks the values of the variables (%1 is symbols[0]) and may
+     * change them, returns false if the sequence does not apply */
+    bool (*fold)(cell* symbols);
 } SEQUENCE;
+
+static bool
+fold_is_zero(cell* symbols)
+{
+    return symbols[0] == 0;
+}
+
+static bool
+fold_is_one(cell* symbols)
+{
+    return symbols[0] == 1;
+}
+
+static bool
+fold_log2(cell* symbols)
+{
+    ucell value = (ucell)symbols[0];
+    if (value <= 1 || (value & (value - 1)) != 0)
+        return false;
+    cell shift = 0;
+    while (value > 1) {
+        value >>= 1;
+        shift++;
+    }
+    symbols[0] = shift;
+    return true;
+}
+
+static bool
+fold_add(cell* symbols)
+{
+    symbols[0] = (cell)((ucell)symbols[0] + (ucell)symbols[1]);
+    return true;
+}
+
+static bool
+fold_neg(cell* symbols)
+{
+    symbols[0] = (cell)(0 - (ucell)symbols[0]);
+    return true;
+}
+
+static bool
+fold_invert(cell* symbols)
+{
+    symbols[0] = ~symbols[0];
+    return true;
+}
+
+static bool
+fold_not(cell* symbols)
+{
+    symbols[0] = !symbols[0];
+    return true;
+}
 static SEQUENCE sequences_cmp[] = {
     /* A very common sequence in four varieties
      *    load.s.pri n1           load.s.pri n2
@@ -516,6 +574,38 @@ static SEQUENCE sequences_cmp[] = {
     {"dec.s %1!load.s.pri %1!;$exp!", "dec.s %1!;$exp!", seqsize(2, 2) - seqsize(1, 1)},
     {"load.s.pri %1!dec.s %1!;$exp!", "dec.s %1!;$exp!", seqsize(2, 2) - seqsize(1, 1)},
     /* ??? the same (increments and decrements) for references */
+    /* Arithmetic on a constant can be done by the compiler, and some
+     * operations have no effect for particular values. These sequences
+     * depend on the values of their operands, so they have a "fold"
+     * function that checks and computes the values. (The code generator
+     * folds constant operands of multiplications and shifts itself.)
+     *    const.pri n1            const.pri n1+n2
+     *    add.c n2                -
+     *    --------------------------------------
+     *    const.pri n1            const.pri -n1
+     *    neg                     -
+     *    (likewise for "invert" and "not")
+     *    --------------------------------------
+     *    stack n1                stack n1+n2
+     *    stack n2                -
+     *    --------------------------------------
+     *    smul.c n1               shl.c.pri log2(n1)    ; n1 is a power of 2
+     *    --------------------------------------
+     *    smul.c 1                -
+     *    add.c 0                 -
+     *    shl.c.pri 0             -
+     *    stack 0                 -
+     */
+    {"const.pri %1!add.c %2!", "const.pri %1!", seqsize(2, 2) - seqsize(1, 1), fold_add},
+    {"const.pri %1!neg!", "const.pri %1!", seqsize(2, 1) - seqsize(1, 1), fold_neg},
+    {"const.pri %1!invert!", "const.pri %1!", seqsize(2, 1) - seqsize(1, 1), fold_invert},
+    {"const.pri %1!not!", "const.pri %1!", seqsize(2, 1) - seqsize(1, 1), fold_not},
+    {"stack %1!stack %2!", "stack %1!", seqsize(2, 2) - seqsize(1, 1), fold_add},
+    {"smul.c %1!", "", seqsize(1, 1), fold_is_one},
+    {"smul.c %1!", "shl.c.pri %1!", 0, fold_log2},
+    {"add.c %1!", "", seqsize(1, 1), fold_is_zero},
+    {"shl.c.pri %1!", "", seqsize(1, 1), fold_is_zero},
+    {"stack %1!", "", seqsize(1, 1), fold_is_zero},
     /* Loading the constant zero has a special opcode.
      * When storing zero in memory, the value of PRI must not be later on.
      *    const.pri 0             zero n1
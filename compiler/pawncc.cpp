@@ -14,6 +14,10 @@
 int
 main(int argc, char* argv[])
 {
+    if (argc == 2 && strcmp(argv[1], "--server") == 0)
+        return pc_compile_server(argv[0], NULL);
+    if (argc == 2 && strncmp(argv[1], "--server=", 9) == 0)
+        return pc_compile_server(argv[0], argv[1] + 9);
     return pc_compile(argc, argv);
 }
 
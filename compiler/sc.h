@@ -450,6 +450,8 @@ struct token_t;
  * Functions you call from the "driver" program
  */
 int pc_compile(int argc, char** argv);
+int pc_compile_server(char* program, const char* socket_path);
+int pc_compile_jobs(int argc, char** argv, int files);
 int pc_addconstant(const char* name, cell value, int tag);
 int pc_addtag(const char* name);
 int pc_findtag(const char* name);
@@ -69,10 +69,49 @@ struct MacroEntry {
     ke::AString second;
     ke::AString documentation;
     bool deprecated;
+    bool compilation; /* substitution is specific to the compilation */
 };
 static bool sMacroTableInitialized;
 static ke::HashMap<ke::AString, MacroEntry, MacroTablePolicy> sMacros;
 
+/* The number of macros in the table for each combination of the first
+ * character and the length of their prefix, so that the lexer can pass over
+ * most identifiers without looking them up (see subst_maybe()).
+ */
+static const size_t kMacroLeadLengths = 32;
+static uint32_t sMacroLeads[128 * kMacroLeadLengths];
+static uint32_t sMacroLeadChars[128];
+
+static inline uint32_t&
+macro_lead(const char* name, size_t length)
+{
+    if (length >= kMacroLeadLengths)
+        length = kMacroLeadLengths - 1;
+    return sMacroLeads[((unsigned char)name[0] & 0x7f) * kMacroLeadLengths + length];
+}
+
+/* The macro definitions and removals since the table was last cleared, as made
+ * by the latest pass. Each change has a number, and the number of the last one
+ * identifies the contents of the table: a pass that repeats the definitions of
+ * the pass before it goes through the same numbers again. The substitution of
+ * a macro that is specific to the compilation, like __TIME__, is left out, so
+ * that a compilation that loads the changes from a precompiled header can go
+ * through the same numbers too.
+ */
+struct MacroChange {
+    ke::AString pattern;
+    ke::AString substitution;
+    bool removed;
+    bool deprecated;
+    bool compilation;
+    unsigned int state;
+};
+static ke::Vector<MacroChange> sMacroChanges;
+static size_t sMacroChangeIndex;
+static unsigned int sMacroState;
+static unsigned int sNextMacroState = 1;
+static unsigned int sCompilationSubstUses;
+
 /* ----- string list functions ----------------------------------- */
 static stringlist*
 insert_string(stringlist* root, const char* string)
@@ -187,8 +226,44 @@ delete_pathtable(void)
 
 /* ----- substitutions (macros) -------------------------------------- */
 
-void
-insert_subst(const char* pattern, size_t pattern_length, const char* substitution)
+static void
+record_subst_change(const char* pattern, size_t length, const char* substitution,
+                    bool deprecated, bool compilation)
+{
+    bool removed = (substitution == NULL);
+    if (compilation)
+        substitution = "";
+    if (sMacroChangeIndex < sMacroChanges.length()) {
+        const MacroChange& change = sMacroChanges[sMacroChangeIndex];
+        if (change.removed == removed && change.deprecated == deprecated &&
+            change.compilation == compilation && change.pattern.length() == length &&
+            strncmp(change.pattern.chars(), pattern, length) == 0 &&
+            (removed || strcmp(change.substitution.chars(), substitution) == 0))
+        {
+            sMacroState = change.state;
+            sMacroChangeIndex++;
+            return;
+        }
+        /* this pass makes other definitions from here on */
+        while (sMacroChanges.length() > sMacroChangeIndex)
+            sMacroChanges.pop();
+    }
+
+    MacroChange change;
+    change.pattern = ke::AString(pattern, length);
+    if (!removed)
+        change.substitution = substitution;
+    change.removed = removed;
+    change.deprecated = deprecated;
+    change.compilation = compilation;
+    change.state = sNextMacroState++;
+    sMacroState = change.state;
+    sMacroChanges.append(ke::Move(change));
+    sMacroChangeIndex++;
+}
+
+static void
+add_subst(const char* pattern, size_t pattern_length, const char* substitution, bool compilation)
 {
     if (!sMacroTableInitialized) {
         sMacros.init(1024);
@@ -199,6 +274,7 @@ insert_subst(const char* pattern, size_t pattern_length, const char* substitutio
     macro.first = pattern;
     macro.second = substitution;
     macro.deprecated = false;
+    macro.compilation = compilation;
     if (pc_deprecate.length() > 0) {
         macro.deprecated = true;
         if (sc_status == statWRITE)
@@ -209,10 +285,31 @@ insert_subst(const char* pattern, size_t pattern_length, const char* substitutio
 
     ke::AString key(pattern, pattern_length);
     auto p = sMacros.findForAdd(key);
-    if (p.found())
+    if (p.found()) {
         p->value = macro;
-    else
+    } else {
         sMacros.add(p, ke::Move(key), macro);
+        macro_lead(pattern, pattern_length)++;
+        sMacroLeadChars[(unsigned char)pattern[0] & 0x7f]++;
+    }
+
+    record_subst_change(pattern, strlen(pattern), substitution, macro.deprecated, compilation);
+}
+
+void
+insert_subst(const char* pattern, size_t pattern_length, const char* substitution)
+{
+    add_subst(pattern, pattern_length, substitution, false);
+}
+
+/* Defines a macro whose substitution differs between compilations of the same
+ * source, like __TIME__. Text that is substituted with it is only valid in the
+ * compilation that made it; see compilation_subst_uses().
+ */
+void
+insert_compilation_subst(const char* pattern, size_t pattern_length, const char* substitution)
+{
+    add_subst(pattern, pattern_length, substitution, true);
 }
 
 bool
@@ -226,6 +323,8 @@ find_subst(const char* name, size_t length, macro_t* macro)
     MacroEntry& entry = p->value;
     if (entry.deprecated)
         error(234, p->key.chars(), entry.documentation.chars());
+    if (entry.compilation)
+        sCompilationSubstUses++;
 
     if (macro) {
         macro->first = entry.first.chars();
@@ -243,13 +342,138 @@ delete_subst(const char* name, size_t length)
         return false;
 
     sMacros.remove(p);
+    assert(macro_lead(name, length) > 0);
+    macro_lead(name, length)--;
+    sMacroLeadChars[(unsigned char)name[0] & 0x7f]--;
+    record_subst_change(name, length, NULL, false, false);
     return true;
 }
 
+/* Returns a number that identifies the contents of the macro table. It is the
+ * same for tables built by the same definitions (in the same order) since the
+ * table was last cleared, as in every pass over the same source, and it is
+ * zero for an empty table.
+ */
+unsigned int
+subst_state(void)
+{
+    return sMacroState;
+}
+
+/* Returns how many times a macro defined by insert_compilation_subst() has been
+ * looked up, so that a caller can tell whether a substitution used one.
+ */
+unsigned int
+compilation_subst_uses(void)
+{
+    return sCompilationSubstUses;
+}
+
+/* Returns false if no macro has a prefix with the first character and the
+ * length of "name"; if it returns true, find_subst() tells whether there is one.
+ */
+bool
+subst_maybe(const char* name, size_t length)
+{
+    return macro_lead(name, length) != 0;
+}
+
+/* Returns false if no macro starts with the character "c", so that a line can
+ * be passed over when none of its words can start a macro.
+ */
+bool
+subst_lead(char c)
+{
+    return sMacroLeadChars[(unsigned char)c & 0x7f] != 0;
+}
+
 void
 delete_substtable(void)
 {
     sMacros.clear();
+    memset(sMacroLeads, 0, sizeof(sMacroLeads));
+    memset(sMacroLeadChars, 0, sizeof(sMacroLeadChars));
+    sMacroChangeIndex = 0;
+    sMacroState = 0;
+}
+
+void
+delete_substhistory(void)
+{
+    delete_substtable();
+    sMacroChanges.clear();
+}
+
+struct MacroChangeRecord {
+    uint32_t state;
+    uint32_t patternlength;
+    uint32_t substlength;
+    uint8_t removed;
+    uint8_t deprecated;
+    uint8_t compilation;
+};
+
+/* Writes the changes of the latest pass to a precompiled header. A compilation
+ * that reads them back and makes the same changes arrives at the same states,
+ * so that it can use the substitutions that were made with them.
+ */
+bool
+write_substhistory(FILE* fp)
+{
+    uint32_t header[2] = {(uint32_t)sMacroChanges.length(), sNextMacroState};
+    if (fwrite(header, sizeof(header), 1, fp) != 1)
+        return false;
+    for (size_t i = 0; i < sMacroChanges.length(); i++) {
+        const MacroChange& change = sMacroChanges[i];
+        MacroChangeRecord record;
+        memset(&record, 0, sizeof(record));
+        record.state = change.state;
+        record.patternlength = (uint32_t)change.pattern.length();
+        record.substlength = (uint32_t)change.substitution.length();
+        record.removed = change.removed;
+        record.deprecated = change.deprecated;
+        record.compilation = change.compilation;
+        if (fwrite(&record, sizeof(record), 1, fp) != 1 ||
+            fwrite(change.pattern.chars(), 1, record.patternlength, fp) != record.patternlength ||
+            fwrite(change.substitution.chars(), 1, record.substlength, fp) != record.substlength)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+read_substhistory(FILE* fp)
+{
+    assert(sMacroChanges.length() == 0 && sMacroChangeIndex == 0);
+    uint32_t header[2];
+    if (fread(header, sizeof(header), 1, fp) != 1)
+        return false;
+
+    ke::Vector<MacroChange> changes;
+    for (uint32_t i = 0; i < header[0]; i++) {
+        MacroChangeRecord record;
+        char pattern[sLINEMAX + 1], substitution[sLINEMAX + 1];
+        if (fread(&record, sizeof(record), 1, fp) != 1 || record.state >= header[1] ||
+            record.patternlength > sLINEMAX || record.substlength > sLINEMAX ||
+            fread(pattern, 1, record.patternlength, fp) != record.patternlength ||
+            fread(substitution, 1, record.substlength, fp) != record.substlength)
+        {
+            return false;
+        }
+        MacroChange change;
+        change.pattern = ke::AString(pattern, record.patternlength);
+        change.substitution = ke::AString(substitution, record.substlength);
+        change.removed = record.removed != 0;
+        change.deprecated = record.deprecated != 0;
+        change.compilation = record.compilation != 0;
+        change.state = record.state;
+        changes.append(ke::Move(change));
+    }
+    sMacroChanges = ke::Move(changes);
+    sNextMacroState = header[1];
+    return true;
 }
 
 /* ----- input file list (explicit files) ------------------------ */
@@ -42,8 +42,17 @@ char* get_path(int index);
 void delete_pathtable(void);
 void insert_subst(const char* pattern, size_t pattern_length, const char* substitution);
 bool find_subst(const char* name, size_t length, macro_t* result);
+bool subst_maybe(const char* name, size_t length);
+bool subst_lead(char c);
 bool delete_subst(const char* name, size_t length);
 void delete_substtable(void);
+void insert_compilation_subst(const char* pattern, size_t pattern_length,
+                              const char* substitution);
+unsigned int subst_state(void);
+unsigned int compilation_subst_uses(void);
+void delete_substhistory(void);
+bool write_substhistory(FILE* fp);
+bool read_substhistory(FILE* fp);
 stringlist* insert_sourcefile(char* string);
 char* get_sourcefile(int index);
 void delete_sourcefiletable(void);
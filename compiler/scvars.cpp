@@ -48,6 +48,8 @@ char* inpfname;                            /* pointer to name of the file curren
 char outfname[_MAX_PATH];                  /* intermediate (assembler) file name */
 char binfname[_MAX_PATH];                  /* binary file name */
 char errfname[_MAX_PATH];                  /* error file name */
+char pchfname[_MAX_PATH];                  /* precompiled header file name */
+char timingsfname[_MAX_PATH];              /* file name for the timings as JSON */
 char sc_ctrlchar = CTRL_CHAR;              /* the control character (or escape character)*/
 char sc_ctrlchar_org = CTRL_CHAR;          /* the default control character */
 int litidx = 0;                            /* index to literal table */
@@ -87,6 +89,10 @@ int sc_showincludes = 0;             /* show include files */
 int sc_require_newdecls = 0;         /* Require new-style declarations */
 bool sc_warnings_are_errors = false;
 int sc_compression_level = 9;
+bool sc_keepincludes = false; /* keep the lines of include files for the next compilation */
+int sc_jobs = 0;              /* compile the files separately, this many at once (-j) */
+int sc_jobfile = -1;          /* the one source file that a job compiles, or -1 */
+bool sc_timings = false;      /* report the time spent in each phase (--timings) */
 bool sc_use_new_parser = false;
 
 void* inpf = NULL;      /* file read from (source or include) */
@@ -105,6 +111,7 @@ ke::Vector<char*> gInputFilenameStack;
 jmp_buf errbuf;
 
 HashTable* sp_Globals = NULL;
+ScopeTable* sp_Locals = NULL;
 
 #if defined __WATCOMC__ && !defined NDEBUG
 /* Watcom's CVPACK dislikes .OBJ files without functions */
@@ -28,6 +28,7 @@ struct memfile_t;
 
 typedef struct HashTable HashTable;
 extern struct HashTable* sp_Globals;
+extern struct ScopeTable* sp_Locals; /* the symbols in "loctab", by name */
 extern symbol loctab;             /* local symbol table */
 extern symbol glbtab;             /* global symbol table */
 extern cell* litq;                /* the literal queue */
@@ -40,6 +41,8 @@ extern char* inpfname;            /* name of the file currently read from */
 extern char outfname[];           /* intermediate (assembler) file name */
 extern char binfname[];           /* binary file name */
 extern char errfname[];           /* error file name */
+extern char pchfname[];           /* precompiled header file name */
+extern char timingsfname[];       /* file name for the timings as JSON */
 extern char sc_ctrlchar;          /* the control character (or escape character) */
 extern char sc_ctrlchar_org;      /* the default control character */
 extern int litidx;                /* index to literal table */
@@ -87,6 +90,10 @@ extern bool sc_warnings_are_errors;
 extern unsigned sc_total_errors;
 extern int pc_code_version; /* override the code version */
 extern int sc_compression_level;
+extern bool sc_keepincludes; /* keep the lines of include files for the next compilation */
+extern int sc_jobs;          /* compile the files separately, this many at once (-j) */
+extern int sc_jobfile;       /* the one source file that a job compiles, or -1 */
+extern bool sc_timings;      /* report the time spent in each phase (--timings) */
 
 extern void* inpf;      /* file read from (source or include) */
 extern void* inpf_org;  /* main source file */
@@ -783,9 +783,10 @@ SymbolExpr::AnalyzeWithOptions(bool allow_types)
 
     if (sym_->ident == iCONSTEXPR) {
         // Hack: __LINE__ is updated by the lexer, so we have to special case
-        // it here.
-        static symbol* sLineConst = findconst("__LINE__");
-        if (sym_ == sLineConst)
+        // it here. The symbol is compared by name, since every compilation
+        // that the process makes has its own.
+        static sp::Atom* sLineAtom = gAtoms.add("__LINE__");
+        if (sym_->nameAtom() == sLineAtom && sym_->vclass == sGLOBAL)
             val_.constval = pos_.line;
         else
             val_.constval = sym_->addr();
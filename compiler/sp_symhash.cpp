@@ -10,8 +10,8 @@ struct NameAndScope {
     sp::Atom* name;
     int fnumber;
 
-    NameAndScope(const char* name, int fnumber)
-     : name(gAtoms.add(name)),
+    NameAndScope(sp::Atom* name, int fnumber)
+     : name(name),
        fnumber(fnumber)
     {}
 };
@@ -46,11 +46,11 @@ struct SymbolHashPolicy {
 
 struct HashTable : public ke::HashTable<SymbolHashPolicy> {};
 
-uint32_t
-NameHash(const char* str)
-{
-    return ke::HashCharSequence(str, strlen(str));
-}
+// The local symbols of each name, in the order that they were declared. Blocks
+// are left in the reverse order that they were entered, so the symbols of a
+// name are removed from the end.
+struct ScopeTable : public ke::HashMap<sp::Atom*, ke::Vector<symbol*>, ke::PointerPolicy<sp::Atom>>
+{};
 
 HashTable*
 NewHashTable()
@@ -70,7 +70,7 @@ DestroyHashTable(HashTable* ht)
 }
 
 symbol*
-FindInHashTable(HashTable* ht, const char* name, int fnumber)
+FindInHashTable(HashTable* ht, sp::Atom* name, int fnumber)
 {
     NameAndScope nas(name, fnumber);
     HashTable::Result r = ht->find(nas);
@@ -94,3 +94,62 @@ RemoveFromHashTable(HashTable* ht, symbol* sym)
     assert(r.found());
     ht->remove(r);
 }
+
+ScopeTable*
+NewScopeTable()
+{
+    ScopeTable* st = new ScopeTable();
+    if (!st->init()) {
+        delete st;
+        return nullptr;
+    }
+    return st;
+}
+
+void
+DestroyScopeTable(ScopeTable* st)
+{
+    delete st;
+}
+
+void
+AddToScopeTable(ScopeTable* st, symbol* sym)
+{
+    ScopeTable::Insert i = st->findForAdd(sym->nameAtom());
+    if (!i.found())
+        st->add(i, sym->nameAtom());
+    i->value.append(sym);
+}
+
+void
+RemoveFromScopeTable(ScopeTable* st, symbol* sym)
+{
+    ScopeTable::Result r = st->find(sym->nameAtom());
+    assert(r.found());
+    ke::Vector<symbol*>& syms = r->value;
+    for (size_t i = syms.length(); i > 0; i--) {
+        if (syms[i - 1] == sym) {
+            syms.remove(i - 1);
+            return;
+        }
+    }
+    assert(false);
+}
+
+symbol*
+FindInScopeTable(ScopeTable* st, sp::Atom* name)
+{
+    ScopeTable::Result r = st->find(name);
+    if (!r.found())
+        return nullptr;
+
+    // The deepest declaration comes first. Sub-types (hierarchical types) are
+    // skipped, except for enum fields.
+    const ke::Vector<symbol*>& syms = r->value;
+    for (size_t i = syms.length(); i > 0; i--) {
+        symbol* sym = syms[i - 1];
+        if (!sym->parent() || sym->ident == iCONSTEXPR)
+            return sym;
+    }
+    return nullptr;
+}
@@ -2,6 +2,7 @@
 #ifndef _INCLUDE_SPCOMP_SYMHASH_H_
 #define _INCLUDE_SPCOMP_SYMHASH_H_
 
+#include <amtl/am-hashmap.h>
 #include <amtl/am-hashtable.h>
 #include <stddef.h>
 #include <string.h>
@@ -19,14 +20,20 @@ struct KeywordTablePolicy {
     }
 };
 
-uint32_t NameHash(const char* str);
-
 struct HashTable;
 
 HashTable* NewHashTable();
 void DestroyHashTable(HashTable* ht);
 void AddToHashTable(HashTable* ht, symbol* sym);
 void RemoveFromHashTable(HashTable* ht, symbol* sym);
-symbol* FindInHashTable(HashTable* ht, const char* name, int fnumber);
+symbol* FindInHashTable(HashTable* ht, sp::Atom* name, int fnumber);
+
+struct ScopeTable;
+
+ScopeTable* NewScopeTable();
+void DestroyScopeTable(ScopeTable* st);
+void AddToScopeTable(ScopeTable* st, symbol* sym);
+void RemoveFromScopeTable(ScopeTable* st, symbol* sym);
+symbol* FindInScopeTable(ScopeTable* st, sp::Atom* name);
 
 #endif /* _INCLUDE_SPCOMP_SYMHASH_H_ */
@@ -257,7 +257,15 @@ namespace sp {
     _G(FLOAT_LE, "float.le", 1)                                             \
     _G(FLOAT_NE, "float.ne", 1)                                             \
     _G(FLOAT_EQ, "float.eq", 1)                                             \
-    _G(FLOAT_NOT, "float.not", 1)
+    _G(FLOAT_NOT, "float.not", 1)                                           \
+    _G(VEC_ADD, "vec.add", 1)                                               \
+    _G(VEC_SUB, "vec.sub", 1)                                               \
+    _G(VEC_SCALE, "vec.scale", 1)                                           \
+    _G(VEC_LENGTH, "vec.length", 1)                                         \
+    _G(VEC_DISTANCE, "vec.distance", 1)                                     \
+    _G(VEC_NORMALIZE, "vec.normalize", 1)                                   \
+    _G(VEC_DOT, "vec.dot", 1)                                               \
+    _G(VEC_CROSS, "vec.cross", 1)
 
 enum OPCODE {
 #define _G(op, text, cells) OP_##op,
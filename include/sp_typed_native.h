@@ -0,0 +1,175 @@
+/**
+ * vim: set ts=4 sw=4 tw=99 et:
+ * =============================================================================
+ * SourcePawn
+ * Copyright (C) 2004-2018 AlliedModders LLC.  All rights reserved.
+ * =============================================================================
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License, version 3.0, as published by the
+ * Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * As a special exception, AlliedModders LLC gives you permission to link the
+ * code of this program (as well as its derivative works) to "Half-Life 2," the
+ * "Source Engine," the "SourcePawn JIT," and any Game MODs that run on software
+ * by the Valve Corporation.  You must obey the GNU General Public License in
+ * all respects for all other code used.  Additionally, AlliedModders LLC grants
+ * this exception to all derivative works.  AlliedModders LLC defines further
+ * exceptions, found in LICENSE.txt (as of this writing, version JULY-31-2007),
+ * or <http://www.sourcemod.net/license.php>.
+ */
+
+#ifndef _INCLUDE_SOURCEPAWN_VM_TYPED_NATIVE_H_
+#define _INCLUDE_SOURCEPAWN_VM_TYPED_NATIVE_H_
+
+/**
+ * @file sp_typed_native.h
+ * @brief Helpers for binding C++ functions as typed natives.
+ *
+ * A typed native is an ordinary function whose first parameter is the
+ * IPluginContext, followed by parameters of these types:
+ *
+ *   cell_t            int, bool, any, enum, or function
+ *   float             float
+ *   const char*       const char[] (or char[])
+ *   sp_stringview_t   const char[], with its length
+ *   char*             char[N], not const
+ *   sp_charbuffer_t   char[N], not const, with its size in bytes
+ *   sp_cellspan_t     one-dimensional array; const unless it has a fixed size
+ *   cell_t*, cell_t&  by-reference int, float, or any
+ *
+ * For example:
+ *
+ *   static cell_t Clamp(IPluginContext* cx, cell_t value, cell_t lo, cell_t hi);
+ *   sp_typednativeinfo_t info = SP_TYPED_NATIVE("Clamp", Clamp);
+ *   runtime->UpdateTypedNativeBinding(index, &info, nullptr);
+ */
+
+#include "sp_vm_api.h"
+
+namespace SourcePawn {
+
+template <typename T> struct TypedNativeArg;
+
+template <> struct TypedNativeArg<cell_t> {
+    static const uint8_t kind = SP_NATIVEARG_INT;
+    static cell_t get(const sp_nativearg_t& arg) {
+        return arg.cell;
+    }
+};
+template <> struct TypedNativeArg<float> {
+    static const uint8_t kind = SP_NATIVEARG_FLOAT;
+    static float get(const sp_nativearg_t& arg) {
+        return arg.fval;
+    }
+};
+template <> struct TypedNativeArg<const char*> {
+    static const uint8_t kind = SP_NATIVEARG_STRING;
+    static const char* get(const sp_nativearg_t& arg) {
+        return arg.str.chars;
+    }
+};
+template <> struct TypedNativeArg<sp_stringview_t> {
+    static const uint8_t kind = SP_NATIVEARG_STRING;
+    static sp_stringview_t get(const sp_nativearg_t& arg) {
+        return arg.str;
+    }
+};
+template <> struct TypedNativeArg<char*> {
+    static const uint8_t kind = SP_NATIVEARG_BUFFER;
+    static char* get(const sp_nativearg_t& arg) {
+        return arg.buf.chars;
+    }
+};
+template <> struct TypedNativeArg<sp_charbuffer_t> {
+    static const uint8_t kind = SP_NATIVEARG_BUFFER;
+    static sp_charbuffer_t get(const sp_nativearg_t& arg) {
+        return arg.buf;
+    }
+};
+template <> struct TypedNativeArg<sp_cellspan_t> {
+    static const uint8_t kind = SP_NATIVEARG_ARRAY;
+    static sp_cellspan_t get(const sp_nativearg_t& arg) {
+        return arg.span;
+    }
+};
+template <> struct TypedNativeArg<cell_t*> {
+    static const uint8_t kind = SP_NATIVEARG_REF;
+    static cell_t* get(const sp_nativearg_t& arg) {
+        return arg.ref;
+    }
+};
+template <> struct TypedNativeArg<cell_t&> {
+    static const uint8_t kind = SP_NATIVEARG_REF;
+    static cell_t& get(const sp_nativearg_t& arg) {
+        return *arg.ref;
+    }
+};
+
+namespace detail {
+template <size_t... Indices> struct IndexList {};
+template <size_t N, size_t... Indices>
+struct MakeIndexList : MakeIndexList<N - 1, N - 1, Indices...> {};
+template <size_t... Indices>
+struct MakeIndexList<0, Indices...> {
+    typedef IndexList<Indices...> type;
+};
+} // namespace detail
+
+template <typename Fn> class TypedNative;
+
+template <typename... Args>
+class TypedNative<cell_t (*)(IPluginContext*, Args...)>
+{
+  public:
+    typedef cell_t (*Fn)(IPluginContext*, Args...);
+
+    template <Fn fn>
+    static sp_typednativeinfo_t Describe(const char* name) {
+        sp_typednativeinfo_t info;
+        info.name = name;
+        info.func = &Invoke<fn>;
+        info.params = kParams;
+        info.nparams = sizeof...(Args);
+        return info;
+    }
+
+  private:
+    template <Fn fn>
+    static cell_t Invoke(IPluginContext* cx, const sp_nativearg_t* args, void* data) {
+        return Call<fn>(cx, args, typename detail::MakeIndexList<sizeof...(Args)>::type());
+    }
+
+    template <Fn fn, size_t... Indices>
+    static cell_t Call(IPluginContext* cx, const sp_nativearg_t* args,
+                       detail::IndexList<Indices...>) {
+        return fn(cx, TypedNativeArg<Args>::get(args[Indices])...);
+    }
+
+    // Padded by one so that natives without parameters still have an array.
+    static const uint8_t kParams[sizeof...(Args) + 1];
+};
+
+template <typename... Args>
+const uint8_t TypedNative<cell_t (*)(IPluginContext*, Args...)>::kParams[sizeof...(Args) + 1] = {
+    TypedNativeArg<Args>::kind..., 0
+};
+
+} // namespace SourcePawn
+
+/**
+ * @brief Describes a C++ function as a typed native. The native's user data
+ * is not passed to the function.
+ */
+#define SP_TYPED_NATIVE(name, fn) \
+    ::SourcePawn::TypedNative<decltype(&fn)>::Describe<&fn>(name)
+
+#endif //_INCLUDE_SOURCEPAWN_VM_TYPED_NATIVE_H_
@@ -23,8 +23,8 @@
 #include "sp_vm_types.h"
 
 /** SourcePawn Engine API Versions */
-#define SOURCEPAWN_ENGINE2_API_VERSION 0xC
-#define SOURCEPAWN_API_VERSION 0x020E
+#define SOURCEPAWN_ENGINE2_API_VERSION 0xD
+#define SOURCEPAWN_API_VERSION 0x0218
 
 namespace SourceMod {
 struct IdentityToken_t;
@@ -256,6 +256,43 @@ class IPluginFunction : public ICallable
 	    * @return       String name.
      */
     virtual const char* DebugName() = 0;
+
+    /**
+     * @brief Like Invoke(), but the function may suspend itself by calling
+     * __coro_yield, and be resumed later with Resume(). Resumable calls
+     * always run in the interpreter, and only cells may be pushed as
+     * parameters. A function can only have one suspended call at a time.
+     *
+     * @param result    Set to the return value, or if the call suspended,
+     *                  to the value passed to __coro_yield.
+     * @param suspended Set to true if the call suspended.
+     * @return          True on success, false on error.
+     */
+    virtual bool InvokeResumable(cell_t* result, bool* suspended) = 0;
+
+    /**
+     * @brief Resume the suspended call of this function. The context's stack
+     * and heap must be where they were when the call started; for example, a
+     * call started outside of any plugin code must also be resumed outside
+     * of plugin code.
+     *
+     * @param value     Value returned by the __coro_yield call.
+     * @param result    As for InvokeResumable().
+     * @param suspended As for InvokeResumable().
+     * @return          True on success, false on error.
+     */
+    virtual bool Resume(cell_t value, cell_t* result, bool* suspended) = 0;
+
+    /**
+     * @brief Returns whether this function has a suspended call.
+     */
+    virtual bool IsSuspended() = 0;
+
+    /**
+     * @brief Drop the suspended call of this function, if any, without
+     * finishing it.
+     */
+    virtual void DiscardSuspended() = 0;
 };
 
 /**
@@ -474,7 +511,8 @@ class IPluginRuntime
     virtual bool IsPaused() = 0;
 
     /**
-     * @brief Returns the estimated memory usage of this plugin.
+     * @brief Returns the estimated memory usage of this plugin. This is the
+     * total of GetMemReport().
      *
      * @return        Memory usage, in bytes.
      */
@@ -516,6 +554,110 @@ class IPluginRuntime
      * @brief Return the file or location this plugin was loaded from.
      */
     virtual const char* GetFilename() = 0;
+
+    /**
+     * @brief Bind a leaf native at the given index. The native's flags become
+     * SP_NTVFLAG_LEAF, and like other non-ephemeral natives, it cannot be
+     * rebound. Leaf natives must be bound before the plugin first runs.
+     *
+     * @param index     Native index.
+     * @param pfn       Leaf native function pointer.
+     * @param data      User data pointer.
+     * @return          Error code, or SP_ERROR_NONE on success.
+     */
+    virtual int UpdateLeafNativeBinding(uint32_t index, SPVM_LEAF_NATIVE_FUNC pfn,
+                                        void* data) = 0;
+
+    /**
+     * @brief Bind a typed native at the given index. The parameter kinds are
+     * checked against the native's RTTI signature, and the VM translates and
+     * bounds-checks every argument before calling the native. Like other
+     * non-ephemeral natives, it cannot be rebound.
+     *
+     * @param index     Native index.
+     * @param info      Typed native description.
+     * @param data      User data pointer, passed to the native.
+     * @return          SP_ERROR_PARAM if the native's signature does not match
+     *                  or cannot be expressed with typed parameters. A native
+     *                  may only write to arrays that are declared with a fixed
+     *                  size, so a non-const array or char buffer parameter
+     *                  without one is also rejected, as is any array parameter
+     *                  if the plugin has no signature for the native.
+     */
+    virtual int UpdateTypedNativeBinding(uint32_t index, const sp_typednativeinfo_t* info,
+                                         void* data) = 0;
+
+    /**
+     * @brief Install or remove a line breakpoint. The debug break handler is
+     * only called at installed breakpoints, or on every line while single-
+     * stepping; other lines run at full speed.
+     *
+     * JIT code is patched in place, so this must be called on the thread
+     * that runs plugins: either while no plugin code is running, or from a
+     * native or the debug break handler. It must never be called while
+     * another thread may be running the plugin.
+     *
+     * @param addr      Line address, from IPluginDebugInfo::LookupLineAddress.
+     * @param enabled   True to install the breakpoint, false to remove it.
+     * @return          SP_ERROR_NOTDEBUGGING if debug breaks are not enabled,
+     *                  or SP_ERROR_INVALID_ADDRESS if addr is not a line.
+     */
+    virtual int SetBreakpoint(ucell_t addr, bool enabled) = 0;
+
+    /**
+     * @brief Enable or disable single-stepping. While enabled, the debug
+     * break handler is called on every line.
+     *
+     * This has the same threading rules as SetBreakpoint.
+     *
+     * @param enabled   True to break on every line.
+     * @return          SP_ERROR_NOTDEBUGGING if debug breaks are not enabled.
+     */
+    virtual int SetSingleStep(bool enabled) = 0;
+
+    /**
+     * @brief Returns the plugin's peak stack and heap usage, to help size
+     * its memory (#pragma dynamic).
+     *
+     * @param peaks     Filled with the peaks since the plugin was loaded, or
+     *                  since they were last reset.
+     * @return          SP_ERROR_NOT_FOUND if memory peak tracking is not
+     *                  enabled.
+     */
+    virtual int GetMemoryPeaks(sp_mempeaks_t* peaks) = 0;
+
+    /**
+     * @brief Forget the recorded peaks, starting again from the plugin's
+     * current stack and heap usage.
+     */
+    virtual void ResetMemoryPeaks() = 0;
+
+    /**
+     * @brief Returns the estimated memory usage of this plugin, broken down
+     * by category.
+     *
+     * @param report    Filled with the plugin's memory usage.
+     */
+    virtual void GetMemReport(sp_memreport_t* report) = 0;
+
+    /**
+     * @brief Reuses work done for a previous version of this plugin, for
+     * functions whose code did not change: each such function skips
+     * verification, and its compiled code is moved to this runtime rather
+     * than compiled again. Functions are matched when they first run.
+     *
+     * This should be called once, after the new version is loaded and its
+     * natives are bound, and before any of its code runs. Compiled code is
+     * only moved if the caller has paused the previous runtime (see
+     * SetPauseState), it is not running, and its natives and memory size are
+     * the same. The previous runtime must stay paused, since its remaining
+     * code may call code that was moved; it may be destroyed afterward. If it
+     * is not paused, only verification results are reused.
+     *
+     * @param previous  Runtime for the previous version of the plugin.
+     * @return          Number of functions that can be reused.
+     */
+    virtual size_t AdoptMethodsFrom(IPluginRuntime* previous) = 0;
 };
 
 /**
@@ -603,6 +745,24 @@ class IFrameIterator
     virtual bool IsInternalFrame() const = 0;
 };
 
+/**
+   * @brief A saved copy of a context's memory and registers; see
+   * IPluginContext::CreateSnapshot.
+   */
+class IContextSnapshot
+{
+  public:
+    /**
+     * @brief Virtual destructor (you may call delete).
+     */
+    virtual ~IContextSnapshot() {}
+
+    /**
+     * @brief Returns the number of bytes used by the snapshot.
+     */
+    virtual size_t GetSize() = 0;
+};
+
 /**
    * @brief Interface to managing a context at runtime.
    */
@@ -1084,6 +1244,28 @@ class IPluginContext
      * @brief Frees an IFrameIterator object. Paired with CreateFrameIterator() 
      */
     virtual void DestroyFrameIterator(IFrameIterator* it) = 0;
+
+    /**
+     * @brief Saves the plugin's memory and registers, so it can be reset to
+     * this state later with RestoreSnapshot. This is usually called right
+     * after the plugin is loaded.
+     *
+     * @return        New snapshot, which the caller must delete, or NULL if
+     *                the plugin is running.
+     */
+    virtual IContextSnapshot* CreateSnapshot() = 0;
+
+    /**
+     * @brief Resets the plugin's memory and registers to a snapshot of this
+     * context. Only memory that changed since the snapshot is rewritten.
+     * Memory peaks (see IPluginRuntime::GetMemoryPeaks) are reset.
+     *
+     * @param snapshot  Snapshot from CreateSnapshot on this context.
+     * @return          SP_ERROR_PARAM if the snapshot is null or from another
+     *                  context, or SP_ERROR_NOT_RUNNABLE if the plugin is running or
+     *                  one of its functions has a suspended resumable call.
+     */
+    virtual int RestoreSnapshot(IContextSnapshot* snapshot) = 0;
 };
 
 /**
@@ -1586,8 +1768,33 @@ class ISourcePawnEnvironment
     virtual const char* GetPendingExceptionMessage(const ExceptionHandler* handler) = 0;
 
     // @brief Enables the line debugger callbacks. This must be called
-    // before any plugins are loaded.
+    // before any plugins are loaded. Lines only break once a breakpoint is
+    // installed with IPluginRuntime::SetBreakpoint, or while single-stepping.
     virtual bool EnableDebugBreak() = 0;
+
+    // @brief Writes /tmp/perf-<pid>.map, so Linux perf can name JIT code.
+    // If jitdump is true, /tmp/jit-<pid>.dump is also written, with code
+    // bytes and line numbers for "perf inject --jit". This must be called
+    // before any plugins are loaded. Returns false if unsupported. Freed code
+    // memory is not reused afterward, so that addresses stay unambiguous.
+    virtual bool EnablePerfMap(bool jitdump) = 0;
+
+    // @brief Records the peak stack and heap usage of each plugin; see
+    // IPluginRuntime::GetMemoryPeaks. This adds a few instructions to each
+    // function call and heap allocation. It must be called before any
+    // plugins are loaded.
+    virtual bool EnableMemoryPeakTracking() = 0;
+
+    // @brief Binds SourceMod's vector natives (GetVectorLength,
+    // GetVectorDistance, NormalizeVector, GetVectorDotProduct and
+    // GetVectorCrossProduct) to the VM's builtins, so that their calls are
+    // compiled inline. A host that enables this must not register these
+    // natives itself. It must be called before any plugins are loaded.
+    virtual bool EnableSourceModVectorNatives() = 0;
+
+    // @brief Returns the estimated memory usage of every loaded plugin, and
+    // of the JIT's code pools.
+    virtual void GetMemReport(sp_envmemreport_t* report) = 0;
 };
 
 // @brief This class is the entry-point to using SourcePawn from a DLL.
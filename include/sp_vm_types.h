@@ -122,6 +122,15 @@ struct sp_context_s;
  */
 typedef cell_t (*SPVM_NATIVE_FUNC)(SourcePawn::IPluginContext*, const cell_t*);
 
+/**
+ * @brief Leaf native callback prototype. Leaf natives are called without an exit
+ * frame, so they must not call back into the VM, allocate from the heap, throw
+ * errors, or walk the stack. The return value is stored in |result|; errors are
+ * reported by returning an SP_ERROR_* code other than SP_ERROR_NONE.
+ */
+typedef int (*SPVM_LEAF_NATIVE_FUNC)(SourcePawn::IPluginContext*, const cell_t* params,
+                                     cell_t* result);
+
 /**
  * @brief Fake native callback prototype, passed a context, parameter stack, and private data.
  * A cell must be returned.
@@ -157,6 +166,7 @@ typedef struct sp_pubvar_s {
 
 #define SP_NTVFLAG_OPTIONAL (1 << 0)  /**< Native is optional */
 #define SP_NTVFLAG_EPHEMERAL (1 << 1) /**< Native can be unbound */
+#define SP_NTVFLAG_LEAF (1 << 2)      /**< Native is an SPVM_LEAF_NATIVE_FUNC */
 
 /** 
  * @brief Information about a native entry in a plugin.
@@ -194,6 +204,76 @@ typedef struct sp_nativeinfo_s {
     SPVM_NATIVE_FUNC func; /**< Address of native implementation */
 } sp_nativeinfo_t;
 
+/**
+ * @brief Parameter kinds for typed natives. At bind time, each kind is checked
+ * against the native's RTTI signature in the plugin.
+ */
+#define SP_NATIVEARG_INT (1)    /**< int, bool, any, enum, or function; as a cell */
+#define SP_NATIVEARG_FLOAT (2)  /**< float; as a float */
+#define SP_NATIVEARG_STRING (3) /**< char array; as a terminated string view */
+#define SP_NATIVEARG_ARRAY (4)  /**< one-dimensional array; as a span of cells */
+#define SP_NATIVEARG_REF (5)    /**< by-reference int, float, or any; as a cell pointer */
+#define SP_NATIVEARG_BUFFER (6) /**< fixed-size char array, not const; as a writable char buffer */
+
+/**
+ * @brief A bounds-checked view of a plugin array. For arrays declared with a
+ * fixed size, length is that size. Otherwise, length is the number of cells
+ * addressable from the start of the array, which is only an upper bound, and
+ * the array must be declared const; the native must not write to it.
+ */
+typedef struct sp_cellspan_s {
+    cell_t* cells;
+    uint32_t length;
+} sp_cellspan_t;
+
+/**
+ * @brief A view of a null-terminated plugin string. length does not include
+ * the terminator.
+ */
+typedef struct sp_stringview_s {
+    const char* chars;
+    uint32_t length;
+} sp_stringview_t;
+
+/**
+ * @brief A writable plugin char array. The array must be declared with a fixed
+ * size, and length is that size in bytes.
+ */
+typedef struct sp_charbuffer_s {
+    char* chars;
+    uint32_t length;
+} sp_charbuffer_t;
+
+/**
+ * @brief A typed native argument, already translated and validated by the VM.
+ */
+typedef union sp_nativearg_u {
+    cell_t cell;          /**< SP_NATIVEARG_INT */
+    float fval;           /**< SP_NATIVEARG_FLOAT */
+    sp_stringview_t str;  /**< SP_NATIVEARG_STRING */
+    sp_cellspan_t span;   /**< SP_NATIVEARG_ARRAY */
+    cell_t* ref;          /**< SP_NATIVEARG_REF */
+    sp_charbuffer_t buf;  /**< SP_NATIVEARG_BUFFER */
+} sp_nativearg_t;
+
+/**
+ * @brief Typed native callback prototype, passed a context, one argument per
+ * declared parameter, and the user data pointer given at bind time.
+ */
+typedef cell_t (*SPVM_TYPED_NATIVE_FUNC)(SourcePawn::IPluginContext*, const sp_nativearg_t*,
+                                         void*);
+
+/**
+ * @brief Describes a typed native. See sp_typed_native.h for a helper that
+ * builds this from an ordinary C++ function.
+ */
+typedef struct sp_typednativeinfo_s {
+    const char* name;            /**< Name of the native */
+    SPVM_TYPED_NATIVE_FUNC func; /**< Address of native implementation */
+    const uint8_t* params;       /**< SP_NATIVEARG_* kind of each parameter */
+    uint32_t nparams;            /**< Number of parameters */
+} sp_typednativeinfo_t;
+
 /** 
  * @brief Run-time debug file table
  */
@@ -240,6 +320,54 @@ typedef struct sp_debug_symbol_s {
     sp_debug_symbol_raw_t* sym; /**< Pointer to original symbol */
 } sp_debug_symbol_t;
 
+/**
+ * @brief Peak memory usage of a plugin, recorded while memory peak tracking
+ * is enabled. Functions are code addresses, which can be passed to
+ * IPluginDebugInfo::LookupFunction, or -1 if no function reached the peak.
+ *
+ * The stack is measured on entry to each function, after it allocates
+ * locals, and at each native call.
+ */
+typedef struct sp_mempeaks_s {
+    uint32_t memory_size;            /**< Bytes reserved for data, heap, and stack */
+    uint32_t data_size;              /**< Bytes of static data */
+    uint32_t stack_peak;             /**< Most bytes of stack in use */
+    ucell_t stack_peak_function;     /**< Function that reached stack_peak */
+    uint32_t heap_peak;              /**< Most bytes of heap in use */
+    ucell_t heap_peak_function;      /**< Function that reached heap_peak */
+    uint32_t largest_alloc;          /**< Largest single heap allocation, in bytes */
+    ucell_t largest_alloc_function;  /**< Function that made largest_alloc */
+} sp_mempeaks_t;
+
+/**
+ * @brief Memory used by a plugin, in bytes, by category.
+ */
+typedef struct sp_memreport_s {
+    size_t runtime;        /**< Runtime and context objects, native and public tables */
+    size_t image;          /**< The loaded plugin file */
+    size_t code;           /**< Aligned copy of the code section, if one was needed */
+    size_t memory;         /**< Data, heap, and stack */
+    size_t jit_code;       /**< JIT code for compiled functions */
+    size_t jit_metadata;   /**< Cip maps, loop edges, and debug break sites */
+    size_t methods;        /**< Method objects and control-flow graphs */
+    size_t function_map;   /**< Method lookup tables */
+    size_t invokers;       /**< Function objects for publics */
+    size_t total;          /**< Sum of the above */
+} sp_memreport_t;
+
+/**
+ * @brief Memory used by every plugin in an environment, plus JIT code pools.
+ */
+typedef struct sp_envmemreport_s {
+    size_t runtimes;            /**< Number of loaded plugins */
+    sp_memreport_t plugins;     /**< Sum of each plugin's report */
+    size_t code_pools;          /**< Number of JIT code pools */
+    size_t code_reserved;       /**< Bytes mapped for code pools */
+    size_t code_used;           /**< Bytes of live code in pools, including stubs */
+    size_t code_free_ranges;    /**< Freed ranges that have not been reused */
+    size_t code_largest_free;   /**< Largest contiguous free range in any pool */
+} sp_envmemreport_t;
+
 /**
  * @brief Context describing the VM state when the SPVM_DEBUGBREAK
  * callback is called.
@@ -100,7 +100,8 @@ class StringPool
     static bool matches(const CharsAndLength& key, const Payload& e) {
       if (key.length() != e->length())
         return false;
-      return strcmp(key.str(), e->chars()) == 0;
+      // The key is not always terminated at its length.
+      return memcmp(key.str(), e->chars(), key.length()) == 0;
     }
   };
 
@@ -0,0 +1,283 @@
+# vim: set ts=2 sw=2 tw=99 et:
+import os, re, sys
+import argparse
+import time
+import testutil
+from runtests import TestPlan
+
+def main():
+  parser = argparse.ArgumentParser()
+  parser.add_argument('objdir', type=str, help='Build folder to benchmark.')
+  parser.add_argument('benchmark', type=str, nargs='?', default=None,
+                      help="Optional benchmark name prefix")
+  parser.add_argument('--arch', type=str, default=None,
+                      help="Force a specific arch on dual-arch builds.")
+  parser.add_argument('--runs', type=int, default=5,
+                      help="Number of times to run each benchmark.")
+  parser.add_argument('--show-cli', default=False, action='store_true',
+                      help='Show the command-line invocation of each benchmark.')
+  parser.add_argument('--compile', default=False, action='store_true',
+                      help='Time the compiler on the plugins in sourcemod/ instead of running '
+                           'the runtime benchmarks.')
+  parser.add_argument('--jobs', type=int, default=None,
+                      help='With --compile, also time compiling all plugins in one spcomp '
+                           'invocation, with -j 1 and with -j JOBS.')
+  parser.add_argument('--lex', default=False, action='store_true',
+                      help='Time the preprocessor on the include files in sourcemod/include and '
+                           'report the throughput in MB/s.')
+  args = parser.parse_args()
+
+  # Options that TestPlan expects, but which do not apply to benchmarks.
+  args.test = None
+  args.spcomp2 = False
+  args.spcomp_args = None
+  args.coverage = None
+
+  plan = TestPlan(args)
+  plan.find_spcomp()
+  plan.find_shells()
+
+  modes = [mode for mode in plan.modes if mode['name'] == 'default']
+  if not len(modes):
+    raise Exception('No compiler binaries were found in {0}'.format(args.objdir))
+  if args.lex:
+    runner = LexBenchmarkRunner(modes[0], args)
+    with testutil.TempFolder() as temp_folder:
+      with testutil.ChangeFolder(temp_folder):
+        if not runner.run():
+          sys.exit(1)
+    sys.exit(0)
+  if args.compile:
+    runner = CompileBenchmarkRunner(modes[0], args)
+    if not runner.find_plugins():
+      raise Exception('No matching plugins were found.')
+    with testutil.TempFolder() as temp_folder:
+      with testutil.ChangeFolder(temp_folder):
+        if not runner.run():
+          sys.exit(1)
+    sys.exit(0)
+  if not len(plan.shells):
+    raise Exception('No spshell binaries were found in {0}'.format(args.objdir))
+
+  runner = BenchmarkRunner(plan, modes[0], args)
+  if not runner.find_benchmarks():
+    raise Exception('No matching benchmarks were found.')
+
+  with testutil.TempFolder() as temp_folder:
+    with testutil.ChangeFolder(temp_folder):
+      if not runner.run():
+        sys.exit(1)
+  sys.exit(0)
+
+class BenchmarkRunner(object):
+  def __init__(self, plan, mode, args):
+    self.plan = plan
+    self.mode = mode
+    self.args = args
+    self.tests_path = os.path.dirname(os.path.abspath(__file__))
+    self.benchmarks_path = os.path.join(self.tests_path, 'benchmarks')
+    self.core_include_path = os.path.join(os.path.dirname(self.tests_path), 'include')
+    self.benchmarks = []
+
+  def find_benchmarks(self):
+    for name in sorted(os.listdir(self.benchmarks_path)):
+      if not name.endswith('.sp'):
+        continue
+      if self.args.benchmark is not None and not name.startswith(self.args.benchmark):
+        continue
+      self.benchmarks.append(os.path.join(self.benchmarks_path, name))
+    return len(self.benchmarks) > 0
+
+  def run(self):
+    ok = True
+    for path in self.benchmarks:
+      if not self.run_benchmark(path):
+        ok = False
+    return ok
+
+  # Benchmarks that count operations declare it with a "// calls: N" header,
+  # so we can report a rate.
+  def read_calls(self, path):
+    with open(path, 'r') as fp:
+      for line in fp:
+        m = re.match(r'//\s*calls:\s*(\d+)', line)
+        if m:
+          return int(m.group(1))
+        if not line.startswith('//'):
+          break
+    return None
+
+  def run_benchmark(self, path):
+    name, _ = os.path.splitext(os.path.basename(path))
+    smx_path = name + '.smx'
+    calls = self.read_calls(path)
+
+    argv = [self.mode['spcomp']['path']]
+    argv += ['-i', self.core_include_path]
+    argv += ['-i', self.tests_path]
+    argv += ['-z', '1']
+    argv += [path]
+    rc, stdout, stderr = self.exec_argv(argv)
+    if rc != 0:
+      print("FAIL: {0} did not compile".format(name))
+      print(stdout + stderr)
+      return False
+
+    for shell in self.plan.shells:
+      argv = [shell['path']] + shell['args'] + [smx_path]
+
+      times = []
+      for i in range(self.args.runs):
+        start = time.time()
+        rc, stdout, stderr = self.exec_argv(argv)
+        times.append(time.time() - start)
+        if rc != 0:
+          print("FAIL: {0} ({1}) returned {2}".format(name, shell['name'], rc))
+          print(stdout + stderr)
+          return False
+
+      times.sort()
+      line = "{0:<32} {1:<16} best {2:8.3f}s  median {3:8.3f}s".format(
+        name, shell['name'], times[0], times[len(times) // 2])
+      if calls is not None and times[0] > 0:
+        line += "  {0:8.2f}M calls/s".format(calls / times[0] / 1000000.0)
+      print(line)
+    return True
+
+  def exec_argv(self, argv):
+    if self.args.show_cli:
+      print(' '.join(argv))
+    return testutil.exec_argv(argv)
+
+# Compiles each SourceMod plugin several times and reports how long spcomp took. These plugins
+# are large enough that the time spent in the parser, code generator and peephole optimizer
+# shows up, unlike the small files in the test suite.
+class CompileBenchmarkRunner(object):
+  def __init__(self, mode, args):
+    self.mode = mode
+    self.args = args
+    self.tests_path = os.path.dirname(os.path.abspath(__file__))
+    self.plugins_path = os.path.join(self.tests_path, 'sourcemod')
+    self.include_path = os.path.join(self.plugins_path, 'include')
+    self.plugins = []
+
+  def find_plugins(self):
+    for name in sorted(os.listdir(self.plugins_path)):
+      if not name.endswith('.sp'):
+        continue
+      if self.args.benchmark is not None and not name.startswith(self.args.benchmark):
+        continue
+      self.plugins.append(os.path.join(self.plugins_path, name))
+    return len(self.plugins) > 0
+
+  def run(self):
+    total_best = 0
+    total_median = 0
+    for path in self.plugins:
+      name, _ = os.path.splitext(os.path.basename(path))
+      argv = [self.mode['spcomp']['path']]
+      argv += ['-i', self.include_path]
+      argv += ['-o', name + '.smx']
+      argv += [path]
+
+      times = []
+      for i in range(self.args.runs):
+        start = time.time()
+        rc, stdout, stderr = self.exec_argv(argv)
+        times.append(time.time() - start)
+        if rc != 0:
+          print("FAIL: {0} did not compile".format(name))
+          print(stdout + stderr)
+          return False
+
+      times.sort()
+      total_best += times[0]
+      total_median += times[len(times) // 2]
+      print("{0:<32} best {1:8.3f}s  median {2:8.3f}s".format(
+        name, times[0], times[len(times) // 2]))
+    print("{0:<32} best {1:8.3f}s  median {2:8.3f}s".format(
+      'total', total_best, total_median))
+    if self.args.jobs is not None:
+      for jobs in [1, self.args.jobs]:
+        if not self.run_jobs(jobs):
+          return False
+    return True
+
+  # Compiles all plugins in one invocation, each into its own output file, with up to "jobs"
+  # compilations at the same time.
+  def run_jobs(self, jobs):
+    argv = [self.mode['spcomp']['path']]
+    argv += ['-i', self.include_path]
+    argv += ['-j', str(jobs)]
+    argv += self.plugins
+
+    times = []
+    for i in range(self.args.runs):
+      start = time.time()
+      rc, stdout, stderr = self.exec_argv(argv)
+      times.append(time.time() - start)
+      if rc != 0:
+        print("FAIL: -j {0} did not compile".format(jobs))
+        print(stdout + stderr)
+        return False
+
+    times.sort()
+    print("{0:<32} best {1:8.3f}s  median {2:8.3f}s".format(
+      'all, -j {0}'.format(jobs), times[0], times[len(times) // 2]))
+    return True
+
+  def exec_argv(self, argv):
+    if self.args.show_cli:
+      print(' '.join(argv))
+    return testutil.exec_argv(argv)
+
+# Preprocesses every SourceMod include file at once (spcomp -l) and reports how many megabytes of
+# source were read, stripped and substituted per second. The include guards make each file count
+# once, and preprocessing stops before the parser, so this is mostly the time spent reading lines.
+class LexBenchmarkRunner(object):
+  def __init__(self, mode, args):
+    self.mode = mode
+    self.args = args
+    self.tests_path = os.path.dirname(os.path.abspath(__file__))
+    self.include_path = os.path.join(self.tests_path, 'sourcemod', 'include')
+
+  def run(self):
+    names = sorted(name for name in os.listdir(self.include_path) if name.endswith('.inc'))
+    total_bytes = 0
+    with open('lex.sp', 'w') as fp:
+      for name in names:
+        total_bytes += os.path.getsize(os.path.join(self.include_path, name))
+        fp.write('#include <{0}>\n'.format(os.path.splitext(name)[0]))
+
+    argv = [self.mode['spcomp']['path']]
+    argv += ['-i', self.include_path]
+    argv += ['-l']
+    argv += ['-o', 'lex.lst']
+    argv += ['lex.sp']
+
+    times = []
+    for i in range(self.args.runs):
+      start = time.time()
+      rc, stdout, stderr = self.exec_argv(argv)
+      times.append(time.time() - start)
+      if rc != 0:
+        print("FAIL: the include files could not be preprocessed")
+        print(stdout + stderr)
+        return False
+
+    times.sort()
+    megabytes = total_bytes / 1000000.0
+    line = "{0:<32} best {1:8.3f}s  median {2:8.3f}s".format(
+      'includes ({0:.2f} MB)'.format(megabytes), times[0], times[len(times) // 2])
+    if times[0] > 0:
+      line += "  {0:8.2f} MB/s".format(megabytes / times[0])
+    print(line)
+    return True
+
+  def exec_argv(self, argv):
+    if self.args.show_cli:
+      print(' '.join(argv))
+    return testutil.exec_argv(argv)
+
+if __name__ == '__main__':
+  main()
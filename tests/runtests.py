@@ -1,4 +1,5 @@
 # vim: set ts=2 sw=2 tw=99 et:
+import io
 import re
 import os, sys
 import argparse
@@ -253,6 +254,12 @@ class Test(object):
     'compiler',
     'force_old_parser',
     'force_new_parser',
+    'spcompArgs',
+    'extraFiles',
+    'compileServer',
+    'shellArgs',
+    'checkPrecompiled',
+    'checkAsm',
   ])
 
   def __init__(self, **kwargs):
@@ -262,6 +269,7 @@ class Test(object):
     self.smx_path = None
     self.stdout_file = None
     self.stderr_file = None
+    self.asm_file = None
 
   def prepare(self):
     if self.local_manifest_ is not None:
@@ -283,6 +291,8 @@ class Test(object):
       self.stderr_file = base_path + '.err'
     if os.path.exists(base_path + '.txt'):
       self.txtout_file = base_path + '.txt'
+    if os.path.exists(base_path + '.asm.txt'):
+      self.asm_file = base_path + '.asm.txt'
 
   def get_expected_output(self, pipe_name):
     if pipe_name == 'stdout':
@@ -292,7 +302,8 @@ class Test(object):
     elif pipe_name == 'txt':
       pipe_file = self.txtout_file
 
-    with open(pipe_file, 'r') as fp:
+    # Shell output is decoded as utf-8, so the expectations must be too.
+    with io.open(pipe_file, 'r', encoding = 'utf-8') as fp:
       # By default we normalize \r\n to \n in the expected output.
       expected_lines = [line.replace("\r\n", "\n") for line in fp]
     return expected_lines
@@ -326,6 +337,34 @@ class Test(object):
   def force_new_parser(self):
     return self.local_manifest_.get('force_new_parser', None) == 'true'
 
+  @property
+  def spcomp_args(self):
+    return self.local_manifest_.get('spcompArgs', '').split()
+
+  # Other source files, relative to the test, given to the compiler after the
+  # test itself.
+  @property
+  def extra_files(self):
+    folder = os.path.dirname(self.path)
+    files = self.local_manifest_.get('extraFiles', '').split()
+    return [os.path.join(folder, path) for path in files]
+
+  @property
+  def shell_args(self):
+    return self.local_manifest_.get('shellArgs', '').split()
+
+  @property
+  def check_precompiled(self):
+    return self.local_manifest_.get('checkPrecompiled', None) == 'true'
+
+  @property
+  def check_asm(self):
+    return self.local_manifest_.get('checkAsm', None) == 'true'
+
+  @property
+  def compile_server(self):
+    return self.local_manifest_.get('compileServer', None) == 'true'
+
   @property
   def expectedReturnCode(self):
     if 'returnCode' in self.local_manifest_:
@@ -431,6 +470,10 @@ class TestRunner(object):
       if not self.compile_ok(mode, test, rc, stdout, stderr):
         self.out_io(stderr, stdout)
         return False
+      if test.check_precompiled and not self.compile_precompiled(mode, test, stdout):
+        return False
+      if test.check_asm and not self.compile_asm(mode, test):
+        return False
       self.out("PASS")
       return True
 
@@ -443,7 +486,7 @@ class TestRunner(object):
     # Run all shells we found.
     return self.run_shells(mode, test)
 
-  def run_compiler(self, mode, test):
+  def run_compiler(self, mode, test, extra_args = []):
     # Make sure any previous output has been deleted.
     try:
       os.unlink(test.smx_path)
@@ -470,13 +513,104 @@ class TestRunner(object):
     argv += ['-z', '1'] # Fast compilation for tests.
     if test.warnings_are_errors:
       argv += ['-E']
+    argv += test.spcomp_args
+    argv += extra_args
     if mode['spcomp']['name'] == 'spcomp2':
       argv += ['-o', test.smx_path]
+    if test.compile_server:
+      argv += ['-o', os.path.abspath(test.smx_path)]
     argv += [self.fix_path(spcomp_path, test.path)]
+    argv += [self.fix_path(spcomp_path, path) for path in test.extra_files]
+
+    if test.compile_server:
+      return self.run_compile_server(mode, test, argv)
 
     # Run and return output.
     return self.do_exec(argv, env = mode['spcomp']['env'])
 
+  # Compiles the test twice more with a precompiled header: once to write it
+  # and once to load it. Both must print the same and write the same binary as
+  # the compilation without it.
+  def compile_precompiled(self, mode, test, expected_stdout):
+    with open(test.smx_path, 'rb') as fp:
+      expected_smx = fp.read()
+
+    pch_path = os.path.splitext(test.smx_path)[0] + '.pch'
+    if os.path.exists(pch_path):
+      os.unlink(pch_path)
+    for step in ['writing', 'loading']:
+      rc, stdout, stderr = self.run_compiler(mode, test, ['-P', pch_path])
+      if rc != 0 or not os.path.exists(test.smx_path):
+        self.out("FAIL: Compile failed while {0} the precompiled header.".format(step))
+        self.out_io(stderr, stdout)
+        return False
+      if stdout != expected_stdout:
+        self.out("FAIL: Output differs while {0} the precompiled header.".format(step))
+        self.out_io(stderr, stdout)
+        return False
+      with open(test.smx_path, 'rb') as fp:
+        if fp.read() != expected_smx:
+          self.out("FAIL: Binary differs while {0} the precompiled header.".format(step))
+          return False
+      if not os.path.exists(pch_path):
+        self.out("FAIL: Precompiled header '{0}' not found.".format(pch_path))
+        return False
+    return True
+
+  # Compiles the test again with "-a", and checks that the listing has each run
+  # of instructions from the test's .asm.txt file, in order. Runs are separated
+  # by blank lines; within a run, the lines must follow each other.
+  def compile_asm(self, mode, test):
+    asm_path = os.path.splitext(test.smx_path)[0] + '.asm'
+    if os.path.exists(asm_path):
+      os.unlink(asm_path)
+    rc, stdout, stderr = self.run_compiler(mode, test, ['-a'])
+    if rc != 0 or not os.path.exists(asm_path):
+      self.out("FAIL: Compile failed while writing the listing '{0}'.".format(asm_path))
+      self.out_io(stderr, stdout)
+      return False
+
+    with open(asm_path, 'r') as fp:
+      actual_lines = [line.strip() for line in fp]
+    with open(test.asm_file, 'r') as fp:
+      runs = [run.strip().split('\n') for run in fp.read().replace('\r\n', '\n').split('\n\n')]
+
+    position = 0
+    for run in runs:
+      run = [line.strip() for line in run]
+      found = position
+      while found + len(run) <= len(actual_lines) and actual_lines[found:found + len(run)] != run:
+        found += 1
+      if found + len(run) > len(actual_lines):
+        self.out("FAIL: Expected to find the following lines in the listing:")
+        for line in run:
+          self.out(line)
+        return False
+      position = found + len(run)
+    return True
+
+  # Sends the compilation to "spcomp --server" twice, from a relative
+  # directory, and checks that both answers are the same. The second request
+  # only finds the directory if the server went back to where it started.
+  def run_compile_server(self, mode, test, argv):
+    if not os.path.isdir('server'):
+      os.mkdir('server')
+    request = '\t'.join(['server'] + argv[1:]) + '\n'
+    rc, stdout, stderr = self.do_exec([argv[0], '--server'], env = mode['spcomp']['env'],
+                                      input = request * 2)
+    if rc != 0:
+      return rc, stdout, stderr
+
+    answers = stdout.split('\0')
+    if len(answers) != 3:
+      return 1, stdout, 'expected 2 answers from the server, got {0}'.format(len(answers) - 1)
+    first_output = answers[0]
+    first_rc, second_output = answers[1].split('\n', 1)
+    second_rc = answers[2].strip()
+    if first_rc != second_rc or first_output != second_output:
+      return 1, stdout, 'the server answered the same request differently'
+    return int(second_rc), second_output, stderr
+
   def run_shells(self, mode, test):
     for shell in self.plan.shells:
       if not self.run_shell(mode, shell, test):
@@ -485,7 +619,7 @@ class TestRunner(object):
 
   def run_shell(self, mode, shell, test):
     self.out("Running with shell ({0})".format(shell['name']))
-    argv = [shell['path']] + shell['args']
+    argv = [shell['path']] + shell['args'] + test.shell_args
     argv += [self.fix_path(shell['path'], test.smx_path)]
 
     rc, stdout, stderr = self.do_exec(argv, shell['env'])
@@ -525,11 +659,23 @@ class TestRunner(object):
         self.out("FAIL: Compile unexpectedly succeeded, expected no .smx file.")
         return False
 
+    # Files compiled along with the test (with -j) get output files of their
+    # own, named like the test's.
+    for path in test.extra_files:
+      name = os.path.basename(path)
+      smx_path = os.path.splitext(name)[0] + '.smx'
+      if name.startswith('fail-') and os.path.exists(smx_path):
+        self.out("FAIL: Compile of {0} unexpectedly succeeded.".format(name))
+        return False
+      if not name.startswith('fail-') and not os.path.exists(smx_path):
+        self.out("FAIL: Compile of {0} failed, binary '{1}' not found.".format(name, smx_path))
+        return False
+
     if test_prefix == 'ok':
       return True
     return self.compare_spcomp_output(test, stdout)
 
-  def do_exec(self, argv, env = None):
+  def do_exec(self, argv, env = None, input = None):
     if self.plan.show_cli:
       self.out(' '.join(argv))
 
@@ -538,7 +684,7 @@ class TestRunner(object):
     else:
       timeout = 5
 
-    return testutil.exec_argv(argv, timeout, logger = self, env = env)
+    return testutil.exec_argv(argv, timeout, logger = self, env = env, input = input)
 
   def compare_output(self, test, pipe_name, actual):
     expected_lines = test.get_expected_output(pipe_name)
@@ -588,11 +734,16 @@ class TestRunner(object):
       for line in fp:
         expected_lines.append(line.strip())
 
+    # When several files are compiled, their messages must also come in order.
+    position = 0
     for expected_line in expected_lines:
-      if expected_line not in actual_stdout:
+      found = actual_stdout.find(expected_line, position)
+      if found < 0:
         self.out("FAIL: Expected to find the following line in stdout:")
         self.out(expected_line)
         return False
+      if test.extra_files:
+        position = found + len(expected_line)
     return True
 
   def fix_path(self, binary, path):
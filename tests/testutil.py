@@ -32,11 +32,12 @@ class ChangeFolder(object):
     if self.cwd is not None:
       os.chdir(self.cwd)
 
-def exec_argv(argv, timeout = None, logger = None, env = None):
+def exec_argv(argv, timeout = None, logger = None, env = None, input = None):
   if argv[0].endswith('.js'):
     argv = ['node'] + argv
 
-  p = subprocess.Popen(argv, stdout = subprocess.PIPE, stderr = subprocess.PIPE,
+  stdin = subprocess.PIPE if input is not None else None
+  p = subprocess.Popen(argv, stdin = stdin, stdout = subprocess.PIPE, stderr = subprocess.PIPE,
                        env = env)
 
   def on_timeout():
@@ -49,7 +50,7 @@ def exec_argv(argv, timeout = None, logger = None, env = None):
     timer.start()
 
   try:
-    stdout, stderr = p.communicate()
+    stdout, stderr = p.communicate(input.encode('utf-8') if input is not None else None)
     stdout = stdout.decode('utf-8')
     stderr = stderr.decode('utf-8')
     return p.returncode, stdout, stderr
@@ -79,9 +79,12 @@ SourcePawnEngine::ExecAlloc(size_t size)
 void*
 SourcePawnEngine::AllocatePageMemory(size_t size)
 {
-  CodeChunk chunk = Environment::get()->AllocateCode(size + sizeof(CodeChunk));
+  CodeChunk chunk = Environment::get()->AllocateCode(size + sizeof(CodeChunk), CodeKind::Legacy);
+  if (!chunk.address())
+    return nullptr;
+
   CodeChunk* hidden = (CodeChunk*)chunk.address();
-  new (hidden) CodeChunk(chunk);
+  new (hidden) CodeChunk(ke::Move(chunk));
   return hidden + 1;
 }
 
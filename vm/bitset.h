@@ -10,6 +10,8 @@
 // You should have received a copy of the GNU General Public License along with
 // SourcePawn. If not, see http://www.gnu.org/licenses/.
 //
+#ifndef _include_sourcepawn_vm_bitset_h_
+#define _include_sourcepawn_vm_bitset_h_
 
 #include <amtl/am-bits.h>
 #include <amtl/am-maybe.h>
@@ -47,6 +49,13 @@ class BitSet
     words_[word] |= (uintptr_t(1) << pos_in_word(bit));
   }
 
+  void clear(uintptr_t bit) {
+    size_t word = word_for_bit(bit);
+    if (word >= words_.length())
+      return;
+    words_[word] &= ~(uintptr_t(1) << pos_in_word(bit));
+  }
+
   void for_each(const ke::Function<void(uintptr_t)>& callback) {
     for (size_t i = 0; i < words_.length(); i++) {
       uintptr_t word = words_[i];
@@ -81,3 +90,5 @@ class BitSet
 };
 
 } // namespace sp
+
+#endif // _include_sourcepawn_vm_bitset_h_
@@ -11,7 +11,9 @@
 // SourcePawn. If not, see http://www.gnu.org/licenses/.
 //
 #include "builtins.h"
+#include <sp_vm_api.h>
 #include <am-float.h>
+#include <float.h>
 #include <math.h>
 
 namespace sp {
@@ -19,6 +21,10 @@ namespace sp {
 using namespace SourcePawn;
 
 extern sp_nativeinfo_t gBuiltinFloatNatives[];
+extern sp_nativeinfo_t gBuiltinVectorNatives[];
+extern sp_nativeinfo_t gSourceModVectorNatives[];
+extern BuiltinFastNativeInfo gBuiltinStringNatives[];
+extern sp_nativeinfo_t gBuiltinCoroutineNatives[];
 
 BuiltinNatives::BuiltinNatives()
 {
@@ -27,26 +33,67 @@ BuiltinNatives::BuiltinNatives()
 bool
 BuiltinNatives::Initialize()
 {
-  if (!map_.init(32))
+  if (!map_.init(64))
     return false;
 
   for (size_t i = 0; gBuiltinFloatNatives[i].name != nullptr; i++) {
     const sp_nativeinfo_t& entry = gBuiltinFloatNatives[i];
     NativeMap::Insert p = map_.findForAdd(entry.name);
     assert(!p.found());
-    map_.add(p, entry.name, entry.func);
+    map_.add(p, entry.name, Builtin{entry.func, nullptr});
+  }
+  for (size_t i = 0; gBuiltinVectorNatives[i].name != nullptr; i++) {
+    const sp_nativeinfo_t& entry = gBuiltinVectorNatives[i];
+    NativeMap::Insert p = map_.findForAdd(entry.name);
+    assert(!p.found());
+    map_.add(p, entry.name, Builtin{entry.func, nullptr});
+  }
+  for (size_t i = 0; gBuiltinStringNatives[i].name != nullptr; i++) {
+    const BuiltinFastNativeInfo& entry = gBuiltinStringNatives[i];
+    NativeMap::Insert p = map_.findForAdd(entry.name);
+    assert(!p.found());
+    map_.add(p, entry.name, Builtin{entry.func, entry.fast_fn});
+  }
+  for (size_t i = 0; gBuiltinCoroutineNatives[i].name != nullptr; i++) {
+    const sp_nativeinfo_t& entry = gBuiltinCoroutineNatives[i];
+    NativeMap::Insert p = map_.findForAdd(entry.name);
+    assert(!p.found());
+    map_.add(p, entry.name, Builtin{entry.func, nullptr});
   }
 
   return true;
 }
 
+bool
+BuiltinNatives::AddSourceModVectorNatives()
+{
+  for (size_t i = 0; gSourceModVectorNatives[i].name != nullptr; i++) {
+    const sp_nativeinfo_t& entry = gSourceModVectorNatives[i];
+    NativeMap::Insert p = map_.findForAdd(entry.name);
+    if (p.found())
+      continue;
+    if (!map_.add(p, entry.name, Builtin{entry.func, nullptr}))
+      return false;
+  }
+  return true;
+}
+
 SPVM_NATIVE_FUNC
 BuiltinNatives::Lookup(const char* name)
 {
   NativeMap::Result r = map_.find(name);
   if (!r.found())
     return nullptr;
-  return r->value;
+  return r->value.func;
+}
+
+BuiltinFastFn
+BuiltinNatives::LookupFast(const char* name)
+{
+  NativeMap::Result r = map_.find(name);
+  if (!r.found())
+    return nullptr;
+  return r->value.fast_fn;
 }
 
 static cell_t
@@ -150,4 +197,225 @@ sp_nativeinfo_t gBuiltinFloatNatives[] = {
   {nullptr,           nullptr},
 };
 
+static const VectorOpInfo sVectorOpInfo[] = {
+  {3, 3},   // Add(a[3], b[3], out[3])
+  {3, 3},   // Sub(a[3], b[3], out[3])
+  {2, 1},   // Scale(vec[3], scale)
+  {2, 1},   // Length(vec[3], squared)
+  {3, 2},   // Distance(a[3], b[3], squared)
+  {2, 2},   // Normalize(vec[3], out[3])
+  {2, 2},   // Dot(a[3], b[3])
+  {3, 3},   // Cross(a[3], b[3], out[3])
+};
+
+const VectorOpInfo&
+GetVectorOpInfo(VectorOp op)
+{
+  assert(size_t(op) < sizeof(sVectorOpInfo) / sizeof(sVectorOpInfo[0]));
+  return sVectorOpInfo[size_t(op)];
+}
+
+// Note: the order of operations here mirrors what the JIT emits, so that
+// inlined and non-inlined results agree. All inputs are read before any
+// output is written, since the output vector may alias an input.
+cell_t
+ExecuteVectorOp(VectorOp op, float* const* vecs, const cell_t* args)
+{
+  switch (op) {
+    case VectorOp::Add:
+    case VectorOp::Sub:
+    {
+      const float* a = vecs[0];
+      const float* b = vecs[1];
+      float x, y, z;
+      if (op == VectorOp::Add) {
+        x = a[0] + b[0];
+        y = a[1] + b[1];
+        z = a[2] + b[2];
+      } else {
+        x = a[0] - b[0];
+        y = a[1] - b[1];
+        z = a[2] - b[2];
+      }
+      vecs[2][0] = x;
+      vecs[2][1] = y;
+      vecs[2][2] = z;
+      return 0;
+    }
+
+    case VectorOp::Scale:
+    {
+      float* vec = vecs[0];
+      float scale = sp_ctof(args[1]);
+      vec[0] *= scale;
+      vec[1] *= scale;
+      vec[2] *= scale;
+      return 0;
+    }
+
+    case VectorOp::Length:
+    {
+      const float* vec = vecs[0];
+      float length = vec[0] * vec[0];
+      length += vec[1] * vec[1];
+      length += vec[2] * vec[2];
+      if (!args[1])
+        length = sqrtf(length);
+      return sp_ftoc(length);
+    }
+
+    case VectorOp::Distance:
+    {
+      const float* a = vecs[0];
+      const float* b = vecs[1];
+      float dx = a[0] - b[0];
+      float dy = a[1] - b[1];
+      float dz = a[2] - b[2];
+      float length = dx * dx;
+      length += dy * dy;
+      length += dz * dz;
+      if (!args[2])
+        length = sqrtf(length);
+      return sp_ftoc(length);
+    }
+
+    case VectorOp::Normalize:
+    {
+      // Matches the Source engine's VectorNormalize: a zero vector stays zero
+      // rather than producing NaNs.
+      const float* vec = vecs[0];
+      float x = vec[0], y = vec[1], z = vec[2];
+      float length = x * x;
+      length += y * y;
+      length += z * z;
+      length = sqrtf(length);
+      float scale = 1.0f / (length + FLT_EPSILON);
+      vecs[1][0] = x * scale;
+      vecs[1][1] = y * scale;
+      vecs[1][2] = z * scale;
+      return sp_ftoc(length);
+    }
+
+    case VectorOp::Dot:
+    {
+      const float* a = vecs[0];
+      const float* b = vecs[1];
+      float dot = a[0] * b[0];
+      dot += a[1] * b[1];
+      dot += a[2] * b[2];
+      return sp_ftoc(dot);
+    }
+
+    case VectorOp::Cross:
+    {
+      const float* a = vecs[0];
+      const float* b = vecs[1];
+      float x = a[1] * b[2] - a[2] * b[1];
+      float y = a[2] * b[0] - a[0] * b[2];
+      float z = a[0] * b[1] - a[1] * b[0];
+      vecs[2][0] = x;
+      vecs[2][1] = y;
+      vecs[2][2] = z;
+      return 0;
+    }
+
+    default:
+      assert(false);
+      return 0;
+  }
+}
+
+static cell_t
+VectorNative(IPluginContext* pCtx, const cell_t* params, VectorOp op)
+{
+  const VectorOpInfo& info = GetVectorOpInfo(op);
+  if (params[0] < cell_t(info.nargs))
+    return pCtx->ThrowNativeError("Expected %d parameters, got %d", info.nargs, params[0]);
+
+  float* vecs[3];
+  for (uint32_t i = 0; i < info.nvectors; i++) {
+    int err;
+    cell_t* addr;
+    cell_t* last;
+    if ((err = pCtx->LocalToPhysAddr(params[i + 1], &addr)) != SP_ERROR_NONE ||
+        (err = pCtx->LocalToPhysAddr(params[i + 1] + 2 * sizeof(cell_t), &last)) != SP_ERROR_NONE)
+    {
+      return pCtx->ThrowNativeErrorEx(err, "Invalid vector address");
+    }
+    vecs[i] = reinterpret_cast<float*>(addr);
+  }
+  return ExecuteVectorOp(op, vecs, &params[1]);
+}
+
+static cell_t
+VecAdd(IPluginContext* pCtx, const cell_t* params)
+{
+  return VectorNative(pCtx, params, VectorOp::Add);
+}
+
+static cell_t
+VecSub(IPluginContext* pCtx, const cell_t* params)
+{
+  return VectorNative(pCtx, params, VectorOp::Sub);
+}
+
+static cell_t
+VecScale(IPluginContext* pCtx, const cell_t* params)
+{
+  return VectorNative(pCtx, params, VectorOp::Scale);
+}
+
+static cell_t
+VecLength(IPluginContext* pCtx, const cell_t* params)
+{
+  return VectorNative(pCtx, params, VectorOp::Length);
+}
+
+static cell_t
+VecDistance(IPluginContext* pCtx, const cell_t* params)
+{
+  return VectorNative(pCtx, params, VectorOp::Distance);
+}
+
+static cell_t
+VecNormalize(IPluginContext* pCtx, const cell_t* params)
+{
+  return VectorNative(pCtx, params, VectorOp::Normalize);
+}
+
+static cell_t
+VecDot(IPluginContext* pCtx, const cell_t* params)
+{
+  return VectorNative(pCtx, params, VectorOp::Dot);
+}
+
+static cell_t
+VecCross(IPluginContext* pCtx, const cell_t* params)
+{
+  return VectorNative(pCtx, params, VectorOp::Cross);
+}
+
+sp_nativeinfo_t gBuiltinVectorNatives[] = {
+  {"__vec_add",       VecAdd},
+  {"__vec_sub",       VecSub},
+  {"__vec_scale",     VecScale},
+  {"__vec_length",    VecLength},
+  {"__vec_distance",  VecDistance},
+  {"__vec_normalize", VecNormalize},
+  {"__vec_dot",       VecDot},
+  {"__vec_cross",     VecCross},
+  {nullptr,           nullptr},
+};
+
+// SourceMod registers these natives itself, so they are only bound to the
+// builtins if the host asks for it.
+sp_nativeinfo_t gSourceModVectorNatives[] = {
+  {"GetVectorLength",       VecLength},
+  {"GetVectorDistance",     VecDistance},
+  {"NormalizeVector",       VecNormalize},
+  {"GetVectorDotProduct",   VecDot},
+  {"GetVectorCrossProduct", VecCross},
+  {nullptr,                 nullptr},
+};
+
 } // namespace sp
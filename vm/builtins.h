@@ -16,9 +16,43 @@
 #include <sp_vm_types.h>
 #include <amtl/am-hashmap.h>
 #include <string.h>
+#include "pcode-visitor.h"
 
 namespace sp {
 
+class PluginContext;
+
+// A builtin that the JIT can call without an exit frame. It must not call
+// back into the VM or report errors itself; instead it returns an SP_ERROR
+// code, and stores the native's return value in |result|.
+typedef int (*BuiltinFastFn)(PluginContext* cx, const cell_t* params, cell_t* result);
+
+struct BuiltinFastNativeInfo
+{
+  const char* name;
+  SPVM_NATIVE_FUNC func;
+  BuiltinFastFn fast_fn;
+};
+
+struct VectorOpInfo
+{
+  // Number of arguments the operation consumes from the stack.
+  uint32_t nargs;
+
+  // Number of leading arguments that are float[3] addresses.
+  uint32_t nvectors;
+};
+
+const VectorOpInfo& GetVectorOpInfo(VectorOp op);
+
+// Perform a vector operation. |vecs| contains the physical address of each
+// vector argument, which must have already been bounds-checked, and |args|
+// contains the raw argument cells. The return value is the native's result.
+//
+// This is shared by the builtin natives, the interpreter, and the JIT when
+// the operation cannot be inlined.
+cell_t ExecuteVectorOp(VectorOp op, float* const* vecs, const cell_t* args);
+
 class BuiltinNatives
 {
  public:
@@ -26,9 +60,22 @@ class BuiltinNatives
 
   bool Initialize();
 
+  // Adds the SourceMod names of the vector natives; see
+  // ISourcePawnEnvironment::EnableSourceModVectorNatives.
+  bool AddSourceModVectorNatives();
+
   SPVM_NATIVE_FUNC Lookup(const char* name);
 
+  // Returns the fast entry point for a builtin, or null if it only has a
+  // normal native entry point.
+  BuiltinFastFn LookupFast(const char* name);
+
  private:
+  struct Builtin {
+    SPVM_NATIVE_FUNC func;
+    BuiltinFastFn fast_fn;
+  };
+
   struct NativeMapPolicy {
     static inline bool matches(const char* lookup, const char* key) {
       return strcmp(lookup, key) == 0;
@@ -38,7 +85,7 @@ class BuiltinNatives
     }
   };
   typedef ke::HashMap<const char*,
-                      SPVM_NATIVE_FUNC,
+                      Builtin,
                       NativeMapPolicy> NativeMap;
 
   NativeMap map_;
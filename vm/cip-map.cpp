@@ -0,0 +1,157 @@
+// vim: set sts=2 ts=8 sw=2 tw=99 et:
+//
+// Copyright (C) 2006-2018 AlliedModders LLC
+//
+// This file is part of SourcePawn. SourcePawn is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License along with
+// SourcePawn. If not, see http://www.gnu.org/licenses/.
+//
+#include "cip-map.h"
+#include <amtl/am-vector.h>
+#include <assert.h>
+#include <string.h>
+#include <sp_vm_types.h>
+
+namespace sp {
+
+using namespace ke;
+
+static void
+WriteUnsigned(Vector<uint8_t>* out, uint32_t value)
+{
+  while (value >= 0x80) {
+    out->append(uint8_t(value | 0x80));
+    value >>= 7;
+  }
+  out->append(uint8_t(value));
+}
+
+static void
+WriteSigned(Vector<uint8_t>* out, int32_t value)
+{
+  // Zig-zag encode, so small negative deltas stay small.
+  WriteUnsigned(out, (uint32_t(value) << 1) ^ uint32_t(value >> 31));
+}
+
+static uint32_t
+ReadUnsigned(const uint8_t** pos)
+{
+  uint32_t value = 0;
+  uint32_t shift = 0;
+  const uint8_t* p = *pos;
+  for (;;) {
+    uint8_t byte = *p++;
+    value |= uint32_t(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      break;
+    shift += 7;
+  }
+  *pos = p;
+  return value;
+}
+
+static int32_t
+ReadSigned(const uint8_t** pos)
+{
+  uint32_t value = ReadUnsigned(pos);
+  return int32_t(value >> 1) ^ -int32_t(value & 1);
+}
+
+CipMap::CipMap(const CipMapEntry* entries, size_t length)
+ : stream_length_(0),
+   length_(length),
+   index_length_(0)
+{
+  Vector<uint8_t> stream;
+  CipMapEntry prev = {0, 0};
+  for (size_t i = 0; i < length; i++) {
+    const CipMapEntry& entry = entries[i];
+    assert(entry.pcoffs >= prev.pcoffs);
+    assert(entry.cipoffs % sizeof(cell_t) == 0);
+
+    WriteUnsigned(&stream, entry.pcoffs - prev.pcoffs);
+    WriteSigned(&stream, (int32_t(entry.cipoffs) - int32_t(prev.cipoffs)) / int32_t(sizeof(cell_t)));
+    prev = entry;
+  }
+
+  stream_length_ = stream.length();
+  stream_ = MakeUnique<uint8_t[]>(stream_length_);
+  if (stream_length_)
+    memcpy(stream_.get(), stream.buffer(), stream_length_);
+}
+
+size_t
+CipMap::EstimateMemUsage() const
+{
+  return sizeof(*this) + stream_length_ + index_length_ * sizeof(IndexEntry);
+}
+
+const CipMapEntry&
+CipMap::Reader::next()
+{
+  assert(remaining_);
+  entry_.pcoffs += ReadUnsigned(&pos_);
+  entry_.cipoffs += ReadSigned(&pos_) * int32_t(sizeof(cell_t));
+  remaining_--;
+  return entry_;
+}
+
+void
+CipMap::buildIndex()
+{
+  index_length_ = length_ / kIndexInterval;
+  index_ = MakeUnique<IndexEntry[]>(index_length_);
+
+  Reader reader(this);
+  for (size_t i = 0; i < index_length_; i++) {
+    for (size_t j = 0; j < kIndexInterval; j++)
+      reader.next();
+    index_[i].entry = reader.entry_;
+    index_[i].next_pos = uint32_t(reader.pos_ - stream_.get());
+  }
+}
+
+bool
+CipMap::Lookup(uint32_t pcoffs, uint32_t* cipoffs)
+{
+  if (length_ >= kIndexInterval && !index_)
+    buildIndex();
+
+  // Find the last indexed entry at or before pcoffs, and decode from there.
+  Reader reader(this);
+  size_t lo = 0, hi = index_length_;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (index_[mid].entry.pcoffs <= pcoffs)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo > 0) {
+    const IndexEntry& start = index_[lo - 1];
+    if (start.entry.pcoffs == pcoffs) {
+      *cipoffs = start.entry.cipoffs;
+      return true;
+    }
+    reader.entry_ = start.entry;
+    reader.pos_ = stream_.get() + start.next_pos;
+    reader.remaining_ = length_ - lo * kIndexInterval;
+  }
+
+  while (reader.more()) {
+    const CipMapEntry& entry = reader.next();
+    if (entry.pcoffs == pcoffs) {
+      *cipoffs = entry.cipoffs;
+      return true;
+    }
+    if (entry.pcoffs > pcoffs)
+      break;
+  }
+  return false;
+}
+
+} // namespace sp
@@ -0,0 +1,100 @@
+// vim: set sts=2 ts=8 sw=2 tw=99 et:
+//
+// Copyright (C) 2006-2018 AlliedModders LLC
+//
+// This file is part of SourcePawn. SourcePawn is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License along with
+// SourcePawn. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef _include_sourcepawn_vm_cip_map_h_
+#define _include_sourcepawn_vm_cip_map_h_
+
+#include <amtl/am-autoptr.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace sp {
+
+struct CipMapEntry {
+  // Offset from the first cip of the function.
+  uint32_t cipoffs;
+  // Offset from the first pc of the function.
+  uint32_t pcoffs;
+};
+
+// Maps return addresses in a compiled function back to cips, for stack
+// walks. Entries are added as code is emitted, so they are sorted by pc.
+//
+// Each entry is stored as two variable-length deltas from the previous
+// entry: the pc delta (unsigned), then the cip delta in cells (signed, since
+// out-of-line paths refer back to earlier instructions). Most entries fit in
+// two or three bytes.
+//
+// The map is decoded on demand. Large maps get a sparse index of decoded
+// entries the first time they are searched, so a lookup only has to decode
+// a few entries.
+class CipMap
+{
+ public:
+  CipMap(const CipMapEntry* entries, size_t length);
+
+  size_t length() const {
+    return length_;
+  }
+
+  // Bytes used by this object and its tables.
+  size_t EstimateMemUsage() const;
+
+  // Find the entry for a return address. Returns false if there is none.
+  bool Lookup(uint32_t pcoffs, uint32_t* cipoffs);
+
+  // Decodes entries in order.
+  class Reader
+  {
+   public:
+    explicit Reader(const CipMap* map)
+     : pos_(map->stream_.get()),
+       remaining_(map->length_)
+    {
+      entry_.cipoffs = 0;
+      entry_.pcoffs = 0;
+    }
+
+    bool more() const {
+      return remaining_ > 0;
+    }
+    const CipMapEntry& next();
+
+   private:
+    friend class CipMap;
+
+    const uint8_t* pos_;
+    size_t remaining_;
+    CipMapEntry entry_;
+  };
+
+ private:
+  void buildIndex();
+
+ private:
+  // Every kIndexInterval'th entry, with the stream position just past it.
+  struct IndexEntry {
+    CipMapEntry entry;
+    uint32_t next_pos;
+  };
+  static const size_t kIndexInterval = 16;
+
+  ke::AutoPtr<uint8_t[]> stream_;
+  size_t stream_length_;
+  size_t length_;
+  ke::AutoPtr<IndexEntry[]> index_;
+  size_t index_length_;
+};
+
+} // namespace sp
+
+#endif // _include_sourcepawn_vm_cip_map_h_
@@ -11,6 +11,9 @@
 // SourcePawn. If not, see http://www.gnu.org/licenses/.
 //
 #include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "code-allocator.h"
 #if defined(_WIN32)
 # include <Windows.h>
@@ -21,64 +24,68 @@
 
 using namespace sp;
 
-static const size_t kMaxCachedPools = 8;
-
 CodeAllocator::CodeAllocator()
+ : never_reuse_(false)
 {
 }
 
 CodeAllocator::~CodeAllocator()
 {
+  AutoLock lock(&lock_);
+  for (size_t i = 0; i < pools_.length(); i++)
+    pools_[i]->alloc_ = nullptr;
+}
+
+void
+CodeAllocator::NeverReuseAddresses()
+{
+  AutoLock lock(&lock_);
+  never_reuse_ = true;
 }
 
 CodeChunk
-CodeAllocator::Allocate(size_t rawBytes)
+CodeAllocator::Allocate(size_t rawBytes, CodeKind kind)
 {
   size_t bytes = Align(rawBytes, kMallocAlignment);
   if (bytes < rawBytes)
     return CodeChunk();
 
-  // First search the cache for any pools we can re-use.
-  RefPtr<CodePool> pool = findPool(bytes);
+  AutoLock lock(&lock_);
+
+  releaseEmptyPools();
+
+  // First search for a pool with a free range we can re-use.
+  RefPtr<CodePool> pool = findPool(bytes, kind);
   if (pool)
     return allocateInPool(pool, bytes);
 
-  pool = CodePool::AllocateFor(bytes);
+  pool = CodePool::AllocateFor(this, bytes, kind);
   if (!pool)
     return CodeChunk();
+  if (!pools_.append(pool))
+    return CodeChunk();
 
-  CodeChunk chunk = allocateInPool(pool, bytes);
-
-  // Enter this pool into the cache if we can.
-  if (cached_pools_.length() < kMaxCachedPools) {
-    cached_pools_.append(pool);
-  } else {
-    // If this pool has more free space than any of our cached pools, then
-    // evict the pool with the least amount of free space left.
-    size_t min_index = 0;
-    for (size_t i = 1; i < cached_pools_.length(); i++) {
-      if (cached_pools_[i]->bytesFree() < cached_pools_[min_index]->bytesFree())
-        min_index = i;
-    }
-    if (cached_pools_[min_index]->bytesFree() < pool->bytesFree())
-      cached_pools_[min_index] = pool;
-  }
-
-  return chunk;
+  return allocateInPool(pool, bytes);
 }
 
 RefPtr<CodePool>
-CodeAllocator::findPool(size_t bytes)
+CodeAllocator::findPool(size_t bytes, CodeKind kind)
 {
-  // Find the cached pool with the smallest free region that holds |bytes|, to
+  // Find the pool with the smallest free region that holds |bytes|, to
   // reduce fragmentation.
   RefPtr<CodePool> min;
-  for (size_t i = 0; i < cached_pools_.length(); i++) {
-    RefPtr<CodePool> pool = cached_pools_[i];
-    if (bytes > pool->bytesFree())
+  size_t min_free = 0;
+  for (size_t i = 0; i < pools_.length(); i++) {
+    RefPtr<CodePool> pool = pools_[i];
+    if (pool->kind_ != kind)
+      continue;
+    size_t largest = pool->largestFree();
+    if (bytes > largest)
       continue;
-    if (!min || pool->bytesFree() < min->bytesFree())
+    if (!min || largest < min_free) {
       min = pool;
+      min_free = largest;
+    }
   }
   return min;
 }
@@ -90,11 +97,125 @@ CodeAllocator::allocateInPool(RefPtr<CodePool> pool, size_t bytes)
   return CodeChunk(pool, address, bytes);
 }
 
+void
+CodeAllocator::releaseEmptyPools()
+{
+  // The address range could be mapped again for a new pool.
+  if (never_reuse_)
+    return;
+
+  // Pools only referenced by this list have no live chunks. Keep one around,
+  // so loading and unloading a plugin does not map and unmap each time.
+  bool kept_one = false;
+  for (size_t i = 0; i < pools_.length(); i++) {
+    if (!pools_[i]->empty())
+      continue;
+    if (!kept_one) {
+      kept_one = true;
+      continue;
+    }
+    pools_.remove(i--);
+  }
+}
+
+void
+CodeAllocator::GetStats(CodeAllocatorStats* stats)
+{
+  AutoLock lock(&lock_);
+
+  memset(stats, 0, sizeof(*stats));
+  for (size_t i = 0; i < pools_.length(); i++) {
+    CodePool* pool = pools_[i];
+    stats->pools++;
+    if (pool->huge_pages_)
+      stats->huge_page_pools++;
+    stats->reserved_bytes += pool->size_;
+    stats->used_bytes += pool->bytes_used_;
+    stats->free_ranges += pool->free_list_.length();
+
+    size_t largest = pool->largestFree();
+    if (largest > stats->largest_free_bytes)
+      stats->largest_free_bytes = largest;
+  }
+}
+
 static size_t kPageGranularity = 0;
 static size_t kMinPoolSize = 1 * kMB;
 
+// Pools are aligned to, and sized in multiples of, this when they are backed
+// by transparent huge pages.
+static const size_t kHugePageSize = 2 * kMB;
+
+static bool
+UseHugePages()
+{
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  static int available = -1;
+  if (available == -1) {
+    // "always" or "madvise" both honor MADV_HUGEPAGE.
+    available = 0;
+    if (FILE* fp = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r")) {
+      char buffer[128];
+      if (fgets(buffer, sizeof(buffer), fp) && !strstr(buffer, "[never]"))
+        available = 1;
+      fclose(fp);
+    }
+  }
+  return !!available;
+#else
+  return false;
+#endif
+}
+
+#if !defined(_WIN32)
+static int
+ProtectionFor(CodeAccess access)
+{
+  switch (access) {
+    case CodeAccess::ReadExecute:
+      return PROT_READ|PROT_EXEC;
+    case CodeAccess::ReadWrite:
+      return PROT_READ|PROT_WRITE;
+    default:
+      return PROT_READ|PROT_WRITE|PROT_EXEC;
+  }
+}
+
+// Map |bytes| aligned to |alignment|, by over-allocating and trimming.
+static void*
+MapAligned(size_t bytes, size_t alignment, int prot)
+{
+  size_t padded = bytes + alignment;
+  void* base = mmap(nullptr, padded, prot, MAP_PRIVATE|MAP_ANON, -1, 0);
+  if (base == MAP_FAILED)
+    return nullptr;
+
+  uintptr_t start = ke::Align(uintptr_t(base), alignment);
+  size_t head = start - uintptr_t(base);
+  size_t tail = padded - head - bytes;
+  if (head)
+    munmap(base, head);
+  if (tail)
+    munmap(reinterpret_cast<void*>(start + bytes), tail);
+  return reinterpret_cast<void*>(start);
+}
+#else
+static DWORD
+ProtectionFor(CodeAccess access)
+{
+  switch (access) {
+    case CodeAccess::ReadExecute:
+      return PAGE_EXECUTE_READ;
+    case CodeAccess::ReadWrite:
+      return PAGE_READWRITE;
+    default:
+      return PAGE_EXECUTE_READWRITE;
+  }
+}
+#endif
+
 RefPtr<CodePool>
-CodePool::AllocateFor(size_t askBytes)
+CodePool::AllocateFor(CodeAllocator* alloc, size_t askBytes, CodeKind kind)
 {
   if (!kPageGranularity) {
     // On Windows, the page granularity is defined as 64KB. On POSIX systems it's
@@ -109,31 +230,56 @@ CodePool::AllocateFor(size_t askBytes)
     assert(ke::IsAligned(kPageGranularity, kMallocAlignment));
   }
 
+  // Only JIT code gets huge pages. Legacy code is handed to hosts, which may
+  // change its protection page by page.
+  bool huge_pages = (kind == CodeKind::Jit) && UseHugePages();
+  size_t granularity = huge_pages ? kHugePageSize : kPageGranularity;
+
   // If the allocation is larger than our minimum pool size, we only align up
   // to the page granularity.
   size_t bytes = (askBytes < kMinPoolSize)
-                 ? kMinPoolSize
-                 : ke::Align(askBytes, kPageGranularity);
+                 ? ke::Align(kMinPoolSize, granularity)
+                 : ke::Align(askBytes, granularity);
   assert(ke::IsAligned(bytes, kPageGranularity));
 
+  CodeAccess access = (kind == CodeKind::Jit)
+                      ? CodeAccess::ReadExecute
+                      : CodeAccess::ReadWriteExecute;
+
 #if defined(_WIN32)
-  void* address = (uint8_t* )VirtualAlloc(nullptr, bytes, MEM_COMMIT|MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+  void* address = (uint8_t* )VirtualAlloc(nullptr, bytes, MEM_COMMIT|MEM_RESERVE, ProtectionFor(access));
   if (!address)
     return nullptr;
 #else
-  void* address = mmap(nullptr, bytes, PROT_READ|PROT_WRITE|PROT_EXEC, MAP_PRIVATE|MAP_ANON, -1, 0);
-  if (address == MAP_FAILED)
-    return nullptr;
+  void* address;
+  if (huge_pages) {
+    if ((address = MapAligned(bytes, kHugePageSize, ProtectionFor(access))) == nullptr)
+      return nullptr;
+# if defined(MADV_HUGEPAGE)
+    // This is only advice; if the kernel has no huge pages to spare, the
+    // pool is still usable.
+    madvise(address, bytes, MADV_HUGEPAGE);
+# endif
+  } else {
+    address = mmap(nullptr, bytes, ProtectionFor(access), MAP_PRIVATE|MAP_ANON, -1, 0);
+    if (address == MAP_FAILED)
+      return nullptr;
+  }
 #endif
 
-  return new CodePool((uint8_t*)address, bytes);
+  return new CodePool(alloc, (uint8_t*)address, bytes, kind, huge_pages);
 }
 
-CodePool::CodePool(uint8_t* start, size_t size)
- : start_(start),
+CodePool::CodePool(CodeAllocator* alloc, uint8_t* start, size_t size, CodeKind kind,
+                   bool huge_pages)
+ : alloc_(alloc),
+   start_(start),
    ptr_(start),
    end_(start + size),
-   size_(size)
+   size_(size),
+   bytes_used_(0),
+   kind_(kind),
+   huge_pages_(huge_pages)
 {
 }
 
@@ -146,11 +292,173 @@ CodePool::~CodePool()
 #endif
 }
 
+size_t
+CodePool::largestFree() const
+{
+  size_t largest = end_ - ptr_;
+  for (size_t i = 0; i < free_list_.length(); i++) {
+    if (free_list_[i].bytes > largest)
+      largest = free_list_[i].bytes;
+  }
+  return largest;
+}
+
 uint8_t*
 CodePool::allocate(size_t bytes)
 {
-  assert(ptr_ + bytes <= end_);
-  uint8_t* result = ptr_;
-  ptr_ += bytes;
+  // Take the smallest released range that fits, before bump allocating.
+  size_t best = free_list_.length();
+  for (size_t i = 0; i < free_list_.length(); i++) {
+    if (free_list_[i].bytes < bytes)
+      continue;
+    if (best == free_list_.length() || free_list_[i].bytes < free_list_[best].bytes)
+      best = i;
+  }
+
+  uint8_t* result;
+  if (best != free_list_.length()) {
+    FreeRange& range = free_list_[best];
+    result = range.start;
+    range.start += bytes;
+    range.bytes -= bytes;
+    if (!range.bytes)
+      free_list_.remove(best);
+  } else {
+    assert(ptr_ + bytes <= end_);
+    result = ptr_;
+    ptr_ += bytes;
+  }
+
+  bytes_used_ += bytes;
   return result;
 }
+
+void
+CodePool::release(uint8_t* address, size_t bytes)
+{
+  if (!alloc_) {
+    releaseLocked(address, bytes);
+    return;
+  }
+
+  AutoLock lock(&alloc_->lock_);
+  releaseLocked(address, bytes);
+}
+
+void
+CodePool::releaseLocked(uint8_t* address, size_t bytes)
+{
+  assert(contains(address) && address + bytes <= ptr_);
+  assert(bytes_used_ >= bytes);
+  bytes_used_ -= bytes;
+
+  if (alloc_ && alloc_->never_reuse_)
+    return;
+
+  // A range that ends at the bump pointer is given back to it, along with a
+  // free range just below it.
+  if (address + bytes == ptr_) {
+    ptr_ = address;
+    if (!free_list_.empty() && free_list_.back().start + free_list_.back().bytes == ptr_) {
+      ptr_ = free_list_.back().start;
+      free_list_.pop();
+    }
+    return;
+  }
+
+  // Otherwise, coalesce with the free ranges on either side.
+  size_t index = 0;
+  while (index < free_list_.length() && free_list_[index].start < address)
+    index++;
+
+  bool joins_prev = index > 0 &&
+                    free_list_[index - 1].start + free_list_[index - 1].bytes == address;
+  bool joins_next = index < free_list_.length() &&
+                    address + bytes == free_list_[index].start;
+  if (joins_prev && joins_next) {
+    free_list_[index - 1].bytes += bytes + free_list_[index].bytes;
+    free_list_.remove(index);
+  } else if (joins_prev) {
+    free_list_[index - 1].bytes += bytes;
+  } else if (joins_next) {
+    free_list_[index].start = address;
+    free_list_[index].bytes += bytes;
+  } else {
+    FreeRange range = { address, bytes };
+    free_list_.insert(index, range);
+  }
+}
+
+bool
+CodePool::protect(uint8_t* address, size_t bytes, CodeAccess access)
+{
+  // Huge pages are protected as a whole, so the kernel does not have to
+  // split them.
+  uint8_t* begin = start_;
+  uint8_t* end = end_;
+  if (!huge_pages_) {
+    begin = reinterpret_cast<uint8_t*>(uintptr_t(address) & ~(kPageGranularity - 1));
+    end = reinterpret_cast<uint8_t*>(ke::Align(uintptr_t(address + bytes), kPageGranularity));
+    if (end > end_)
+      end = end_;
+  }
+
+#if defined(_WIN32)
+  DWORD old_protect;
+  return !!VirtualProtect(begin, end - begin, ProtectionFor(access), &old_protect);
+#else
+  return mprotect(begin, end - begin, ProtectionFor(access)) == 0;
+#endif
+}
+
+AutoWritableCode::AutoWritableCode(CodeAllocator* alloc, void* address, size_t bytes)
+ : lock_(&alloc->lock_),
+   alloc_(alloc),
+   pool_(nullptr),
+   address_(reinterpret_cast<uint8_t*>(address)),
+   bytes_(bytes)
+{
+  for (size_t i = 0; i < alloc_->pools_.length(); i++) {
+    CodePool* pool = alloc_->pools_[i];
+    if (pool->kind_ == CodeKind::Jit && pool->contains(address)) {
+      pool_ = pool;
+      break;
+    }
+  }
+
+  if (pool_ && !pool_->protect(address_, bytes_, CodeAccess::ReadWrite)) {
+    // Patching would fault; this is not recoverable.
+    fprintf(stderr, "Unable to make JIT code writable\n");
+    abort();
+  }
+}
+
+AutoWritableCode::AutoWritableCode(CodeAllocator* alloc)
+ : lock_(&alloc->lock_),
+   alloc_(alloc),
+   pool_(nullptr),
+   address_(nullptr),
+   bytes_(0)
+{
+  for (size_t i = 0; i < alloc_->pools_.length(); i++) {
+    CodePool* pool = alloc_->pools_[i];
+    if (pool->kind_ == CodeKind::Jit)
+      pool->protect(pool->start_, pool->size_, CodeAccess::ReadWriteExecute);
+  }
+}
+
+AutoWritableCode::~AutoWritableCode()
+{
+  if (pool_) {
+    pool_->protect(address_, bytes_, CodeAccess::ReadExecute);
+    return;
+  }
+  if (address_)
+    return;
+
+  for (size_t i = 0; i < alloc_->pools_.length(); i++) {
+    CodePool* pool = alloc_->pools_[i];
+    if (pool->kind_ == CodeKind::Jit)
+      pool->protect(pool->start_, pool->size_, CodeAccess::ReadExecute);
+  }
+}
@@ -16,28 +16,60 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <am-refcounting.h>
+#include <am-thread-utils.h>
 #include <am-vector.h>
 
 namespace sp {
 
 using namespace ke;
 
-// Manages CodeChunks, optimized for the underlying system allocator.
+class CodeAllocator;
+
+// JIT code is mapped read-execute, and can only be written inside an
+// AutoWritableCode window. Legacy code, handed out by AllocatePageMemory(),
+// stays read-write-execute since hosts write to it directly.
+enum class CodeKind
+{
+  Jit,
+  Legacy
+};
+
+enum class CodeAccess
+{
+  ReadExecute,
+  ReadWrite,
+  ReadWriteExecute
+};
+
+// Manages CodeChunks, optimized for the underlying system allocator. Space
+// is bump allocated, and ranges released by CodeChunks are kept on a free
+// list for reuse. The pool is guarded by its allocator's lock, since chunks
+// can be released on any thread.
 class CodePool : public ke::Refcounted<CodePool>
 {
   friend class CodeAllocator;
+  friend class AutoWritableCode;
+  friend struct CodeChunk;
 
  public:
   ~CodePool();
 
  private:
-  CodePool(uint8_t* start, size_t size);
+  CodePool(CodeAllocator* alloc, uint8_t* start, size_t size, CodeKind kind, bool huge_pages);
 
-  static RefPtr<CodePool> AllocateFor(size_t bytes);
+  static RefPtr<CodePool> AllocateFor(CodeAllocator* alloc, size_t bytes, CodeKind kind);
 
   uint8_t* allocate(size_t bytes);
-  size_t bytesFree() const {
-    return end_ - ptr_;
+  void release(uint8_t* address, size_t bytes);
+  void releaseLocked(uint8_t* address, size_t bytes);
+  size_t largestFree() const;
+  bool protect(uint8_t* address, size_t bytes, CodeAccess access);
+
+  bool contains(const void* address) const {
+    return address >= start_ && address < end_;
+  }
+  bool empty() const {
+    return bytes_used_ == 0;
   }
 
  private:
@@ -45,13 +77,27 @@ class CodePool : public ke::Refcounted<CodePool>
   void operator =(const CodePool&) = delete;
 
  private:
+  struct FreeRange {
+    uint8_t* start;
+    size_t bytes;
+  };
+
+  // Null once the allocator is gone; chunks may outlive it at shutdown.
+  CodeAllocator* alloc_;
   uint8_t* start_;
   uint8_t* ptr_;
   uint8_t* end_;
   size_t size_;
+  size_t bytes_used_;
+  CodeKind kind_;
+  bool huge_pages_;
+
+  // Released ranges below ptr_, sorted by address and coalesced.
+  Vector<FreeRange> free_list_;
 };
 
-// Raw reference to allocated code.
+// Owning reference to allocated code. The range is returned to its pool
+// when the chunk is destroyed.
 struct CodeChunk
 {
   CodeChunk()
@@ -63,6 +109,27 @@ struct CodeChunk
      address_(address),
      bytes_(bytes)
   {}
+  CodeChunk(CodeChunk&& other)
+   : pool_(Move(other.pool_)),
+     address_(other.address_),
+     bytes_(other.bytes_)
+  {
+    other.address_ = nullptr;
+    other.bytes_ = 0;
+  }
+  ~CodeChunk() {
+    reset();
+  }
+
+  CodeChunk& operator =(CodeChunk&& other) {
+    reset();
+    pool_ = Move(other.pool_);
+    address_ = other.address_;
+    bytes_ = other.bytes_;
+    other.address_ = nullptr;
+    other.bytes_ = 0;
+    return *this;
+  }
 
   uint8_t* address() const {
     return address_;
@@ -71,32 +138,97 @@ struct CodeChunk
     return bytes_;
   }
 
+ private:
+  void reset() {
+    if (pool_) {
+      pool_->release(address_, bytes_);
+      pool_ = nullptr;
+    }
+  }
+
+  CodeChunk(const CodeChunk&) = delete;
+  void operator =(const CodeChunk&) = delete;
+
  private:
   RefPtr<CodePool> pool_;
   uint8_t* address_;
   size_t bytes_;
 };
 
+struct CodeAllocatorStats
+{
+  size_t pools;
+  size_t huge_page_pools;
+
+  // Bytes mapped for pools, and bytes in live chunks.
+  size_t reserved_bytes;
+  size_t used_bytes;
+
+  // Released ranges that have not been reused, and the largest contiguous
+  // free range in any pool. Fragmentation is the share of free space that
+  // is not in the largest range.
+  size_t free_ranges;
+  size_t largest_free_bytes;
+};
+
 // Manages CodePools.
 class CodeAllocator
 {
+  friend class AutoWritableCode;
+  friend class CodePool;
+
  public:
   CodeAllocator();
   ~CodeAllocator();
 
-  CodeChunk Allocate(size_t bytes);
+  CodeChunk Allocate(size_t bytes, CodeKind kind = CodeKind::Jit);
+
+  // Stop reusing released ranges and unmapping empty pools, so that an
+  // address is never handed out twice. The perf map cannot retire a symbol,
+  // so reused code would be attributed to whatever was there before.
+  void NeverReuseAddresses();
+
+  void GetStats(CodeAllocatorStats* stats);
 
  private:
-  RefPtr<CodePool> newPool(size_t bytes);
-  RefPtr<CodePool> findPool(size_t bytes);
+  RefPtr<CodePool> findPool(size_t bytes, CodeKind kind);
   CodeChunk allocateInPool(RefPtr<CodePool> pool, size_t bytes);
+  void releaseEmptyPools();
 
  private:
   CodeAllocator(const CodeAllocator&) = delete;
   void operator =(const CodeAllocator&) = delete;
 
  private:
-  Vector<RefPtr<CodePool>> cached_pools_;
+  // Held while allocating or releasing, and while any window is open, since
+  // the watchdog thread patches code.
+  ke::Mutex lock_;
+  Vector<RefPtr<CodePool>> pools_;
+  bool never_reuse_;
+};
+
+// Makes JIT code writable for the lifetime of the object, and read-execute
+// again afterward. Windows must not be nested.
+class AutoWritableCode
+{
+ public:
+  // Write to [address, address + bytes) on the thread that runs plugin code.
+  // The range is not executable until the window closes. Ranges that are not
+  // JIT code are left alone.
+  AutoWritableCode(CodeAllocator* alloc, void* address, size_t bytes);
+
+  // Write to any JIT code. Code stays executable, since it may be running on
+  // another thread.
+  explicit AutoWritableCode(CodeAllocator* alloc);
+
+  ~AutoWritableCode();
+
+ private:
+  AutoLock lock_;
+  CodeAllocator* alloc_;
+  CodePool* pool_;
+  uint8_t* address_;
+  size_t bytes_;
 };
 
 } // namespace sp
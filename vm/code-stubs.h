@@ -37,6 +37,9 @@ class CodeStubs
   InvokeStubFn InvokeStub() const {
     return (InvokeStubFn)invoke_stub_.address();
   }
+  const CodeChunk& InvokeStubCode() const {
+    return invoke_stub_;
+  }
   void* ReturnStub() const {
     return return_stub_;
   }
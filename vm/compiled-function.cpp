@@ -16,15 +16,24 @@
 
 using namespace sp;
 
-CompiledFunction::CompiledFunction(const CodeChunk& code,
+CompiledFunction::CompiledFunction(CodeChunk&& code,
                                    cell_t pcode_offs,
                                    FixedArray<LoopEdge>* edges,
-                                   FixedArray<CipMapEntry>* cipmap)
- : code_(code),
+                                   CipMap* cipmap,
+                                   FixedArray<DebugBreakSite>* break_sites,
+                                   uint32_t break_handler_offset,
+                                   FixedArray<uint32_t>* absolute_refs,
+                                   FixedArray<uint32_t>* code_offset_refs,
+                                   FixedArray<CallSite>* call_sites)
+ : code_(ke::Move(code)),
    code_offset_(pcode_offs),
    edges_(edges),
    cip_map_(cipmap),
-   cip_map_sorted_(false)
+   break_sites_(break_sites),
+   break_handler_offset_(break_handler_offset),
+   absolute_refs_(absolute_refs),
+   code_offset_refs_(code_offset_refs),
+   call_sites_(call_sites)
 {
 }
 
@@ -32,28 +41,6 @@ CompiledFunction::~CompiledFunction()
 {
 }
 
-static int cip_map_entry_sort_cmp(const void* a1, const void* a2)
-{
-  const CipMapEntry* c1 = reinterpret_cast<const CipMapEntry*>(a1);
-  const CipMapEntry* c2 = reinterpret_cast<const CipMapEntry*>(a2);
-  if (c1->pcoffs < c2->pcoffs)
-    return -1;
-  if (c1->pcoffs == c2->pcoffs)
-    return 0;
-  return 1;
-}
-
-static int cip_map_entry_cmp(const void* a1, const void* aEntry)
-{
-  uint32_t pcoffs = (uint32_t)(intptr_t)a1;
-  const CipMapEntry* entry = reinterpret_cast<const CipMapEntry*>(aEntry);
-  if (pcoffs < entry->pcoffs)
-    return -1;
-  if (pcoffs == entry->pcoffs)
-    return 0;
-  return pcoffs > entry->pcoffs;
-}
-
 ucell_t
 CompiledFunction::FindCipByPc(void* pc)
 {
@@ -64,26 +51,12 @@ CompiledFunction::FindCipByPc(void* pc)
   if (pcoffs > code_.bytes())
     return kInvalidCip;
 
-  if (!cip_map_sorted_) {
-    qsort(cip_map_->buffer(),
-          cip_map_->length(),
-          sizeof(CipMapEntry),
-          cip_map_entry_sort_cmp);
-    cip_map_sorted_ = true;
-  }
-
-  void* ptr = bsearch(
-    (void*)(uintptr_t)pcoffs,
-    cip_map_->buffer(),
-    cip_map_->length(),
-    sizeof(CipMapEntry),
-    cip_map_entry_cmp);
-  assert(ptr);
-
-  if (!ptr) {
+  uint32_t cipoffs;
+  if (!cip_map_->Lookup(pcoffs, &cipoffs)) {
     // Shouldn't happen, but fail gracefully.
+    assert(false);
     return kInvalidCip;
   }
 
-  return code_offset_ + reinterpret_cast<CipMapEntry*>(ptr)->cipoffs;
+  return code_offset_ + cipoffs;
 }
@@ -18,6 +18,7 @@
 #include <amtl/am-fixedarray.h>
 #include <amtl/am-refcounting.h>
 #include "code-allocator.h"
+#include "cip-map.h"
 
 namespace sp {
 
@@ -35,22 +36,43 @@ struct LoopEdge
   int32_t disp32;
 };
 
-struct CipMapEntry {
-  // Offset from the first cip of the function.
+struct DebugBreakSite {
+  // Offset from the first cip of the function, to the BREAK instruction.
   uint32_t cipoffs;
-  // Offset from the first pc of the function.
+  // Offset from the first pc of the function, to a 5-byte instruction that
+  // is either a nop or a call to the debug break handler.
   uint32_t pcoffs;
 };
 
+// A call to another scripted function. When the function is adopted by a new
+// version of its plugin, the callee may be somewhere else in the new code.
+struct CallSite {
+  // Offset from the first cip of the function, to the CALL instruction.
+  uint32_t cipoffs;
+  // Offset from the first pc of the function, to the end of the call.
+  uint32_t pcoffs;
+  // Offset from the first pc of the function, to the thunk that compiles the
+  // callee, or 0 if the callee was already compiled and is called directly.
+  uint32_t thunk;
+  // Offset from the first pc of the function, to the end of the thunk's
+  // immediate holding the callee's code offset.
+  uint32_t thunk_callee;
+};
+
 static const ucell_t kInvalidCip = 0xffffffff;
 
 class CompiledFunction
 {
  public:
-  CompiledFunction(const CodeChunk& code,
+  CompiledFunction(CodeChunk&& code,
                    cell_t pcode_offs,
                    FixedArray<LoopEdge>* edges,
-                   FixedArray<CipMapEntry>* cip_map);
+                   CipMap* cip_map,
+                   FixedArray<DebugBreakSite>* break_sites,
+                   uint32_t break_handler_offset,
+                   FixedArray<uint32_t>* absolute_refs,
+                   FixedArray<uint32_t>* code_offset_refs,
+                   FixedArray<CallSite>* call_sites);
   ~CompiledFunction();
 
  public:
@@ -66,15 +88,60 @@ class CompiledFunction
   LoopEdge& GetLoopEdge(size_t i) {
     return edges_->at(i);
   }
+  size_t GetCodeSize() const {
+    return code_.bytes();
+  }
+  const CipMap* GetCipMap() const {
+    return cip_map_;
+  }
+  size_t NumDebugBreakSites() const {
+    return break_sites_->length();
+  }
+  const DebugBreakSite& GetDebugBreakSite(size_t i) const {
+    return break_sites_->at(i);
+  }
+  uint32_t DebugBreakHandlerOffset() const {
+    return break_handler_offset_;
+  }
+
+  // Relocation info, for moving the function to a new version of its plugin.
+  // Each offset is to the end of a 4-byte value in the code: the address of
+  // an object, or the code offset of an instruction in this function.
+  const FixedArray<uint32_t>& AbsoluteRefs() const {
+    return *absolute_refs_;
+  }
+  const FixedArray<uint32_t>& CodeOffsetRefs() const {
+    return *code_offset_refs_;
+  }
+  const FixedArray<CallSite>& CallSites() const {
+    return *call_sites_;
+  }
+  void SetCodeOffset(cell_t pcode_offs) {
+    code_offset_ = pcode_offs;
+  }
 
   ucell_t FindCipByPc(void* pc);
 
+  // Bytes used by this object and its tables, not including code.
+  size_t EstimateMetadataSize() const {
+    return sizeof(*this) +
+           sizeof(LoopEdge) * edges_->length() +
+           cip_map_->EstimateMemUsage() +
+           sizeof(DebugBreakSite) * break_sites_->length() +
+           sizeof(uint32_t) * (absolute_refs_->length() + code_offset_refs_->length()) +
+           sizeof(CallSite) * call_sites_->length();
+  }
+
  private:
   CodeChunk code_;
   cell_t code_offset_;
   AutoPtr<FixedArray<LoopEdge>> edges_;
-  AutoPtr<FixedArray<CipMapEntry>> cip_map_;
-  bool cip_map_sorted_;
+  AutoPtr<CipMap> cip_map_;
+  AutoPtr<FixedArray<DebugBreakSite>> break_sites_;
+  uint32_t break_handler_offset_;
+  AutoPtr<FixedArray<uint32_t>> absolute_refs_;
+  AutoPtr<FixedArray<uint32_t>> code_offset_refs_;
+  AutoPtr<FixedArray<CallSite>> call_sites_;
 };
 
 }
@@ -0,0 +1,128 @@
+// vim: set sts=2 ts=8 sw=2 tw=99 et:
+//
+// Copyright (C) 2006-2018 AlliedModders LLC
+//
+// This file is part of SourcePawn. SourcePawn is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License along with
+// SourcePawn. If not, see http://www.gnu.org/licenses/.
+//
+#include "context-snapshot.h"
+#include "plugin-context.h"
+#include <string.h>
+
+namespace sp {
+
+using namespace ke;
+
+static const uint8_t sZeroPage[ContextSnapshot::kPageSize] = {};
+
+ContextSnapshot::ContextSnapshot(PluginContext* cx)
+ : cx_(cx),
+   hp_(cx->hp()),
+   sp_(cx->sp()),
+   frm_(cx->frm()),
+   mem_size_(cx->HeapSize()),
+   num_stored_pages_(0)
+{
+}
+
+size_t
+ContextSnapshot::numPages() const
+{
+  return (mem_size_ + kPageSize - 1) / kPageSize;
+}
+
+size_t
+ContextSnapshot::pageBytes(size_t index) const
+{
+  // The last page may be partial.
+  size_t remaining = mem_size_ - index * kPageSize;
+  return remaining < kPageSize ? remaining : kPageSize;
+}
+
+bool
+ContextSnapshot::isLivePage(size_t index) const
+{
+  size_t offset = index * kPageSize;
+  return offset < size_t(hp_) || offset + pageBytes(index) > size_t(sp_);
+}
+
+const uint8_t*
+ContextSnapshot::savedPage(size_t index) const
+{
+  if (page_map_[index] == kZeroPage)
+    return sZeroPage;
+  return pages_.get() + page_map_[index] * kPageSize;
+}
+
+ContextSnapshot*
+ContextSnapshot::Capture(PluginContext* cx)
+{
+  AutoPtr<ContextSnapshot> snapshot(new ContextSnapshot(cx));
+  const uint8_t* memory = cx->memory();
+  size_t num_pages = snapshot->numPages();
+
+  snapshot->page_map_ = MakeUnique<uint32_t[]>(num_pages);
+  for (size_t i = 0; i < num_pages; i++) {
+    size_t offset = i * kPageSize;
+    size_t bytes = snapshot->pageBytes(i);
+    if (!snapshot->isLivePage(i) || memcmp(memory + offset, sZeroPage, bytes) == 0) {
+      snapshot->page_map_[i] = kZeroPage;
+    } else {
+      snapshot->page_map_[i] = uint32_t(snapshot->num_stored_pages_++);
+    }
+  }
+
+  snapshot->pages_ = MakeUnique<uint8_t[]>(snapshot->num_stored_pages_ * kPageSize);
+  for (size_t i = 0; i < num_pages; i++) {
+    if (snapshot->page_map_[i] == kZeroPage)
+      continue;
+    size_t offset = i * kPageSize;
+    size_t bytes = snapshot->pageBytes(i);
+    memcpy(snapshot->pages_.get() + snapshot->page_map_[i] * kPageSize, memory + offset, bytes);
+  }
+  return snapshot.take();
+}
+
+size_t
+ContextSnapshot::GetSize()
+{
+  return sizeof(*this) +
+         numPages() * sizeof(uint32_t) +
+         num_stored_pages_ * kPageSize;
+}
+
+// Rewrite the bytes in [begin, end) that differ from the snapshot.
+void
+ContextSnapshot::restoreRange(uint8_t* memory, size_t begin, size_t end)
+{
+  for (size_t i = begin / kPageSize; i * kPageSize < end; i++) {
+    size_t page_start = i * kPageSize;
+    size_t page_end = page_start + pageBytes(i);
+    size_t start = begin > page_start ? begin : page_start;
+    size_t stop = end < page_end ? end : page_end;
+
+    const uint8_t* saved = savedPage(i) + (start - page_start);
+    if (memcmp(memory + start, saved, stop - start) != 0)
+      memcpy(memory + start, saved, stop - start);
+  }
+}
+
+void
+ContextSnapshot::Restore()
+{
+  uint8_t* memory = cx_->memory();
+  restoreRange(memory, 0, size_t(hp_));
+  restoreRange(memory, size_t(sp_), mem_size_);
+
+  *cx_->addressOfHp() = hp_;
+  *cx_->addressOfSp() = sp_;
+  *cx_->addressOfFrm() = frm_;
+  cx_->resetMemoryPeaks();
+}
+
+} // namespace sp
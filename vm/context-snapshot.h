@@ -0,0 +1,77 @@
+// vim: set sts=2 ts=8 sw=2 tw=99 et:
+//
+// Copyright (C) 2006-2018 AlliedModders LLC
+//
+// This file is part of SourcePawn. SourcePawn is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License along with
+// SourcePawn. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef _include_sourcepawn_vm_context_snapshot_h_
+#define _include_sourcepawn_vm_context_snapshot_h_
+
+#include <sp_vm_api.h>
+#include <amtl/am-autoptr.h>
+
+namespace sp {
+
+using namespace SourcePawn;
+
+class PluginContext;
+
+// A copy of a context's memory and registers.
+//
+// Only live memory is saved: the data and heap below hp, and the stack above
+// sp. The free space between them holds nothing that a plugin may rely on.
+// Memory is split into fixed-size pages, and pages that are all zero are not
+// stored. Restoring compares the live part of each page against the snapshot
+// and only rewrites the ones that differ, so resetting a plugin that touched
+// little memory writes little memory, and an idle plugin is only read.
+class ContextSnapshot : public IContextSnapshot
+{
+ public:
+  static const size_t kPageSize = 4096;
+
+  static ContextSnapshot* Capture(PluginContext* cx);
+
+  size_t GetSize() override;
+
+  PluginContext* cx() const {
+    return cx_;
+  }
+
+  // The context must not be running, nor have a suspended resumable call.
+  // Memory peaks are reset, since they describe calls that are undone.
+  void Restore();
+
+ private:
+  explicit ContextSnapshot(PluginContext* cx);
+
+  size_t numPages() const;
+  size_t pageBytes(size_t index) const;
+  bool isLivePage(size_t index) const;
+  const uint8_t* savedPage(size_t index) const;
+  void restoreRange(uint8_t* memory, size_t begin, size_t end);
+
+ private:
+  // Marks a page that is not stored because it is all zero or not live.
+  static const uint32_t kZeroPage = 0xffffffff;
+
+  PluginContext* cx_;
+  cell_t hp_;
+  cell_t sp_;
+  cell_t frm_;
+  size_t mem_size_;
+
+  // For each page, its index in pages_, or kZeroPage.
+  ke::AutoPtr<uint32_t[]> page_map_;
+  ke::AutoPtr<uint8_t[]> pages_;
+  size_t num_stored_pages_;
+};
+
+} // namespace sp
+
+#endif // _include_sourcepawn_vm_context_snapshot_h_
@@ -257,6 +257,20 @@ ControlFlowGraph::computeLoopHeaders()
   return true;
 }
 
+size_t
+ControlFlowGraph::EstimateMemUsage()
+{
+  size_t bytes = sizeof(*this);
+  for (RpoIterator iter = rpoBegin(); iter != rpoEnd(); iter++) {
+    Block* block = *iter;
+    size_t edges = block->predecessors().length() +
+                   block->successors().length() +
+                   block->immediatelyDominated().length();
+    bytes += sizeof(Block) + edges * sizeof(ke::RefPtr<Block>);
+  }
+  return bytes;
+}
+
 void
 ControlFlowGraph::dump(FILE* fp)
 {
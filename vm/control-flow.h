@@ -222,6 +222,9 @@ class ControlFlowGraph : public ke::Refcounted<ControlFlowGraph>
     return epoch_;
   }
 
+  // Bytes used by the graph and its blocks.
+  size_t EstimateMemUsage();
+
   void dump(FILE* fp);
   void dumpDot(FILE* fp);
   void dumpDomTreeDot(FILE* fp);
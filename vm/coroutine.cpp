@@ -0,0 +1,215 @@
+// vim: set sts=2 ts=8 sw=2 tw=99 et:
+//
+// Copyright (C) 2006-2018 AlliedModders LLC
+//
+// This file is part of SourcePawn. SourcePawn is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License along with
+// SourcePawn. If not, see http://www.gnu.org/licenses/.
+//
+#include "coroutine.h"
+#include "environment.h"
+#include "interpreter.h"
+#include "method-info.h"
+#include "plugin-context.h"
+#include <string.h>
+
+namespace sp {
+
+using namespace SourcePawn;
+
+Coroutine::Coroutine(PluginContext* cx)
+ : cx_(cx),
+   suspended_(false),
+   resuming_(false),
+   yield_requested_(false),
+   yield_value_(0),
+   resume_value_(0),
+   base_sp_(0),
+   base_hp_(0),
+   method_(nullptr),
+   cip_(0),
+   alt_(0),
+   sp_(0),
+   hp_(0),
+   frm_(0)
+{
+}
+
+Coroutine::~Coroutine()
+{
+  if (suspended_)
+    cx_->noteCallResumed();
+}
+
+bool
+Coroutine::Start(const char* name, RefPtr<MethodInfo> method, const cell_t* params,
+                 unsigned int num_params, cell_t* result)
+{
+  Environment* env = Environment::get();
+  if (suspended_) {
+    env->ReportErrorFmt(SP_ERROR_NOT_RUNNABLE, "Coroutine is already suspended");
+    return false;
+  }
+
+  EnterProfileScope profileScope("SourcePawn", "EnterJIT");
+
+  if (!cx_->prepareInvoke(num_params))
+    return false;
+
+  EnterProfileScope scriptScope("SourcePawn", name);
+
+  // Coroutines always run in the interpreter, which relies on the verifier.
+  int err = method->Validate();
+  if (err != SP_ERROR_NONE) {
+    env->ReportError(err);
+    return false;
+  }
+
+  entry_ = method;
+  base_sp_ = cx_->sp();
+  base_hp_ = cx_->hp();
+
+  cell_t outer_frm = cx_->frm();
+  cx_->pushInvokeParams(params, num_params);
+  return run(outer_frm, result);
+}
+
+bool
+Coroutine::Resume(const char* name, cell_t value, cell_t* result)
+{
+  Environment* env = Environment::get();
+  if (!suspended_) {
+    env->ReportErrorFmt(SP_ERROR_NOT_RUNNABLE, "Coroutine is not suspended");
+    return false;
+  }
+
+  if (cx_->sp() != base_sp_ || cx_->hp() != base_hp_) {
+    env->ReportErrorFmt(
+      SP_ERROR_NOT_RUNNABLE,
+      "Coroutine must resume at sp:%d hp:%d, not sp:%d hp:%d",
+      base_sp_, base_hp_, cx_->sp(), cx_->hp());
+    return false;
+  }
+
+  EnterProfileScope profileScope("SourcePawn", "EnterJIT");
+
+  if (!cx_->prepareInvoke(0))
+    return false;
+
+  EnterProfileScope scriptScope("SourcePawn", name);
+
+  cell_t outer_frm = cx_->frm();
+
+  // Move the call's stack and heap back into the context.
+  memcpy(cx_->memory() + sp_, stack_.get(), base_sp_ - sp_);
+  memcpy(cx_->memory() + base_hp_, heap_.get(), hp_ - base_hp_);
+  *cx_->addressOfSp() = sp_;
+  *cx_->addressOfHp() = hp_;
+  *cx_->addressOfFrm() = frm_;
+
+  suspended_ = false;
+  cx_->noteCallResumed();
+  resuming_ = true;
+  resume_value_ = value;
+  return run(outer_frm, result);
+}
+
+void
+Coroutine::Discard()
+{
+  // The context was restored when the call suspended, so there is nothing
+  // left to unwind.
+  if (suspended_)
+    cx_->noteCallResumed();
+  reset();
+}
+
+bool
+Coroutine::run(cell_t outer_frm, cell_t* result)
+{
+  bool ok = Interpreter::Run(cx_, this, result);
+
+  if (ok && suspended_) {
+    // Move the call's stack and heap out of the context.
+    sp_ = cx_->sp();
+    hp_ = cx_->hp();
+    frm_ = cx_->frm();
+    stack_ = MakeUnique<uint8_t[]>(base_sp_ - sp_);
+    heap_ = MakeUnique<uint8_t[]>(hp_ - base_hp_);
+    memcpy(stack_.get(), cx_->memory() + sp_, base_sp_ - sp_);
+    memcpy(heap_.get(), cx_->memory() + base_hp_, hp_ - base_hp_);
+
+    *cx_->addressOfSp() = base_sp_;
+    *cx_->addressOfHp() = base_hp_;
+    *cx_->addressOfFrm() = outer_frm;
+    cx_->noteCallSuspended();
+    *result = yield_value_;
+    return true;
+  }
+
+  ok = cx_->finishInvoke(ok, base_sp_, base_hp_, outer_frm);
+  reset();
+  return ok;
+}
+
+void
+Coroutine::reset()
+{
+  entry_ = nullptr;
+  suspended_ = false;
+  resuming_ = false;
+  yield_requested_ = false;
+  method_ = nullptr;
+  callers_.clear();
+  stack_ = nullptr;
+  heap_ = nullptr;
+}
+
+void
+Coroutine::suspend(InterpInvokeFrame* ivk, cell_t cip, cell_t alt)
+{
+  assert(yield_requested_);
+  yield_requested_ = false;
+  suspended_ = true;
+  ivk->saveCalls(&method_, &callers_);
+  cip_ = cip;
+  alt_ = alt;
+}
+
+cell_t
+Coroutine::resume(InterpInvokeFrame* ivk, cell_t* pri, cell_t* alt)
+{
+  assert(resuming_);
+  resuming_ = false;
+  ivk->restoreCalls(method_, ke::Move(callers_));
+  *pri = resume_value_;
+  *alt = alt_;
+  return cip_;
+}
+
+// any __coro_yield(any value)
+static cell_t
+CoroutineYield(IPluginContext* cx, const cell_t* params)
+{
+  // Only a coroutine's own frames may yield. If a native called back into
+  // the VM, the innermost invoke frame belongs to that call instead.
+  InvokeFrame* top = Environment::get()->top();
+  InterpInvokeFrame* ivk = top ? top->AsInterpInvokeFrame() : nullptr;
+  if (!ivk || !ivk->coroutine())
+    return cx->ThrowNativeError("__coro_yield can only be called by a resumable call");
+
+  // The return value is replaced with the resume value.
+  ivk->coroutine()->requestYield(params[0] >= 1 ? params[1] : 0);
+  return 0;
+}
+
+sp_nativeinfo_t gBuiltinCoroutineNatives[] = {
+  {"__coro_yield", CoroutineYield},
+  {nullptr,        nullptr},
+};
+
+} // namespace sp
@@ -0,0 +1,121 @@
+// vim: set sts=2 ts=8 sw=2 tw=99 et:
+//
+// Copyright (C) 2006-2018 AlliedModders LLC
+//
+// This file is part of SourcePawn. SourcePawn is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License along with
+// SourcePawn. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef _include_sourcepawn_vm_coroutine_h_
+#define _include_sourcepawn_vm_coroutine_h_
+
+#include <sp_vm_types.h>
+#include <amtl/am-autoptr.h>
+#include <amtl/am-refcounting.h>
+#include <amtl/am-vector.h>
+#include "stack-frames.h"
+
+namespace sp {
+
+using namespace ke;
+
+class PluginContext;
+class MethodInfo;
+
+// A scripted call that can suspend itself with __coro_yield, to be resumed
+// later by the host.
+//
+// Coroutines always run in the interpreter, since JIT frames live on the
+// native stack and cannot be captured. Natives called by a coroutine run
+// normally, but cannot yield on its behalf.
+//
+// While suspended, the call's stack and heap are copied out of the context,
+// so the context can run other calls. Pawn addresses are absolute, so the
+// coroutine can only resume when the context's stack and heap are where they
+// were when it started.
+class Coroutine
+{
+ public:
+  explicit Coroutine(PluginContext* cx);
+  ~Coroutine();
+
+  // Start a call. Returns false if an exception was thrown. If the call
+  // suspended itself, suspended() is true and |result| is the value passed
+  // to __coro_yield. Otherwise, |result| is the return value. |name| is
+  // the function's name for profiling.
+  bool Start(const char* name, RefPtr<MethodInfo> method, const cell_t* params,
+             unsigned int num_params, cell_t* result);
+
+  // Resume a suspended call; __coro_yield returns |value|. The result is the
+  // same as for Start().
+  bool Resume(const char* name, cell_t value, cell_t* result);
+
+  // Drop a suspended call without finishing it.
+  void Discard();
+
+  bool suspended() const {
+    return suspended_;
+  }
+
+ public:
+  // Called by __coro_yield. The interpreter suspends the call once the
+  // native returns.
+  void requestYield(cell_t value) {
+    yield_requested_ = true;
+    yield_value_ = value;
+  }
+  bool yieldRequested() const {
+    return yield_requested_;
+  }
+
+  // Called by the interpreter when it starts running the coroutine. Returns
+  // true if it should resume a suspended call instead of entering |entry|.
+  bool resuming() const {
+    return resuming_;
+  }
+  MethodInfo* entry() const {
+    return entry_;
+  }
+
+  // Called by the interpreter to save its state when the call suspends, and
+  // to restore it when the call resumes. resume() returns the cip to
+  // continue at.
+  void suspend(InterpInvokeFrame* ivk, cell_t cip, cell_t alt);
+  cell_t resume(InterpInvokeFrame* ivk, cell_t* pri, cell_t* alt);
+
+ private:
+  bool run(cell_t outer_frm, cell_t* result);
+  void reset();
+
+ private:
+  PluginContext* cx_;
+  RefPtr<MethodInfo> entry_;
+  bool suspended_;
+  bool resuming_;
+  bool yield_requested_;
+  cell_t yield_value_;
+  cell_t resume_value_;
+
+  // The context's stack and heap when the call started.
+  cell_t base_sp_;
+  cell_t base_hp_;
+
+  // Interpreter state while suspended.
+  MethodInfo* method_;
+  ke::Vector<InterpInvokeFrame::CallerFrame> callers_;
+  cell_t cip_;
+  cell_t alt_;
+  cell_t sp_;
+  cell_t hp_;
+  cell_t frm_;
+  ke::AutoPtr<uint8_t[]> stack_;
+  ke::AutoPtr<uint8_t[]> heap_;
+};
+
+} // namespace sp
+
+#endif // _include_sourcepawn_vm_coroutine_h_
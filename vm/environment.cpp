@@ -25,6 +25,7 @@
 #include "interpreter.h"
 #include "builtins.h"
 #include "debugging.h"
+#include "perf-map.h"
 #include <stdarg.h>
 
 using namespace sp;
@@ -35,9 +36,13 @@ static Environment* sEnvironment = nullptr;
 Environment::Environment()
  : debug_break_enabled_(false),
    debug_break_handler_(nullptr),
+   main_thread_(ke::GetCurrentThreadId()),
+   memory_peaks_enabled_(false),
+   sm_vector_natives_enabled_(false),
    debugger_(nullptr),
    eh_top_(nullptr),
    exception_code_(SP_ERROR_NONE),
+   exception_message_ready_(false),
    profiler_(nullptr),
 #if defined(SP_HAS_JIT)
    jit_enabled_(true),
@@ -45,7 +50,8 @@ Environment::Environment()
    jit_enabled_(false),
 #endif
    profiling_enabled_(false),
-   top_(nullptr)
+   top_(nullptr),
+   exit_fp_(nullptr)
 {
 }
 
@@ -103,6 +109,7 @@ Environment::Shutdown()
   builtins_ = nullptr;
   code_stubs_ = nullptr;
   code_alloc_ = nullptr;
+  perf_map_ = nullptr;
   PoolAllocator::FreeDefault();
 
   assert(sEnvironment == this);
@@ -126,6 +133,88 @@ Environment::EnableDebugBreak()
   return true;
 }
 
+bool
+Environment::EnableMemoryPeakTracking()
+{
+  // Can't change this after any plugins are loaded.
+  if (!runtimes_.empty())
+    return false;
+
+  memory_peaks_enabled_ = true;
+  return true;
+}
+
+bool
+Environment::EnableSourceModVectorNatives()
+{
+  // Can't change this after any plugins are loaded.
+  if (!runtimes_.empty())
+    return false;
+
+  if (!sm_vector_natives_enabled_) {
+    if (!builtins_->AddSourceModVectorNatives())
+      return false;
+    sm_vector_natives_enabled_ = true;
+  }
+  return true;
+}
+
+void
+Environment::GetMemReport(sp_envmemreport_t* report)
+{
+  ke::AutoLock lock(&mutex_);
+
+  memset(report, 0, sizeof(*report));
+  for (ke::InlineList<PluginRuntime>::iterator iter = runtimes_.begin(); iter != runtimes_.end(); iter++) {
+    sp_memreport_t rt_report;
+    (*iter)->GetMemReportLocked(&rt_report);
+
+    report->runtimes++;
+    report->plugins.runtime += rt_report.runtime;
+    report->plugins.image += rt_report.image;
+    report->plugins.code += rt_report.code;
+    report->plugins.memory += rt_report.memory;
+    report->plugins.jit_code += rt_report.jit_code;
+    report->plugins.jit_metadata += rt_report.jit_metadata;
+    report->plugins.methods += rt_report.methods;
+    report->plugins.function_map += rt_report.function_map;
+    report->plugins.invokers += rt_report.invokers;
+    report->plugins.total += rt_report.total;
+  }
+
+  CodeAllocatorStats stats;
+  code_alloc_->GetStats(&stats);
+  report->code_pools = stats.pools;
+  report->code_reserved = stats.reserved_bytes;
+  report->code_used = stats.used_bytes;
+  report->code_free_ranges = stats.free_ranges;
+  report->code_largest_free = stats.largest_free_bytes;
+}
+
+bool
+Environment::EnablePerfMap(bool jitdump)
+{
+  // Code that is already linked would be missing from the map.
+  if (!runtimes_.empty() || perf_map_)
+    return false;
+
+  ke::AutoPtr<PerfMap> perf(new PerfMap());
+  if (!perf->Open(jitdump))
+    return false;
+
+  // Neither file can say that code went away, so freed code must not be
+  // replaced by other code at the same address.
+  code_alloc_->NeverReuseAddresses();
+
+  // Stubs are linked when the environment is created, so record them now.
+  const CodeChunk& invoke = code_stubs_->InvokeStubCode();
+  if (invoke.address())
+    perf->RecordStub("InvokeStub", invoke.address(), invoke.bytes());
+
+  perf_map_ = perf.take();
+  return true;
+}
+
 void
 Environment::EnableProfiling()
 {
@@ -202,9 +291,9 @@ Environment::GetErrorString(int error)
 }
 
 CodeChunk
-Environment::AllocateCode(size_t size)
+Environment::AllocateCode(size_t size, CodeKind kind)
 {
-  return code_alloc_->Allocate(size);
+  return code_alloc_->Allocate(size, kind);
 }
 
 void
@@ -234,6 +323,7 @@ void
 Environment::PatchAllJumpsForTimeout()
 {
   mutex_.AssertCurrentThreadOwns();
+  AutoWritableCode writable(code_alloc_);
   for (ke::InlineList<PluginRuntime>::iterator iter = runtimes_.begin(); iter != runtimes_.end(); iter++) {
     PluginRuntime* rt = *iter;
 
@@ -255,6 +345,7 @@ void
 Environment::UnpatchAllJumpsFromTimeout()
 {
   mutex_.AssertCurrentThreadOwns();
+  AutoWritableCode writable(code_alloc_);
   for (ke::InlineList<PluginRuntime>::iterator iter = runtimes_.begin(); iter != runtimes_.end(); iter++) {
     PluginRuntime* rt = *iter;
 
@@ -313,14 +404,18 @@ Environment::Invoke(PluginContext* cx,
 void
 Environment::ReportError(int code)
 {
-  const char* message = GetErrorString(code);
-  if (!message) {
-    char buffer[255];
-    UTIL_Format(buffer, sizeof(buffer), "Unknown error code %d", code);
-    ReportError(code, buffer);
-  } else {
-    ReportError(code, message);
-  }
+  // The message is looked up only if someone asks for it.
+  ErrorReport report(code, nullptr, top_ ? top_->cx() : nullptr, nullptr);
+  DispatchReport(report);
+}
+
+void
+Environment::FormatErrorCode(int code, char* buffer, size_t maxlength)
+{
+  if (const char* message = GetErrorString(code))
+    UTIL_Format(buffer, maxlength, "%s", message);
+  else
+    UTIL_Format(buffer, maxlength, "Unknown error code %d", code);
 }
 
 ErrorReport::ErrorReport(int code, const char* message, PluginContext* cx, SourcePawn::IPluginFunction* pf)
@@ -332,6 +427,13 @@ ErrorReport::ErrorReport(int code, const char* message, PluginContext* cx, Sourc
 
 const char*
 ErrorReport::Message() const {
+  if (!message_) {
+    message_ = Environment::get()->GetErrorString(code_);
+    if (!message_) {
+      Environment::get()->FormatErrorCode(code_, unknown_message_, sizeof(unknown_message_));
+      message_ = unknown_message_;
+    }
+  }
   return message_;
 }
 
@@ -417,20 +519,23 @@ void Environment::BlamePluginErrorVA(SourcePawn::IPluginFunction* pf, const char
 void
 Environment::DispatchReport(const ErrorReport& report)
 {
-  FrameIterator iter;
-
   // If this fires, someone forgot to propagate an error.
   assert(!hasPendingException());
 
-  // Save the exception state.
+  // Save the exception state. Reports that only carry an error code are not
+  // formatted until a handler asks for the message.
   if (eh_top_) {
     exception_code_ = report.Code();
-    UTIL_Format(exception_message_, sizeof(exception_message_), "%s", report.Message());
+    exception_message_ready_ = report.HasMessage();
+    if (exception_message_ready_)
+      UTIL_Format(exception_message_, sizeof(exception_message_), "%s", report.Message());
   }
 
   // Do not report exceptions if the ExceptionHandler doesn't want us to.
-  if (debugger_ && (!eh_top_ || eh_top_->Debug()))
+  if (debugger_ && (!eh_top_ || eh_top_->Debug())) {
+    FrameIterator iter;
     debugger_->ReportError(report, iter);
+  }
 
   // See if the plugin is being debugged
   if (top_)
@@ -472,6 +577,10 @@ Environment::GetPendingExceptionMessage(const ExceptionHandler* handler)
   // API may need to query the handler.
   assert(handler == eh_top_);
   assert(HasPendingException(handler));
+  if (!exception_message_ready_) {
+    FormatErrorCode(exception_code_, exception_message_, sizeof(exception_message_));
+    exception_message_ready_ = true;
+  }
   return exception_message_;
 }
 
@@ -30,6 +30,7 @@ class CodeStubs;
 class WatchdogTimer;
 class ErrorReport;
 class BuiltinNatives;
+class PerfMap;
 
 // An Environment encapsulates everything that's needed to load and run
 // instances of plugins on a single thread. There can be at most one
@@ -62,9 +63,14 @@ class Environment : public ISourcePawnEnvironment
   bool HasPendingException(const ExceptionHandler* handler) override;
   const char* GetPendingExceptionMessage(const ExceptionHandler* handler) override;
   bool EnableDebugBreak() override;
+  bool EnablePerfMap(bool jitdump) override;
+  bool EnableMemoryPeakTracking() override;
+  bool EnableSourceModVectorNatives() override;
+  void GetMemReport(sp_envmemreport_t* report) override;
 
   // Runtime functions.
   const char* GetErrorString(int err);
+  void FormatErrorCode(int code, char* buffer, size_t maxlength);
   void ReportError(int code);
   void ReportError(int code, const char* message);
   void ReportErrorFmt(int code, const char* message, ...);
@@ -73,7 +79,10 @@ class Environment : public ISourcePawnEnvironment
   void BlamePluginErrorVA(SourcePawn::IPluginFunction* pf, const char* fmt, va_list ap);
 
   // Allocate and free executable memory.
-  CodeChunk AllocateCode(size_t size);
+  CodeChunk AllocateCode(size_t size, CodeKind kind = CodeKind::Jit);
+  CodeAllocator* code_allocator() const {
+    return code_alloc_;
+  }
 
   CodeStubs* stubs() {
     return code_stubs_;
@@ -127,9 +136,24 @@ class Environment : public ISourcePawnEnvironment
     return debug_break_handler_;
   }
 
+  // Plugins run on the thread that created the environment.
+  bool IsOnMainThread() const {
+    return ke::GetCurrentThreadId() == main_thread_;
+  }
+
+  bool IsMemoryPeakTrackingEnabled() const {
+    return memory_peaks_enabled_;
+  }
+  bool IsSourceModVectorNativesEnabled() const {
+    return sm_vector_natives_enabled_;
+  }
+
   WatchdogTimer* watchdog() const {
     return watchdog_timer_;
   }
+  PerfMap* perf_map() const {
+    return perf_map_;
+  }
 
   bool hasPendingException() const;
   void clearPendingException();
@@ -183,10 +207,14 @@ class Environment : public ISourcePawnEnvironment
 
   bool debug_break_enabled_;
   SPVM_DEBUGBREAK debug_break_handler_;
+  ke::ThreadId main_thread_;
+  bool memory_peaks_enabled_;
+  bool sm_vector_natives_enabled_;
 
   IDebugListener* debugger_;
   ExceptionHandler* eh_top_;
   int exception_code_;
+  bool exception_message_ready_;
   char exception_message_[1024];
 
   IProfilingTool* profiler_;
@@ -195,6 +223,7 @@ class Environment : public ISourcePawnEnvironment
 
   ke::AutoPtr<CodeAllocator> code_alloc_;
   ke::AutoPtr<CodeStubs> code_stubs_;
+  ke::AutoPtr<PerfMap> perf_map_;
 
   ke::InlineList<PluginRuntime> runtimes_;
 
@@ -237,9 +266,14 @@ class ErrorReport : public SourcePawn::IErrorReport
   bool IsFatal() const override;
   IPluginContext* Context() const override;
 
+  bool HasMessage() const {
+    return !!message_;
+  }
+
  private:
   int code_;
-  const char* message_;
+  mutable const char* message_;
+  mutable char unknown_message_[48];
   PluginContext* context_;
   IPluginFunction* blame_;
 };
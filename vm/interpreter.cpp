@@ -16,6 +16,8 @@
 // along with SourcePawn.  If not, see <http://www.gnu.org/licenses/>.
 //
 #include "interpreter.h"
+#include "builtins.h"
+#include "coroutine.h"
 #include "debugging.h"
 #include "environment.h"
 #include "method-info.h"
@@ -42,45 +44,113 @@ Interpreter::Run(PluginContext* cx, RefPtr<MethodInfo> method, cell_t* rval)
   return true;
 }
 
-Interpreter::Interpreter(PluginContext* cx, RefPtr<MethodInfo> method)
+bool
+Interpreter::Run(PluginContext* cx, Coroutine* co, cell_t* rval)
+{
+  Interpreter interpreter(cx, co->entry(), co);
+  if (!interpreter.run())
+    return false;
+
+  if (!co->suspended())
+    *rval = interpreter.return_value();
+  return true;
+}
+
+Interpreter::Interpreter(PluginContext* cx, RefPtr<MethodInfo> method, Coroutine* co)
  : env_(Environment::get()),
    rt_(cx->runtime()),
    cx_(cx),
    reader_(rt_, method->pcode_offset(), this),
    method_(method),
+   call_targets_(nullptr),
    has_returned_(false),
-   return_value_(0)
+   suspended_(false),
+   track_memory_(env_->IsMemoryPeakTrackingEnabled()),
+   return_value_(0),
+   ivk_(nullptr),
+   coroutine_(co)
 {
 }
 
 bool
 Interpreter::run()
 {
-  assert(reader_.peekOpcode() == OP_PROC);
-
-  InterpInvokeFrame ivk(cx_, method_, reader_.cip());
+  InterpInvokeFrame ivk(cx_, method_, reader_.cip(), coroutine_);
   ke::SaveAndSet<InterpInvokeFrame*> enterIvk(&ivk_, &ivk);
 
-  reader_.begin();
+  if (coroutine_ && coroutine_->resuming()) {
+    // Continue after the __coro_yield call that suspended the coroutine.
+    reader_.jump(coroutine_->resume(&ivk, &regs_.pri(), &regs_.alt()));
+  } else {
+    assert(reader_.peekOpcode() == OP_PROC);
+    reader_.begin();
 
-  if (!cx_->pushAmxFrame())
-    return false;
+    if (!cx_->pushAmxFrame())
+      return false;
+    noteStackPeak();
+  }
 
-  while (!has_returned_ && reader_.more()) {
-    if (reader_.peekOpcode() == OP_PROC || reader_.peekOpcode() == OP_ENDPROC)
-      break;
+  // Scripted calls do not recurse: visitCALL jumps into the callee, and
+  // visitRETN jumps back to the caller. Only the outermost return ends the
+  // loop.
+  while (!has_returned_ && !suspended_ && reader_.more()) {
+    if (reader_.peekOpcode() == OP_PROC || reader_.peekOpcode() == OP_ENDPROC) {
+      // Fell off the end of a method without returning. A callee returns 0,
+      // and its frame is unwound as if it had reached a RETN.
+      if (!ivk_->hasCallers())
+        break;
+      regs_.pri() = 0;
+      if (!visitRETN())
+        return false;
+      continue;
+    }
     if (!reader_.visitNext())
       return false;
   }
 
+  if (suspended_)
+    coroutine_->suspend(&ivk, reader_.cip_offset(), regs_.alt());
   return true;
 }
 
+void
+Interpreter::returnToCaller()
+{
+  reader_.jump(ivk_->leaveCall());
+}
+
+void
+Interpreter::noteStackPeak()
+{
+  // Peaks are attributed to the current instruction.
+  if (track_memory_)
+    cx_->noteStackPeak(reader_.cip_offset());
+}
+
 bool
 Interpreter::invokeNative(uint32_t native_index)
 {
   NativeEntry* native = rt_->NativeAt(native_index);
 
+  noteStackPeak();
+
+  // Fast builtins and leaf natives do not get a native frame, as in the JIT.
+  // Errors are attributed to the calling instruction.
+  if (native->fast_fn || native->leaf_fn) {
+    const cell_t* params = reinterpret_cast<const cell_t*>(cx_->memory() + cx_->sp());
+
+    cell_t result;
+    int err = native->fast_fn
+              ? native->fast_fn(cx_, params, &result)
+              : native->leaf_fn(cx_, params, &result);
+    if (err != SP_ERROR_NONE) {
+      cx_->ReportErrorNumber(err);
+      return false;
+    }
+    regs_.pri() = result;
+    return true;
+  }
+
   ivk_->enterNativeCall(native_index);
   if (native->status == SP_NATIVE_BOUND) {
     ke::SaveAndSet<cell_t> saveSp(cx_->addressOfSp(), cx_->sp());
@@ -88,13 +158,22 @@ Interpreter::invokeNative(uint32_t native_index)
 
     const cell_t* params = reinterpret_cast<const cell_t*>(cx_->memory() + cx_->sp());
 
-    regs_.pri() = native->legacy_fn(cx_, params);
+    if (native->typed)
+      regs_.pri() = native->typed->Invoke(cx_, params);
+    else
+      regs_.pri() = native->legacy_fn(cx_, params);
   } else {
     cx_->ReportErrorNumber(SP_ERROR_INVALID_NATIVE);
   }
   ivk_->leaveNativeCall();
 
-  return !env_->hasPendingException();
+  if (env_->hasPendingException())
+    return false;
+
+  // Stop once this instruction finishes, if the native was __coro_yield.
+  if (coroutine_ && coroutine_->yieldRequested())
+    suspended_ = true;
+  return true;
 }
 
 bool
@@ -103,6 +182,11 @@ Interpreter::visitRETN()
   if (!cx_->popAmxFrame())
     return false;
 
+  if (ivk_->hasCallers()) {
+    returnToCaller();
+    return true;
+  }
+
   has_returned_ = true;
   return_value_ = regs_.pri();
   return true;
@@ -145,30 +229,48 @@ Interpreter::visitPUSH(const cell_t* addresses, size_t nvals)
 bool
 Interpreter::visitCALL(cell_t offset)
 {
-  RefPtr<MethodInfo> target = cx_->runtime()->AcquireMethod(offset);
+  // Targets are resolved and validated once per call site. The reader is
+  // past the CALL and its operand, so the call site is two cells back.
+  if (!call_targets_)
+    call_targets_ = rt_->InterpCallTargets();
+
+  MethodInfo*& target = call_targets_[reader_.cip_offset() / sizeof(cell_t) - 2];
   if (!target) {
-    cx_->ReportErrorNumber(SP_ERROR_INVALID_ADDRESS);
-    return false;
-  }
-  int err = target->Validate();
-  if (err != SP_ERROR_NONE) {
-    cx_->ReportErrorNumber(err);
-    return false;
+    RefPtr<MethodInfo> method = rt_->AcquireMethod(offset);
+    if (!method) {
+      cx_->ReportErrorNumber(SP_ERROR_INVALID_ADDRESS);
+      return false;
+    }
+    int err = method->Validate();
+    if (err != SP_ERROR_NONE) {
+      cx_->ReportErrorNumber(err);
+      return false;
+    }
+
+    // The runtime holds a reference to every acquired method.
+    target = method;
   }
 
   // We don't interleave between the interpreter and JIT (yet).
-  cell_t value = 0;
-  if (!Run(cx_, target, &value))
+  ivk_->enterCall(target, reader_.cip_offset());
+  reader_.jump(target->pcode_offset());
+  reader_.begin();
+  if (!cx_->pushAmxFrame())
     return false;
-
-  regs_.pri() = value;
+  noteStackPeak();
   return true;
 }
 
 bool
 Interpreter::visitHEAP(cell_t amount)
 {
-  return cx_->heapAlloc(amount, &regs_.alt());
+  if (!cx_->heapAlloc(amount, &regs_.alt()))
+    return false;
+  if (track_memory_ && amount > 0) {
+    cx_->noteHeapPeak(reader_.cip_offset());
+    cx_->noteAlloc(amount, reader_.cip_offset());
+  }
+  return true;
 }
 
 bool
@@ -239,7 +341,11 @@ Interpreter::visitZERO_S(cell_t offset)
 bool
 Interpreter::visitSTACK(cell_t amount)
 {
-  return cx_->addStack(amount);
+  if (!cx_->addStack(amount))
+    return false;
+  if (amount < 0)
+    noteStackPeak();
+  return true;
 }
 
 bool
@@ -980,6 +1086,29 @@ Interpreter::visitFLOAT_NOT()
   return true;
 }
 
+bool
+Interpreter::visitVECTOR_OP(VectorOp op)
+{
+  const VectorOpInfo& info = GetVectorOpInfo(op);
+
+  cell_t args[3];
+  for (uint32_t i = 0; i < info.nargs; i++) {
+    if (!cx_->popStack(&args[i]))
+      return false;
+  }
+
+  float* vecs[3];
+  for (uint32_t i = 0; i < info.nvectors; i++) {
+    cell_t* addr = cx_->acquireAddrRange(args[i], 3 * sizeof(cell_t));
+    if (!addr)
+      return false;
+    vecs[i] = reinterpret_cast<float*>(addr);
+  }
+
+  regs_.pri() = ExecuteVectorOp(op, vecs, args);
+  return true;
+}
+
 bool
 Interpreter::visitGENARRAY(uint32_t dims, bool autozero)
 {
@@ -1001,6 +1130,8 @@ Interpreter::visitGENARRAY(uint32_t dims, bool autozero)
       return false;
   }
 
+  if (track_memory_)
+    cx_->noteTrackedAlloc(reader_.cip_offset());
   return true;
 }
 
@@ -1012,6 +1143,8 @@ Interpreter::visitTRACKER_PUSH_C(cell_t amount)
     cx_->ReportErrorNumber(err);
     return false;
   }
+  if (track_memory_)
+    cx_->noteTrackedAlloc(reader_.cip_offset());
   return true;
 }
 
@@ -1040,6 +1173,10 @@ Interpreter::visitBREAK()
   if (!Environment::get()->IsDebugBreakEnabled())
     return true;
 
+  // Only break at installed breakpoints, or while single-stepping.
+  if (!rt_->ShouldBreakAt(reader_.cip_offset() - sizeof(cell_t)))
+    return true;
+
   InvokeDebugger(cx_, nullptr);
   return !env_->hasPendingException();
 }
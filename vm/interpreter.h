@@ -33,6 +33,7 @@ class Environment;
 class PluginContext;
 class PluginRuntime;
 class MethodInfo;
+class Coroutine;
 
 class InterpRegs
 {
@@ -61,6 +62,9 @@ class Interpreter final : public PcodeVisitor
  public:
   static bool Run(PluginContext* cx, RefPtr<MethodInfo> method, cell_t* rval);
 
+  // Start or resume a coroutine, running until it returns or suspends.
+  static bool Run(PluginContext* cx, Coroutine* co, cell_t* rval);
+
  public:
   bool visitPUSH_C(const cell_t* vals, size_t nvals) override;
   bool visitPUSH_ADR(const cell_t* offsets, size_t nvals) override;
@@ -143,6 +147,7 @@ class Interpreter final : public PcodeVisitor
   bool visitFLOATCMP() override;
   bool visitFLOAT_CMP_OP(CompareOp op) override;
   bool visitFLOAT_NOT() override;
+  bool visitVECTOR_OP(VectorOp op) override;
   bool visitBOUNDS(uint32_t limit) override;
   bool visitGENARRAY(uint32_t dims, bool autozero) override;
   bool visitTRACKER_PUSH_C(cell_t amount) override;
@@ -153,7 +158,7 @@ class Interpreter final : public PcodeVisitor
   bool visitREBASE(cell_t addr, cell_t iv_size, cell_t data_size) override;
 
  private:
-  Interpreter(PluginContext* cx, RefPtr<MethodInfo> method);
+  Interpreter(PluginContext* cx, RefPtr<MethodInfo> method, Coroutine* co = nullptr);
 
   bool run();
 
@@ -163,6 +168,9 @@ class Interpreter final : public PcodeVisitor
 
  private:
   bool invokeNative(uint32_t native_index);
+  void returnToCaller();
+
+  void noteStackPeak();
 
  private:
   Environment* env_;
@@ -170,10 +178,14 @@ class Interpreter final : public PcodeVisitor
   PluginContext* cx_;
   PcodeReader<Interpreter> reader_;
   RefPtr<MethodInfo> method_;
+  MethodInfo** call_targets_;
   bool has_returned_;
+  bool suspended_;
+  bool track_memory_;
   cell_t return_value_;
   InterpRegs regs_;
   InterpInvokeFrame* ivk_;
+  Coroutine* coroutine_;
 };
 
 } // namespace sp
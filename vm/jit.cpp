@@ -22,6 +22,8 @@
 #include "opcodes.h"
 #include "outofline-asm.h"
 #include "pcode-reader.h"
+#include "perf-map.h"
+#include "plugin-context.h"
 #include "plugin-runtime.h"
 #include "stack-frames.h"
 #include "watchdog_timer.h"
@@ -64,6 +66,9 @@ CompilerBase::Compile(PluginContext* cx, RefPtr<MethodInfo> method, int* err)
   }
 
   method->setCompiledFunction(fun);
+
+  if (PerfMap* perf = Environment::get()->perf_map())
+    perf->RecordFunction(cx->runtime(), fun);
   return fun;
 }
 
@@ -165,12 +170,133 @@ CompilerBase::emit()
     edges->at(i).disp32 = int32_t(jump.timeout_offset) - int32_t(jump.pc);
   }
 
-  AutoPtr<FixedArray<CipMapEntry>> cipmap(
-    new FixedArray<CipMapEntry>(cip_map_.length()));
-  memcpy(cipmap->buffer(), cip_map_.buffer(), cip_map_.length() * sizeof(CipMapEntry));
+  AutoPtr<CipMap> cipmap(new CipMap(cip_map_.buffer(), cip_map_.length()));
+
+  AutoPtr<FixedArray<DebugBreakSite>> break_sites(
+    new FixedArray<DebugBreakSite>(debug_break_sites_.length()));
+  memcpy(break_sites->buffer(), debug_break_sites_.buffer(),
+         debug_break_sites_.length() * sizeof(DebugBreakSite));
+
+  const ke::Vector<uint32_t>& absolute_refs = masm.absolute_refs();
+  AutoPtr<FixedArray<uint32_t>> absolutes(new FixedArray<uint32_t>(absolute_refs.length()));
+  memcpy(absolutes->buffer(), absolute_refs.buffer(), absolute_refs.length() * sizeof(uint32_t));
+
+  AutoPtr<FixedArray<uint32_t>> code_offsets(
+    new FixedArray<uint32_t>(code_offset_refs_.length()));
+  memcpy(code_offsets->buffer(), code_offset_refs_.buffer(),
+         code_offset_refs_.length() * sizeof(uint32_t));
+
+  AutoPtr<FixedArray<CallSite>> call_sites(new FixedArray<CallSite>(call_sites_.length()));
+  memcpy(call_sites->buffer(), call_sites_.buffer(), call_sites_.length() * sizeof(CallSite));
 
   assert(error_ == SP_ERROR_NONE);
-  return new CompiledFunction(code, pcode_start_, edges.take(), cipmap.take());
+  return new CompiledFunction(ke::Move(code), pcode_start_, edges.take(), cipmap.take(),
+                              break_sites.take(), debug_break_.offset(), absolutes.take(),
+                              code_offsets.take(), call_sites.take());
+}
+
+// Map an address that the previous version's code refers to, to the same
+// object in |rt|. Anything else, such as the environment, is shared.
+static uintptr_t
+RelocateAddress(PluginRuntime* rt, const PreviousVersion& prev, uintptr_t addr)
+{
+  uintptr_t context = uintptr_t(rt->GetBaseContext());
+  if (addr >= prev.context && addr - prev.context < sizeof(PluginContext))
+    return context + (addr - prev.context);
+
+  size_t natives_size = sizeof(NativeEntry) * prev.glue.length();
+  if (addr >= prev.natives && addr - prev.natives < natives_size)
+    return uintptr_t(rt->NativeAt(0)) + (addr - prev.natives);
+
+  for (size_t i = 0; i < prev.glue.length(); i++) {
+    if (prev.glue[i] && addr == prev.glue[i])
+      return uintptr_t(rt->NativeAt(i)->typed.get());
+  }
+  return addr;
+}
+
+bool
+CompilerBase::AdoptCompiledFunction(PluginRuntime* rt, MethodInfo* method,
+                                    CompiledFunction* fun, const PreviousVersion& prev)
+{
+  uint8_t* base = reinterpret_cast<uint8_t*>(fun->GetEntryAddress());
+  cell_t pcode_offs = method->pcode_offset();
+  const uint8_t* code = rt->code().bytes + pcode_offs;
+  const FixedArray<CallSite>& call_sites = fun->CallSites();
+
+  // A direct call cannot be redirected, so the callee must have been adopted
+  // too. It was compiled before this function, so this cannot recurse forever.
+  for (size_t i = 0; i < call_sites.length(); i++) {
+    const CallSite& site = call_sites[i];
+    if (site.thunk)
+      continue;
+
+    cell_t target = *reinterpret_cast<const cell_t*>(code + site.cipoffs + sizeof(cell_t));
+    RefPtr<MethodInfo> callee = rt->AcquireMethod(target);
+    if (!callee || !callee->jit() ||
+        callee->jit()->GetEntryAddress() != ReadCallTarget(base + site.pcoffs))
+    {
+      return false;
+    }
+  }
+
+  {
+    AutoWritableCode writable(Environment::get()->code_allocator(), base, fun->GetCodeSize());
+
+    const FixedArray<uint32_t>& absolute_refs = fun->AbsoluteRefs();
+    for (size_t i = 0; i < absolute_refs.length(); i++) {
+      uintptr_t* addr = reinterpret_cast<uintptr_t*>(base + absolute_refs[i] - sizeof(uintptr_t));
+      *addr = RelocateAddress(rt, prev, *addr);
+    }
+
+    int32_t delta = pcode_offs - fun->GetCodeOffset();
+    const FixedArray<uint32_t>& code_offset_refs = fun->CodeOffsetRefs();
+    for (size_t i = 0; i < code_offset_refs.length(); i++)
+      *reinterpret_cast<int32_t*>(base + code_offset_refs[i] - sizeof(int32_t)) += delta;
+
+    // Point each thunk at the callee's new offset. A call that was patched to
+    // go straight to its callee goes back through the thunk, unless the callee
+    // was adopted too.
+    for (size_t i = 0; i < call_sites.length(); i++) {
+      const CallSite& site = call_sites[i];
+      if (!site.thunk)
+        continue;
+
+      cell_t target = *reinterpret_cast<const cell_t*>(code + site.cipoffs + sizeof(cell_t));
+      *reinterpret_cast<int32_t*>(base + site.thunk_callee - sizeof(int32_t)) = target;
+
+      void* dest = ReadCallTarget(base + site.pcoffs);
+      if (dest == base + site.thunk)
+        continue;
+      RefPtr<MethodInfo> callee = rt->GetMethod(target);
+      if (!callee || !callee->jit() || callee->jit()->GetEntryAddress() != dest)
+        PatchCallThunk(base + site.pcoffs, base + site.thunk);
+    }
+  }
+
+  fun->SetCodeOffset(pcode_offs);
+  method->adoptCompiledFunction(fun);
+
+  ke::AutoLock lock(Environment::get()->lock());
+  UpdateDebugBreakSites(rt, fun);
+  return true;
+}
+
+void
+CompilerBase::UpdateDebugBreakSites(PluginRuntime* rt, CompiledFunction* fun)
+{
+  if (!fun->NumDebugBreakSites())
+    return;
+
+  uint8_t* base = reinterpret_cast<uint8_t*>(fun->GetEntryAddress());
+  uint8_t* handler = base + fun->DebugBreakHandlerOffset();
+
+  AutoWritableCode writable(Environment::get()->code_allocator(), base, fun->GetCodeSize());
+  for (size_t i = 0; i < fun->NumDebugBreakSites(); i++) {
+    const DebugBreakSite& site = fun->GetDebugBreakSite(i);
+    bool enabled = rt->ShouldBreakAt(fun->GetCodeOffset() + site.cipoffs);
+    PatchDebugBreakSite(base + site.pcoffs, handler, enabled);
+  }
 }
 
 void
@@ -255,7 +381,8 @@ CompilerBase::CompileFromThunk(PluginContext* cx, cell_t pcode_offs, void** addr
 
   *addrp = fn->GetEntryAddress();
 
-  /* Right now, we always keep the code RWE */
+  AutoWritableCode writable(Environment::get()->code_allocator(),
+                            pc - sizeof(intptr_t), sizeof(intptr_t));
   PatchCallThunk(pc, fn->GetEntryAddress());
   return SP_ERROR_NONE;
 }
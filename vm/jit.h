@@ -35,6 +35,7 @@ using namespace SourcePawn;
 class PluginRuntime;
 class PluginContext;
 class LegacyImage;
+struct PreviousVersion;
 
 struct BackwardJump {
   // The pc at the jump instruction (i.e. after it).
@@ -81,6 +82,24 @@ class CompilerBase : public PcodeVisitor
   static void InvokeReportError(int err);
   static void InvokeReportTimeout();
   static void PatchCallThunk(uint8_t* pc, void* target);
+  static void* ReadCallTarget(uint8_t* pc);
+
+ public:
+  // Patch each BREAK in a compiled function to either call the debug break
+  // handler or fall through, depending on the runtime's breakpoints. The
+  // caller must own the environment lock, and be on the thread that runs
+  // plugins: each site is rewritten in place, not atomically.
+  static void UpdateDebugBreakSites(PluginRuntime* rt, CompiledFunction* fun);
+
+  // Move |fun|, compiled for a previous version of the plugin, to |method|,
+  // whose code hashes the same. The code is relocated to |rt| in place. Returns
+  // false, leaving |fun| untouched, if a callee that |fun| calls directly was
+  // not adopted along with it.
+  static bool AdoptCompiledFunction(PluginRuntime* rt, MethodInfo* method,
+                                    CompiledFunction* fun, const PreviousVersion& prev);
+
+ protected:
+  static void PatchDebugBreakSite(uint8_t* site, uint8_t* handler, bool enabled);
 
  protected:
   cell_t readCell();
@@ -95,6 +114,13 @@ class CompilerBase : public PcodeVisitor
     cip_map_.append(entry);
   }
 
+  // Mark the last four bytes emitted as the code offset of an instruction in
+  // this function, which moves if the function is adopted by a new version of
+  // its plugin.
+  void markCodeOffset() {
+    code_offset_refs_.append(masm.pc());
+  }
+
   bool isNextBlock(Block* target) {
     return target->id() == (block_->id() + 1);
   }
@@ -134,9 +160,14 @@ class CompilerBase : public PcodeVisitor
 
   // Debugging.
   Label debug_break_;
+  ke::Vector<DebugBreakSite> debug_break_sites_;
 
   ke::Vector<BackwardJump> backward_jumps_;
   ke::Vector<CipMapEntry> cip_map_;
+
+  // Relocation info; see CompiledFunction.
+  ke::Vector<uint32_t> code_offset_refs_;
+  ke::Vector<CallSite> call_sites_;
 };
 
 } // namespace sp
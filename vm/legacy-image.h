@@ -42,6 +42,9 @@ class LegacyImage
   virtual Data DescribeData() const = 0;
   virtual size_t NumNatives() const = 0;
   virtual const char* GetNative(size_t index) const = 0;
+  // Returns the native's RTTI signature, and the number of bytes that may be
+  // read from it, or false if the image has no RTTI.
+  virtual bool GetNativeSignature(size_t index, const uint8_t** bytes, size_t* length) const = 0;
   virtual bool FindNative(const char* name, size_t* indexp) const = 0;
   virtual size_t NumPublics() const = 0;
   virtual void GetPublic(size_t index, uint32_t* offsetp, const char** namep) const = 0;
@@ -92,6 +95,9 @@ class EmptyImage : public LegacyImage
   const char* GetNative(size_t index) const override {
     return nullptr;
   }
+  bool GetNativeSignature(size_t index, const uint8_t** bytes, size_t* length) const override {
+    return false;
+  }
   bool FindNative(const char* name, size_t* indexp) const override {
     return false;
   }
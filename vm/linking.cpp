@@ -25,6 +25,7 @@ sp::LinkCode(Environment* env, Assembler& masm)
   if (!code.address())
     return code;
 
+  AutoWritableCode writable(env->code_allocator(), code.address(), code.bytes());
   masm.emitToExecutableMemory(code.address());
   return code;
 }
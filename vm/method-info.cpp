@@ -15,6 +15,11 @@
 #include "method-info.h"
 #include "method-verifier.h"
 #include "graph-builder.h"
+#include "opcodes.h"
+#include "plugin-runtime.h"
+#include "md5/md5.h"
+#include <limits.h>
+#include <string.h>
 
 namespace sp {
 
@@ -23,7 +28,9 @@ MethodInfo::MethodInfo(PluginRuntime* rt, uint32_t codeOffset)
    pcode_offset_(codeOffset),
    checked_(false),
    validation_error_(SP_ERROR_NONE),
-   max_stack_(0)
+   max_stack_(0),
+   adopted_verification_(false),
+   adopted_code_(false)
 {
 }
 
@@ -42,9 +49,148 @@ MethodInfo::setCompiledFunction(CompiledFunction* fun)
   jit_ = fun;
 }
 
+size_t
+MethodInfo::EstimateMemUsage() const
+{
+  size_t bytes = sizeof(*this);
+  if (graph_)
+    bytes += graph_->EstimateMemUsage();
+  return bytes;
+}
+
+static void
+HashCell(MD5* md5, cell_t value)
+{
+  md5->update(reinterpret_cast<const unsigned char*>(&value), sizeof(value));
+}
+
+static void
+HashString(MD5* md5, const char* str)
+{
+  md5->update(reinterpret_cast<const unsigned char*>(str), strlen(str) + 1);
+}
+
+bool
+MethodInfo::ComputeContentHash(uint8_t digest[16]) const
+{
+  const uint8_t* code = rt_->code().bytes;
+  const uint8_t* end = code + rt_->code().length;
+  const cell_t* cip = reinterpret_cast<const cell_t*>(code + pcode_offset_);
+  assert(*cip == OP_PROC);
+  cip++;
+
+  MD5 md5;
+  while (reinterpret_cast<const uint8_t*>(cip + 1) <= end) {
+    OPCODE op = OPCODE(cip[0]);
+    if (op == OP_PROC || op == OP_ENDPROC)
+      break;
+    if (op <= 0 || op >= OP_UNGEN_FIRST_FAKE)
+      return false;
+
+    size_t ncells;
+    if (op == OP_CASETBL) {
+      if (reinterpret_cast<const uint8_t*>(cip + 2) > end)
+        return false;
+      if (cip[1] < 0 || cip[1] > (INT_MAX - 3) / 2)
+        return false;
+      ncells = GetCaseTableSize(reinterpret_cast<const uint8_t*>(cip));
+    } else {
+      ncells = kOpcodeSizes[op];
+      if (!ncells)
+        return false;
+    }
+    if (reinterpret_cast<const uint8_t*>(cip + ncells) > end)
+      return false;
+
+    HashCell(&md5, op);
+    switch (op) {
+      case OP_JUMP:
+      case OP_JZER:
+      case OP_JNZ:
+      case OP_JEQ:
+      case OP_JNEQ:
+      case OP_JSLESS:
+      case OP_JSLEQ:
+      case OP_JSGRTR:
+      case OP_JSGEQ:
+      case OP_SWITCH:
+        HashCell(&md5, cip[1] - cell_t(pcode_offset_));
+        break;
+
+      case OP_CASETBL:
+        // ncases, default, then (value, target) pairs.
+        HashCell(&md5, cip[1]);
+        HashCell(&md5, cip[2] - cell_t(pcode_offset_));
+        for (cell_t i = 0; i < cip[1]; i++) {
+          HashCell(&md5, cip[3 + i * 2]);
+          HashCell(&md5, cip[4 + i * 2] - cell_t(pcode_offset_));
+        }
+        break;
+
+      case OP_CALL:
+      {
+        cell_t target = cip[1];
+        if (target < 0 || size_t(target) >= rt_->code().length ||
+            !ke::IsAligned(target, sizeof(cell_t)) ||
+            *reinterpret_cast<const cell_t*>(code + target) != OP_PROC)
+        {
+          return false;
+        }
+        if (const char* name = rt_->image()->LookupFunction(target))
+          HashString(&md5, name);
+        else
+          HashCell(&md5, target - cell_t(pcode_offset_));
+        break;
+      }
+
+      case OP_SYSREQ_C:
+      case OP_SYSREQ_N:
+        if (cip[1] < 0 || size_t(cip[1]) >= rt_->image()->NumNatives())
+          return false;
+        HashString(&md5, rt_->image()->GetNative(cip[1]));
+        for (size_t i = 2; i < ncells; i++)
+          HashCell(&md5, cip[i]);
+        break;
+
+      default:
+        for (size_t i = 1; i < ncells; i++)
+          HashCell(&md5, cip[i]);
+        break;
+    }
+
+    cip += ncells;
+  }
+
+  md5.finalize();
+  md5.raw_digest(digest);
+  return true;
+}
+
+void
+MethodInfo::AdoptVerification(int32_t max_stack)
+{
+  if (checked_)
+    return;
+
+  max_stack_ = max_stack;
+  validation_error_ = SP_ERROR_NONE;
+  checked_ = true;
+  adopted_verification_ = true;
+}
+
 void
 MethodInfo::InternalValidate()
 {
+  if (verified()) {
+    // Only the graph is needed, since this method was already verified, or
+    // adopted the result from an identical method.
+    GraphBuilder builder(rt_, pcode_offset_);
+    graph_ = builder.build();
+    if (!graph_)
+      validation_error_ = builder.error_code();
+    return;
+  }
+
   MethodVerifier verifier(rt_, pcode_offset_);
   graph_ = verifier.verify();
   if (graph_) {
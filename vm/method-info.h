@@ -44,6 +44,9 @@ class MethodInfo final : public ke::Refcounted<MethodInfo>
   int validationError() const {
     return validation_error_;
   }
+  bool verified() const {
+    return checked_ && validation_error_ == SP_ERROR_NONE;
+  }
   uint32_t pcode_offset() const {
     return pcode_offset_;
   }
@@ -56,6 +59,39 @@ class MethodInfo final : public ke::Refcounted<MethodInfo>
     return jit_;
   }
 
+  // Link in code compiled for an identical method of a previous version of
+  // the plugin, or give this method's code away to a new version.
+  void adoptCompiledFunction(CompiledFunction* fun) {
+    setCompiledFunction(fun);
+    adopted_code_ = true;
+  }
+  CompiledFunction* takeCompiledFunction() {
+    return jit_.take();
+  }
+
+  // Bytes used by this object and its graph, if it is holding one. Compiled
+  // code is not included.
+  size_t EstimateMemUsage() const;
+
+  // Hash the method's code such that it is the same in another build of the
+  // plugin if the method did not change. Jump targets are hashed relative to
+  // the method, and calls and natives by name. Returns false if the code is
+  // malformed.
+  bool ComputeContentHash(uint8_t digest[16]) const;
+
+  // Take the verification result of an identical method, from a previous
+  // version of the plugin, instead of verifying this one.
+  void AdoptVerification(int32_t max_stack);
+
+  // Whether the verification result or the code came from a previous version
+  // of the plugin.
+  bool adoptedVerification() const {
+    return adopted_verification_;
+  }
+  bool adoptedCode() const {
+    return adopted_code_;
+  }
+
  private:
   void InternalValidate();
 
@@ -68,6 +104,8 @@ class MethodInfo final : public ke::Refcounted<MethodInfo>
   bool checked_;
   int validation_error_;
   int32_t max_stack_;
+  bool adopted_verification_;
+  bool adopted_code_;
 };
 
 } // namespace sp
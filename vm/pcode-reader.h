@@ -493,7 +493,7 @@ class PcodeReader
       if (native->status == SP_NATIVE_BOUND &&
           !(native->flags & (SP_NTVFLAG_EPHEMERAL|SP_NTVFLAG_OPTIONAL)))
       {
-        uint32_t replacement = rt_->GetNativeReplacement(index);
+        uint32_t replacement = rt_->GetNativeReplacement(index, nparams);
         if (replacement != OP_NOP)
           return visitOp((OPCODE)replacement);
       }
@@ -595,6 +595,23 @@ class PcodeReader
     case OP_FLOAT_NOT:
       return visitor_->visitFLOAT_NOT();
 
+    case OP_VEC_ADD:
+      return visitor_->visitVECTOR_OP(VectorOp::Add);
+    case OP_VEC_SUB:
+      return visitor_->visitVECTOR_OP(VectorOp::Sub);
+    case OP_VEC_SCALE:
+      return visitor_->visitVECTOR_OP(VectorOp::Scale);
+    case OP_VEC_LENGTH:
+      return visitor_->visitVECTOR_OP(VectorOp::Length);
+    case OP_VEC_DISTANCE:
+      return visitor_->visitVECTOR_OP(VectorOp::Distance);
+    case OP_VEC_NORMALIZE:
+      return visitor_->visitVECTOR_OP(VectorOp::Normalize);
+    case OP_VEC_DOT:
+      return visitor_->visitVECTOR_OP(VectorOp::Dot);
+    case OP_VEC_CROSS:
+      return visitor_->visitVECTOR_OP(VectorOp::Cross);
+
     case OP_HALT:
     {
       cell_t value = readCell();
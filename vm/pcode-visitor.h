@@ -36,6 +36,18 @@ enum class CompareOp {
   Sgeq
 };
 
+// Operations on float[3] vectors, replacing the builtin vector natives.
+enum class VectorOp {
+  Add,
+  Sub,
+  Scale,
+  Length,
+  Distance,
+  Normalize,
+  Dot,
+  Cross
+};
+
 struct CaseTableEntry {
   cell_t value;
   cell_t address;
@@ -132,6 +144,7 @@ class PcodeVisitor
   virtual bool visitFLOATCMP() = 0;
   virtual bool visitFLOAT_CMP_OP(CompareOp op) = 0;
   virtual bool visitFLOAT_NOT() = 0;
+  virtual bool visitVECTOR_OP(VectorOp op) = 0;
   virtual bool visitHALT(cell_t value) = 0;
   virtual bool visitSWITCH(cell_t defaultOffset, const CaseTableEntry* cases, size_t ncases) = 0;
   virtual bool visitREBASE(cell_t addr, cell_t iv_size, cell_t data_size) = 0;
@@ -484,6 +497,10 @@ class IncompletePcodeVisitor : public PcodeVisitor
     assert(false);
     return false;
   }
+  virtual bool visitVECTOR_OP(VectorOp op) override {
+    assert(false);
+    return false;
+  }
   virtual bool visitHALT(cell_t value) override {
     assert(false);
     return false;
@@ -0,0 +1,301 @@
+// vim: set sts=2 ts=8 sw=2 tw=99 et:
+//
+// Copyright (C) 2006-2018 AlliedModders LLC
+//
+// This file is part of SourcePawn. SourcePawn is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License along with
+// SourcePawn. If not, see http://www.gnu.org/licenses/.
+//
+#include "perf-map.h"
+#include "compiled-function.h"
+#include "plugin-runtime.h"
+#include <amtl/am-vector.h>
+#include <inttypes.h>
+#include <string.h>
+#if defined(__linux__)
+# include <elf.h>
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <time.h>
+# include <unistd.h>
+#endif
+
+namespace sp {
+
+// Both files are written in large chunks; perf only reads them after the
+// process has exited.
+static const size_t kBufferSize = 64 * 1024;
+
+#if defined(__linux__)
+// See tools/perf/Documentation/jitdump-specification.txt in the kernel tree.
+static const uint32_t kJitDumpMagic = 0x4A695444;
+static const uint32_t kJitDumpVersion = 1;
+static const uint32_t kJitCodeLoad = 0;
+static const uint32_t kJitCodeDebugInfo = 2;
+
+# if defined(__x86_64__)
+static const uint32_t kElfMachine = EM_X86_64;
+# else
+static const uint32_t kElfMachine = EM_386;
+# endif
+
+struct JitDumpHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t total_size;
+  uint32_t elf_mach;
+  uint32_t pad1;
+  uint32_t pid;
+  uint64_t timestamp;
+  uint64_t flags;
+};
+
+struct JitDumpRecord {
+  uint32_t id;
+  uint32_t total_size;
+  uint64_t timestamp;
+};
+
+// Followed by the symbol name and the code bytes.
+struct JitDumpCodeLoad {
+  JitDumpRecord record;
+  uint32_t pid;
+  uint32_t tid;
+  uint64_t vma;
+  uint64_t code_addr;
+  uint64_t code_size;
+  uint64_t code_index;
+};
+
+// Followed by |nr_entry| entries.
+struct JitDumpDebugInfo {
+  JitDumpRecord record;
+  uint64_t code_addr;
+  uint64_t nr_entry;
+};
+
+// Followed by the file name.
+struct JitDumpDebugEntry {
+  uint64_t code_addr;
+  uint32_t line;
+  uint32_t discrim;
+};
+
+// perf must be recorded with -k mono for these to line up with samples.
+static uint64_t
+Timestamp()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+#endif
+
+PerfMap::PerfMap()
+ : map_(nullptr),
+   dump_(nullptr),
+   dump_marker_(nullptr),
+   dump_marker_size_(0),
+   code_index_(0)
+{
+  map_path_[0] = '\0';
+}
+
+PerfMap::~PerfMap()
+{
+  if (map_)
+    fclose(map_);
+  if (dump_)
+    fclose(dump_);
+#if defined(__linux__)
+  if (dump_marker_)
+    munmap(dump_marker_, dump_marker_size_);
+#endif
+}
+
+bool
+PerfMap::Open(bool jitdump)
+{
+#if defined(__linux__)
+  snprintf(map_path_, sizeof(map_path_), "/tmp/perf-%d.map", int(getpid()));
+  if ((map_ = fopen(map_path_, "w")) == nullptr)
+    return false;
+  setvbuf(map_, nullptr, _IOFBF, kBufferSize);
+
+  if (jitdump && !OpenJitDump())
+    return false;
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool
+PerfMap::OpenJitDump()
+{
+#if defined(__linux__)
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/jit-%d.dump", int(getpid()));
+
+  int fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0666);
+  if (fd == -1)
+    return false;
+
+  // perf finds the dump file by looking for an executable mapping of it in
+  // the recorded process.
+  dump_marker_size_ = sysconf(_SC_PAGESIZE);
+  dump_marker_ = mmap(nullptr, dump_marker_size_, PROT_READ | PROT_EXEC, MAP_PRIVATE, fd, 0);
+  if (dump_marker_ == MAP_FAILED) {
+    dump_marker_ = nullptr;
+    close(fd);
+    return false;
+  }
+
+  if ((dump_ = fdopen(fd, "wb")) == nullptr) {
+    close(fd);
+    return false;
+  }
+  setvbuf(dump_, nullptr, _IOFBF, kBufferSize);
+
+  JitDumpHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = kJitDumpMagic;
+  header.version = kJitDumpVersion;
+  header.total_size = sizeof(header);
+  header.elf_mach = kElfMachine;
+  header.pid = getpid();
+  header.timestamp = Timestamp();
+  fwrite(&header, sizeof(header), 1, dump_);
+  return true;
+#else
+  return false;
+#endif
+}
+
+void
+PerfMap::RecordStub(const char* name, void* address, size_t bytes)
+{
+  char symbol[128];
+  snprintf(symbol, sizeof(symbol), "sourcepawn::%s", name);
+
+  WriteMapEntry(symbol, address, bytes);
+  if (dump_)
+    WriteCodeLoad(symbol, address, bytes);
+}
+
+void
+PerfMap::RecordFunction(PluginRuntime* rt, CompiledFunction* fun)
+{
+  const char* name = rt->image()->LookupFunction(fun->GetCodeOffset());
+
+  char symbol[256];
+  if (name)
+    snprintf(symbol, sizeof(symbol), "%s::%s", rt->Name(), name);
+  else
+    snprintf(symbol, sizeof(symbol), "%s::%x", rt->Name(), fun->GetCodeOffset());
+
+  WriteMapEntry(symbol, fun->GetEntryAddress(), fun->GetCodeSize());
+  if (dump_) {
+    WriteDebugInfo(rt, fun);
+    WriteCodeLoad(symbol, fun->GetEntryAddress(), fun->GetCodeSize());
+  }
+}
+
+void
+PerfMap::Flush()
+{
+  if (map_)
+    fflush(map_);
+  if (dump_)
+    fflush(dump_);
+}
+
+void
+PerfMap::WriteMapEntry(const char* name, void* address, size_t bytes)
+{
+  fprintf(map_, "%" PRIxPTR " %zx %s\n", uintptr_t(address), bytes, name);
+}
+
+void
+PerfMap::WriteCodeLoad(const char* name, void* address, size_t bytes)
+{
+#if defined(__linux__)
+  size_t name_length = strlen(name) + 1;
+
+  JitDumpCodeLoad load;
+  load.record.id = kJitCodeLoad;
+  load.record.total_size = uint32_t(sizeof(load) + name_length + bytes);
+  load.record.timestamp = Timestamp();
+  load.pid = getpid();
+  load.tid = uint32_t(syscall(SYS_gettid));
+  load.vma = uintptr_t(address);
+  load.code_addr = uintptr_t(address);
+  load.code_size = bytes;
+  load.code_index = code_index_++;
+
+  fwrite(&load, sizeof(load), 1, dump_);
+  fwrite(name, name_length, 1, dump_);
+  fwrite(address, bytes, 1, dump_);
+#endif
+}
+
+void
+PerfMap::WriteDebugInfo(PluginRuntime* rt, CompiledFunction* fun)
+{
+#if defined(__linux__)
+  struct LineEntry {
+    uint64_t pc;
+    uint32_t line;
+    const char* file;
+  };
+
+  // The cip map is in code order, since it is appended to as code is
+  // emitted. Runs of entries on the same line are collapsed.
+  LegacyImage* image = rt->image();
+  ke::Vector<LineEntry> lines;
+  for (CipMap::Reader reader(fun->GetCipMap()); reader.more();) {
+    const CipMapEntry& entry = reader.next();
+    ucell_t cip = fun->GetCodeOffset() + entry.cipoffs;
+
+    LineEntry line;
+    if (!image->LookupLine(cip, &line.line))
+      continue;
+    if ((line.file = image->LookupFile(cip)) == nullptr)
+      continue;
+    if (!lines.empty() && lines.back().line == line.line && lines.back().file == line.file)
+      continue;
+    line.pc = uintptr_t(fun->GetEntryAddress()) + entry.pcoffs;
+    lines.append(line);
+  }
+  if (lines.empty())
+    return;
+
+  size_t total_size = sizeof(JitDumpDebugInfo);
+  for (size_t i = 0; i < lines.length(); i++)
+    total_size += sizeof(JitDumpDebugEntry) + strlen(lines[i].file) + 1;
+
+  JitDumpDebugInfo info;
+  info.record.id = kJitCodeDebugInfo;
+  info.record.total_size = uint32_t(total_size);
+  info.record.timestamp = Timestamp();
+  info.code_addr = uintptr_t(fun->GetEntryAddress());
+  info.nr_entry = lines.length();
+  fwrite(&info, sizeof(info), 1, dump_);
+
+  for (size_t i = 0; i < lines.length(); i++) {
+    JitDumpDebugEntry entry;
+    entry.code_addr = lines[i].pc;
+    entry.line = lines[i].line;
+    entry.discrim = 0;
+    fwrite(&entry, sizeof(entry), 1, dump_);
+    fwrite(lines[i].file, strlen(lines[i].file) + 1, 1, dump_);
+  }
+#endif
+}
+
+} // namespace sp
@@ -0,0 +1,71 @@
+// vim: set sts=2 ts=8 sw=2 tw=99 et:
+//
+// Copyright (C) 2006-2018 AlliedModders LLC
+//
+// This file is part of SourcePawn. SourcePawn is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License along with
+// SourcePawn. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef _include_sourcepawn_vm_perf_map_h_
+#define _include_sourcepawn_vm_perf_map_h_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+namespace sp {
+
+class PluginRuntime;
+class CompiledFunction;
+
+// Describes JIT code to Linux perf, so samples in code pools can be
+// attributed to plugin functions instead of [unknown].
+//
+// The perf map (/tmp/perf-<pid>.map) only has symbol names. The jitdump
+// file (jit-<pid>.dump, read by "perf inject --jit") also has a copy of the
+// code and a line table built from the cip map.
+//
+// Records are only written when code is linked, and both files are buffered,
+// so enabling this has no cost once plugins are running.
+class PerfMap
+{
+ public:
+  PerfMap();
+  ~PerfMap();
+
+  // Returns false if the files could not be created, or perf is not
+  // supported on this platform.
+  bool Open(bool jitdump);
+
+  void RecordStub(const char* name, void* address, size_t bytes);
+  void RecordFunction(PluginRuntime* rt, CompiledFunction* fun);
+
+  // Write out buffered records, so the files can be read while running.
+  void Flush();
+
+  const char* map_path() const {
+    return map_path_;
+  }
+
+ private:
+  bool OpenJitDump();
+  void WriteMapEntry(const char* name, void* address, size_t bytes);
+  void WriteCodeLoad(const char* name, void* address, size_t bytes);
+  void WriteDebugInfo(PluginRuntime* rt, CompiledFunction* fun);
+
+ private:
+  FILE* map_;
+  FILE* dump_;
+  void* dump_marker_;
+  size_t dump_marker_size_;
+  uint64_t code_index_;
+  char map_path_[64];
+};
+
+} // namespace sp
+
+#endif // _include_sourcepawn_vm_perf_map_h_
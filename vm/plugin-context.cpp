@@ -19,6 +19,8 @@
 #include "watchdog_timer.h"
 #include "environment.h"
 #include "method-info.h"
+#include "stack-frames.h"
+#include "context-snapshot.h"
 
 using namespace sp;
 using namespace SourcePawn;
@@ -34,7 +36,8 @@ PluginContext::PluginContext(PluginRuntime* pRuntime)
    data_size_(m_pRuntime->data().length),
    mem_size_(m_pRuntime->image()->HeapSize()),
    m_pNullVec(nullptr),
-   m_pNullString(nullptr)
+   m_pNullString(nullptr),
+   suspended_calls_(0)
 {
   // Compute and align a minimum memory amount.
   if (mem_size_ < data_size_)
@@ -50,6 +53,7 @@ PluginContext::PluginContext(PluginRuntime* pRuntime)
   sp_ = mem_size_ - sizeof(cell_t);
   stp_ = sp_;
   frm_ = sp_;
+  resetMemoryPeaks();
 }
 
 PluginContext::~PluginContext()
@@ -123,6 +127,22 @@ PluginContext::HeapAlloc(unsigned int cells, cell_t* local_addr, cell_t** phys_a
 
   hp_ += realmem;
 
+  if (Environment::get()->IsMemoryPeakTrackingEnabled() &&
+      (hp_ > peaks_.heap_high || cell_t(realmem) > peaks_.largest_alloc))
+  {
+    // Attribute the allocation to the scripted function that called the
+    // native, if any.
+    cell_t function = -1;
+    for (FrameIterator iter; !iter.Done(); iter.Next()) {
+      if (iter.IsScriptedFrame() && iter.Context() == this) {
+        function = iter.cip();
+        break;
+      }
+    }
+    noteHeapPeak(function);
+    noteAlloc(realmem, function);
+  }
+
   return SP_ERROR_NONE;
 }
 
@@ -380,6 +400,28 @@ PluginContext::GetNullRef(SP_NULL_TYPE type)
   return NULL;
 }
 
+IContextSnapshot*
+PluginContext::CreateSnapshot()
+{
+  // Registers are in flux while the plugin is running.
+  if (IsInExec())
+    return nullptr;
+  return ContextSnapshot::Capture(this);
+}
+
+int
+PluginContext::RestoreSnapshot(IContextSnapshot* api)
+{
+  ContextSnapshot* snapshot = static_cast<ContextSnapshot*>(api);
+  if (!snapshot || snapshot->cx() != this)
+    return SP_ERROR_PARAM;
+  if (IsInExec() || hasSuspendedCalls())
+    return SP_ERROR_NOT_RUNNABLE;
+
+  snapshot->Restore();
+  return SP_ERROR_NONE;
+}
+
 bool
 PluginContext::IsInExec()
 {
@@ -391,15 +433,71 @@ PluginContext::IsInExec()
 }
 
 bool
-PluginContext::Invoke(funcid_t fnid, const cell_t* params, unsigned int num_params, cell_t* result)
+PluginContext::prepareInvoke(unsigned int num_params)
 {
-  EnterProfileScope profileScope("SourcePawn", "EnterJIT");
-
   if (!env_->watchdog()->HandleInterrupt()) {
     ReportErrorNumber(SP_ERROR_TIMEOUT);
     return false;
   }
 
+  if ((cell_t)(hp_ + 16*sizeof(cell_t)) > (cell_t)(sp_ - (sizeof(cell_t) * (num_params + 1)))) {
+    ReportErrorNumber(SP_ERROR_STACKLOW);
+    return false;
+  }
+
+  // Yuck. We have to do this for compatibility, otherwise something like
+  // ForwardSys or any sort of multi-callback-fire code would die. Later,
+  // we'll expose an Invoke() or something that doesn't do this.
+  env_->clearPendingException();
+  return true;
+}
+
+void
+PluginContext::pushInvokeParams(const cell_t* params, unsigned int num_params)
+{
+  sp_ -= sizeof(cell_t) * (num_params + 1);
+  cell_t* sp = (cell_t*)(memory_ + sp_);
+
+  sp[0] = num_params;
+  for (unsigned int i = 0; i < num_params; i++)
+    sp[i + 1] = params[i];
+}
+
+bool
+PluginContext::finishInvoke(bool ok, cell_t save_sp, cell_t save_hp, cell_t save_frm)
+{
+  if (ok) {
+    // Verify that our state is still sane.
+    if (sp_ != save_sp) {
+      env_->ReportErrorFmt(
+        SP_ERROR_STACKLEAK,
+        "Stack leak detected: sp:%d should be %d!", 
+        sp_, 
+        save_sp);
+      ok = false;
+    } else if (hp_ != save_hp) {
+      env_->ReportErrorFmt(
+        SP_ERROR_HEAPLEAK,
+        "Heap leak detected: hp:%d should be %d!", 
+        hp_, 
+        save_hp);
+      ok = false;
+    }
+  }
+
+  // A failed call leaves frm_ pointing into its own frame, which the
+  // interpreter would otherwise unwind the caller from.
+  sp_ = save_sp;
+  hp_ = save_hp;
+  frm_ = save_frm;
+  return ok;
+}
+
+bool
+PluginContext::Invoke(funcid_t fnid, const cell_t* params, unsigned int num_params, cell_t* result)
+{
+  EnterProfileScope profileScope("SourcePawn", "EnterJIT");
+
   assert((fnid & 1) != 0);
 
   unsigned public_id = fnid >> 1;
@@ -414,15 +512,8 @@ PluginContext::Invoke(funcid_t fnid, const cell_t* params, unsigned int num_para
     return false;
   }
 
-  if ((cell_t)(hp_ + 16*sizeof(cell_t)) > (cell_t)(sp_ - (sizeof(cell_t) * (num_params + 1)))) {
-    ReportErrorNumber(SP_ERROR_STACKLOW);
+  if (!prepareInvoke(num_params))
     return false;
-  }
-
-  // Yuck. We have to do this for compatibility, otherwise something like
-  // ForwardSys or any sort of multi-callback-fire code would die. Later,
-  // we'll expose an Invoke() or something that doesn't do this.
-  env_->clearPendingException();
 
   cell_t ignore_result;
   if (result == NULL)
@@ -441,41 +532,14 @@ PluginContext::Invoke(funcid_t fnid, const cell_t* params, unsigned int num_para
   /* Save our previous state. */
   cell_t save_sp = sp_;
   cell_t save_hp = hp_;
+  cell_t save_frm = frm_;
 
   /* Push parameters */
-  sp_ -= sizeof(cell_t) * (num_params + 1);
-  cell_t* sp = (cell_t*)(memory_ + sp_);
-
-  sp[0] = num_params;
-  for (unsigned int i = 0; i < num_params; i++)
-    sp[i + 1] = params[i];
+  pushInvokeParams(params, num_params);
 
   // Enter the execution engine.
   bool ok = env_->Invoke(this, method, result);
-
-  if (ok) {
-    // Verify that our state is still sane.
-    if (sp_ != save_sp) {
-      env_->ReportErrorFmt(
-        SP_ERROR_STACKLEAK,
-        "Stack leak detected: sp:%d should be %d!", 
-        sp_, 
-        save_sp);
-      return false;
-    }
-    if (hp_ != save_hp) {
-      env_->ReportErrorFmt(
-        SP_ERROR_HEAPLEAK,
-        "Heap leak detected: hp:%d should be %d!", 
-        hp_, 
-        save_hp);
-      return false;
-    }
-  }
-
-  sp_ = save_sp;
-  hp_ = save_hp;
-  return ok;
+  return finishInvoke(ok, save_sp, save_hp, save_frm);
 }
 
 IPluginRuntime*
@@ -509,6 +573,17 @@ PluginContext::popTrackerAndSetHeap()
   return SP_ERROR_NONE;
 }
 
+void
+PluginContext::resetMemoryPeaks()
+{
+  peaks_.stack_low = sp_;
+  peaks_.stack_low_function = -1;
+  peaks_.heap_high = hp_;
+  peaks_.heap_high_function = -1;
+  peaks_.largest_alloc = 0;
+  peaks_.largest_alloc_function = -1;
+}
+
 int
 PluginContext::pushTracker(uint32_t amount)
 {
@@ -895,8 +970,15 @@ PluginContext::acquireAddrRange(cell_t address, uint32_t bounds)
   cell_t* addr = throwIfBadAddress(address);
   if (!addr)
     return nullptr;
-  if (bounds && !throwIfBadAddress(address + bounds - 1))
+
+  // Checking the last byte is not enough: the gap between hp and sp may be
+  // narrower than the range.
+  if (bounds > uint32_t(stp_ - address) ||
+      (address < sp_ && cell_t(address + bounds) > hp_))
+  {
+    ReportErrorNumber(SP_ERROR_INVALID_ADDRESS);
     return nullptr;
+  }
   return addr;
 }
 
@@ -25,6 +25,19 @@ static const cell_t STACK_MARGIN = 64; // 16 parameters of safety, I guess
 class Environment;
 class PluginContext;
 
+// Peak stack and heap usage, when memory peak tracking is enabled. The
+// interpreter updates these through the note*() functions below; the JIT
+// updates them inline.
+struct MemoryPeaks
+{
+  cell_t stack_low;
+  cell_t stack_low_function;
+  cell_t heap_high;
+  cell_t heap_high_function;
+  cell_t largest_alloc;
+  cell_t largest_alloc_function;
+};
+
 class PluginContext : public BasePluginContext
 {
  public:
@@ -60,6 +73,15 @@ class PluginContext : public BasePluginContext
 
   bool Invoke(funcid_t fnid, const cell_t* params, unsigned int num_params, cell_t* result);
 
+  // Shared by Invoke() and resumable calls. prepareInvoke() checks the
+  // watchdog and that there is room for the arguments, and clears any
+  // pending exception; it returns false if an error was reported.
+  // finishInvoke() reports a stack or heap leak if a call that succeeded
+  // did not restore sp or hp, and then restores sp, hp and frm.
+  bool prepareInvoke(unsigned int num_params);
+  void pushInvokeParams(const cell_t* params, unsigned int num_params);
+  bool finishInvoke(bool ok, cell_t save_sp, cell_t save_hp, cell_t save_frm);
+
   size_t HeapSize() const {
     return mem_size_;
   }
@@ -75,6 +97,8 @@ class PluginContext : public BasePluginContext
 
  public:
   bool IsInExec() override;
+  IContextSnapshot* CreateSnapshot() override;
+  int RestoreSnapshot(IContextSnapshot* snapshot) override;
 
   static inline size_t offsetOfSp() {
     return offsetof(PluginContext, sp_);
@@ -105,10 +129,59 @@ class PluginContext : public BasePluginContext
   cell_t hp() const {
     return hp_;
   }
+  cell_t stp() const {
+    return stp_;
+  }
 
   int popTrackerAndSetHeap();
   int pushTracker(uint32_t amount);
 
+  MemoryPeaks* peaks() {
+    return &peaks_;
+  }
+  void resetMemoryPeaks();
+
+  // Resumable calls that are suspended hold copies of stack and heap memory,
+  // which a snapshot restore would leave stale.
+  void noteCallSuspended() {
+    suspended_calls_++;
+  }
+  void noteCallResumed() {
+    assert(suspended_calls_ > 0);
+    suspended_calls_--;
+  }
+  bool hasSuspendedCalls() const {
+    return suspended_calls_ > 0;
+  }
+
+  // Record sp or hp if it is a new peak, on behalf of the function that
+  // contains the code address |function|.
+  void noteStackPeak(cell_t function) {
+    if (sp_ < peaks_.stack_low) {
+      peaks_.stack_low = sp_;
+      peaks_.stack_low_function = function;
+    }
+  }
+  void noteHeapPeak(cell_t function) {
+    if (hp_ > peaks_.heap_high) {
+      peaks_.heap_high = hp_;
+      peaks_.heap_high_function = function;
+    }
+  }
+  void noteAlloc(cell_t bytes, cell_t function) {
+    if (bytes > peaks_.largest_alloc) {
+      peaks_.largest_alloc = bytes;
+      peaks_.largest_alloc_function = function;
+    }
+  }
+
+  // Record an allocation that just pushed a tracker; the tracker holds its
+  // size.
+  void noteTrackedAlloc(cell_t function) {
+    noteHeapPeak(function);
+    noteAlloc(*reinterpret_cast<cell_t*>(memory_ + hp_ - sizeof(cell_t)), function);
+  }
+
   int generateArray(cell_t dims, cell_t* stk, bool autozero);
   int generateFullArray(uint32_t argc, cell_t* argv, int autozero);
 
@@ -126,6 +199,19 @@ class PluginContext : public BasePluginContext
   bool setCellValue(cell_t address, cell_t value);
   bool heapAlloc(cell_t amount, cell_t* out);
   cell_t* acquireAddrRange(cell_t address, uint32_t bounds);
+
+  // Return the number of bytes accessible from |addr| before the end of the
+  // region it is in, either [0, hp) or [sp, stack top). Returns 0 if |addr|
+  // is not a valid address.
+  size_t addressableBytes(cell_t addr) const {
+    if (addr < 0 || addr >= stp_)
+      return 0;
+    if (addr < hp_)
+      return hp_ - addr;
+    if (addr < sp_)
+      return 0;
+    return stp_ - addr;
+  }
   int rebaseArray(cell_t array_addr,
                   cell_t dat_addr,
                   cell_t iv_size,
@@ -149,6 +235,9 @@ class PluginContext : public BasePluginContext
   cell_t sp_;
   cell_t hp_;
   cell_t frm_;
+
+  MemoryPeaks peaks_;
+  size_t suspended_calls_;
 };
 
 } // namespace sp
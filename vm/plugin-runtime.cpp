@@ -15,12 +15,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <limits.h>
 #include <smx/smx-v1-opcodes.h>
 #include "compiled-function.h"
 #include "environment.h"
 #include "method-info.h"
+#include "opcodes.h"
 #include "plugin-context.h"
 #include "builtins.h"
+#if defined(SP_HAS_JIT)
+# include "jit.h"
+#endif
 
 #include "md5/md5.h"
 
@@ -29,6 +34,8 @@ using namespace SourcePawn;
 
 PluginRuntime::PluginRuntime(LegacyImage* image)
  : image_(image),
+   num_breakpoints_(0),
+   single_step_(false),
    paused_(false),
    computed_code_hash_(false),
    computed_data_hash_(false)
@@ -139,23 +146,51 @@ static const NativeMapping sNativeMap[] = {
   { "__float_eq",     OP_FLOAT_EQ },
   { "__float_ne",     OP_FLOAT_NE },
   { "__float_not",    OP_FLOAT_NOT },
+  { "__vec_add",      OP_VEC_ADD },
+  { "__vec_sub",      OP_VEC_SUB },
+  { "__vec_scale",    OP_VEC_SCALE },
+  { "__vec_length",   OP_VEC_LENGTH },
+  { "__vec_distance", OP_VEC_DISTANCE },
+  { "__vec_normalize", OP_VEC_NORMALIZE },
+  { "__vec_dot",      OP_VEC_DOT },
+  { "__vec_cross",    OP_VEC_CROSS },
   { NULL,             0 },
 };
 
+// Only mapped if the host enabled them with EnableSourceModVectorNatives,
+// since SourceMod otherwise binds these itself.
+static const NativeMapping sSourceModVectorMap[] = {
+  { "GetVectorLength",       OP_VEC_LENGTH },
+  { "GetVectorDistance",     OP_VEC_DISTANCE },
+  { "NormalizeVector",       OP_VEC_NORMALIZE },
+  { "GetVectorDotProduct",   OP_VEC_DOT },
+  { "GetVectorCrossProduct", OP_VEC_CROSS },
+  { NULL,                    0 },
+};
+
+static const NativeMapping*
+FindNativeMapping(const NativeMapping* iter, const char* name)
+{
+  for (; iter->name; iter++) {
+    if (strcmp(name, iter->name) == 0)
+      return iter;
+  }
+  return nullptr;
+}
+
 void
 PluginRuntime::SetupFloatNativeRemapping()
 {
   float_table_ = MakeUnique<floattbl_t[]>(image_->NumNatives());
+  bool sm_vectors = Environment::get()->IsSourceModVectorNativesEnabled();
   for (size_t i = 0; i < image_->NumNatives(); i++) {
     const char* name = image_->GetNative(i);
-    const NativeMapping* iter = sNativeMap;
-    while (iter->name) {
-      if (strcmp(name, iter->name) == 0) {
-        float_table_[i].found = true;
-        float_table_[i].index = iter->opcode;
-        break;
-      }
-      iter++;
+    const NativeMapping* mapping = FindNativeMapping(sNativeMap, name);
+    if (!mapping && sm_vectors)
+      mapping = FindNativeMapping(sSourceModVectorMap, name);
+    if (mapping) {
+      float_table_[i].found = true;
+      float_table_[i].index = mapping->opcode;
     }
   }
 }
@@ -172,10 +207,19 @@ PluginRuntime::InstallBuiltinNatives()
 {
   Environment* env = Environment::get();
   for (size_t i = 0; i < image_->NumNatives(); i++) {
-    if (!float_table_[i].found)
+    const char* name = image_->GetNative(i);
+
+    if (!float_table_[i].found) {
+      // Builtins with a fast entry point are bound normally, but callsites
+      // invoke them without an exit frame.
+      SPVM_NATIVE_FUNC func = env->builtins()->Lookup(name);
+      if (!func)
+        continue;
+      if (UpdateNativeBinding(i, func, 0, nullptr) == SP_ERROR_NONE)
+        natives_[i].fast_fn = env->builtins()->LookupFast(name);
       continue;
+    }
 
-    const char* name = image_->GetNative(i);
     SPVM_NATIVE_FUNC func = env->builtins()->Lookup(name);
     if (!func)
       func = NativeMustBeReplaced;
@@ -184,11 +228,20 @@ PluginRuntime::InstallBuiltinNatives()
 }
 
 unsigned
-PluginRuntime::GetNativeReplacement(size_t index)
+PluginRuntime::GetNativeReplacement(size_t index, cell_t nparams)
 {
   if (!float_table_[index].found)
     return (unsigned)OP_NOP;
-  return float_table_[index].index;
+
+  // The vector pseudo-ops pop a fixed number of arguments, so a native that
+  // was declared with a different arity must stay an ordinary call.
+  unsigned op = float_table_[index].index;
+  if (op >= OP_VEC_ADD && op <= OP_VEC_CROSS) {
+    VectorOp vop = VectorOp(op - OP_VEC_ADD);
+    if (nparams != cell_t(GetVectorOpInfo(vop).nargs))
+      return (unsigned)OP_NOP;
+  }
+  return op;
 }
 
 void
@@ -239,6 +292,9 @@ PluginRuntime::AcquireMethod(cell_t pcode_offset)
     if (!methods_.append(method))
       return nullptr;
   }
+
+  if (previous_)
+    AdoptPreviousMethod(method);
   return method;
 }
 
@@ -249,6 +305,14 @@ PluginRuntime::AllMethods() const
   return methods_;
 }
 
+MethodInfo**
+PluginRuntime::InterpCallTargets()
+{
+  if (!interp_call_targets_)
+    interp_call_targets_ = MakeUnique<MethodInfo*[]>(code_.length / sizeof(cell_t));
+  return interp_call_targets_.get();
+}
+
 int
 PluginRuntime::FindNativeByName(const char* name, uint32_t* index)
 {
@@ -285,7 +349,13 @@ PluginRuntime::UpdateNativeBinding(uint32_t index, SPVM_NATIVE_FUNC pfn, uint32_
     return SP_ERROR_PARAM;
   }
 
+  // Leaf natives have a different signature.
+  if (flags & SP_NTVFLAG_LEAF)
+    return SP_ERROR_PARAM;
+
   native->legacy_fn = pfn;
+  native->fast_fn = nullptr;
+  native->leaf_fn = nullptr;
   native->status = pfn
                    ? SP_NATIVE_BOUND
                    : SP_NATIVE_UNBOUND;
@@ -294,6 +364,61 @@ PluginRuntime::UpdateNativeBinding(uint32_t index, SPVM_NATIVE_FUNC pfn, uint32_
   return SP_ERROR_NONE;
 }
 
+int
+PluginRuntime::UpdateLeafNativeBinding(uint32_t index, SPVM_LEAF_NATIVE_FUNC pfn, void* data)
+{
+  if (index >= image_->NumNatives())
+    return SP_ERROR_INDEX;
+  if (!pfn)
+    return SP_ERROR_PARAM;
+
+  // Callsites bake in the address of a leaf native, so it can only be bound
+  // once, and only if it was never bound before. Callsites compiled before
+  // then find it through InvokeLateBoundLeafNative in the JIT.
+  NativeEntry* native = &natives_[index];
+  if (native->status == SP_NATIVE_BOUND)
+    return SP_ERROR_PARAM;
+
+  native->legacy_fn = nullptr;
+  native->fast_fn = nullptr;
+  native->leaf_fn = pfn;
+  native->status = SP_NATIVE_BOUND;
+  native->flags = SP_NTVFLAG_LEAF;
+  native->user = data;
+  return SP_ERROR_NONE;
+}
+
+int
+PluginRuntime::UpdateTypedNativeBinding(uint32_t index, const sp_typednativeinfo_t* info,
+                                        void* data)
+{
+  if (index >= image_->NumNatives())
+    return SP_ERROR_INDEX;
+
+  // As with leaf natives, callsites assume the glue never changes.
+  NativeEntry* native = &natives_[index];
+  if (native->status == SP_NATIVE_BOUND)
+    return SP_ERROR_PARAM;
+
+  const uint8_t* sig = nullptr;
+  size_t sig_length = 0;
+  if (!image_->GetNativeSignature(index, &sig, &sig_length))
+    sig = nullptr;
+
+  TypedNativeGlue* glue = TypedNativeGlue::Compile(info, data, sig, sig_length);
+  if (!glue)
+    return SP_ERROR_PARAM;
+
+  native->legacy_fn = nullptr;
+  native->fast_fn = nullptr;
+  native->leaf_fn = nullptr;
+  native->typed = glue;
+  native->status = SP_NATIVE_BOUND;
+  native->flags = 0;
+  native->user = data;
+  return SP_ERROR_NONE;
+}
+
 const sp_native_t*
 PluginRuntime::GetNative(uint32_t index)
 {
@@ -477,14 +602,217 @@ PluginRuntime::IsPaused()
   return paused_;
 }
 
+PreviousVersion::~PreviousVersion()
+{
+  for (MethodMap::iterator iter = methods.iter(); !iter.empty(); iter.next())
+    delete iter->value.code;
+}
+
+size_t
+PluginRuntime::AdoptMethodsFrom(IPluginRuntime* api)
+{
+  PluginRuntime* previous = PluginRuntime::FromAPI(api);
+  if (previous == this || previous_)
+    return 0;
+
+  // The verifier only checks offsets against the upper bounds of each
+  // region, so its results still hold if no region shrank.
+  size_t mem_size = context_->HeapSize();
+  size_t prev_mem_size = previous->context_->HeapSize();
+  if (code_.features != previous->code_.features ||
+      data_.length < previous->data_.length ||
+      mem_size < prev_mem_size ||
+      mem_size - data_.length < prev_mem_size - previous->data_.length)
+  {
+    return 0;
+  }
+
+  ke::AutoLock lock(Environment::get()->lock());
+
+  AutoPtr<PreviousVersion> prev(new PreviousVersion());
+  if (!prev->methods.init(16))
+    return 0;
+
+  bool adopt_code = CanAdoptCodeFrom(previous);
+  if (adopt_code) {
+    prev->context = uintptr_t(previous->context_.get());
+    prev->natives = uintptr_t(previous->natives_.get());
+    for (size_t i = 0; i < image_->NumNatives(); i++) {
+      if (!prev->glue.append(uintptr_t(previous->natives_[i].typed.get())))
+        return 0;
+    }
+  }
+
+  // Index the previous version's verified methods by content. New methods
+  // are hashed when they are acquired, so methods that never run cost
+  // nothing.
+  size_t count = 0;
+  for (size_t i = 0; i < previous->methods_.length(); i++) {
+    const RefPtr<MethodInfo>& method = previous->methods_[i];
+    ContentHash key;
+    if (!method->verified() || !method->ComputeContentHash(key.bytes))
+      continue;
+    PreviousVersion::MethodMap::Insert p = prev->methods.findForAdd(key);
+    if (p.found())
+      continue;
+
+    PreviousVersion::Method entry;
+    entry.max_stack = method->max_stack();
+    entry.code = nullptr;
+    if (!prev->methods.add(p, key, entry))
+      break;
+    if (adopt_code && method->jit())
+      p->value.code = method->takeCompiledFunction();
+    count++;
+  }
+  if (!count)
+    return 0;
+
+  previous_ = prev.take();
+  return count;
+}
+
+// Compiled code depends on the natives it was compiled against and on the
+// size of the plugin's memory. The previous version must also have nothing
+// on the stack that could return into the code, and the caller must have
+// paused it: taken code still refers to the previous version until it is
+// adopted, and the previous version's remaining code may call it.
+bool
+PluginRuntime::CanAdoptCodeFrom(PluginRuntime* previous)
+{
+  if (!previous->IsPaused())
+    return false;
+  if (previous->context_->IsInExec() || previous->context_->hasSuspendedCalls())
+    return false;
+  if (context_->DataSize() != previous->context_->DataSize() ||
+      context_->HeapSize() != previous->context_->HeapSize())
+  {
+    return false;
+  }
+
+  if (image_->NumNatives() != previous->image_->NumNatives())
+    return false;
+  for (size_t i = 0; i < image_->NumNatives(); i++) {
+    const NativeEntry& a = natives_[i];
+    const NativeEntry& b = previous->natives_[i];
+    if (strcmp(image_->GetNative(i), previous->image_->GetNative(i)) != 0 ||
+        a.status != b.status ||
+        a.flags != b.flags ||
+        a.legacy_fn != b.legacy_fn ||
+        a.fast_fn != b.fast_fn ||
+        a.leaf_fn != b.leaf_fn ||
+        !a.typed != !b.typed)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+void
+PluginRuntime::AdoptPreviousMethod(MethodInfo* method)
+{
+  ContentHash key;
+  if (!method->ComputeContentHash(key.bytes))
+    return;
+
+  PreviousVersion::MethodMap::Result r = previous_->methods.find(key);
+  if (!r.found())
+    return;
+
+  method->AdoptVerification(r->value.max_stack);
+
+#if defined(SP_HAS_JIT)
+  // Adopting code can acquire the methods it calls, which never adds to the
+  // map, so |r| stays valid.
+  CompiledFunction* fun = r->value.code;
+  if (fun && CompilerBase::AdoptCompiledFunction(this, method, fun, *previous_.get()))
+    r->value.code = nullptr;
+#endif
+}
+
 size_t
 PluginRuntime::GetMemUsage()
 {
-  return sizeof(*this) +
-         sizeof(PluginContext) +
-         image_->ImageSize() +
-         (aligned_code_ ? code_.length : 0) +
-         context_->HeapSize();
+  sp_memreport_t report;
+  GetMemReport(&report);
+  return report.total;
+}
+
+void
+PluginRuntime::GetMemReport(sp_memreport_t* report)
+{
+  ke::AutoLock lock(Environment::get()->lock());
+  GetMemReportLocked(report);
+}
+
+void
+PluginRuntime::GetMemReportLocked(sp_memreport_t* report)
+{
+  Environment::get()->lock()->AssertCurrentThreadOwns();
+
+  memset(report, 0, sizeof(*report));
+
+  report->runtime = sizeof(*this) +
+                    sizeof(PluginContext) +
+                    sizeof(NativeEntry) * image_->NumNatives() +
+                    sizeof(sp_public_t) * image_->NumPublics() +
+                    sizeof(sp_pubvar_t) * image_->NumPubvars() +
+                    sizeof(ScriptedInvoker*) * image_->NumPublics() +
+                    (float_table_ ? sizeof(floattbl_t) * image_->NumNatives() : 0) +
+                    name_.length() + full_name_.length();
+  for (size_t i = 0; i < image_->NumNatives(); i++) {
+    if (natives_[i].typed)
+      report->runtime += sizeof(TypedNativeGlue);
+  }
+
+  report->image = image_->ImageSize();
+  report->code = aligned_code_ ? code_.length : 0;
+  report->memory = context_->HeapSize();
+
+  for (size_t i = 0; i < methods_.length(); i++) {
+    const RefPtr<MethodInfo>& method = methods_[i];
+    report->methods += method->EstimateMemUsage();
+
+    CompiledFunction* fun = method->jit();
+    if (!fun)
+      continue;
+    report->jit_code += fun->GetCodeSize();
+    report->jit_metadata += fun->EstimateMetadataSize();
+  }
+
+  // Code from a previous version that no method has adopted yet.
+  if (previous_) {
+    report->runtime += sizeof(PreviousVersion) + sizeof(uintptr_t) * previous_->glue.length();
+    report->function_map += previous_->methods.estimateMemoryUse();
+    for (PreviousVersion::MethodMap::iterator iter = previous_->methods.iter(); !iter.empty();
+         iter.next())
+    {
+      if (CompiledFunction* fun = iter->value.code) {
+        report->jit_code += fun->GetCodeSize();
+        report->jit_metadata += fun->EstimateMetadataSize();
+      }
+    }
+  }
+
+  report->function_map += function_map_.estimateMemoryUse() +
+                          sizeof(RefPtr<MethodInfo>) * methods_.length() +
+                          (interp_call_targets_ ? code_.length / sizeof(cell_t) * sizeof(MethodInfo*) : 0);
+
+  for (size_t i = 0; i < image_->NumPublics(); i++) {
+    if (entrypoints_[i])
+      report->invokers += entrypoints_[i]->EstimateMemUsage();
+  }
+
+  report->total = report->runtime +
+                  report->image +
+                  report->code +
+                  report->memory +
+                  report->jit_code +
+                  report->jit_metadata +
+                  report->methods +
+                  report->function_map +
+                  report->invokers;
 }
 
 unsigned char*
@@ -582,3 +910,93 @@ PluginRuntime::LookupLineAddress(const uint32_t line, const char* file, ucell_t*
     return SP_ERROR_NOT_FOUND;
   return SP_ERROR_NONE;
 }
+
+int
+PluginRuntime::SetBreakpoint(ucell_t addr, bool enabled)
+{
+  if (!Environment::get()->IsDebugBreakEnabled())
+    return SP_ERROR_NOTDEBUGGING;
+
+  // Line addresses point at the BREAK emitted for each line.
+  if (!ke::IsAligned(addr, sizeof(cell_t)) || addr >= code_.length)
+    return SP_ERROR_INVALID_ADDRESS;
+  if (*reinterpret_cast<const cell_t*>(code_.bytes + addr) != OP_BREAK)
+    return SP_ERROR_INVALID_ADDRESS;
+
+  // Break sites in JIT code are patched in place, which is only safe if no
+  // other thread could be running them.
+  assert(Environment::get()->IsOnMainThread());
+
+  ke::AutoLock lock(Environment::get()->lock());
+
+  uintptr_t bit = addr / sizeof(cell_t);
+  if (breakpoints_.test(bit) == enabled)
+    return SP_ERROR_NONE;
+
+  if (enabled) {
+    breakpoints_.set(bit);
+    num_breakpoints_++;
+  } else {
+    breakpoints_.clear(bit);
+    num_breakpoints_--;
+  }
+  UpdateDebugBreakSites();
+  return SP_ERROR_NONE;
+}
+
+int
+PluginRuntime::SetSingleStep(bool enabled)
+{
+  if (!Environment::get()->IsDebugBreakEnabled())
+    return SP_ERROR_NOTDEBUGGING;
+
+  assert(Environment::get()->IsOnMainThread());
+
+  ke::AutoLock lock(Environment::get()->lock());
+
+  if (single_step_ == enabled)
+    return SP_ERROR_NONE;
+
+  single_step_ = enabled;
+  UpdateDebugBreakSites();
+  return SP_ERROR_NONE;
+}
+
+int
+PluginRuntime::GetMemoryPeaks(sp_mempeaks_t* peaks)
+{
+  if (!Environment::get()->IsMemoryPeakTrackingEnabled())
+    return SP_ERROR_NOT_FOUND;
+
+  const MemoryPeaks* p = context_->peaks();
+  cell_t stack_top = cell_t(context_->HeapSize() - sizeof(cell_t));
+
+  peaks->memory_size = uint32_t(context_->HeapSize());
+  peaks->data_size = uint32_t(context_->DataSize());
+  peaks->stack_peak = uint32_t(stack_top - p->stack_low);
+  peaks->stack_peak_function = p->stack_low_function;
+  peaks->heap_peak = uint32_t(p->heap_high - cell_t(context_->DataSize()));
+  peaks->heap_peak_function = p->heap_high_function;
+  peaks->largest_alloc = uint32_t(p->largest_alloc);
+  peaks->largest_alloc_function = p->largest_alloc_function;
+  return SP_ERROR_NONE;
+}
+
+void
+PluginRuntime::ResetMemoryPeaks()
+{
+  context_->resetMemoryPeaks();
+}
+
+void
+PluginRuntime::UpdateDebugBreakSites()
+{
+  // The interpreter checks ShouldBreakAt() itself, so only JIT code needs to
+  // be patched.
+#if defined(SP_HAS_JIT)
+  for (size_t i = 0; i < methods_.length(); i++) {
+    if (CompiledFunction* fun = methods_[i]->jit())
+      CompilerBase::UpdateDebugBreakSites(this, fun);
+  }
+#endif
+}
@@ -14,6 +14,7 @@
 #define _INCLUDE_SOURCEPAWN_JIT_RUNTIME_H_
 
 #include <sp_vm_api.h>
+#include <string.h>
 #include <am-vector.h>
 #include <am-string.h>
 #include <am-inlinelist.h>
@@ -21,6 +22,9 @@
 #include <amtl/am-refcounting.h>
 #include "scripted-invoker.h"
 #include "legacy-image.h"
+#include "builtins.h"
+#include "typed-natives.h"
+#include "bitset.h"
 
 namespace sp {
 
@@ -28,6 +32,7 @@ using namespace ke;
 
 class PluginContext;
 class MethodInfo;
+class CompiledFunction;
 
 struct floattbl_t
 {
@@ -42,9 +47,63 @@ struct floattbl_t
 struct NativeEntry : public sp_native_t
 {
   NativeEntry()
-   : legacy_fn(nullptr)
+   : legacy_fn(nullptr),
+     fast_fn(nullptr),
+     leaf_fn(nullptr)
   {}
   SPVM_NATIVE_FUNC legacy_fn;
+
+  // If bound to a builtin with a fast entry point, the JIT and interpreter
+  // call this instead of legacy_fn.
+  BuiltinFastFn fast_fn;
+
+  // If bound with SP_NTVFLAG_LEAF, the native has no legacy entry point, and
+  // is called the same way as a fast builtin.
+  SPVM_LEAF_NATIVE_FUNC leaf_fn;
+
+  // If bound as a typed native, the glue replaces legacy_fn. It is called
+  // with an exit frame, like any other native.
+  ke::AutoPtr<TypedNativeGlue> typed;
+};
+
+struct ContentHash
+{
+  uint8_t bytes[16];
+};
+
+struct ContentHashPolicy
+{
+  static inline uint32_t hash(const ContentHash& key) {
+    uint32_t value;
+    memcpy(&value, key.bytes, sizeof(value));
+    return value;
+  }
+  static inline bool matches(const ContentHash& a, const ContentHash& b) {
+    return memcmp(a.bytes, b.bytes, sizeof(a.bytes)) == 0;
+  }
+};
+
+// What a previous version of a plugin left for the new one, indexed by the
+// content hash of each method. New methods look themselves up when they are
+// first acquired. See PluginRuntime::AdoptMethodsFrom().
+struct PreviousVersion
+{
+  ~PreviousVersion();
+
+  struct Method {
+    int32_t max_stack;
+    // Code compiled for the method, owned here until a new method adopts it,
+    // or null.
+    CompiledFunction* code;
+  };
+  typedef ke::HashMap<ContentHash, Method, ContentHashPolicy> MethodMap;
+  MethodMap methods;
+
+  // Where the previous version kept the objects that its code refers to: its
+  // context, its natives, and the glue of each typed native (or 0).
+  uintptr_t context;
+  uintptr_t natives;
+  ke::Vector<uintptr_t> glue;
 };
 
 /* Jit wants fast access to this so we expose things as public */
@@ -82,9 +141,12 @@ class PluginRuntime
   virtual unsigned char* GetCodeHash() override;
   virtual unsigned char* GetDataHash() override;
   void SetNames(const char* fullname, const char* name);
-  unsigned GetNativeReplacement(size_t index);
+  unsigned GetNativeReplacement(size_t index, cell_t nparams);
   ScriptedInvoker* GetPublicFunction(size_t index);
   int UpdateNativeBinding(uint32_t index, SPVM_NATIVE_FUNC pfn, uint32_t flags, void* data) override;
+  int UpdateLeafNativeBinding(uint32_t index, SPVM_LEAF_NATIVE_FUNC pfn, void* data) override;
+  int UpdateTypedNativeBinding(uint32_t index, const sp_typednativeinfo_t* info,
+                               void* data) override;
   const sp_native_t* GetNative(uint32_t index) override;
   int LookupLine(ucell_t addr, uint32_t* line) override;
   int LookupFunction(ucell_t addr, const char** name) override;
@@ -93,10 +155,20 @@ class PluginRuntime
   const char* GetFileName(size_t index) override;
   int LookupFunctionAddress(const char* function, const char* file, ucell_t* addr) override;
   int LookupLineAddress(const uint32_t line, const char* file, ucell_t* addr) override;
+  int SetBreakpoint(ucell_t addr, bool enabled) override;
+  int SetSingleStep(bool enabled) override;
+  int GetMemoryPeaks(sp_mempeaks_t* peaks) override;
+  void ResetMemoryPeaks() override;
+  void GetMemReport(sp_memreport_t* report) override;
+  size_t AdoptMethodsFrom(IPluginRuntime* previous) override;
   const char* GetFilename() override {
     return full_name_.chars();
   }
 
+  // Same as GetMemReport(), for callers that already hold the environment
+  // lock.
+  void GetMemReportLocked(sp_memreport_t* report);
+
   // Mark builtin natives as bound.
   void InstallBuiltinNatives();
 
@@ -110,6 +182,17 @@ class PluginRuntime
   // Return a list of all methods. The caller must own the environment lock.
   const ke::Vector<RefPtr<MethodInfo>>& AllMethods() const;
 
+  // Return the interpreter's call target cache, which is indexed by the cell
+  // number of each CALL instruction. Entries are null until the call site
+  // has been resolved and validated. It is allocated on first use.
+  MethodInfo** InterpCallTargets();
+
+  // Return whether the BREAK instruction at the given cip should call the
+  // debug break handler.
+  bool ShouldBreakAt(ucell_t cip) {
+    return single_step_ || (num_breakpoints_ && breakpoints_.test(cip / sizeof(cell_t)));
+  }
+
   NativeEntry* NativeAt(size_t index) {
     return &natives_[index];
   }
@@ -143,6 +226,9 @@ class PluginRuntime
 
  private:
   void SetupFloatNativeRemapping();
+  void UpdateDebugBreakSites();
+  bool CanAdoptCodeFrom(PluginRuntime* previous);
+  void AdoptPreviousMethod(MethodInfo* method);
 
  private:
   ke::AutoPtr<sp::LegacyImage> image_;
@@ -170,6 +256,13 @@ class PluginRuntime
 
   FunctionMap function_map_;
   ke::Vector<RefPtr<MethodInfo>> methods_;;
+  ke::AutoPtr<MethodInfo*[]> interp_call_targets_;
+  ke::AutoPtr<PreviousVersion> previous_;
+
+  // Breakpoints, indexed by cell number.
+  BitSet breakpoints_;
+  size_t num_breakpoints_;
+  bool single_step_;
 
   // Pause state.
   bool paused_;
@@ -18,6 +18,7 @@
 #include "environment.h"
 #include "plugin-context.h"
 #include "method-info.h"
+#include "coroutine.h"
 
 /********************
 * FUNCTION CALLING*
@@ -335,6 +336,95 @@ ScriptedInvoker::Invoke(cell_t* result)
   return !env_->hasPendingException();
 }
 
+bool
+ScriptedInvoker::InvokeResumable(cell_t* result, bool* suspended)
+{
+  *suspended = false;
+
+  if (!IsRunnable()) {
+    Cancel();
+    env_->ReportError(SP_ERROR_NOT_RUNNABLE);
+    return false;
+  }
+  if (int err = m_errorstate) {
+    Cancel();
+    env_->ReportError(err);
+    return false;
+  }
+
+  // Arrays and references live on the heap, and would have to be copied back
+  // when the call finishes, which may be many resumes later.
+  unsigned int numparams = m_curparam;
+  for (unsigned int i = 0; i < numparams; i++) {
+    if (m_info[i].marked) {
+      Cancel();
+      env_->ReportErrorFmt(SP_ERROR_PARAM, "Resumable calls can only take cell parameters");
+      return false;
+    }
+  }
+
+  cell_t temp_params[SP_MAX_EXEC_PARAMS];
+  memcpy(temp_params, m_params, numparams * sizeof(cell_t));
+  m_curparam = 0;
+
+  RefPtr<MethodInfo> method = AcquireMethod();
+  if (!method) {
+    env_->ReportError(SP_ERROR_INVALID_ADDRESS);
+    return false;
+  }
+
+  if (!coroutine_)
+    coroutine_ = new Coroutine(context_);
+
+  cell_t ignore_result;
+  if (!result)
+    result = &ignore_result;
+
+  if (!coroutine_->Start(DebugName(), method, temp_params, numparams, result))
+    return false;
+
+  *suspended = coroutine_->suspended();
+  return true;
+}
+
+bool
+ScriptedInvoker::Resume(cell_t value, cell_t* result, bool* suspended)
+{
+  *suspended = false;
+
+  if (!IsRunnable()) {
+    env_->ReportError(SP_ERROR_NOT_RUNNABLE);
+    return false;
+  }
+  if (!IsSuspended()) {
+    env_->ReportErrorFmt(SP_ERROR_NOT_RUNNABLE, "Function has no suspended call");
+    return false;
+  }
+
+  cell_t ignore_result;
+  if (!result)
+    result = &ignore_result;
+
+  if (!coroutine_->Resume(DebugName(), value, result))
+    return false;
+
+  *suspended = coroutine_->suspended();
+  return true;
+}
+
+bool
+ScriptedInvoker::IsSuspended()
+{
+  return coroutine_ && coroutine_->suspended();
+}
+
+void
+ScriptedInvoker::DiscardSuspended()
+{
+  if (coroutine_)
+    coroutine_->Discard();
+}
+
 int
 ScriptedInvoker::Execute2(IPluginContext* ctx, cell_t* result)
 {
@@ -362,6 +452,17 @@ ScriptedInvoker::SetError(int err)
   return err;
 }
 
+size_t
+ScriptedInvoker::EstimateMemUsage() const
+{
+  size_t bytes = sizeof(*this);
+  if (full_name_)
+    bytes += strlen(full_name_.get()) + 1;
+  if (coroutine_)
+    bytes += sizeof(Coroutine);
+  return bytes;
+}
+
 RefPtr<MethodInfo>
 ScriptedInvoker::AcquireMethod()
 {
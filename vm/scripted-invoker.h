@@ -26,6 +26,7 @@ class PluginRuntime;
 class PluginContext;
 class CompiledFunction;
 class MethodInfo;
+class Coroutine;
 
 struct ParamInfo
 {
@@ -71,6 +72,10 @@ class ScriptedInvoker : public IPluginFunction
   const char* DebugName() {
     return full_name_.get();
   }
+  bool InvokeResumable(cell_t* result, bool* suspended);
+  bool Resume(cell_t value, cell_t* result, bool* suspended);
+  bool IsSuspended();
+  void DiscardSuspended();
 
  public:
   sp_public_t* Public() const {
@@ -80,6 +85,8 @@ class ScriptedInvoker : public IPluginFunction
   // Helper for pRuntime->AcquireMethod that caches the result.
   RefPtr<MethodInfo> AcquireMethod();
 
+  size_t EstimateMemUsage() const;
+
  private:
   int _PushString(const char* string, int sz_flags, int cp_flags, size_t len);
   int SetError(int err);
@@ -95,6 +102,7 @@ class ScriptedInvoker : public IPluginFunction
   ke::AutoPtr<char[]> full_name_;
   sp_public_t* public_;
   RefPtr<MethodInfo> method_;
+  ke::AutoPtr<Coroutine> coroutine_;
 };
 
 } // namespace sp
@@ -11,12 +11,17 @@
 // SourcePawn. If not, see http://www.gnu.org/licenses/.
 //
 #include <sp_vm_api.h>
+#include <sp_typed_native.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <amtl/am-cxx.h>
+#include <amtl/am-string.h>
 #include <amtl/experimental/am-argparser.h>
+#include "builtins.h"
 #include "dll_exports.h"
 #include "environment.h"
+#include "method-info.h"
+#include "perf-map.h"
 #include "stack-frames.h"
 
 #ifdef __EMSCRIPTEN__
@@ -34,6 +39,10 @@ using namespace sp;
 using namespace SourcePawn;
 
 Environment* sEnv;
+static bool sPrintMemoryPeaks = false;
+static bool sRestoreSnapshot = false;
+static const char* sFilename = nullptr;
+static int sStepsLeft = 0;
 
 static const char*
 BaseFilename(const char* path)
@@ -155,8 +164,8 @@ static cell_t WriteFloat(IPluginContext* cx, const cell_t* params)
 static cell_t DoExecute(IPluginContext* cx, const cell_t* params)
 {
   int32_t ok = 0;
-  for (size_t i = 0; i < size_t(params[2]); i++) {
-    if (IPluginFunction* fn = cx->GetFunctionById(params[1])) {
+  for (size_t i = 0; i < size_t(params[1]); i++) {
+    if (IPluginFunction* fn = cx->GetFunctionById(params[2])) {
       if (fn->Execute(nullptr) != SP_ERROR_NONE)
         continue;
       ok++;
@@ -165,10 +174,25 @@ static cell_t DoExecute(IPluginContext* cx, const cell_t* params)
   return ok;
 }
 
+static cell_t DoExecuteQuietly(IPluginContext* cx, const cell_t* params)
+{
+  int32_t ok = 0;
+  for (size_t i = 0; i < size_t(params[1]); i++) {
+    if (IPluginFunction* fn = cx->GetFunctionById(params[2])) {
+      ExceptionHandler eh(cx);
+      eh.Debug(false);
+      if (!fn->Invoke())
+        continue;
+      ok++;
+    }
+  }
+  return ok;
+}
+
 static cell_t DoInvoke(IPluginContext* cx, const cell_t* params)
 {
-  for (size_t i = 0; i < size_t(params[2]); i++) {
-    if (IPluginFunction* fn = cx->GetFunctionById(params[1])) {
+  for (size_t i = 0; i < size_t(params[1]); i++) {
+    if (IPluginFunction* fn = cx->GetFunctionById(params[2])) {
       if (!fn->Invoke())
         return 0;
     }
@@ -176,6 +200,115 @@ static cell_t DoInvoke(IPluginContext* cx, const cell_t* params)
   return 1;
 }
 
+static cell_t RunCoroutine(IPluginContext* cx, const cell_t* params)
+{
+  IPluginFunction* fn = cx->GetFunctionById(params[1]);
+  if (!fn)
+    return cx->ThrowNativeError("Invalid function id: %x", params[1]);
+
+  // Each time the call yields a value, resume it with twice that value.
+  cell_t result;
+  bool suspended;
+  fn->PushCell(params[2]);
+  if (!fn->InvokeResumable(&result, &suspended))
+    return 0;
+  while (suspended) {
+    if (!fn->Resume(result * 2, &result, &suspended))
+      return 0;
+  }
+  return result;
+}
+
+static cell_t StartCoroutine(IPluginContext* cx, const cell_t* params)
+{
+  IPluginFunction* fn = cx->GetFunctionById(params[1]);
+  if (!fn)
+    return cx->ThrowNativeError("Invalid function id: %x", params[1]);
+
+  // Leave the call suspended at its first yield.
+  cell_t result;
+  bool suspended;
+  fn->PushCell(params[2]);
+  if (!fn->InvokeResumable(&result, &suspended))
+    return 0;
+  return result;
+}
+
+static int DoNothingLeaf(IPluginContext* cx, const cell_t* params, cell_t* result)
+{
+  *result = 1;
+  return SP_ERROR_NONE;
+}
+
+static int DivideLeaf(IPluginContext* cx, const cell_t* params, cell_t* result)
+{
+  if (params[2] == 0)
+    return SP_ERROR_DIVIDE_BY_ZERO;
+  *result = params[1] / params[2];
+  return SP_ERROR_NONE;
+}
+
+static void BindLeafNative(IPluginRuntime* rt, const char* name, SPVM_LEAF_NATIVE_FUNC fn)
+{
+  int err;
+  uint32_t index;
+  if ((err = rt->FindNativeByName(name, &index)) != SP_ERROR_NONE)
+    return;
+
+  rt->UpdateLeafNativeBinding(index, fn, nullptr);
+}
+
+static cell_t BindLateLeaf(IPluginContext* cx, const cell_t* params)
+{
+  BindLeafNative(cx->GetRuntime(), "late_divide_leaf", DivideLeaf);
+  return 0;
+}
+
+static cell_t TypedSum(IPluginContext* cx, sp_cellspan_t values, cell_t count)
+{
+  if (count < 0 || uint32_t(count) > values.length)
+    return cx->ThrowNativeError("Count %d is out of bounds", count);
+
+  cell_t total = 0;
+  for (cell_t i = 0; i < count; i++)
+    total += values.cells[i];
+  return total;
+}
+
+static cell_t TypedSumFixed(IPluginContext* cx, sp_cellspan_t values)
+{
+  cell_t total = 0;
+  for (uint32_t i = 0; i < values.length; i++)
+    total += values.cells[i];
+  return total;
+}
+
+static cell_t TypedStrLen(IPluginContext* cx, sp_stringview_t str)
+{
+  return str.length;
+}
+
+static cell_t TypedFormat(IPluginContext* cx, sp_charbuffer_t buffer, cell_t value)
+{
+  return cell_t(SafeSprintf(buffer.chars, buffer.length, "value=%d", value));
+}
+
+static cell_t TypedScale(IPluginContext* cx, float value, float factor, cell_t& result)
+{
+  result = sp_ftoc(value * factor);
+  return 0;
+}
+
+static void BindTypedNative(IPluginRuntime* rt, const sp_typednativeinfo_t& info)
+{
+  int err;
+  uint32_t index;
+  if ((err = rt->FindNativeByName(info.name, &index)) != SP_ERROR_NONE)
+    return;
+
+  rt->UpdateTypedNativeBinding(index, &info, nullptr);
+}
+
 static cell_t DumpStackTrace(IPluginContext* cx, const cell_t* params)
 {
   FrameIterator iter;
@@ -189,17 +322,177 @@ static cell_t ReportError(IPluginContext* cx, const cell_t* params)
   return 0;
 }
 
-static int Execute(const char* file)
+static cell_t ThrowErrorCode(IPluginContext* cx, const cell_t* params)
+{
+  return cx->ThrowNativeErrorEx(params[1], nullptr);
+}
+
+// Check that the plugin's memory report adds up, and agrees with
+// GetMemUsage() and the environment's report.
+static cell_t CheckMemReport(IPluginContext* cx, const cell_t* params)
+{
+  IPluginRuntime* rt = cx->GetRuntime();
+
+  sp_memreport_t report;
+  rt->GetMemReport(&report);
+
+  size_t sum = report.runtime + report.image + report.code + report.memory +
+               report.jit_code + report.jit_metadata + report.methods +
+               report.function_map + report.invokers;
+  if (report.total != sum) {
+    return cx->ThrowNativeError("Report total %u is not the sum of its categories, %u",
+                                unsigned(report.total), unsigned(sum));
+  }
+
+  size_t usage = rt->GetMemUsage();
+  if (report.total != usage) {
+    return cx->ThrowNativeError("Report total %u does not match GetMemUsage(), %u",
+                                unsigned(report.total), unsigned(usage));
+  }
+
+  sp_envmemreport_t env_report;
+  sEnv->GetMemReport(&env_report);
+  if (env_report.runtimes != 1 || env_report.plugins.total != report.total) {
+    return cx->ThrowNativeError("Environment reports %u bytes in %u plugins, not %u in 1",
+                                unsigned(env_report.plugins.total),
+                                unsigned(env_report.runtimes), unsigned(report.total));
+  }
+  return 1;
+}
+
+// Check that the perf map has exactly one line for each function of this
+// plugin that has been compiled.
+static cell_t CheckPerfMap(IPluginContext* cx, const cell_t* params)
+{
+  PerfMap* perf = sEnv->perf_map();
+  if (!perf)
+    return cx->ThrowNativeError("The perf map is not enabled");
+  perf->Flush();
+
+  FILE* fp = fopen(perf->map_path(), "r");
+  if (!fp)
+    return cx->ThrowNativeError("Could not open %s", perf->map_path());
+
+  PluginRuntime* rt = PluginRuntime::FromAPI(cx->GetRuntime());
+  size_t prefix_len = strlen(rt->Name());
+
+  char line[512];
+  size_t lines = 0;
+  while (fgets(line, sizeof(line), fp)) {
+    // Lines are "<address> <size> <name>".
+    const char* name = strchr(line, ' ');
+    if (name)
+      name = strchr(name + 1, ' ');
+    if (!name) {
+      fclose(fp);
+      return cx->ThrowNativeError("Malformed perf map line: %s", line);
+    }
+    name++;
+    if (strncmp(name, rt->Name(), prefix_len) == 0 && strncmp(name + prefix_len, "::", 2) == 0)
+      lines++;
+  }
+  fclose(fp);
+
+  size_t compiled = 0;
+  {
+    ke::AutoLock lock(Environment::get()->lock());
+    const ke::Vector<RefPtr<MethodInfo>>& methods = rt->AllMethods();
+    for (size_t i = 0; i < methods.length(); i++) {
+      if (methods[i]->jit())
+        compiled++;
+    }
+  }
+  if (lines != compiled) {
+    return cx->ThrowNativeError("Perf map has %u lines for %u compiled functions",
+                                unsigned(lines), unsigned(compiled));
+  }
+  return 1;
+}
+
+static void BindShellNatives(PluginRuntime* rt);
+
+// Run |name| in a new copy of the plugin. Then run it in another copy that
+// adopts the first copy's methods, and print how much work was done again.
+static cell_t ReloadAndRun(IPluginContext* cx, const cell_t* params)
 {
+  char* name;
+  cx->LocalToString(params[1], &name);
+
   char error[255];
-  AutoPtr<IPluginRuntime> rtb(sEnv->APIv2()->LoadBinaryFromFile(file, error, sizeof(error)));
-  if (!rtb) {
-    fprintf(stderr, "Could not load plugin %s: %s\n", file, error);
-    return 1;
+  AutoPtr<IPluginRuntime> first(sEnv->APIv2()->LoadBinaryFromFile(sFilename, error, sizeof(error)));
+  if (!first)
+    return cx->ThrowNativeError("Could not load plugin %s: %s", sFilename, error);
+  AutoPtr<IPluginRuntime> second(sEnv->APIv2()->LoadBinaryFromFile(sFilename, error, sizeof(error)));
+  if (!second)
+    return cx->ThrowNativeError("Could not load plugin %s: %s", sFilename, error);
+  BindShellNatives(PluginRuntime::FromAPI(first));
+  BindShellNatives(PluginRuntime::FromAPI(second));
+
+  IPluginFunction* fn = first->GetFunctionByName(name);
+  if (!fn)
+    return cx->ThrowNativeError("Function %s not found", name);
+  if (fn->Execute(nullptr) != SP_ERROR_NONE)
+    return 0;
+
+  // Pause the first copy so its compiled code can move too.
+  first->SetPauseState(true);
+  second->AdoptMethodsFrom(first);
+  if (second->GetFunctionByName(name)->Execute(nullptr) != SP_ERROR_NONE)
+    return 0;
+
+  int verified = 0, adopted = 0, compiled = 0, adopted_code = 0;
+  {
+    ke::AutoLock lock(Environment::get()->lock());
+    const ke::Vector<RefPtr<MethodInfo>>& methods = PluginRuntime::FromAPI(second)->AllMethods();
+    for (size_t i = 0; i < methods.length(); i++) {
+      const RefPtr<MethodInfo>& method = methods[i];
+      if (method->adoptedVerification())
+        adopted++;
+      else if (method->verified())
+        verified++;
+      if (method->jit() && !method->adoptedCode())
+        compiled++;
+      if (method->adoptedCode())
+        adopted_code++;
+    }
   }
 
-  PluginRuntime* rt = PluginRuntime::FromAPI(rtb);
+  // Everything the first copy ran was compiled, so with the JIT, the second
+  // copy should have run that code rather than compiling its own.
+  if (sEnv->IsJitEnabled() && adopted_code != adopted)
+    return cx->ThrowNativeError("%d of %d adopted functions reused compiled code",
+                                adopted_code, adopted);
+  printf("verified: %d, adopted: %d, compiled: %d\n", verified, adopted, compiled);
+  return 1;
+}
 
+static const char*
+PeakFunctionName(IPluginRuntime* rt, ucell_t addr)
+{
+  const char* name;
+  if (addr == ucell_t(-1) || rt->GetDebugInfo()->LookupFunction(addr, &name) != SP_ERROR_NONE)
+    return "?";
+  return name;
+}
+
+static void
+PrintMemoryPeaks(IPluginRuntime* rt)
+{
+  sp_mempeaks_t peaks;
+  if (rt->GetMemoryPeaks(&peaks) != SP_ERROR_NONE)
+    return;
+
+  fprintf(stderr, "Memory: %u bytes (%u data)\n", peaks.memory_size, peaks.data_size);
+  fprintf(stderr, "  stack peak: %u bytes in %s\n",
+          peaks.stack_peak, PeakFunctionName(rt, peaks.stack_peak_function));
+  fprintf(stderr, "  heap peak: %u bytes in %s\n",
+          peaks.heap_peak, PeakFunctionName(rt, peaks.heap_peak_function));
+  fprintf(stderr, "  largest allocation: %u bytes in %s\n",
+          peaks.largest_alloc, PeakFunctionName(rt, peaks.largest_alloc_function));
+}
+
+static void BindShellNatives(PluginRuntime* rt)
+{
   rt->InstallBuiltinNatives();
   BindNative(rt, "print", Print);
   BindNative(rt, "printnum", PrintNum);
@@ -209,10 +502,98 @@ static int Execute(const char* file)
   BindNative(rt, "writefloat", WriteFloat);
   BindNative(rt, "donothing", DoNothing);
   BindNative(rt, "execute", DoExecute);
+  BindNative(rt, "execute_quietly", DoExecuteQuietly);
   BindNative(rt, "invoke", DoInvoke);
+  BindNative(rt, "run_coroutine", RunCoroutine);
+  BindNative(rt, "start_coroutine", StartCoroutine);
+  BindNative(rt, "reload_and_run", ReloadAndRun);
   BindNative(rt, "dump_stack_trace", DumpStackTrace);
   BindNative(rt, "report_error", ReportError);
+  BindNative(rt, "throw_error_code", ThrowErrorCode);
+  BindNative(rt, "check_mem_report", CheckMemReport);
+  BindNative(rt, "check_perf_map", CheckPerfMap);
   BindNative(rt, "CloseHandle", DoNothing);
+  BindLeafNative(rt, "donothing_leaf", DoNothingLeaf);
+  BindLeafNative(rt, "divide_leaf", DivideLeaf);
+  BindNative(rt, "bind_late_leaf", BindLateLeaf);
+  BindTypedNative(rt, SP_TYPED_NATIVE("typed_sum", TypedSum));
+  BindTypedNative(rt, SP_TYPED_NATIVE("typed_sum_fixed", TypedSumFixed));
+  BindTypedNative(rt, SP_TYPED_NATIVE("typed_strlen", TypedStrLen));
+  BindTypedNative(rt, SP_TYPED_NATIVE("typed_scale", TypedScale));
+  BindTypedNative(rt, SP_TYPED_NATIVE("typed_format", TypedFormat));
+  BindTypedNative(rt, SP_TYPED_NATIVE("typed_format_small", TypedFormat));
+  BindTypedNative(rt, SP_TYPED_NATIVE("typed_format_unsized", TypedFormat));
+  BindTypedNative(rt, SP_TYPED_NATIVE("typed_format_const", TypedFormat));
+  BindTypedNative(rt, SP_TYPED_NATIVE("typed_mismatch", TypedStrLen));
+
+  // Expose some builtins under names that are not replaced by the VM, so
+  // benchmarks can compare them against the inlined versions.
+  BuiltinNatives* builtins = Environment::get()->builtins();
+  BindNative(rt, "host_vec_add", builtins->Lookup("__vec_add"));
+  BindNative(rt, "host_vec_length", builtins->Lookup("__vec_length"));
+  BindNative(rt, "host_vec_cross", builtins->Lookup("__vec_cross"));
+  BindNative(rt, "host_str_len", builtins->Lookup("__str_len"));
+  BindNative(rt, "host_str_compare", builtins->Lookup("__str_compare"));
+  BindNative(rt, "host_str_equal", builtins->Lookup("__str_equal"));
+  BindNative(rt, "host_str_copy", builtins->Lookup("__str_copy"));
+  BindNative(rt, "host_str_find_char", builtins->Lookup("__str_find_char"));
+}
+
+// Print each line the plugin breaks at. The first break starts single-
+// stepping, which stops again after a few lines.
+static void
+ShellDebugBreak(IPluginContext* cx, sp_debug_break_info_t& info, const IErrorReport* report)
+{
+  if (report)
+    return;
+
+  IPluginRuntime* rt = cx->GetRuntime();
+  uint32_t line;
+  if (rt->GetDebugInfo()->LookupLine(info.cip, &line) != SP_ERROR_NONE)
+    return;
+  printf("break: line %u\n", line);
+
+  static const int kSteps = 3;
+  if (!sStepsLeft) {
+    sStepsLeft = kSteps;
+    rt->SetSingleStep(true);
+  } else if (--sStepsLeft == 0) {
+    rt->SetSingleStep(false);
+  }
+}
+
+static bool
+SetLineBreakpoint(IPluginRuntime* rt, int line)
+{
+  // The plugin's own file is the last one it names. The line table counts
+  // from zero.
+  IPluginDebugInfo* info = rt->GetDebugInfo();
+  for (size_t i = info->NumFiles(); i > 0; i--) {
+    ucell_t addr;
+    if (info->LookupLineAddress(line - 1, info->GetFileName(i - 1), &addr) == SP_ERROR_NONE)
+      return rt->SetBreakpoint(addr, true) == SP_ERROR_NONE;
+  }
+  return false;
+}
+
+static int Execute(const char* file, int break_line)
+{
+  char error[255];
+  AutoPtr<IPluginRuntime> rtb(sEnv->APIv2()->LoadBinaryFromFile(file, error, sizeof(error)));
+  if (!rtb) {
+    fprintf(stderr, "Could not load plugin %s: %s\n", file, error);
+    return 1;
+  }
+
+  sFilename = file;
+
+  PluginRuntime* rt = PluginRuntime::FromAPI(rtb);
+  BindShellNatives(rt);
+
+  if (break_line && !SetLineBreakpoint(rt, break_line)) {
+    fprintf(stderr, "Could not set a breakpoint at line %d\n", break_line);
+    return 1;
+  }
 
   IPluginFunction* fun = rt->GetFunctionByName("main");
   if (!fun)
@@ -220,6 +601,8 @@ static int Execute(const char* file)
 
   IPluginContext* cx = rt->GetDefaultContext();
 
+  AutoPtr<IContextSnapshot> snapshot(sRestoreSnapshot ? cx->CreateSnapshot() : nullptr);
+
   int result;
   {
     ExceptionHandler eh(cx);
@@ -229,6 +612,23 @@ static int Execute(const char* file)
     }
   }
 
+  // Run main again from the state the plugin was loaded in.
+  if (snapshot.get()) {
+    int err = cx->RestoreSnapshot(snapshot.get());
+    if (err != SP_ERROR_NONE) {
+      fprintf(stderr, "Could not restore the snapshot: %s\n", sEnv->APIv2()->GetErrorString(err));
+      return 1;
+    }
+
+    ExceptionHandler eh(cx);
+    if (!fun->Invoke(&result)) {
+      fprintf(stderr, "Error executing main: %s\n", eh.Message());
+      return 1;
+    }
+  }
+
+  if (sPrintMemoryPeaks)
+    PrintMemoryPeaks(rt);
   return result;
 }
 
@@ -254,6 +654,26 @@ int main(int argc, char** argv)
     "w", "disable-watchdog",
     Some(false),
     "Disable the watchdog timer.");
+  BoolOption perf_map(parser,
+    "p", "perf-map",
+    Some(false),
+    "Write a perf map for JIT code to /tmp.");
+  BoolOption jitdump(parser,
+    "d", "jitdump",
+    Some(false),
+    "Write a perf map and a jitdump file for JIT code to /tmp.");
+  BoolOption memory_peaks(parser,
+    "m", "memory-peaks",
+    Some(false),
+    "Print peak stack and heap usage after running main.");
+  BoolOption restore_snapshot(parser,
+    "r", "restore-snapshot",
+    Some(false),
+    "Run main twice, restoring a snapshot of the plugin in between.");
+  IntOption break_line(parser,
+    "-b", "--break-line",
+    {},
+    "Break at a line, then single-step for a few lines, printing each.");
   StringOption filename(parser,
     "file",
     "SMX file to execute.");
@@ -284,13 +704,33 @@ int main(int argc, char** argv)
   if (getenv("DISABLE_JIT") || disable_jit.value())
     sEnv->SetJitEnabled(false);
 
+  if (perf_map.value() || jitdump.value()) {
+    if (!sEnv->EnablePerfMap(jitdump.value()))
+      fprintf(stderr, "Could not create perf map files\n");
+  }
+
+  if (memory_peaks.value()) {
+    if (sEnv->EnableMemoryPeakTracking())
+      sPrintMemoryPeaks = true;
+  }
+
+  sRestoreSnapshot = restore_snapshot.value();
+
+  if (break_line.hasValue()) {
+    if (!sEnv->EnableDebugBreak()) {
+      fprintf(stderr, "Could not enable debug breaks\n");
+      return 1;
+    }
+    sEnv->SetDebugBreakHandler(ShellDebugBreak);
+  }
+
   ShellDebugListener debug;
   sEnv->SetDebugger(&debug);
 
   if (!getenv("DISABLE_WATCHDOG") && !disable_watchdog.value())
     sEnv->InstallWatchdogTimer(5000);
 
-  int errcode = Execute(filename.value().chars());
+  int errcode = Execute(filename.value().chars(), break_line.hasValue() ? break_line.value() : 0);
 
   sEnv->SetDebugger(NULL);
   sEnv->Shutdown();
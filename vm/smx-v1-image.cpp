@@ -25,7 +25,8 @@ SmxV1Image::SmxV1Image(FILE* fp)
    debug_syms_(nullptr),
    debug_syms_unpacked_(nullptr),
    rtti_data_(nullptr),
-   rtti_methods_(nullptr)
+   rtti_methods_(nullptr),
+   rtti_natives_(nullptr)
 {
 }
 
@@ -392,6 +393,26 @@ SmxV1Image::validateRtti()
   if (rtti_methods_ && !validateRttiMethods())
     return false;
 
+  rtti_natives_ = findRttiSection("rtti.natives");
+  if (rtti_natives_ && !validateRttiNatives())
+    return false;
+
+  return true;
+}
+
+bool
+SmxV1Image::validateRttiNatives()
+{
+  if (rtti_natives_->row_count != natives_.length())
+    return error("rtti.natives does not match the native table");
+  if (rtti_natives_->row_size < sizeof(smx_rtti_native))
+    return error("invalid rtti.natives row size");
+
+  for (uint32_t i = 0; i < rtti_natives_->row_count; i++) {
+    const smx_rtti_native* native = getRttiRow<smx_rtti_native>(rtti_natives_, i);
+    if (native->signature >= rtti_data_->size)
+      return error("invalid native signature type offset");
+  }
   return true;
 }
 
@@ -561,6 +582,19 @@ SmxV1Image::GetNative(size_t index) const
   return names_ + natives_[index].name;
 }
 
+bool
+SmxV1Image::GetNativeSignature(size_t index, const uint8_t** bytes, size_t* length) const
+{
+  assert(index < natives_.length());
+  if (!rtti_natives_)
+    return false;
+
+  const smx_rtti_native* native = getRttiRow<smx_rtti_native>(rtti_natives_, index);
+  *bytes = buffer() + rtti_data_->dataoffs + native->signature;
+  *length = rtti_data_->size - native->signature;
+  return true;
+}
+
 bool
 SmxV1Image::FindNative(const char* name, size_t* indexp) const
 {
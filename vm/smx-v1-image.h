@@ -46,6 +46,7 @@ class SmxV1Image
   Data DescribeData() const override;
   size_t NumNatives() const override;
   const char* GetNative(size_t index) const override;
+  bool GetNativeSignature(size_t index, const uint8_t** bytes, size_t* length) const override;
   bool FindNative(const char* name, size_t* indexp) const override;
   size_t NumPublics() const override;
   void GetPublic(size_t index, uint32_t* offsetp, const char** namep) const override;
@@ -187,6 +188,7 @@ class SmxV1Image
   bool validateNatives();
   bool validateRtti();
   bool validateRttiMethods();
+  bool validateRttiNatives();
   bool validateDebugInfo();
   bool validateTags();
 
@@ -204,7 +206,7 @@ class SmxV1Image
   }
 
   template <typename T>
-  const T* getRttiRow(const smx_rtti_table_header* header, size_t index) {
+  const T* getRttiRow(const smx_rtti_table_header* header, size_t index) const {
     assert(index < header->row_count);
     const uint8_t* base = reinterpret_cast<const uint8_t*>(header) + header->header_size;
     return reinterpret_cast<const T*>(base + header->row_size * index);
@@ -237,6 +239,7 @@ class SmxV1Image
 
   const Section* rtti_data_;
   const smx_rtti_table_header* rtti_methods_;
+  const smx_rtti_table_header* rtti_natives_;
 };
 
 } // namespace sp
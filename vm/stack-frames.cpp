@@ -44,11 +44,13 @@ InvokeFrame::~InvokeFrame()
 
 InterpInvokeFrame::InterpInvokeFrame(PluginContext* cx,
                                      MethodInfo* method,
-                                     const cell_t* const& cip)
+                                     const cell_t* const& cip,
+                                     Coroutine* coroutine)
  : InvokeFrame(cx, method->pcode_offset()),
    method_(method),
    cip_(cip),
-   native_index_(-1)
+   native_index_(-1),
+   coroutine_(coroutine)
 {
 }
 
@@ -71,6 +73,37 @@ InterpInvokeFrame::leaveNativeCall()
   native_index_ = -1;
 }
 
+void
+InterpInvokeFrame::enterCall(MethodInfo* callee, cell_t return_cip)
+{
+  CallerFrame frame = { method_, return_cip };
+  callers_.append(frame);
+  method_ = callee;
+}
+
+cell_t
+InterpInvokeFrame::leaveCall()
+{
+  CallerFrame frame = callers_.popCopy();
+  method_ = frame.method;
+  return frame.return_cip;
+}
+
+void
+InterpInvokeFrame::saveCalls(MethodInfo** method, ke::Vector<CallerFrame>* callers)
+{
+  *method = method_;
+  *callers = ke::Move(callers_);
+}
+
+void
+InterpInvokeFrame::restoreCalls(MethodInfo* method, ke::Vector<CallerFrame>&& callers)
+{
+  assert(callers_.empty());
+  method_ = method;
+  callers_ = ke::Move(callers);
+}
+
 JitInvokeFrame::JitInvokeFrame(PluginContext* cx, ucell_t entry_cip)
  : InvokeFrame(cx, entry_cip),
    prev_exit_fp_(Environment::get()->exit_fp())
@@ -83,7 +116,8 @@ JitInvokeFrame::~JitInvokeFrame()
 }
 
 InterpFrameIterator::InterpFrameIterator(InterpInvokeFrame* ivk)
- : ivk_(ivk)
+ : ivk_(ivk),
+   depth_(ivk->callers_.length())
 {
   if (ivk_->native_index_ != -1)
     current_ = FrameType::Native;
@@ -94,14 +128,17 @@ InterpFrameIterator::InterpFrameIterator(InterpInvokeFrame* ivk)
 bool
 InterpFrameIterator::done() const
 {
-  return current_ == FrameType::Scripted;
+  return current_ == FrameType::Scripted && depth_ == 0;
 }
 
 void
 InterpFrameIterator::next()
 {
   assert(!done());
-  current_ = FrameType::Scripted;
+  if (current_ == FrameType::Native)
+    current_ = FrameType::Scripted;
+  else
+    depth_--;
 }
 
 FrameType
@@ -114,6 +151,8 @@ cell_t
 InterpFrameIterator::function_cip() const
 {
   assert(current_ == FrameType::Scripted);
+  if (depth_ < ivk_->callers_.length())
+    return ivk_->callers_[depth_].method->pcode_offset();
   return ivk_->method_->pcode_offset();
 }
 
@@ -121,6 +160,9 @@ cell_t
 InterpFrameIterator::cip() const
 {
   assert(current_ == FrameType::Scripted);
+  if (depth_ < ivk_->callers_.length())
+    return ivk_->callers_[depth_].return_cip;
+
   auto& code = ivk_->cx()->runtime()->code();
 
   const uint8_t* ptr = reinterpret_cast<const uint8_t*>(ivk_->cip_);
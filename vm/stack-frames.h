@@ -19,6 +19,7 @@
 #include <amtl/am-autoptr.h>
 #include <amtl/am-platform.h>
 #include <amtl/am-refcounting.h>
+#include <amtl/am-vector.h>
 #include <amtl/am-enum.h>
 #if defined(KE_ARCH_X86)
 # include "x86/frames-x86.h"
@@ -79,6 +80,7 @@ static inline uintptr_t GetExitFramePayload(uintptr_t stack_val)
 
 class JitInvokeFrame;
 class InterpInvokeFrame;
+class Coroutine;
 
 // An InvokeFrame represents one activation of Execute2().
 class InvokeFrame
@@ -112,28 +114,61 @@ class InvokeFrame
   ucell_t entry_cip_;
 };
 
-// Created by the interpreter. These are 1:1 with interpreter frames, for now.
+// Created by the interpreter. Scripted calls stay within the interpreter's
+// loop, so one invoke frame may hold many scripted frames: for each call,
+// the caller's method and return address are pushed here.
 class InterpInvokeFrame final : public InvokeFrame
 {
   friend class InterpFrameIterator;
 
+ public:
+  struct CallerFrame {
+    MethodInfo* method;
+    cell_t return_cip;
+  };
+
  public:
   InterpInvokeFrame(PluginContext* cx,
                     MethodInfo* method,
-                    const cell_t* const& cip);
+                    const cell_t* const& cip,
+                    Coroutine* coroutine = nullptr);
   ~InterpInvokeFrame();
 
   void enterNativeCall(uint32_t native_index);
   void leaveNativeCall();
 
+  // Enter |callee|; the caller will resume at |return_cip|.
+  void enterCall(MethodInfo* callee, cell_t return_cip);
+
+  // Leave the current method, returning the cip to resume at.
+  cell_t leaveCall();
+
+  bool hasCallers() const {
+    return !callers_.empty();
+  }
+
+  // When a coroutine suspends, its scripted frames are moved out of the
+  // invoke frame, and moved back in when it resumes.
+  void saveCalls(MethodInfo** method, ke::Vector<CallerFrame>* callers);
+  void restoreCalls(MethodInfo* method, ke::Vector<CallerFrame>&& callers);
+
+  // The coroutine this frame is running, or null. Only the innermost invoke
+  // frame may yield.
+  Coroutine* coroutine() const {
+    return coroutine_;
+  }
+
   InterpInvokeFrame* AsInterpInvokeFrame() override {
     return this;
   }
 
  private:
-  ke::RefPtr<MethodInfo> method_;
+  // Methods are owned by the runtime.
+  MethodInfo* method_;
   const cell_t* const& cip_;
   int native_index_;
+  ke::Vector<CallerFrame> callers_;
+  Coroutine* coroutine_;
 };
 
 // JIT frames are always contained within JitInvokeFrame.
@@ -186,6 +221,10 @@ class InterpFrameIterator final : public InlineFrameIterator
  private:
   InterpInvokeFrame* ivk_;
   FrameType current_;
+
+  // Index of the current caller frame, or the number of callers if this is
+  // the innermost frame.
+  size_t depth_;
 };
 
 class JitFrameIterator final : public InlineFrameIterator
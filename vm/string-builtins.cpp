@@ -0,0 +1,360 @@
+// vim: set sts=2 ts=8 sw=2 tw=99 et:
+//
+// Copyright (C) 2006-2018 AlliedModders LLC
+//
+// This file is part of SourcePawn. SourcePawn is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License along with
+// SourcePawn. If not, see http://www.gnu.org/licenses/.
+//
+#include "builtins.h"
+#include "plugin-context.h"
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+// The compiler targets SSE2, so it is always there.
+# define SP_STRING_SSE2
+# define SP_STRING_SSE2_BASELINE
+# define SSE2_TARGET
+#elif defined(__i386__) && (defined(__GNUC__) || defined(__clang__))
+// 32-bit builds do not assume SSE2. The SSE2 paths are compiled for it on
+// their own, and taken if CPUID says the processor has it.
+# define SP_STRING_SSE2
+# define SSE2_TARGET __attribute__((target("sse2")))
+# include <cpuid.h>
+#elif defined(_M_IX86)
+// MSVC allows SSE2 intrinsics in any function.
+# define SP_STRING_SSE2
+# define SSE2_TARGET
+#endif
+
+#if defined(SP_STRING_SSE2)
+# include <emmintrin.h>
+# if defined(_MSC_VER)
+#  include <intrin.h>
+# endif
+#endif
+
+namespace sp {
+
+using namespace SourcePawn;
+
+// String builtins are "fast" builtins: the JIT calls them without an exit
+// frame, so they must not call back into the VM or report errors through
+// the context. Instead they return an error code, and the caller reports it.
+//
+// Strings are bounds-checked against the region they start in, which is
+// either [0, hp) or [sp, stack top). A string that runs off the end of its
+// region without a terminator is an invalid address.
+
+static inline unsigned char
+AsciiToLower(unsigned char c)
+{
+  return (c >= 'A' && c <= 'Z') ? (c | 0x20) : c;
+}
+
+#if defined(SP_STRING_SSE2)
+static bool
+DetectSse2()
+{
+# if defined(SP_STRING_SSE2_BASELINE)
+  return true;
+# elif defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  return (info[3] & (1 << 26)) != 0;
+# else
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return false;
+  return (edx & bit_SSE2) != 0;
+# endif
+}
+
+static const bool sHasSse2 = DetectSse2();
+
+static inline size_t
+LowestSetBit(int mask)
+{
+# if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return index;
+# else
+  return __builtin_ctz(mask);
+# endif
+}
+
+SSE2_TARGET static inline __m128i
+AsciiToLower(__m128i chars)
+{
+  // Bytes >= 0x80 are negative in a signed compare, so they are never
+  // considered upper-case.
+  __m128i is_upper = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('A' - 1)),
+                                   _mm_cmplt_epi8(chars, _mm_set1_epi8('Z' + 1)));
+  return _mm_or_si128(chars, _mm_and_si128(is_upper, _mm_set1_epi8(0x20)));
+}
+
+// Scan the whole 16-byte blocks of |str| for |c|. Returns the index of the
+// first match, or of the first byte that was not scanned.
+SSE2_TARGET static size_t
+FindByteSse2(const char* str, size_t limit, char c)
+{
+  const __m128i needle = _mm_set1_epi8(c);
+  size_t i = 0;
+  for (; i + 16 <= limit; i += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + i));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+    if (mask)
+      return i + LowestSetBit(mask);
+  }
+  return i;
+}
+
+// Compare the whole 16-byte blocks of |a| and |b|. Returns the index of the
+// first block that differs, or of the first byte that was not compared.
+SSE2_TARGET static size_t
+EqualsCaseInsensitiveSse2(const char* a, const char* b, size_t length)
+{
+  size_t i = 0;
+  for (; i + 16 <= length; i += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+    __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+    __m128i eq = _mm_cmpeq_epi8(AsciiToLower(x), AsciiToLower(y));
+    if (_mm_movemask_epi8(eq) != 0xffff)
+      break;
+  }
+  return i;
+}
+#endif
+
+// Return the index of the first |c| in |str|, or |limit| if there is none.
+// Only whole 16-byte blocks are scanned with SSE2, so we never read past
+// |limit|.
+static size_t
+FindByte(const char* str, size_t limit, char c)
+{
+  size_t i = 0;
+#if defined(SP_STRING_SSE2)
+  if (sHasSse2) {
+    i = FindByteSse2(str, limit, c);
+    if (i < limit && str[i] == c)
+      return i;
+  }
+#endif
+  for (; i < limit; i++) {
+    if (str[i] == c)
+      return i;
+  }
+  return limit;
+}
+
+static bool
+EqualsCaseInsensitive(const char* a, const char* b, size_t length)
+{
+  size_t i = 0;
+#if defined(SP_STRING_SSE2)
+  if (sHasSse2)
+    i = EqualsCaseInsensitiveSse2(a, b, length);
+#endif
+  for (; i < length; i++) {
+    if (AsciiToLower(a[i]) != AsciiToLower(b[i]))
+      return false;
+  }
+  return true;
+}
+
+static int
+GetString(PluginContext* cx, cell_t addr, const char** out, size_t* length)
+{
+  size_t limit = cx->addressableBytes(addr);
+  if (!limit)
+    return SP_ERROR_INVALID_ADDRESS;
+
+  const char* str = reinterpret_cast<const char*>(cx->memory() + addr);
+  size_t len = FindByte(str, limit, '\0');
+  if (len == limit)
+    return SP_ERROR_INVALID_ADDRESS;
+
+  *out = str;
+  *length = len;
+  return SP_ERROR_NONE;
+}
+
+// int __str_len(const char[] str)
+static int
+StrLen(PluginContext* cx, const cell_t* params, cell_t* result)
+{
+  if (params[0] < 1)
+    return SP_ERROR_PARAM;
+
+  int err;
+  const char* str;
+  size_t len;
+  if ((err = GetString(cx, params[1], &str, &len)) != SP_ERROR_NONE)
+    return err;
+
+  *result = cell_t(len);
+  return SP_ERROR_NONE;
+}
+
+// int __str_compare(const char[] a, const char[] b, bool caseSensitive)
+static int
+StrCompare(PluginContext* cx, const cell_t* params, cell_t* result)
+{
+  if (params[0] < 3)
+    return SP_ERROR_PARAM;
+
+  int err;
+  const char* a;
+  const char* b;
+  size_t alen, blen;
+  if ((err = GetString(cx, params[1], &a, &alen)) != SP_ERROR_NONE)
+    return err;
+  if ((err = GetString(cx, params[2], &b, &blen)) != SP_ERROR_NONE)
+    return err;
+
+  // Both strings are terminated, so comparing the terminator of the shorter
+  // string orders it first.
+  size_t length = ((alen < blen) ? alen : blen) + 1;
+
+  int cmp = 0;
+  if (params[3]) {
+    cmp = memcmp(a, b, length);
+  } else {
+    for (size_t i = 0; i < length; i++) {
+      unsigned char x = AsciiToLower(a[i]);
+      unsigned char y = AsciiToLower(b[i]);
+      if (x != y) {
+        cmp = int(x) - int(y);
+        break;
+      }
+    }
+  }
+
+  *result = (cmp < 0) ? -1 : (cmp > 0) ? 1 : 0;
+  return SP_ERROR_NONE;
+}
+
+// bool __str_equal(const char[] a, const char[] b, bool caseSensitive)
+static int
+StrEqual(PluginContext* cx, const cell_t* params, cell_t* result)
+{
+  if (params[0] < 3)
+    return SP_ERROR_PARAM;
+
+  int err;
+  const char* a;
+  const char* b;
+  size_t alen, blen;
+  if ((err = GetString(cx, params[1], &a, &alen)) != SP_ERROR_NONE)
+    return err;
+  if ((err = GetString(cx, params[2], &b, &blen)) != SP_ERROR_NONE)
+    return err;
+
+  if (alen != blen)
+    *result = 0;
+  else if (params[3])
+    *result = memcmp(a, b, alen) == 0;
+  else
+    *result = EqualsCaseInsensitive(a, b, alen);
+  return SP_ERROR_NONE;
+}
+
+// int __str_copy(char[] dest, int maxlength, const char[] source)
+//
+// Returns the number of bytes written, not including the terminator. If the
+// source must be truncated, it is cut before any partial UTF-8 sequence.
+static int
+StrCopy(PluginContext* cx, const cell_t* params, cell_t* result)
+{
+  if (params[0] < 3)
+    return SP_ERROR_PARAM;
+
+  cell_t maxlength = params[2];
+  if (maxlength <= 0) {
+    *result = 0;
+    return SP_ERROR_NONE;
+  }
+  if (cx->addressableBytes(params[1]) < size_t(maxlength))
+    return SP_ERROR_INVALID_ADDRESS;
+
+  int err;
+  const char* source;
+  size_t length;
+  if ((err = GetString(cx, params[3], &source, &length)) != SP_ERROR_NONE)
+    return err;
+
+  if (length >= size_t(maxlength)) {
+    length = maxlength - 1;
+
+    // source[length] is the first byte we drop. If it continues a multi-byte
+    // sequence, drop the rest of that sequence too.
+    while (length > 0 && (source[length] & 0xc0) == 0x80)
+      length--;
+  }
+
+  char* dest = reinterpret_cast<char*>(cx->memory() + params[1]);
+  memmove(dest, source, length);
+  dest[length] = '\0';
+
+  *result = cell_t(length);
+  return SP_ERROR_NONE;
+}
+
+// int __str_find_char(const char[] str, char c, bool reverse)
+//
+// Returns the index of the first (or last) occurrence of |c|, or -1.
+static int
+StrFindChar(PluginContext* cx, const cell_t* params, cell_t* result)
+{
+  if (params[0] < 3)
+    return SP_ERROR_PARAM;
+
+  int err;
+  const char* str;
+  size_t len;
+  if ((err = GetString(cx, params[1], &str, &len)) != SP_ERROR_NONE)
+    return err;
+
+  char c = char(params[2]);
+  if (params[3]) {
+    for (size_t i = len; i > 0; i--) {
+      if (str[i - 1] == c) {
+        *result = cell_t(i - 1);
+        return SP_ERROR_NONE;
+      }
+    }
+    *result = -1;
+    return SP_ERROR_NONE;
+  }
+
+  size_t index = FindByte(str, len, c);
+  *result = (index < len) ? cell_t(index) : -1;
+  return SP_ERROR_NONE;
+}
+
+template <BuiltinFastFn Fn>
+static cell_t
+InvokeFastBuiltin(IPluginContext* pCtx, const cell_t* params)
+{
+  cell_t result = 0;
+  int err = Fn(static_cast<PluginContext*>(pCtx), params, &result);
+  if (err != SP_ERROR_NONE)
+    return pCtx->ThrowNativeErrorEx(err, nullptr);
+  return result;
+}
+
+BuiltinFastNativeInfo gBuiltinStringNatives[] = {
+  {"__str_len",       InvokeFastBuiltin<StrLen>,      StrLen},
+  {"__str_compare",   InvokeFastBuiltin<StrCompare>,  StrCompare},
+  {"__str_equal",     InvokeFastBuiltin<StrEqual>,    StrEqual},
+  {"__str_copy",      InvokeFastBuiltin<StrCopy>,     StrCopy},
+  {"__str_find_char", InvokeFastBuiltin<StrFindChar>, StrFindChar},
+  {nullptr,           nullptr,                        nullptr},
+};
+
+} // namespace sp
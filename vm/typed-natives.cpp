@@ -0,0 +1,313 @@
+// vim: set sts=2 ts=8 sw=2 tw=99 et:
+//
+// Copyright (C) 2006-2018 AlliedModders LLC
+//
+// This file is part of SourcePawn. SourcePawn is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License along with
+// SourcePawn. If not, see http://www.gnu.org/licenses/.
+//
+#include "typed-natives.h"
+#include "plugin-context.h"
+#include "environment.h"
+#include <smx/smx-typeinfo.h>
+#include <assert.h>
+#include <string.h>
+
+namespace sp {
+
+// Reads the encoding described in smx-typeinfo.h. Every read is checked
+// against the end of rtti.data.
+class SignatureReader
+{
+ public:
+  SignatureReader(const uint8_t* bytes, size_t length)
+   : pos_(bytes),
+     end_(bytes + length)
+  {}
+
+  bool readByte(uint8_t* out) {
+    if (pos_ >= end_)
+      return false;
+    *out = *pos_++;
+    return true;
+  }
+  bool match(uint8_t b) {
+    if (pos_ >= end_ || *pos_ != b)
+      return false;
+    pos_++;
+    return true;
+  }
+  bool readUint32(uint32_t* out) {
+    uint32_t value = 0;
+    for (uint32_t shift = 0; shift < 35; shift += 7) {
+      uint8_t b;
+      if (!readByte(&b))
+        return false;
+      value |= uint32_t(b & 0x7f) << shift;
+      if (!(b & 0x80)) {
+        *out = value;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Skip a <type>, returning its base type byte. Array dimensions are not
+  // returned.
+  bool skipType(uint8_t* base) {
+    for (;;) {
+      uint32_t size;
+      if (match(cb::kFixedArray)) {
+        if (!readUint32(&size))
+          return false;
+      } else if (!match(cb::kArray) && !match(cb::kConst)) {
+        break;
+      }
+    }
+
+    if (!readByte(base))
+      return false;
+
+    uint32_t index;
+    switch (*base) {
+      case cb::kEnum:
+      case cb::kTypedef:
+      case cb::kTypeset:
+      case cb::kClassdef:
+      case cb::kEnumStruct:
+        return readUint32(&index);
+      case cb::kFunction:
+        return skipSignature();
+      default:
+        return true;
+    }
+  }
+
+  bool skipSignature() {
+    uint8_t argc;
+    if (!readByte(&argc))
+      return false;
+    match(cb::kVariadic);
+
+    uint8_t base;
+    if (!match(cb::kVoid) && !skipType(&base))
+      return false;
+
+    for (uint8_t i = 0; i < argc; i++) {
+      match(cb::kByRef);
+      if (!skipType(&base))
+        return false;
+    }
+    return true;
+  }
+
+ private:
+  const uint8_t* pos_;
+  const uint8_t* end_;
+};
+
+// Decode one parameter, and check that |kind| can represent it.
+static bool
+CheckParam(SignatureReader& reader, uint8_t kind, uint32_t* length)
+{
+  bool by_ref = reader.match(cb::kByRef);
+
+  bool is_const = false;
+  uint32_t dims = 0;
+  *length = 0;
+  for (;;) {
+    if (reader.match(cb::kFixedArray)) {
+      if (!reader.readUint32(length))
+        return false;
+      dims++;
+    } else if (reader.match(cb::kArray)) {
+      *length = 0;
+      dims++;
+    } else if (reader.match(cb::kConst)) {
+      is_const = true;
+    } else {
+      break;
+    }
+  }
+
+  uint8_t base;
+  uint32_t index;
+  if (!reader.readByte(&base))
+    return false;
+  switch (base) {
+    case cb::kEnum:
+    case cb::kTypedef:
+    case cb::kTypeset:
+    case cb::kClassdef:
+    case cb::kEnumStruct:
+      if (!reader.readUint32(&index))
+        return false;
+      break;
+    case cb::kFunction:
+      if (!reader.skipSignature())
+        return false;
+      break;
+  }
+
+  // Without a fixed size, the VM only knows how many bytes are addressable
+  // from the start of an array, and that includes the rest of the plugin's
+  // stack or heap. So a native may only write to arrays of a fixed size.
+
+  // Enum structs are passed by address, like an unsized array.
+  if (base == cb::kEnumStruct) {
+    if (dims)
+      return false;
+    *length = 0;
+    return kind == SP_NATIVEARG_ARRAY && is_const;
+  }
+
+  if (dims > 1)
+    return false;
+  if (dims == 1) {
+    if (base == cb::kChar8) {
+      // A buffer is written to, so the plugin must not have declared the
+      // array const.
+      if (kind == SP_NATIVEARG_BUFFER)
+        return !is_const && *length;
+      return kind == SP_NATIVEARG_STRING;
+    }
+    return kind == SP_NATIVEARG_ARRAY && (is_const || *length);
+  }
+
+  if (by_ref)
+    return kind == SP_NATIVEARG_REF;
+  if (base == cb::kFloat32)
+    return kind == SP_NATIVEARG_FLOAT;
+  if (base == cb::kAny)
+    return kind == SP_NATIVEARG_INT || kind == SP_NATIVEARG_FLOAT;
+  return kind == SP_NATIVEARG_INT;
+}
+
+TypedNativeGlue::TypedNativeGlue(SPVM_TYPED_NATIVE_FUNC func, void* data)
+ : func_(func),
+   data_(data)
+{
+}
+
+TypedNativeGlue*
+TypedNativeGlue::Compile(const sp_typednativeinfo_t* info, void* data,
+                         const uint8_t* sig, size_t sig_length)
+{
+  if (!info->func || info->nparams > SP_MAX_EXEC_PARAMS)
+    return nullptr;
+  if (info->nparams && !info->params)
+    return nullptr;
+
+  ke::AutoPtr<TypedNativeGlue> glue(new TypedNativeGlue(info->func, data));
+
+  if (!sig) {
+    for (uint32_t i = 0; i < info->nparams; i++) {
+      uint8_t kind = info->params[i];
+      if (kind < SP_NATIVEARG_INT || kind > SP_NATIVEARG_BUFFER)
+        return nullptr;
+
+      // Without a signature, array sizes and constness are unknown.
+      if (kind == SP_NATIVEARG_ARRAY || kind == SP_NATIVEARG_BUFFER)
+        return nullptr;
+      Param param = { kind, 0 };
+      glue->params_.append(param);
+    }
+    return glue.take();
+  }
+
+  SignatureReader reader(sig, sig_length);
+
+  uint8_t argc;
+  if (!reader.readByte(&argc) || argc != info->nparams)
+    return nullptr;
+  if (reader.match(cb::kVariadic))
+    return nullptr;
+
+  // Any return type fits in a cell.
+  uint8_t base;
+  if (!reader.match(cb::kVoid) && !reader.skipType(&base))
+    return nullptr;
+
+  for (uint32_t i = 0; i < info->nparams; i++) {
+    Param param = { info->params[i], 0 };
+    if (!CheckParam(reader, param.kind, &param.length))
+      return nullptr;
+    glue->params_.append(param);
+  }
+  return glue.take();
+}
+
+cell_t
+TypedNativeGlue::Invoke(PluginContext* cx, const cell_t* params) const
+{
+  if (params[0] != cell_t(params_.length())) {
+    cx->ReportErrorNumber(SP_ERROR_PARAM);
+    return 0;
+  }
+
+  sp_nativearg_t args[SP_MAX_EXEC_PARAMS];
+  for (size_t i = 0; i < params_.length(); i++) {
+    const Param& param = params_[i];
+    cell_t value = params[i + 1];
+
+    if (param.kind == SP_NATIVEARG_INT || param.kind == SP_NATIVEARG_FLOAT) {
+      args[i].cell = value;
+      continue;
+    }
+
+    size_t bytes = cx->addressableBytes(value);
+    void* addr = cx->memory() + value;
+    switch (param.kind) {
+      case SP_NATIVEARG_REF:
+        if (bytes < sizeof(cell_t))
+          break;
+        args[i].ref = reinterpret_cast<cell_t*>(addr);
+        continue;
+
+      case SP_NATIVEARG_ARRAY:
+        if (bytes < sizeof(cell_t) || bytes / sizeof(cell_t) < param.length)
+          break;
+        args[i].span.cells = reinterpret_cast<cell_t*>(addr);
+        args[i].span.length = param.length ? param.length : uint32_t(bytes / sizeof(cell_t));
+        continue;
+
+      case SP_NATIVEARG_STRING:
+      {
+        const char* chars = reinterpret_cast<const char*>(addr);
+        const void* terminator = bytes ? memchr(chars, '\0', bytes) : nullptr;
+        if (!terminator)
+          break;
+        args[i].str.chars = chars;
+        args[i].str.length = uint32_t(reinterpret_cast<const char*>(terminator) - chars);
+        continue;
+      }
+
+      case SP_NATIVEARG_BUFFER:
+        assert(param.length);
+        if (bytes < param.length)
+          break;
+        args[i].buf.chars = reinterpret_cast<char*>(addr);
+        args[i].buf.length = param.length;
+        continue;
+    }
+
+    Environment::get()->ReportErrorFmt(SP_ERROR_INVALID_ADDRESS,
+                                       "Invalid address for native parameter %d",
+                                       int(i + 1));
+    return 0;
+  }
+
+  return func_(cx, args, data_);
+}
+
+cell_t
+InvokeTypedNative(PluginContext* cx, const cell_t* params, const TypedNativeGlue* glue)
+{
+  return glue->Invoke(cx, params);
+}
+
+} // namespace sp
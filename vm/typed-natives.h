@@ -0,0 +1,62 @@
+// vim: set sts=2 ts=8 sw=2 tw=99 et:
+//
+// Copyright (C) 2006-2018 AlliedModders LLC
+//
+// This file is part of SourcePawn. SourcePawn is free software: you can
+// redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License along with
+// SourcePawn. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef _include_sourcepawn_vm_typed_natives_h_
+#define _include_sourcepawn_vm_typed_natives_h_
+
+#include <sp_vm_types.h>
+#include <amtl/am-autoptr.h>
+#include <amtl/am-vector.h>
+
+namespace sp {
+
+class PluginContext;
+
+// Call glue for a typed native. It is built once, when the native is bound,
+// from the native's RTTI signature; each call then translates and checks the
+// plugin's arguments before calling the host function.
+class TypedNativeGlue
+{
+ public:
+  TypedNativeGlue(SPVM_TYPED_NATIVE_FUNC func, void* data);
+
+  // Build glue for |info|. If |sig| is non-null, it is the native's RTTI
+  // signature, and the parameter kinds must match it. Otherwise, the host's
+  // parameter kinds are trusted and no array sizes are known. Returns null if
+  // the native cannot be bound.
+  static TypedNativeGlue* Compile(const sp_typednativeinfo_t* info, void* data,
+                                  const uint8_t* sig, size_t sig_length);
+
+  // Translate the arguments and call the native. Errors are reported to the
+  // environment, as if the native had thrown them.
+  cell_t Invoke(PluginContext* cx, const cell_t* params) const;
+
+ private:
+  struct Param {
+    uint8_t kind;
+
+    // For arrays, the declared number of cells, or 0 if unsized. For char
+    // buffers, the declared number of bytes.
+    uint32_t length;
+  };
+
+  SPVM_TYPED_NATIVE_FUNC func_;
+  void* data_;
+  ke::Vector<Param> params_;
+};
+
+// Entry point for JIT callsites.
+cell_t InvokeTypedNative(PluginContext* cx, const cell_t* params, const TypedNativeGlue* glue);
+
+} // namespace sp
+
+#endif // _include_sourcepawn_vm_typed_natives_h_
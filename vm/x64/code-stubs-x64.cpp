@@ -15,6 +15,8 @@
 #include "linking.h"
 #include "macro-assembler-x64.h"
 #include "constants-x64.h"
+#include "environment.h"
+#include "perf-map.h"
 #include "plugin-context.h"
 
 #define __ masm.
@@ -113,7 +115,10 @@ CodeStubs::CreateFakeNativeStub(SPVM_FAKENATIVE_FUNC callback, void* pData)
   __ leave();
   __ ret();
 
-  return (SPVM_NATIVE_FUNC)LinkCodeToLegacyPtr(env_, masm);
+  uint8_t* code = LinkCodeToLegacyPtr(env_, masm);
+  if (code && env_->perf_map())
+    env_->perf_map()->RecordStub("FakeNative", code, masm.length());
+  return (SPVM_NATIVE_FUNC)code;
 }
 
 } // namespace sp
@@ -246,6 +246,9 @@ struct Operand
   bool isRegister() const {
     return mode() == kModeReg;
   }
+  bool isAbsolute() const {
+    return mode() == kModeDisp0 && rm() == kRIP;
+  }
   bool isRegister(Register r) const {
     return mode() == kModeReg && rm() == r.code;
   }
@@ -259,7 +262,7 @@ struct Operand
   }
 
   size_t length() const {
-    if (mode() == kModeDisp0 && rm() == kRIP)
+    if (isAbsolute())
       return 5;
     size_t sib = (mode() != kModeReg && rm() == kSIB);
     if (mode() == kModeDisp32)
@@ -599,6 +602,14 @@ class Assembler : public AssemblerBase
   void cld() {
     emit1(0xfc);
   }
+  // A single 5-byte nop (nopl 0(%eax,%eax,1)), the same size as a call.
+  void nop5() {
+    emit1(0x0f);
+    emit1(0x1f);
+    emit1(0x44);
+    emit1(0x00);
+    emit1(0x00);
+  }
   void push(Register reg) {
     emit1(0x50 + reg.code);
   }
@@ -835,6 +846,10 @@ class Assembler : public AssemblerBase
     assert(Features().sse);
     emit3(0xf3, 0x0f, 0x10, dest.code, src);
   }
+  void movss(const Operand& dest, FloatRegister src) {
+    assert(Features().sse);
+    emit3(0xf3, 0x0f, 0x11, src.code, dest);
+  }
   void cvttss2si(Register dest, Register src) {
     assert(Features().sse);
     emit3(0xf3, 0x0f, 0x2c, dest.code, src.code);
@@ -863,18 +878,38 @@ class Assembler : public AssemblerBase
     assert(Features().sse);
     emit3(0xf3, 0x0f, 0x58, dest.code, src);
   }
+  void addss(FloatRegister dest, FloatRegister src) {
+    assert(Features().sse);
+    emit3(0xf3, 0x0f, 0x58, dest.code, src.code);
+  }
   void subss(FloatRegister dest, const Operand& src) {
     assert(Features().sse);
     emit3(0xf3, 0x0f, 0x5c, dest.code, src);
   }
+  void subss(FloatRegister dest, FloatRegister src) {
+    assert(Features().sse);
+    emit3(0xf3, 0x0f, 0x5c, dest.code, src.code);
+  }
   void mulss(FloatRegister dest, const Operand& src) {
     assert(Features().sse);
     emit3(0xf3, 0x0f, 0x59, dest.code, src);
   }
+  void mulss(FloatRegister dest, FloatRegister src) {
+    assert(Features().sse);
+    emit3(0xf3, 0x0f, 0x59, dest.code, src.code);
+  }
   void divss(FloatRegister dest, const Operand& src) {
     assert(Features().sse);
     emit3(0xf3, 0x0f, 0x5e, dest.code, src);
   }
+  void divss(FloatRegister dest, FloatRegister src) {
+    assert(Features().sse);
+    emit3(0xf3, 0x0f, 0x5e, dest.code, src.code);
+  }
+  void sqrtss(FloatRegister dest, FloatRegister src) {
+    assert(Features().sse);
+    emit3(0xf3, 0x0f, 0x51, dest.code, src.code);
+  }
   void xorps(FloatRegister dest, FloatRegister src) {
     assert(Features().sse);
     emit2(0x0f, 0x57, src.code, dest.code);
@@ -902,6 +937,20 @@ class Assembler : public AssemblerBase
     *reinterpret_cast<int32_t*>(ip - 4) = delta;
   }
 
+  // Mark the last four bytes emitted as an absolute address. Addresses in
+  // operands are marked when they are emitted; immediates that are pointers
+  // must be marked by the caller.
+  void markAbsoluteAddress() {
+    if (!absolute_refs_.append(pc()))
+      outOfMemory_ = true;
+  }
+
+  // Offsets just past each absolute address in the code, so that code that
+  // refers to objects of one plugin runtime can be relocated to another.
+  const ke::Vector<uint32_t>& absolute_refs() const {
+    return absolute_refs_;
+  }
+
   void emitToExecutableMemory(void* code) {
     assert(!outOfMemory());
 
@@ -1014,6 +1063,8 @@ class Assembler : public AssemblerBase
     size_t length = operand.length();
     for (size_t i = 1; i < length; i++)
       *pos_++ = operand.getByte(i);
+    if (operand.isAbsolute())
+      markAbsoluteAddress();
   }
 
   void emit1(uint8_t opcode) {
@@ -1103,6 +1154,7 @@ class Assembler : public AssemblerBase
  private:
   ke::Vector<uint32_t> external_refs_;
   ke::Vector<uint32_t> local_refs_;
+  ke::Vector<uint32_t> absolute_refs_;
 };
 
 static inline ConditionCode
@@ -15,6 +15,7 @@
 #include "linking.h"
 #include "jit_x86.h"
 #include "environment.h"
+#include "perf-map.h"
 
 using namespace sp;
 using namespace SourcePawn;
@@ -129,5 +130,8 @@ CodeStubs::CreateFakeNativeStub(SPVM_FAKENATIVE_FUNC callback, void* pData)
   __ pop(ebx);
   __ ret();
 
-  return (SPVM_NATIVE_FUNC)LinkCodeToLegacyPtr(env_, masm);
+  uint8_t* code = LinkCodeToLegacyPtr(env_, masm);
+  if (code && env_->perf_map())
+    env_->perf_map()->RecordStub("FakeNative", code, masm.length());
+  return (SPVM_NATIVE_FUNC)code;
 }
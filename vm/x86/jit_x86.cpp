@@ -32,7 +32,9 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <float.h>
 #include "jit_x86.h"
+#include "builtins.h"
 #include "plugin-runtime.h"
 #include "plugin-context.h"
 #include "watchdog_timer.h"
@@ -233,6 +235,7 @@ void
 Compiler::emitPrologue()
 {
   __ enterFrame(JitFrameType::Scripted, pcode_start_);
+  markCodeOffset();
 
   // Push the old frame onto the stack.
   __ subl(stk, 8);
@@ -257,6 +260,83 @@ Compiler::emitPrologue()
     __ cmpl(ecx, eax);
     jumpOnError(below, SP_ERROR_STACKLOW);
   }
+
+  if (env_->IsMemoryPeakTrackingEnabled())
+    emitStackPeakCheck();
+}
+
+// Peak tracking is inlined, and only clobbers tmp. Peaks are attributed to
+// the current instruction, or to the function entry in the prologue.
+cell_t
+Compiler::peakFunction()
+{
+  if (!op_cip_)
+    return pcode_start_;
+  return pcode_start_ + cell_t(uintptr_t(op_cip_) - uintptr_t(code_start_));
+}
+
+void
+Compiler::emitStackPeakCheck()
+{
+  MemoryPeaks* peaks = context_->peaks();
+
+  Label done;
+  __ movl(tmp, stk);
+  __ subl(tmp, dat);
+  __ cmpl(tmp, Operand(ExternalAddress(&peaks->stack_low)));
+  __ j(not_below, &done);
+  __ movl(Operand(ExternalAddress(&peaks->stack_low)), tmp);
+  __ movl(Operand(ExternalAddress(&peaks->stack_low_function)), peakFunction());
+  markCodeOffset();
+  __ bind(&done);
+}
+
+void
+Compiler::emitHeapPeakCheck()
+{
+  MemoryPeaks* peaks = context_->peaks();
+
+  Label done;
+  __ movl(tmp, Operand(hpAddr()));
+  __ cmpl(tmp, Operand(ExternalAddress(&peaks->heap_high)));
+  __ j(not_above, &done);
+  __ movl(Operand(ExternalAddress(&peaks->heap_high)), tmp);
+  __ movl(Operand(ExternalAddress(&peaks->heap_high_function)), peakFunction());
+  markCodeOffset();
+  __ bind(&done);
+}
+
+void
+Compiler::emitAllocPeakCheck(cell_t bytes)
+{
+  MemoryPeaks* peaks = context_->peaks();
+
+  Label done;
+  __ cmpl(Operand(ExternalAddress(&peaks->largest_alloc)), bytes);
+  __ j(not_below, &done);
+  __ movl(Operand(ExternalAddress(&peaks->largest_alloc)), bytes);
+  __ movl(Operand(ExternalAddress(&peaks->largest_alloc_function)), peakFunction());
+  markCodeOffset();
+  __ bind(&done);
+}
+
+void
+Compiler::emitTrackedAllocPeakCheck()
+{
+  MemoryPeaks* peaks = context_->peaks();
+
+  emitHeapPeakCheck();
+
+  // The allocation's size is in the tracker it just pushed, below hp.
+  Label done;
+  __ movl(tmp, Operand(hpAddr()));
+  __ movl(tmp, Operand(dat, tmp, NoScale, -4));
+  __ cmpl(tmp, Operand(ExternalAddress(&peaks->largest_alloc)));
+  __ j(not_above, &done);
+  __ movl(Operand(ExternalAddress(&peaks->largest_alloc)), tmp);
+  __ movl(Operand(ExternalAddress(&peaks->largest_alloc_function)), peakFunction());
+  markCodeOffset();
+  __ bind(&done);
 }
 
 bool
@@ -973,10 +1053,190 @@ Compiler::visitFLOAT_NOT()
   return true;
 }
 
+bool
+Compiler::visitVECTOR_OP(VectorOp op)
+{
+  const VectorOpInfo& info = GetVectorOpInfo(op);
+
+  for (uint32_t i = 0; i < info.nvectors; i++) {
+    __ movl(pri, Operand(stk, i * sizeof(cell_t)));
+    emitCheckAddressRange(pri, 3 * sizeof(cell_t));
+  }
+
+  if (MacroAssembler::Features().sse2)
+    emitVectorOp(op);
+  else
+    emitVectorOpCall(op);
+
+  __ addl(stk, info.nargs * sizeof(cell_t));
+  return true;
+}
+
+void
+Compiler::emitVectorOp(VectorOp op)
+{
+  // Vectors are dat-relative addresses, so components are addressed as
+  // (dat + reg + offset). All inputs are loaded before any output is stored,
+  // since the output may alias an input. The order of operations mirrors
+  // ExecuteVectorOp().
+  static const FloatRegister va[3] = { xmm0, xmm1, xmm2 };
+  static const FloatRegister vb[3] = { xmm3, xmm4, xmm5 };
+  static float kFloatEpsilon = FLT_EPSILON;
+  static float kFloatOne = 1.0f;
+
+  switch (op) {
+    case VectorOp::Add:
+    case VectorOp::Sub:
+      __ movl(pri, Operand(stk, 0));
+      __ movl(tmp, Operand(stk, 4));
+      for (int i = 0; i < 3; i++) {
+        __ movss(va[i], Operand(dat, pri, NoScale, i * 4));
+        if (op == VectorOp::Add)
+          __ addss(va[i], Operand(dat, tmp, NoScale, i * 4));
+        else
+          __ subss(va[i], Operand(dat, tmp, NoScale, i * 4));
+      }
+      __ movl(pri, Operand(stk, 8));
+      for (int i = 0; i < 3; i++)
+        __ movss(Operand(dat, pri, NoScale, i * 4), va[i]);
+      break;
+
+    case VectorOp::Scale:
+      __ movl(pri, Operand(stk, 0));
+      __ movss(xmm3, Operand(stk, 4));
+      for (int i = 0; i < 3; i++) {
+        __ movss(va[i], Operand(dat, pri, NoScale, i * 4));
+        __ mulss(va[i], xmm3);
+        __ movss(Operand(dat, pri, NoScale, i * 4), va[i]);
+      }
+      break;
+
+    case VectorOp::Length:
+    case VectorOp::Distance:
+    {
+      __ movl(pri, Operand(stk, 0));
+      if (op == VectorOp::Distance)
+        __ movl(tmp, Operand(stk, 4));
+      for (int i = 0; i < 3; i++) {
+        __ movss(va[i], Operand(dat, pri, NoScale, i * 4));
+        if (op == VectorOp::Distance)
+          __ subss(va[i], Operand(dat, tmp, NoScale, i * 4));
+        __ mulss(va[i], va[i]);
+      }
+      __ addss(xmm0, xmm1);
+      __ addss(xmm0, xmm2);
+
+      // The last argument asks for the squared length.
+      Label done;
+      int32_t squared = (op == VectorOp::Length) ? 4 : 8;
+      __ cmpl(Operand(stk, squared), 0);
+      __ j(not_equal, &done);
+      __ sqrtss(xmm0, xmm0);
+      __ bind(&done);
+      __ movd(pri, xmm0);
+      break;
+    }
+
+    case VectorOp::Normalize:
+      __ movl(pri, Operand(stk, 0));
+      for (int i = 0; i < 3; i++) {
+        __ movss(va[i], Operand(dat, pri, NoScale, i * 4));
+        __ movaps(vb[i], va[i]);
+        __ mulss(vb[i], vb[i]);
+      }
+      __ addss(xmm3, xmm4);
+      __ addss(xmm3, xmm5);
+      __ sqrtss(xmm3, xmm3);
+
+      // scale = 1 / (length + epsilon)
+      __ movaps(xmm4, xmm3);
+      __ addss(xmm4, Operand(ExternalAddress(&kFloatEpsilon)));
+      __ movss(xmm5, Operand(ExternalAddress(&kFloatOne)));
+      __ divss(xmm5, xmm4);
+
+      __ movl(pri, Operand(stk, 4));
+      for (int i = 0; i < 3; i++) {
+        __ mulss(va[i], xmm5);
+        __ movss(Operand(dat, pri, NoScale, i * 4), va[i]);
+      }
+      __ movd(pri, xmm3);
+      break;
+
+    case VectorOp::Dot:
+      __ movl(pri, Operand(stk, 0));
+      __ movl(tmp, Operand(stk, 4));
+      for (int i = 0; i < 3; i++) {
+        __ movss(va[i], Operand(dat, pri, NoScale, i * 4));
+        __ mulss(va[i], Operand(dat, tmp, NoScale, i * 4));
+      }
+      __ addss(xmm0, xmm1);
+      __ addss(xmm0, xmm2);
+      __ movd(pri, xmm0);
+      break;
+
+    case VectorOp::Cross:
+    {
+      __ movl(pri, Operand(stk, 0));
+      __ movl(tmp, Operand(stk, 4));
+      for (int i = 0; i < 3; i++) {
+        __ movss(va[i], Operand(dat, pri, NoScale, i * 4));
+        __ movss(vb[i], Operand(dat, tmp, NoScale, i * 4));
+      }
+
+      // out[i] = a[j] * b[k] - a[k] * b[j]
+      __ movl(pri, Operand(stk, 8));
+      for (int i = 0; i < 3; i++) {
+        int j = (i + 1) % 3;
+        int k = (i + 2) % 3;
+        __ movaps(xmm6, va[j]);
+        __ mulss(xmm6, vb[k]);
+        __ movaps(xmm7, va[k]);
+        __ mulss(xmm7, vb[j]);
+        __ subss(xmm6, xmm7);
+        __ movss(Operand(dat, pri, NoScale, i * 4), xmm6);
+      }
+      break;
+    }
+
+    default:
+      assert(false);
+      break;
+  }
+}
+
+void
+Compiler::emitVectorOpCall(VectorOp op)
+{
+  const VectorOpInfo& info = GetVectorOpInfo(op);
+
+  // cell_t ExecuteVectorOp(VectorOp op, float* const* vecs, const cell_t* args);
+  //
+  // No exit frame - the operation cannot fail once the addresses have been
+  // checked. The relocated vector addresses live in the upper half of our
+  // reserved block, and ALT is saved in the last slot.
+  static const size_t kStackReserve = 8 * sizeof(void*);
+  __ subl(esp, kStackReserve);
+  __ movl(Operand(esp, 7 * sizeof(void*)), alt);
+  for (uint32_t i = 0; i < info.nvectors; i++) {
+    __ movl(pri, Operand(stk, i * sizeof(cell_t)));
+    __ addl(pri, dat);
+    __ movl(Operand(esp, (4 + i) * sizeof(void*)), pri);
+  }
+  __ lea(pri, Operand(esp, 4 * sizeof(void*)));
+  __ movl(Operand(esp, 2 * sizeof(void*)), stk);
+  __ movl(Operand(esp, 1 * sizeof(void*)), pri);
+  __ movl(Operand(esp, 0), int32_t(op));
+  __ callWithABI(ExternalAddress((void*)ExecuteVectorOp));
+  __ movl(alt, Operand(esp, 7 * sizeof(void*)));
+  __ addl(esp, kStackReserve);
+}
+
 bool
 Compiler::visitSTACK(cell_t amount)
 {
   __ addl(stk, amount);
+  if (amount < 0 && env_->IsMemoryPeakTrackingEnabled())
+    emitStackPeakCheck();
   return true;
 }
 
@@ -995,6 +1255,11 @@ Compiler::visitHEAP(cell_t amount)
     __ lea(tmp, Operand(dat, ecx, NoScale, STACK_MARGIN));
     __ cmpl(tmp, stk);
     jumpOnError(above, SP_ERROR_HEAPLOW);
+
+    if (env_->IsMemoryPeakTrackingEnabled()) {
+      emitHeapPeakCheck();
+      emitAllocPeakCheck(amount);
+    }
   }
   return true;
 }
@@ -1081,6 +1346,7 @@ Compiler::visitTRACKER_PUSH_C(cell_t amount)
 
   __ push(amount);
   __ push(intptr_t(rt_->GetBaseContext()));
+  __ markAbsoluteAddress();
   __ callWithABI(ExternalAddress((void*)InvokePushTracker));
   __ addl(esp, 8);
   __ testl(eax, eax);
@@ -1088,6 +1354,9 @@ Compiler::visitTRACKER_PUSH_C(cell_t amount)
 
   __ pop(alt);
   __ pop(pri);
+
+  if (env_->IsMemoryPeakTrackingEnabled())
+    emitTrackedAllocPeakCheck();
   return true;
 }
 
@@ -1101,6 +1370,7 @@ Compiler::visitTRACKER_POP_SETHEAP()
 
   // Get the context pointer and call the sanity checker.
   __ push(intptr_t(rt_->GetBaseContext()));
+  __ markAbsoluteAddress();
   __ callWithABI(ExternalAddress((void*)InvokePopTrackerAndSetHeap));
   __ addl(esp, 4);
   __ testl(eax, eax);
@@ -1126,6 +1396,7 @@ Compiler::visitREBASE(cell_t addr, cell_t iv_size, cell_t data_size)
   __ push(addr);
   __ push(pri);
   __ push(intptr_t(rt_->GetBaseContext()));
+  __ markAbsoluteAddress();
   __ callWithABI(ExternalAddress((void*)InvokeRebaseArray));
   __ addl(esp, 8 * sizeof(intptr_t));
   __ testl(eax, eax);
@@ -1139,7 +1410,20 @@ Compiler::visitBREAK()
   if (!Environment::get()->IsDebugBreakEnabled())
     return true;
 
-  __ call(&debug_break_);
+  // Lines without a breakpoint cost a nop. The site is patched to call the
+  // debug break handler when a breakpoint is installed.
+  DebugBreakSite site;
+  site.cipoffs = uintptr_t(op_cip_) - uintptr_t(code_start_);
+  site.pcoffs = masm.pc();
+  if (!debug_break_sites_.append(site)) {
+    reportError(SP_ERROR_OUT_OF_MEMORY);
+    return false;
+  }
+
+  if (rt_->ShouldBreakAt(pcode_start_ + site.cipoffs))
+    __ call(&debug_break_);
+  else
+    __ nop5();
   emitCipMapping(op_cip_);
   return true;
 }
@@ -1184,6 +1468,28 @@ Compiler::emitCheckAddress(Register reg)
   __ bind(&done);
 }
 
+// Check every byte of [reg, reg + bytes), like acquireAddrRange(), which
+// reports the same error.
+void
+Compiler::emitCheckAddressRange(Register reg, uint32_t bytes)
+{
+  // The range must end below the top of the stack. This also rejects
+  // negative addresses.
+  __ cmpl(reg, context_->stp() - cell_t(bytes));
+  jumpOnError(above, SP_ERROR_INVALID_ADDRESS);
+
+  // It must not overlap the invalid region between hp and sp, which may be
+  // narrower than the range.
+  Label done;
+  __ lea(tmp, Operand(reg, bytes));
+  __ cmpl(tmp, Operand(hpAddr()));
+  __ j(below_equal, &done);
+  __ lea(tmp, Operand(dat, reg, NoScale));
+  __ cmpl(tmp, stk);
+  jumpOnError(below, SP_ERROR_INVALID_ADDRESS);
+  __ bind(&done);
+}
+
 bool
 Compiler::visitGENARRAY(uint32_t dims, bool autozero)
 {
@@ -1204,6 +1510,7 @@ Compiler::visitGENARRAY(uint32_t dims, bool autozero)
     __ subl(esp, 8);
     __ push(tmp);
     __ push(intptr_t(rt_->GetBaseContext()));
+    __ markAbsoluteAddress();
     __ callWithABI(ExternalAddress((void*)InvokePushTracker));
     __ movl(tmp, Operand(esp, 4));
     __ addl(esp, 16);
@@ -1232,6 +1539,7 @@ Compiler::visitGENARRAY(uint32_t dims, bool autozero)
     __ push(stk);
     __ push(dims);
     __ push(intptr_t(context_));
+    __ markAbsoluteAddress();
     __ callWithABI(ExternalAddress((void*)InvokeGenerateFullArray));
     __ addl(esp, 4 * sizeof(void*) + 12);
 
@@ -1245,14 +1553,18 @@ Compiler::visitGENARRAY(uint32_t dims, bool autozero)
     __ movl(pri, tmp);
     __ addl(stk, (dims - 1) * 4);
   }
+
+  if (env_->IsMemoryPeakTrackingEnabled())
+    emitTrackedAllocPeakCheck();
   return true;
 }
 
 class CallThunk : public OutOfLinePath
 {
  public:
-  CallThunk(cell_t pcode_offset)
-   : pcode_offset(pcode_offset)
+  CallThunk(cell_t pcode_offset, size_t call_site)
+   : pcode_offset(pcode_offset),
+     call_site(call_site)
   {
   }
 
@@ -1262,15 +1574,21 @@ class CallThunk : public OutOfLinePath
   }
 
   cell_t pcode_offset;
+  size_t call_site;
 };
 
 bool
 Compiler::visitCALL(cell_t offset)
 {
+  CallSite site;
+  site.cipoffs = uintptr_t(op_cip_) - uintptr_t(code_start_);
+  site.thunk = 0;
+  site.thunk_callee = 0;
+
   RefPtr<MethodInfo> method = rt_->GetMethod(offset);
   if (!method || !method->jit()) {
     // Need to emit a delayed thunk.
-    CallThunk* thunk = new CallThunk(offset);
+    CallThunk* thunk = new CallThunk(offset, call_sites_.length());
     __ callWithABI(thunk->label());
     if (!ool_paths_.append(thunk)) {
       reportError(SP_ERROR_OUT_OF_MEMORY);
@@ -1281,6 +1599,12 @@ Compiler::visitCALL(cell_t offset)
     __ callWithABI(ExternalAddress(method->jit()->GetEntryAddress()));
   }
 
+  site.pcoffs = masm.pc();
+  if (!call_sites_.append(site)) {
+    reportError(SP_ERROR_OUT_OF_MEMORY);
+    return false;
+  }
+
   // Map the return address to the cip that started this call.
   emitCipMapping(op_cip_);
   return true;
@@ -1289,6 +1613,9 @@ Compiler::visitCALL(cell_t offset)
 void
 Compiler::emitCallThunk(CallThunk* thunk)
 {
+  CallSite& site = call_sites_[thunk->call_site];
+  site.thunk = masm.pc();
+
   // Get the return address, since that is the call that we need to patch.
   __ movl(eax, Operand(esp, 0));
 
@@ -1308,7 +1635,9 @@ Compiler::emitCallThunk(CallThunk* thunk)
   __ lea(edx, Operand(esp, 4 * sizeof(void*)));
   __ movl(Operand(esp, 2 * sizeof(void*)), edx);
   __ movl(Operand(esp, 1 * sizeof(void*)), intptr_t(thunk->pcode_offset));
+  site.thunk_callee = masm.pc();
   __ movl(Operand(esp, 0 * sizeof(void*)), intptr_t(context_));
+  __ markAbsoluteAddress();
 
   __ callWithABI(ExternalAddress((void*)CompileFromThunk));
   __ movl(edx, Operand(esp, 4 * sizeof(void*)));
@@ -1328,7 +1657,7 @@ Compiler::visitSYSREQ_N(uint32_t native_index, uint32_t nparams)
   // Store the number of parameters on the stack.
   __ movl(Operand(stk, -4), nparams);
   __ subl(stk, 4);
-  emitLegacyNativeCall(native_index, native);
+  emitNativeCall(native_index, native);
   __ addl(stk, (nparams + 1) * sizeof(cell_t));
   return true;
 }
@@ -1336,16 +1665,92 @@ Compiler::visitSYSREQ_N(uint32_t native_index, uint32_t nparams)
 bool
 Compiler::visitSYSREQ_C(uint32_t native_index)
 {
-  emitLegacyNativeCall(native_index, rt_->NativeAt(native_index));
+  emitNativeCall(native_index, rt_->NativeAt(native_index));
   return true;
 }
 
+void
+Compiler::emitNativeCall(uint32_t native_index, NativeEntry* native)
+{
+  if (env_->IsMemoryPeakTrackingEnabled())
+    emitStackPeakCheck();
+
+  if (native->fast_fn)
+    emitFastNativeCall(native, (void*)native->fast_fn);
+  else if (native->leaf_fn)
+    emitFastNativeCall(native, (void*)native->leaf_fn);
+  else
+    emitLegacyNativeCall(native_index, native);
+}
+
+void
+Compiler::emitFastNativeCall(NativeEntry* native, void* fn)
+{
+  // The native is a builtin or leaf native that can be bound only once, so
+  // we call it directly.
+  assert(native->status == SP_NATIVE_BOUND &&
+         !(native->flags & (SP_NTVFLAG_EPHEMERAL|SP_NTVFLAG_OPTIONAL)));
+
+  // int fn(PluginContext* cx, const cell_t* params, cell_t* result);
+  //
+  // Leaf natives have the same signature, taking the context as an
+  // IPluginContext.
+  //
+  // No exit frame - error code is returned directly. The builtin only needs
+  // the context's view of sp, for bounds checks. The result goes in slot 4,
+  // and ALT is saved in slot 5.
+  static const size_t kStackReserve = 8 * sizeof(void*);
+  __ subl(esp, kStackReserve);
+  __ movl(Operand(esp, 5 * sizeof(void*)), alt);
+  __ movl(tmp, stk);
+  __ subl(tmp, dat);
+  __ movl(Operand(spAddr()), tmp);
+  __ lea(tmp, Operand(esp, 4 * sizeof(void*)));
+  __ movl(Operand(esp, 2 * sizeof(void*)), tmp);
+  __ movl(Operand(esp, 1 * sizeof(void*)), stk);
+  __ movl(Operand(esp, 0), intptr_t(context_));
+  __ markAbsoluteAddress();
+  __ callWithABI(ExternalAddress(fn));
+  __ movl(alt, Operand(esp, 5 * sizeof(void*)));
+  __ movl(tmp, Operand(esp, 4 * sizeof(void*)));
+  __ addl(esp, kStackReserve);
+  __ testl(eax, eax);
+  jumpOnError(not_zero);
+  __ movl(pri, tmp);
+}
+
+// A call site compiled while its native was unbound reads legacy_fn when it
+// runs. If the native was bound as a leaf native since, legacy_fn is still
+// null, so the call site calls this instead, which finds the native from its
+// exit frame.
+static cell_t
+InvokeLateBoundLeafNative(PluginContext* cx, const cell_t* params)
+{
+  FrameLayout* frame = FrameLayout::FromFp(Environment::get()->exit_fp());
+  NativeEntry* native = cx->runtime()->NativeAt(GetExitFramePayload(frame->function_id));
+  assert(native->leaf_fn);
+
+  cell_t result;
+  int err = native->leaf_fn(cx, params, &result);
+  if (err != SP_ERROR_NONE) {
+    cx->ReportErrorNumber(err);
+    return 0;
+  }
+  return result;
+}
+
 void
 Compiler::emitLegacyNativeCall(uint32_t native_index, NativeEntry* native)
 {
   CodeLabel return_address;
   __ pushInlineExitFrame(ExitFrameType::Native, native_index, &return_address);
 
+  // Typed natives take their glue as an extra argument. Pad the stack so it
+  // stays aligned.
+  TypedNativeGlue* glue = native->typed.get();
+  if (glue)
+    __ subl(esp, 3 * sizeof(intptr_t));
+
   // Save registers.
   __ push(edx);
 
@@ -1353,15 +1758,24 @@ Compiler::emitLegacyNativeCall(uint32_t native_index, NativeEntry* native)
   bool immutable = native->status == SP_NATIVE_BOUND &&
                    !(native->flags & (SP_NTVFLAG_EPHEMERAL|SP_NTVFLAG_OPTIONAL));
   if (!immutable) {
+    Label bound;
     __ movl(edx, Operand(ExternalAddress(&native->legacy_fn)));
     __ testl(edx, edx);
-    __ j(zero, &unbound_native_error_);
+    __ j(not_zero, &bound);
+    __ cmpl(Operand(ExternalAddress(&native->leaf_fn)), 0);
+    __ j(equal, &unbound_native_error_);
+    __ movl(edx, intptr_t(InvokeLateBoundLeafNative));
+    __ bind(&bound);
   }
 
   // Save the old heap pointer.
   __ push(Operand(hpAddr()));
 
   // Push the last parameter for the C++ function.
+  if (glue) {
+    __ push(intptr_t(glue));
+    __ markAbsoluteAddress();
+  }
   __ push(stk);
 
   // Relocate our absolute stk to be dat-relative, and update the context's
@@ -1371,9 +1785,12 @@ Compiler::emitLegacyNativeCall(uint32_t native_index, NativeEntry* native)
 
   // Push the first parameter, the context.
   __ push(intptr_t(rt_->GetBaseContext()));
+  __ markAbsoluteAddress();
 
   // Invoke the native.
-  if (immutable)
+  if (glue)
+    __ callWithABI(ExternalAddress((void*)InvokeTypedNative));
+  else if (immutable)
     __ callWithABI(ExternalAddress((void*)native->legacy_fn));
   else
     __ callWithABI(edx);
@@ -1382,17 +1799,19 @@ Compiler::emitLegacyNativeCall(uint32_t native_index, NativeEntry* native)
   emitCipMapping(op_cip_);
 
   // Restore the heap pointer.
-  __ movl(edx, Operand(esp, 2 * sizeof(intptr_t)));
+  size_t hp_slot = glue ? 3 : 2;
+  __ movl(edx, Operand(esp, hp_slot * sizeof(intptr_t)));
   __ movl(Operand(hpAddr()), edx);
 
   // Restore ALT.
-  __ movl(edx, Operand(esp, 3 * sizeof(intptr_t)));
+  __ movl(edx, Operand(esp, (hp_slot + 1) * sizeof(intptr_t)));
 
   // Restore SP.
   __ addl(stk, dat);
 
-  // Remove the inline frame, + our four arguments.
-  __ popInlineExitFrame(4);
+  // Remove the inline frame, + our four arguments (eight for typed natives,
+  // counting the glue and padding).
+  __ popInlineExitFrame(glue ? 8 : 4);
 
   // Check for errors. Note we jump directly to the return stub since the
   // error has already been reported.
@@ -1657,6 +2076,7 @@ Compiler::emitDebugBreakHandler()
   // Get the context pointer and call the debugging break handler.
   __ movl(Operand(esp, 1 * sizeof(void *)), 0); // IErrorReport*
   __ movl(Operand(esp, 0 * sizeof(void *)), intptr_t(rt_->GetBaseContext()));
+  __ markAbsoluteAddress();
   __ call(ExternalAddress((void *)InvokeDebugger));
   __ leaveExitFrame();
   __ testl(eax, eax);
@@ -1670,4 +2090,23 @@ CompilerBase::PatchCallThunk(uint8_t* pc, void* target)
   *(intptr_t*)(pc - 4) = intptr_t(target) - intptr_t(pc);
 }
 
+void*
+CompilerBase::ReadCallTarget(uint8_t* pc)
+{
+  return pc + *(int32_t*)(pc - 4);
+}
+
+void
+CompilerBase::PatchDebugBreakSite(uint8_t* site, uint8_t* handler, bool enabled)
+{
+  static const uint8_t kNop5[] = { 0x0f, 0x1f, 0x44, 0x00, 0x00 };
+
+  if (enabled) {
+    site[0] = 0xe8;
+    *reinterpret_cast<int32_t*>(site + 1) = int32_t(intptr_t(handler) - intptr_t(site + 5));
+  } else {
+    memcpy(site, kNop5, sizeof(kNop5));
+  }
+}
+
 } // namespace sp
@@ -130,6 +130,7 @@ class Compiler : public CompilerBase
   bool visitFLOATCMP() override;
   bool visitFLOAT_CMP_OP(CompareOp op) override;
   bool visitFLOAT_NOT() override;
+  bool visitVECTOR_OP(VectorOp op) override;
   bool visitHALT(cell_t value) override;
   bool visitSWITCH(
     cell_t defaultOffset,
@@ -148,10 +149,20 @@ class Compiler : public CompilerBase
   void emitDebugBreakHandler() override;
 
   void emitLegacyNativeCall(uint32_t native_index, NativeEntry* native);
+  void emitNativeCall(uint32_t native_index, NativeEntry* native);
+  void emitFastNativeCall(NativeEntry* native, void* fn);
   void emitGenArray(bool autozero);
   void emitCheckAddress(Register reg);
+  void emitCheckAddressRange(Register reg, uint32_t bytes);
   void emitFloatCmp(ConditionCode cc);
+  void emitVectorOp(VectorOp op);
+  void emitVectorOpCall(VectorOp op);
   void emitCallThunk(CallThunk* thunk);
+  void emitStackPeakCheck();
+  void emitHeapPeakCheck();
+  void emitAllocPeakCheck(cell_t bytes);
+  void emitTrackedAllocPeakCheck();
+  cell_t peakFunction();
   void jumpOnError(ConditionCode cc, int err = 0);
 
   ExternalAddress hpAddr() {